@@ -105,6 +105,9 @@ uint32 char_ip = 0;
 char bind_ip_str[128];
 uint32 bind_ip = INADDR_ANY;
 uint16 char_port = 6121;
+char login_socket[256] = ""; // unix domain socket of a co-located login-server (empty: tcp)
+char char_socket[256] = ""; // unix domain socket co-located map-servers can connect to (empty: none)
+int map_zip_threshold = 0; // compress packets to map-servers of at least this size (0: off, map-servers are not asked)
 int char_maintenance = 0;
 bool char_new = true;
 int char_new_display = 0;
@@ -132,6 +135,9 @@ int subnet_count = 0;
 int max_connect_user = -1;
 int gm_allow_group = -1;
 int autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
+int save_queue_interval = 100; // how long character saves wait to be committed together (ms, 0 = commit each one)
+int save_queue_batch = 64; // commit right away once this many characters wait
+int guild_save_delay = 60*1000; // how long guild exp and online changes wait before the guild is queued for saving (ms)
 int start_zeny = 0;
 int start_items[MAX_START_ITEMS*2];
 int guild_exp_rate = 100;
@@ -208,6 +214,8 @@ void set_char_charselect(int account_id)
 		if( server[character->server].users > 0 ) // Prevent this value from going negative.
 			server[character->server].users--;
 
+	if( character->char_id != -1 )
+		char_route_set(character->char_id, -1);
 	character->char_id = -1;
 	character->server = -1;
 	if(character->pincode_enable == -1)
@@ -247,8 +255,11 @@ void set_char_online(int map_id, int char_id, int account_id)
 	}
 
 	//Update state data
+	if( character->char_id != -1 && character->char_id != char_id )
+		char_route_set(character->char_id, -1);
 	character->char_id = char_id;
 	character->server = map_id;
+	char_route_set(char_id, map_id);
 
 	if( character->server > -1 )
 		server[character->server].users++;
@@ -286,6 +297,7 @@ void set_char_offline(int char_id, int account_id)
 	{
 		struct mmo_charstatus* cp = (struct mmo_charstatus*)idb_get(char_db_,char_id);
 		inter_guild_CharOffline(char_id, cp?cp->guild_id:-1);
+		char_route_set(char_id, -1);
 		if (cp)
 			idb_remove(char_db_,char_id);
 
@@ -304,6 +316,8 @@ void set_char_offline(int char_id, int account_id)
 			character->waiting_disconnect = INVALID_TIMER;
 		}
 
+		if( char_id == -1 && character->char_id != -1 )
+			char_route_set(character->char_id, -1);
 		if(character->char_id == char_id)
 		{
 			character->char_id = -1;
@@ -332,14 +346,18 @@ static int char_db_setoffline(DBKey key, DBData *data, va_list ap)
 	struct online_char_data* character = (struct online_char_data*)DB->data2ptr(data);
 	int server = va_arg(ap, int);
 	if (server == -1) {
+		if (character->char_id != -1)
+			char_route_set(character->char_id, -1);
 		character->char_id = -1;
 		character->server = -1;
 		if(character->waiting_disconnect != INVALID_TIMER){
 			timer->delete(character->waiting_disconnect, chardb_waiting_disconnect);
 			character->waiting_disconnect = INVALID_TIMER;
 		}
-	} else if (character->server == server)
+	} else if (character->server == server) {
 		character->server = -2; //In some map server that we aren't connected to.
+		char_route_set(character->char_id, -2);
+	}
 	return 0;
 }
 
@@ -392,6 +410,240 @@ void set_all_offline_sql(void)
 		Sql_ShowDebug(sql_handle);
 }
 
+//-----------------------------------------------------
+// Map-server routing index
+// Which map-server each online character is on, and how many members of
+// each guild/party every map-server hosts, so guild/party chat and whispers
+// are only forwarded to the map-servers that have a recipient.
+//-----------------------------------------------------
+
+struct char_route {
+	int char_id;
+	short server;           // id of the map-server the character is on
+	int guild_id, party_id; // -1: not known, the character's map-server gets all guild/party messages
+	char name[NAME_LENGTH];
+};
+
+/// Number of online members per map-server
+struct char_route_members {
+	int count[MAX_MAP_SERVERS];
+};
+
+static DBMap* route_char_db;  // int char_id -> struct char_route*
+static DBMap* route_name_db;  // char* name -> struct char_route* (case-sensitive if name_ignoring_case allows names differing only in case)
+static DBMap* route_guild_db; // int guild_id -> struct char_route_members*
+static DBMap* route_party_db; // int party_id -> struct char_route_members*
+static int route_unknown[MAX_MAP_SERVERS]; // characters with an unknown guild/party per map-server
+
+static struct {
+	unsigned int messages; // messages routed
+	unsigned int sent;     // map-servers they were sent to
+	unsigned int skipped;  // connected map-servers they were not sent to
+} route_stats[CHAR_ROUTE_MAX];
+
+/**
+ * @see DBCreateData
+ */
+static DBData create_char_route_members(DBKey key, va_list args)
+{
+	struct char_route_members* members;
+	CREATE(members, struct char_route_members, 1);
+	return DB->ptr2data(members);
+}
+
+/// Adds (count = 1) or removes (count = -1) a member of guild/party id hosted on map-server map_id.
+static void char_route_count(DBMap* db, int id, short map_id, int count)
+{
+	struct char_route_members* members;
+	int i;
+
+	if( id == 0 )
+		return; // not in a guild/party
+	if( id < 0 ) {
+		route_unknown[map_id] += count;
+		return;
+	}
+
+	members = (struct char_route_members*)idb_ensure(db, id, create_char_route_members);
+	members->count[map_id] += count;
+	ARR_FIND(0, MAX_MAP_SERVERS, i, members->count[i] > 0);
+	if( i == MAX_MAP_SERVERS )
+		idb_remove(db, id); // no members online anymore
+}
+
+/// Records that char_id is on map-server map_id (-1 or lower: offline or in transit).
+void char_route_set(int char_id, int map_id)
+{
+	struct char_route* route = (struct char_route*)idb_get(route_char_db, char_id);
+	struct mmo_charstatus* cp;
+
+	if( route != NULL ) {
+		if( route->server == map_id )
+			return;
+		char_route_count(route_guild_db, route->guild_id, route->server, -1);
+		char_route_count(route_party_db, route->party_id, route->server, -1);
+		if( map_id < 0 ) {
+			strdb_remove(route_name_db, route->name);
+			idb_remove(route_char_db, char_id);
+			return;
+		}
+	} else {
+		if( map_id < 0 )
+			return;
+
+		CREATE(route, struct char_route, 1);
+		route->char_id = char_id;
+		route->guild_id = route->party_id = -1;
+		if( (cp = (struct mmo_charstatus*)idb_get(char_db_, char_id)) != NULL ) {
+			route->guild_id = cp->guild_id;
+			route->party_id = cp->party_id;
+			safestrncpy(route->name, cp->name, NAME_LENGTH);
+		} else if( SQL_ERROR == SQL->Query(sql_handle, "SELECT `name`,`guild_id`,`party_id` FROM `%s` WHERE `char_id`='%d'", char_db, char_id) ) {
+			Sql_ShowDebug(sql_handle);
+		} else {
+			if( SQL_SUCCESS == SQL->NextRow(sql_handle) ) {
+				char* data;
+				SQL->GetData(sql_handle, 0, &data, NULL); safestrncpy(route->name, data, NAME_LENGTH);
+				SQL->GetData(sql_handle, 1, &data, NULL); route->guild_id = atoi(data);
+				SQL->GetData(sql_handle, 2, &data, NULL); route->party_id = atoi(data);
+			}
+			SQL->FreeResult(sql_handle);
+		}
+		idb_put(route_char_db, char_id, route);
+		if( route->name[0] != '\0' )
+			strdb_put(route_name_db, route->name, route);
+	}
+
+	route->server = map_id;
+	char_route_count(route_guild_db, route->guild_id, route->server, 1);
+	char_route_count(route_party_db, route->party_id, route->server, 1);
+}
+
+/// Records that online character char_id is now in guild guild_id (0: none).
+void char_route_guild(int char_id, int guild_id)
+{
+	struct char_route* route = (struct char_route*)idb_get(route_char_db, char_id);
+
+	if( route == NULL || route->guild_id == guild_id )
+		return;
+	char_route_count(route_guild_db, route->guild_id, route->server, -1);
+	route->guild_id = guild_id;
+	char_route_count(route_guild_db, route->guild_id, route->server, 1);
+}
+
+/// Records that online character char_id is now in party party_id (0: none).
+void char_route_party(int char_id, int party_id)
+{
+	struct char_route* route = (struct char_route*)idb_get(route_char_db, char_id);
+
+	if( route == NULL || route->party_id == party_id )
+		return;
+	char_route_count(route_party_db, route->party_id, route->server, -1);
+	route->party_id = party_id;
+	char_route_count(route_party_db, route->party_id, route->server, 1);
+}
+
+/// Returns the id of the map-server the character is on, or -1 if it is not known.
+int char_route_find(const char* name)
+{
+	struct char_route* route = (struct char_route*)strdb_get(route_name_db, name);
+	return route ? route->server : -1;
+}
+
+/// Sends to the map-servers, except sfd, that host an online member.
+static int mapif_send_members(enum char_route_type type, DBMap* db, int id, int sfd, unsigned char* buf, unsigned int len)
+{
+	struct char_route_members* members = (struct char_route_members*)idb_get(db, id);
+	int i, c = 0, skipped = 0;
+
+	for( i = 0; i < ARRAYLENGTH(server); i++ ) {
+		int fd;
+		if( (fd = server[i].fd) <= 0 || fd == sfd )
+			continue;
+		if( (members == NULL || members->count[i] <= 0) && route_unknown[i] <= 0 ) {
+			skipped++;
+			continue;
+		}
+		WFIFOHEAD(fd,len);
+		memcpy(WFIFOP(fd,0), buf, len);
+		WFIFOSET(fd,len);
+		c++;
+	}
+
+	route_stats[type].messages++;
+	route_stats[type].sent += c;
+	route_stats[type].skipped += skipped;
+	return c;
+}
+
+/// Sends to the map-servers, except sfd, that host an online member of the guild.
+int mapif_send_guild(int guild_id, int sfd, unsigned char* buf, unsigned int len)
+{
+	return mapif_send_members(CHAR_ROUTE_GUILD, route_guild_db, guild_id, sfd, buf, len);
+}
+
+/// Sends to the map-servers, except sfd, that host an online member of the party.
+int mapif_send_party(int party_id, int sfd, unsigned char* buf, unsigned int len)
+{
+	return mapif_send_members(CHAR_ROUTE_PARTY, route_party_db, party_id, sfd, buf, len);
+}
+
+/// Sends to the map-server the named character is on, or to all of them if that is not known.
+int mapif_send_name(const char* name, unsigned char* buf, unsigned int len)
+{
+	int i, id = char_route_find(name), c = 0;
+
+	if( id < 0 || server[id].fd <= 0 ) {
+		c = mapif_sendall(buf, len);
+		route_stats[CHAR_ROUTE_NAME].messages++;
+		route_stats[CHAR_ROUTE_NAME].sent += c;
+		return c;
+	}
+
+	mapif_send(server[id].fd, buf, len);
+	for( i = 0; i < ARRAYLENGTH(server); i++ )
+		if( server[i].fd > 0 && i != id )
+			c++;
+	route_stats[CHAR_ROUTE_NAME].messages++;
+	route_stats[CHAR_ROUTE_NAME].sent++;
+	route_stats[CHAR_ROUTE_NAME].skipped += c;
+	return 1;
+}
+
+static void char_route_init(void)
+{
+	route_char_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	// names differing only in case are the same character unless name_ignoring_case allows both
+	route_name_db = name_ignoring_case ? strdb_alloc(DB_OPT_BASE, NAME_LENGTH) : stridb_alloc(DB_OPT_BASE, NAME_LENGTH);
+	route_guild_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	route_party_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	memset(route_unknown, 0, sizeof(route_unknown));
+	memset(route_stats, 0, sizeof(route_stats));
+}
+
+static void char_route_final(void)
+{
+	db_destroy(route_name_db);
+	db_destroy(route_char_db);
+	db_destroy(route_guild_db);
+	db_destroy(route_party_db);
+}
+
+/// Prints how many map-server sends the routing index saved.
+static void char_route_report(void)
+{
+	static const char* names[CHAR_ROUTE_MAX] = { "guild messages", "party messages", "whispers" };
+	int i;
+
+	for( i = 0; i < CHAR_ROUTE_MAX; i++ ) {
+		unsigned int total = route_stats[i].sent + route_stats[i].skipped;
+		ShowInfo("%s: %u routed, sent to %u map-servers, %u sends saved (%.1f%%)\n", names[i],
+			route_stats[i].messages, route_stats[i].sent, route_stats[i].skipped, total ? 100. * route_stats[i].skipped / total : 0.);
+	}
+	ShowInfo("%d characters indexed, %d guilds and %d parties online\n",
+		db_size(route_char_db), db_size(route_guild_db), db_size(route_party_db));
+}
+
 /**
  * @see DBCreateData
  */
@@ -403,9 +655,10 @@ static DBData create_charstatus(DBKey key, va_list args)
 	return DB->ptr2data(cp);
 }
 
-int inventory_to_sql(const struct item items[], int max, int id);
+int inventory_to_sql(Sql* handle, const struct item items[], int max, int id);
+static bool memitemdata_slots_changed(const struct item old[], struct item items[], int max, int tableswitch);
 
-int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
+int mmo_char_tosql(Sql* handle, int char_id, struct mmo_charstatus* p)
 {
 	int i = 0;
 	int count = 0;
@@ -413,38 +666,42 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 	char save_status[128]; //For displaying save information. [Skotlex]
 	struct mmo_charstatus *cp;
 	int errors = 0; //If there are any errors while saving, "cp" will not be updated at the end.
+	int item_errors = 0;
+	bool items_known; //Whether the items in "cp" are what the item tables hold
 	StringBuf buf;
 
 	if (char_id!=p->char_id) return 0;
 
+	items_known = ( idb_get(char_db_, char_id) != NULL ); //Otherwise not loaded, cp is created empty
 	cp = idb_ensure(char_db_, char_id, create_charstatus);
 
 	StrBuf->Init(&buf);
 	memset(save_status, 0, sizeof(save_status));
 
 	//map inventory data
-	if( memcmp(p->inventory, cp->inventory, sizeof(p->inventory)) ) {
-		if (!inventory_to_sql(p->inventory, MAX_INVENTORY, p->char_id))
+	if( memitemdata_slots_changed(cp->inventory, p->inventory, MAX_INVENTORY, TABLE_INVENTORY) ) {
+		if (!memitemdata_slots_to_sql(handle, items_known ? cp->inventory : NULL, p->inventory, MAX_INVENTORY, p->char_id, TABLE_INVENTORY))
 			strcat(save_status, " inventory");
 		else
-			errors++;
+			item_errors++;
 	}
 
 	//map cart data
-	if( memcmp(p->cart, cp->cart, sizeof(p->cart)) ) {
-		if (!memitemdata_to_sql(p->cart, MAX_CART, p->char_id, TABLE_CART))
+	if( memitemdata_slots_changed(cp->cart, p->cart, MAX_CART, TABLE_CART) ) {
+		if (!memitemdata_slots_to_sql(handle, items_known ? cp->cart : NULL, p->cart, MAX_CART, p->char_id, TABLE_CART))
 			strcat(save_status, " cart");
 		else
-			errors++;
+			item_errors++;
 	}
 
 	//map storage data
-	if( memcmp(p->storage.items, cp->storage.items, sizeof(p->storage.items)) ) {
-		if (!memitemdata_to_sql(p->storage.items, MAX_STORAGE, p->account_id, TABLE_STORAGE))
+	if( memitemdata_slots_changed(cp->storage.items, p->storage.items, MAX_STORAGE, TABLE_STORAGE) ) {
+		if (!memitemdata_slots_to_sql(handle, items_known ? cp->storage.items : NULL, p->storage.items, MAX_STORAGE, p->account_id, TABLE_STORAGE))
 			strcat(save_status, " storage");
 		else
-			errors++;
+			item_errors++;
 	}
+	errors += item_errors;
 	
 	if (
 		(p->base_exp != cp->base_exp) || (p->base_level != cp->base_level) ||
@@ -472,7 +729,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		if( p->show_equip )
 			opt |= OPT_SHOW_EQUIP;
 		
-		if( SQL_ERROR == SQL->Query(sql_handle, "UPDATE `%s` SET `base_level`='%d', `job_level`='%d',"
+		if( SQL_ERROR == SQL->Query(handle, "UPDATE `%s` SET `base_level`='%d', `job_level`='%d',"
 			"`base_exp`='%u', `job_exp`='%u', `zeny`='%d',"
 			"`max_hp`='%d',`hp`='%d',`max_sp`='%d',`sp`='%d',`status_point`='%d',`skill_point`='%d',"
 			"`str`='%d',`agi`='%d',`vit`='%d',`int`='%d',`dex`='%d',`luk`='%d',"
@@ -493,15 +750,15 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 			p->robe,p->slotchange,opt,
 			p->account_id, p->char_id) )
 		{
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
 			errors++;
 		} else
 			strcat(save_status, " status");
 	}
 	
 	if( p->bank_vault != cp->bank_vault ) {
-		if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`account_id`,`bank_vault`) VALUES ('%d','%d')",account_data_db,p->account_id,p->bank_vault) ) {
-			Sql_ShowDebug(sql_handle);
+		if( SQL_ERROR == SQL->Query(handle, "REPLACE INTO `%s` (`account_id`,`bank_vault`) VALUES ('%d','%d')",account_data_db,p->account_id,p->bank_vault) ) {
+			Sql_ShowDebug(handle);
 			errors++;
 		} else
 			strcat(save_status, " bank");
@@ -517,7 +774,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		(p->fame != cp->fame)
 	)
 	{
-		if( SQL_ERROR == SQL->Query(sql_handle, "UPDATE `%s` SET `class`='%d',"
+		if( SQL_ERROR == SQL->Query(handle, "UPDATE `%s` SET `class`='%d',"
 			"`hair`='%d',`hair_color`='%d',`clothes_color`='%d',"
 			"`partner_id`='%d', `father`='%d', `mother`='%d', `child`='%d',"
 			"`karma`='%d',`manner`='%d', `fame`='%d'"
@@ -528,7 +785,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 			p->karma, p->manner, p->fame,
 			p->account_id, p->char_id) )
 		{
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
 			errors++;
 		} else
 			strcat(save_status, " status2");
@@ -540,7 +797,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		(p->spear_calls != cp->spear_calls) || (p->spear_faith != cp->spear_faith) ||
 		(p->sword_calls != cp->sword_calls) || (p->sword_faith != cp->sword_faith) )
 	{
-		if (mercenary_owner_tosql(char_id, p))
+		if (mercenary_owner_tosql(handle, char_id, p))
 			strcat(save_status, " mercenary");
 		else
 			errors++;
@@ -552,9 +809,9 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		char esc_mapname[NAME_LENGTH*2+1];
 
 		//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
-		if( SQL_ERROR == SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", memo_db, p->char_id) )
+		if( SQL_ERROR == SQL->Query(handle, "DELETE FROM `%s` WHERE `char_id`='%d'", memo_db, p->char_id) )
 		{
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
 			errors++;
 		}
 
@@ -567,16 +824,16 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 			{
 				if( count )
 					StrBuf->AppendStr(&buf, ",");
-				SQL->EscapeString(sql_handle, esc_mapname, mapindex_id2name(p->memo_point[i].map));
+				SQL->EscapeString(handle, esc_mapname, mapindex_id2name(p->memo_point[i].map));
 				StrBuf->Printf(&buf, "('%d', '%s', '%d', '%d')", char_id, esc_mapname, p->memo_point[i].x, p->memo_point[i].y);
 				++count;
 			}
 		}
 		if( count )
 		{
-			if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+			if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 			{
-				Sql_ShowDebug(sql_handle);
+				Sql_ShowDebug(handle);
 				errors++;
 			}
 		}
@@ -586,8 +843,8 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 	//skills
 	if( memcmp(p->skill, cp->skill, sizeof(p->skill)) ) {
 		//`skill` (`char_id`, `id`, `lv`)
-		if( SQL_ERROR == SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", skill_db, p->char_id) ) {
-			Sql_ShowDebug(sql_handle);
+		if( SQL_ERROR == SQL->Query(handle, "DELETE FROM `%s` WHERE `char_id`='%d'", skill_db, p->char_id) ) {
+			Sql_ShowDebug(handle);
 			errors++;
 		}
 
@@ -611,9 +868,9 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		}
 		if( count )
 		{
-			if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+			if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 			{
-				Sql_ShowDebug(sql_handle);
+				Sql_ShowDebug(handle);
 				errors++;
 			}
 		}
@@ -632,9 +889,9 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 
 	if(diff == 1)
 	{	//Save friends
-		if( SQL_ERROR == SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", friend_db, char_id) )
+		if( SQL_ERROR == SQL->Query(handle, "DELETE FROM `%s` WHERE `char_id`='%d'", friend_db, char_id) )
 		{
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
 			errors++;
 		}
 
@@ -652,9 +909,9 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		}
 		if( count )
 		{
-			if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+			if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 			{
-				Sql_ShowDebug(sql_handle);
+				Sql_ShowDebug(handle);
 				errors++;
 			}
 		}
@@ -676,9 +933,9 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		}
 	}
 	if(diff) {
-		if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+		if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 		{
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
 			errors++;
 		} else
 			strcat(save_status, " hotkeys");
@@ -690,11 +947,282 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		ShowInfo("Saved char %d - %s:%s.\n", char_id, p->name, save_status);
 	if (!errors)
 		memcpy(cp, p, sizeof(struct mmo_charstatus));
+	else if (item_errors) //The item tables may hold anything now, next save must compare with them
+		idb_remove(char_db_, char_id);
+	else { //The item tables hold the new items, with the ids of their rows in "p"
+		memcpy(cp->inventory, p->inventory, sizeof(p->inventory));
+		memcpy(cp->cart, p->cart, sizeof(p->cart));
+		memcpy(cp->storage.items, p->storage.items, sizeof(p->storage.items));
+	}
+	return errors;
+}
+
+/*==========================================
+ * Character save queue [group commit]
+ * Saves received from the map-servers wait here for a short while and are
+ * written together, in one transaction on their own connection; a character
+ * saved again before that only keeps its newest data.
+ * Final saves are acked (0x2b21) once their data is committed.
+ *------------------------------------------*/
+struct char_save_entry {
+	struct mmo_charstatus status; // newest data received
+	int account_id;
+	int map_id, map_fd; // map-server that sent it, acked on final save
+	bool final; // set the character offline once saved
+	int errors; // errors while saving it in the current commit
+	unsigned int tick; // when it was queued
+	struct char_save_entry *next;
+};
+
+static DBMap* char_save_db; // int char_id -> struct char_save_entry*
+static struct char_save_entry *char_save_head = NULL, **char_save_tail = &char_save_head;
+static Sql* save_handle = NULL; // connection the queue commits on
+static bool char_save_in_transaction = false; // whether save_handle is in a group commit
+
+static struct {
+	unsigned int depth, max_depth; // characters waiting
+	unsigned int saves, coalesced; // saves received, saves merged into a waiting one
+	unsigned int commits, failures; // transactions committed, failed
+	unsigned int committed; // characters committed
+	unsigned int latency_total, latency_max; // time spent committing (ms)
+	unsigned int wait_max; // longest a save waited to be committed (ms)
+} save_stats;
+
+/// Returns the data waiting to be saved for a character, or NULL.
+static struct mmo_charstatus* char_save_pending(int char_id)
+{
+	struct char_save_entry *entry = (struct char_save_entry*)idb_get(char_save_db, char_id);
+	return entry ? &entry->status : NULL;
+}
+
+/// Commits all waiting saves in one transaction.
+/// Returns the number of characters saved, or -1 if the transaction failed
+/// (the saves stay queued and are tried again).
+int char_save_flush(void)
+{
+	struct char_save_entry *entry, *next;
+	unsigned int tick, latency;
+	bool result;
+	int count = 0;
+
+	if( char_save_head == NULL )
+		return 0;
+
+	tick = timer->gettick();
+	char_save_in_transaction = true;
+
+	// try
+	do
+	{
+
+	if( SQL_SUCCESS != SQL->QueryStr(save_handle, "START TRANSACTION") ) {
+		Sql_ShowDebug(save_handle);
+		result = false;
+		break;
+	}
+
+	for( entry = char_save_head; entry != NULL; entry = entry->next )
+		entry->errors = mmo_char_tosql(save_handle, entry->status.char_id, &entry->status);
+
+	result = true;
+
+	} while(0);
+	// finally
+
+	if( result && SQL_SUCCESS != SQL->QueryStr(save_handle, "COMMIT") ) {
+		Sql_ShowDebug(save_handle);
+		if( SQL_ERROR == SQL->QueryStr(save_handle, "ROLLBACK") )
+			Sql_ShowDebug(save_handle);
+		result = false;
+	}
+	char_save_in_transaction = false;
+
+	if( !result ) { // nothing was written, though "cp" says otherwise: compare with the tables on the next try
+		save_stats.failures++;
+		for( entry = char_save_head; entry != NULL; entry = entry->next )
+			idb_remove(char_db_, entry->status.char_id);
+		ShowError("char_save_flush: Failed to commit %u character saves, trying again later.\n", save_stats.depth);
+		return -1;
+	}
+
+	latency = (unsigned int)DIFF_TICK(timer->gettick(), tick);
+	save_stats.commits++;
+	save_stats.latency_total += latency;
+	save_stats.latency_max = max(save_stats.latency_max, latency);
+
+	for( entry = char_save_head; entry != NULL; entry = next ) {
+		int aid = entry->account_id, cid = entry->status.char_id;
+		struct online_char_data* character = (struct online_char_data*)idb_get(online_char_db, aid);
+		unsigned int wait = (unsigned int)DIFF_TICK(timer->gettick(), entry->tick);
+
+		next = entry->next;
+		save_stats.wait_max = max(save_stats.wait_max, wait);
+		if( entry->errors && character != NULL && character->char_id == cid )
+			character->save_seq = 0; // parts failed to save, have the next save send everything again
+
+		if( entry->final )
+		{	//Flag, set character offline after saving. [Skotlex]
+			int fd = entry->map_fd;
+			set_char_offline(cid, aid);
+			if( server[entry->map_id].fd == fd && session_isActive(fd) ) {
+				WFIFOHEAD(fd,10);
+				WFIFOW(fd,0) = 0x2b21; //Save ack only needed on final save.
+				WFIFOL(fd,2) = aid;
+				WFIFOL(fd,6) = cid;
+				WFIFOSET(fd,10);
+			}
+		}
+		idb_remove(char_save_db, cid);
+		count++;
+	}
+	char_save_head = NULL;
+	char_save_tail = &char_save_head;
+	save_stats.depth = 0;
+	save_stats.committed += count;
+	return count;
+}
+
+/// Queues a character save received from map-server 'id'.
+/// If the character is already waiting, its data is replaced and it keeps its place.
+void char_save_enqueue(int id, int account_id, const struct mmo_charstatus *status, bool final)
+{
+	struct char_save_entry *entry = (struct char_save_entry*)idb_get(char_save_db, status->char_id);
+
+	save_stats.saves++;
+	if( entry != NULL )
+		save_stats.coalesced++;
+	else {
+		CREATE(entry, struct char_save_entry, 1);
+		entry->tick = timer->gettick();
+		*char_save_tail = entry;
+		char_save_tail = &entry->next;
+		idb_put(char_save_db, status->char_id, entry);
+		save_stats.depth++;
+		save_stats.max_depth = max(save_stats.max_depth, save_stats.depth);
+	}
+	memcpy(&entry->status, status, sizeof(struct mmo_charstatus));
+	entry->account_id = account_id;
+	entry->map_id = id;
+	entry->map_fd = server[id].fd;
+	entry->final |= final;
+
+	if( save_queue_interval <= 0 || save_stats.depth >= (unsigned int)save_queue_batch )
+		char_save_flush();
+}
+
+/// Commits the waiting saves before data is read from the tables, if one of them is
+/// of character 'char_id' or of another character of account 'account_id' (storage and
+/// bank zeny belong to the account). 0 matches nothing.
+void char_save_sync(int account_id, int char_id)
+{
+	struct char_save_entry *entry;
+
+	if( char_id && idb_exists(char_save_db, char_id) ) {
+		char_save_flush();
+		return;
+	}
+	if( account_id == 0 )
+		return;
+	for( entry = char_save_head; entry != NULL; entry = entry->next ) {
+		if( entry->account_id == account_id ) {
+			char_save_flush();
+			return;
+		}
+	}
+}
+
+static int char_save_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	char_save_flush();
+	return 0;
+}
+
+static int char_save_stats_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	unsigned int depth;
+
+	if( save_stats.commits && save_log )
+		ShowInfo("Character saves: %u received (%u coalesced), %u committed in %u transactions (%u failed), "
+			"queue depth %u (max %u), commit latency avg %u ms max %u ms, longest wait %u ms.\n",
+			save_stats.saves, save_stats.coalesced, save_stats.committed, save_stats.commits, save_stats.failures,
+			save_stats.depth, save_stats.max_depth, save_stats.latency_total / save_stats.commits, save_stats.latency_max, save_stats.wait_max);
+	depth = save_stats.depth;
+	memset(&save_stats, 0, sizeof(save_stats));
+	save_stats.depth = save_stats.max_depth = depth;
+	return 0;
+}
+
+void char_save_init(void)
+{
+	char_save_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	if( (save_handle = inter_sql_connect()) == NULL ) {
+		ShowWarning("char_save_init: Could not open a connection for character saves, sharing the main one.\n");
+		save_handle = sql_handle;
+	}
+
+	if( save_queue_interval > 0 ) {
+		timer->add_func_list(char_save_timer, "char_save_timer");
+		timer->add_interval(timer->gettick() + save_queue_interval, char_save_timer, 0, 0, save_queue_interval);
+	}
+	timer->add_func_list(char_save_stats_timer, "char_save_stats_timer");
+	timer->add_interval(timer->gettick() + 300*1000, char_save_stats_timer, 0, 0, 300*1000);
+}
+
+void char_save_final(void)
+{
+	int tries;
+
+	for( tries = 0; tries < 3 && char_save_flush() < 0; ++tries )
+		;
+	if( char_save_head != NULL )
+		ShowError("char_save_final: %u character saves could not be committed.\n", save_stats.depth);
+	char_save_db->destroy(char_save_db, NULL);
+	if( save_handle != sql_handle )
+		SQL->Free(save_handle);
+	save_handle = NULL;
+}
+
+/// Rebuilds a character from the parts of its data that changed on the map-server (0x2b28).
+/// Parts are (offset.L, length.W, data) records applied on top of the queued or cached character;
+/// a save without base (base = 0) carries the complete struct as one part.
+/// Returns -1 if the parts can't be applied, else 0 with the character in 'char_dat'.
+int char_save_delta(int char_id, unsigned int base, unsigned int known_seq, const uint8 *data, int len, struct mmo_charstatus *char_dat)
+{
+	struct mmo_charstatus *cp;
+	int pos;
+
+	if (base != 0) { // changes since save 'base', must be what we have (queued or saved)
+		if (base != known_seq || ((cp = char_save_pending(char_id)) == NULL && (cp = (struct mmo_charstatus*)idb_get(char_db_, char_id)) == NULL))
+			return -1;
+		memcpy(char_dat, cp, sizeof(struct mmo_charstatus));
+	} else if (len != 6 + sizeof(struct mmo_charstatus) || RBUFL(data,0) != 0 || RBUFW(data,4) != sizeof(struct mmo_charstatus)) {
+		ShowError("char_save_delta: Size mismatch! %d != %d\n", len-6, sizeof(struct mmo_charstatus));
+		return -1;
+	}
+
+	for (pos = 0; pos < len; ) {
+		uint32 offset;
+		uint16 length;
+
+		if (len - pos < 6)
+			return -1;
+		offset = RBUFL(data,pos);
+		length = RBUFW(data,pos+4);
+		if (offset > sizeof(struct mmo_charstatus) || length > sizeof(struct mmo_charstatus) - offset || len - pos - 6 < length) {
+			ShowError("char_save_delta: Invalid part (offset %u, length %u) for character %d.\n", offset, length, char_id);
+			return -1;
+		}
+		memcpy((uint8*)char_dat + offset, data + pos + 6, length);
+		pos += 6 + length;
+	}
+
+	if (char_dat->char_id != char_id)
+		return -1;
 	return 0;
 }
 
 /// Saves an array of 'item' entries into the specified table.
-int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch)
+int memitemdata_to_sql(Sql* handle, const struct item items[], int max, int id, int tableswitch)
 {
 	StringBuf buf;
 	SqlStmt* stmt;
@@ -729,7 +1257,7 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 		StrBuf->Printf(&buf, ", `card%d`", j);
 	StrBuf->Printf(&buf, " FROM `%s` WHERE `%s`='%d'", tablename, selectoption, id);
 
-	stmt = SQL->StmtMalloc(sql_handle);
+	stmt = SQL->StmtMalloc(handle);
 	if( SQL_ERROR == SQL->StmtPrepareStr(stmt, StrBuf->Value(&buf))
 	||  SQL_ERROR == SQL->StmtExecute(stmt) )
 	{
@@ -787,9 +1315,9 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 						StrBuf->Printf(&buf, ", `card%d`=%d", j, items[i].card[j]);
 					StrBuf->Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
 
-					if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+					if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 					{
-						Sql_ShowDebug(sql_handle);
+						Sql_ShowDebug(handle);
 						errors++;
 					}
 				}
@@ -800,9 +1328,9 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 		}
 		if( !found )
 		{// Item not present in inventory, remove it.
-			if( SQL_ERROR == SQL->Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) )
+			if( SQL_ERROR == SQL->Query(handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) )
 			{
-				Sql_ShowDebug(sql_handle);
+				Sql_ShowDebug(handle);
 				errors++;
 			}
 		}
@@ -836,11 +1364,11 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 		
 		updateLastUid(items[i].unique_id); // Unique Non Stackable Item ID
 	}
-	dbUpdateUid(sql_handle); // Unique Non Stackable Item ID
+	dbUpdateUid(handle); // Unique Non Stackable Item ID
 
-	if( found && SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+	if( found && SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) )
 	{
-		Sql_ShowDebug(sql_handle);
+		Sql_ShowDebug(handle);
 		errors++;
 	}
 
@@ -851,7 +1379,7 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 }
 /* pretty much a copy of memitemdata_to_sql except it handles inventory_db exclusively,
  * - this is required because inventory db is the only one with the 'favorite' column. */
-int inventory_to_sql(const struct item items[], int max, int id) {
+int inventory_to_sql(Sql* handle, const struct item items[], int max, int id) {
 	StringBuf buf;
 	SqlStmt* stmt;
 	int i;
@@ -873,7 +1401,7 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 		StrBuf->Printf(&buf, ", `card%d`", j);
 	StrBuf->Printf(&buf, " FROM `%s` WHERE `char_id`='%d'", inventory_db, id);
 
-	stmt = SQL->StmtMalloc(sql_handle);
+	stmt = SQL->StmtMalloc(handle);
 	if( SQL_ERROR == SQL->StmtPrepareStr(stmt, StrBuf->Value(&buf))
 	   ||  SQL_ERROR == SQL->StmtExecute(stmt) )
 	{
@@ -930,8 +1458,8 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 						StrBuf->Printf(&buf, ", `card%d`=%d", j, items[i].card[j]);
 					StrBuf->Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
 
-					if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) ) {
-						Sql_ShowDebug(sql_handle);
+					if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) ) {
+						Sql_ShowDebug(handle);
 						errors++;
 					}
 				}
@@ -941,8 +1469,8 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 			}
 		}
 		if( !found ) {// Item not present in inventory, remove it.
-			if( SQL_ERROR == SQL->Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", inventory_db, item.id) ) {
-				Sql_ShowDebug(sql_handle);
+			if( SQL_ERROR == SQL->Query(handle, "DELETE from `%s` where `id`='%d' LIMIT 1", inventory_db, item.id) ) {
+				Sql_ShowDebug(handle);
 				errors++;
 			}
 		}
@@ -975,10 +1503,10 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 
 		updateLastUid(items[i].unique_id);// Unique Non Stackable Item ID
 	}
-	dbUpdateUid(sql_handle);
+	dbUpdateUid(handle);
 
-	if( found && SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) ) {
-		Sql_ShowDebug(sql_handle);
+	if( found && SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(&buf)) ) {
+		Sql_ShowDebug(handle);
 		errors++;
 	}
 
@@ -988,6 +1516,316 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 	return errors;
 }
 
+/// Returns whether two slots hold the same contents (the ids of their rows aside).
+static bool memitemdata_equal(const struct item *a, const struct item *b, bool favorite)
+{
+	if( a->nameid == 0 || b->nameid == 0 )
+		return ( a->nameid == b->nameid );
+	return ( a->nameid == b->nameid && a->amount == b->amount && a->equip == b->equip
+		&& a->identify == b->identify && a->refine == b->refine && a->attribute == b->attribute
+		&& a->expire_time == b->expire_time && a->unique_id == b->unique_id
+		&& memcmp(a->card, b->card, sizeof(a->card)) == 0
+		&& (!favorite || a->favorite == b->favorite) );
+}
+
+/// Returns whether the slots of 'items' differ from 'old', the slots as saved,
+/// not counting the ids of the rows. If they don't, the ids are copied to 'items'.
+static bool memitemdata_slots_changed(const struct item old[], struct item items[], int max, int tableswitch)
+{
+	bool favorite = ( tableswitch == TABLE_INVENTORY );
+	int i;
+
+	ARR_FIND( 0, max, i, !memitemdata_equal(&old[i], &items[i], favorite) );
+	if( i < max )
+		return true;
+	for( i = 0; i < max; ++i )
+		items[i].id = old[i].id;
+	return false;
+}
+
+/// Runs a query that must affect exactly 'rows' rows.
+static bool memitemdata_query(Sql* handle, StringBuf *buf, uint64 rows)
+{
+	if( SQL_ERROR == SQL->QueryStr(handle, StrBuf->Value(buf)) ) {
+		Sql_ShowDebug(handle);
+		return false;
+	}
+	return ( SQL->NumAffectedRows(handle) == rows );
+}
+
+/// Sets the id of the 'pending' slots of 'items' to the rows of the table holding them,
+/// out of the rows of 'id' starting at 'min_id'. Returns false if a row or slot is left over.
+static bool memitemdata_ids_fromsql(Sql* handle, const char* tablename, const char* selectoption, int id, bool favorite, struct item items[], bool pending[], int max, uint64 min_id)
+{
+	StringBuf buf;
+	SqlStmt* stmt;
+	struct item item; // temp storage variable
+	int i, j;
+	bool result = true;
+
+	StrBuf->Init(&buf);
+	StrBuf->AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`");
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StrBuf->Printf(&buf, ", `card%d`", j);
+	if( favorite )
+		StrBuf->AppendStr(&buf, ", `favorite`");
+	StrBuf->Printf(&buf, " FROM `%s` WHERE `%s`='%d' AND `id`>='%"PRIu64"'", tablename, selectoption, id, min_id);
+
+	stmt = SQL->StmtMalloc(handle);
+	if( SQL_ERROR == SQL->StmtPrepareStr(stmt, StrBuf->Value(&buf))
+	||  SQL_ERROR == SQL->StmtExecute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		SQL->StmtFree(stmt);
+		StrBuf->Destroy(&buf);
+		return false;
+	}
+
+	memset(&item, 0, sizeof(item));
+	SQL->StmtBindColumn(stmt, 0, SQLDT_INT,       &item.id,          0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 1, SQLDT_SHORT,     &item.nameid,      0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 2, SQLDT_SHORT,     &item.amount,      0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 3, SQLDT_USHORT,    &item.equip,       0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 4, SQLDT_CHAR,      &item.identify,    0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 5, SQLDT_CHAR,      &item.refine,      0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 6, SQLDT_CHAR,      &item.attribute,   0, NULL, NULL);
+	SQL->StmtBindColumn(stmt, 7, SQLDT_UINT,      &item.expire_time, 0, NULL, NULL);
+	for( j = 0; j < MAX_SLOTS; ++j )
+		SQL->StmtBindColumn(stmt, 8+j, SQLDT_SHORT, &item.card[j], 0, NULL, NULL);
+	if( favorite )
+		SQL->StmtBindColumn(stmt, 8+MAX_SLOTS, SQLDT_CHAR, &item.favorite, 0, NULL, NULL);
+
+	while( SQL_SUCCESS == SQL->StmtNextRow(stmt) ) {
+		// rows updated by memitemdata_to_sql keep their unique_id, it isn't compared
+		for( i = 0; i < max; ++i ) {
+			if( !pending[i] )
+				continue;
+			item.unique_id = items[i].unique_id;
+			if( memitemdata_equal(&item, &items[i], favorite) )
+				break;
+		}
+		if( i == max ) { // not one of ours
+			result = false;
+			break;
+		}
+		items[i].id = item.id;
+		pending[i] = false;
+	}
+	SQL->StmtFree(stmt);
+	StrBuf->Destroy(&buf);
+
+	ARR_FIND( 0, max, i, pending[i] );
+	return ( result && i == max );
+}
+
+/// Saves 'items' by comparing with the table contents (memitemdata_to_sql/inventory_to_sql)
+/// and reads back the ids of their rows.
+static int memitemdata_resync(Sql* handle, const char* tablename, const char* selectoption, struct item items[], int max, int id, int tableswitch)
+{
+	bool favorite = ( tableswitch == TABLE_INVENTORY );
+	bool *pending;
+	int i, errors;
+
+	errors = favorite ? inventory_to_sql(handle, items, max, id) : memitemdata_to_sql(handle, items, max, id, tableswitch);
+	if( errors )
+		return errors;
+
+	CREATE(pending, bool, max);
+	for( i = 0; i < max; ++i )
+		pending[i] = ( items[i].nameid != 0 );
+	if( !memitemdata_ids_fromsql(handle, tablename, selectoption, id, favorite, items, pending, max, 0) ) {
+		ShowError("memitemdata_resync: Could not read the rows of `%s` of %s %d back.\n", tablename, selectoption, id);
+		errors++;
+	}
+	aFree(pending);
+	return errors;
+}
+
+/// Saves an array of 'item' entries into the specified table, given 'old',
+/// the entries the table holds for 'id' (as last loaded or saved) with the ids of their rows.
+/// Only slots that differ are written, in one transaction:
+/// - items that moved to another slot keep their row
+/// - the other changed slots take over a row that is no longer needed, updated
+///   by id (usually their own, only the amount changed)
+/// - rows left over are removed with a single DELETE, items left over are
+///   inserted with a single multi-row INSERT
+/// On success the id of every item of 'items' is set to the row holding it.
+/// If 'old' is NULL or turns out not to match the table, this falls back to
+/// comparing with the table contents (memitemdata_resync).
+int memitemdata_slots_to_sql(Sql* handle, const struct item old[], struct item items[], int max, int id, int tableswitch)
+{
+	StringBuf buf;
+	const char* tablename;
+	const char* selectoption;
+	int *freed, *wanted; // changed slots: rows no longer needed, items without a row
+	bool *pending; // items in the INSERT
+	int nfreed = 0, nwanted = 0, ninsert = 0, ndelete = 0, last = -1;
+	int i, j, k, pass;
+	bool favorite = ( tableswitch == TABLE_INVENTORY ); // only inventory_db has the 'favorite' column
+	bool result = false;
+
+	switch (tableswitch) {
+	case TABLE_INVENTORY:     tablename = inventory_db;     selectoption = "char_id";    break;
+	case TABLE_CART:          tablename = cart_db;          selectoption = "char_id";    break;
+	case TABLE_STORAGE:       tablename = storage_db;       selectoption = "account_id"; break;
+	case TABLE_GUILD_STORAGE: tablename = guild_storage_db; selectoption = "guild_id";   break;
+	default:
+		ShowError("Invalid table name!\n");
+		return 1;
+	}
+
+	if( old != NULL ) // rows of every item are needed
+		ARR_FIND( 0, max, i, old[i].nameid != 0 && old[i].id == 0 );
+	if( old == NULL || i < max ) // table contents unknown
+		return memitemdata_resync(handle, tablename, selectoption, items, max, id, tableswitch);
+
+	CREATE(freed, int, max);
+	CREATE(wanted, int, max);
+	CREATE(pending, bool, max);
+	for( i = 0; i < max; ++i ) {
+		if( memitemdata_equal(&old[i], &items[i], favorite) ) {
+			items[i].id = old[i].id;
+			continue;
+		}
+		if( old[i].nameid )
+			freed[nfreed++] = i;
+		if( items[i].nameid )
+			wanted[nwanted++] = i;
+	}
+
+	// items that only moved to another slot keep their row
+	for( i = 0; i < nwanted; ++i ) {
+		ARR_FIND( 0, nfreed, j, freed[j] >= 0 && memitemdata_equal(&old[freed[j]], &items[wanted[i]], favorite) );
+		if( j < nfreed ) {
+			items[wanted[i]].id = old[freed[j]].id;
+			freed[j] = wanted[i] = -1;
+		}
+	}
+
+	StrBuf->Init(&buf);
+
+	// try
+	do
+	{
+
+	// inside a group-committed save only this part can be undone
+	if( SQL_SUCCESS != SQL->QueryStr(handle, char_save_in_transaction ? "SAVEPOINT `slots`" : "START TRANSACTION") ) {
+		Sql_ShowDebug(handle);
+		break;
+	}
+
+	// changed items: update a freed row, the one of their own slot first
+	for( pass = 0; pass < 2; ++pass ) {
+		for( i = 0; i < nwanted; ++i ) {
+			const struct item *it;
+			if( wanted[i] < 0 )
+				continue;
+			if( pass == 0 )
+				ARR_FIND( 0, nfreed, k, freed[k] == wanted[i] );
+			else
+				ARR_FIND( 0, nfreed, k, freed[k] >= 0 );
+			if( k == nfreed )
+				continue;
+
+			it = &items[wanted[i]];
+			StrBuf->Clear(&buf);
+			StrBuf->Printf(&buf, "UPDATE `%s` SET `nameid`='%d', `amount`='%d', `equip`='%d', `identify`='%d', `refine`='%d', `attribute`='%d', `expire_time`='%u', `unique_id`='%"PRIu64"'",
+				tablename, it->nameid, it->amount, it->equip, it->identify, it->refine, it->attribute, it->expire_time, it->unique_id);
+			if( favorite )
+				StrBuf->Printf(&buf, ", `favorite`='%d'", it->favorite);
+			for( j = 0; j < MAX_SLOTS; ++j )
+				StrBuf->Printf(&buf, ", `card%d`='%d'", j, it->card[j]);
+			StrBuf->Printf(&buf, " WHERE `id`='%d' AND `%s`='%d' LIMIT 1", old[freed[k]].id, selectoption, id);
+			if( !memitemdata_query(handle, &buf, 1) )
+				break;
+
+			items[wanted[i]].id = old[freed[k]].id;
+			freed[k] = wanted[i] = -1;
+		}
+		if( i < nwanted )
+			break;
+	}
+	if( pass < 2 )
+		break;
+
+	// rows left over: one delete
+	StrBuf->Clear(&buf);
+	StrBuf->Printf(&buf, "DELETE FROM `%s` WHERE `%s`='%d' AND `id` IN (", tablename, selectoption, id);
+	for( i = 0; i < nfreed; ++i ) {
+		if( freed[i] < 0 )
+			continue;
+		if( ndelete++ )
+			StrBuf->AppendStr(&buf, ",");
+		StrBuf->Printf(&buf, "'%d'", old[freed[i]].id);
+	}
+	StrBuf->AppendStr(&buf, ")");
+	if( ndelete && !memitemdata_query(handle, &buf, ndelete) )
+		break;
+
+	// items left over: one multi-row insert
+	StrBuf->Clear(&buf);
+	StrBuf->Printf(&buf, "INSERT INTO `%s` (`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `unique_id`", tablename, selectoption);
+	if( favorite )
+		StrBuf->AppendStr(&buf, ", `favorite`");
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StrBuf->Printf(&buf, ", `card%d`", j);
+	StrBuf->AppendStr(&buf, ") VALUES ");
+
+	for( i = 0; i < nwanted; ++i ) {
+		const struct item *it;
+		if( wanted[i] < 0 )
+			continue;
+		it = &items[wanted[i]];
+		if( ninsert++ )
+			StrBuf->AppendStr(&buf, ",");
+		StrBuf->Printf(&buf, "('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%u', '%"PRIu64"'",
+			id, it->nameid, it->amount, it->equip, it->identify, it->refine, it->attribute, it->expire_time, it->unique_id);
+		if( favorite )
+			StrBuf->Printf(&buf, ", '%d'", it->favorite);
+		for( j = 0; j < MAX_SLOTS; ++j )
+			StrBuf->Printf(&buf, ", '%d'", it->card[j]);
+		StrBuf->AppendStr(&buf, ")");
+
+		updateLastUid(it->unique_id); // Unique Non Stackable Item ID
+		pending[wanted[i]] = true;
+		last = wanted[i];
+	}
+	if( ninsert ) {
+		uint64 insert_id;
+		dbUpdateUid(handle); // Unique Non Stackable Item ID
+		if( !memitemdata_query(handle, &buf, ninsert) )
+			break;
+		// ids of the new rows: the first one is known, the others are read back
+		insert_id = SQL->LastInsertId(handle);
+		if( ninsert == 1 )
+			items[last].id = (int)insert_id;
+		else if( !memitemdata_ids_fromsql(handle, tablename, selectoption, id, favorite, items, pending, max, insert_id) )
+			break;
+	}
+
+	// if we got this far, everything was successful
+	result = true;
+
+	} while(0);
+	// finally
+
+	if( char_save_in_transaction )
+		result &= ( SQL_SUCCESS == SQL->QueryStr(handle, (result == true) ? "RELEASE SAVEPOINT `slots`" : "ROLLBACK TO SAVEPOINT `slots`") );
+	else
+		result &= ( SQL_SUCCESS == SQL->QueryStr(handle, (result == true) ? "COMMIT" : "ROLLBACK") );
+
+	StrBuf->Destroy(&buf);
+	aFree(freed);
+	aFree(wanted);
+	aFree(pending);
+
+	if( !result ) { // table didn't hold what we expected, compare with its contents instead
+		ShowWarning("memitemdata_slots_to_sql: `%s` of %s %d does not match the cached items, saving all of them.\n", tablename, selectoption, id);
+		return memitemdata_resync(handle, tablename, selectoption, items, max, id, tableswitch);
+	}
+	return 0;
+}
+
 
 int mmo_char_tobuf(uint8* buf, struct mmo_charstatus* p);
 
@@ -1009,6 +1847,8 @@ int mmo_chars_fromsql(struct char_session_data* sd, uint8* buf)
 
 	for(i = 0 ; i < MAX_CHARS; i++ )
 		sd->found_char[i] = -1;
+
+	char_save_sync(sd->account_id, 0); // the last save of a character may still be waiting
 	
 	// read char data
 	if( SQL_ERROR == SQL->StmtPrepare(stmt, "SELECT "
@@ -1097,6 +1937,8 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus* p, bool load_everything
 	unsigned int opt;
 	int account_id;
 
+	if (load_everything)
+		char_save_sync(0, char_id); // don't read what is about to be overwritten
 	memset(p, 0, sizeof(struct mmo_charstatus));
 
 	if (save_log) ShowInfo("Char load request (%d)\n", char_id);
@@ -1187,6 +2029,8 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus* p, bool load_everything
 	}
 	
 	account_id = p->account_id;
+	if (load_everything)
+		char_save_sync(account_id, 0); // nor what other characters of the account are about to write
 	
 	p->last_point.map = mapindex_name2id(last_map);
 	p->save_point.map = mapindex_name2id(save_map);
@@ -1664,6 +2508,7 @@ int delete_char_sql(int char_id)
 	char *data;
 	size_t len;
 
+	char_save_sync(0, char_id);
 	if (SQL_ERROR == SQL->Query(sql_handle, "SELECT `name`,`account_id`,`party_id`,`guild_id`,`base_level`,`homun_id`,`partner_id`,`father`,`mother`,`elemental_id` FROM `%s` WHERE `char_id`='%d'", char_db, char_id))
 		Sql_ShowDebug(sql_handle);
 
@@ -2733,6 +3578,11 @@ int parse_frommap(int fd)
 		return 0;
 	}
 	if( session[fd]->flag.eof ) {
+		if( session[fd]->zip ) {
+			char name[32];
+			snprintf(name, sizeof(name), "Map-server %d link", id);
+			socket_zip_report(fd, name);
+		}
 		do_close(fd);
 		server[id].fd = -1;
 		mapif_on_disconnect(id);
@@ -2791,6 +3641,20 @@ int parse_frommap(int fd)
 							id, j, CONVIP(server[id].ip), server[id].port);
 				ShowStatus("Map-server %d loading complete.\n", id);
 
+				// announce delta character saves
+				WFIFOHEAD(fd, 4);
+				WFIFOW(fd,0) = 0x2b2a;
+				WFIFOW(fd,2) = CHARSAVE_DELTA_VERSION;
+				WFIFOSET(fd,4);
+
+				// offer compression, the map-server answers with its own 0x2b2b
+				if( map_zip_threshold > 0 ) {
+					WFIFOHEAD(fd, 6);
+					WFIFOW(fd,0) = 0x2b2b;
+					WFIFOL(fd,2) = map_zip_threshold;
+					WFIFOSET(fd,6);
+				}
+
 				// send name for wisp to player
 				WFIFOHEAD(fd, 3 + NAME_LENGTH);
 				WFIFOW(fd,0) = 0x2afb;
@@ -2919,8 +3783,11 @@ int parse_frommap(int fd)
 							character->account_id, character->char_id, character->server, id, aid, cid);
 						mapif_disconnectplayer(server[character->server].fd, character->account_id, character->char_id, 2);
 					}
+					if( character->char_id != -1 && character->char_id != cid )
+						char_route_set(character->char_id, -1);
 					character->server = id;
 					character->char_id = cid;
+					char_route_set(cid, id);
 				}
 				//If any chars remain in -2, they will be cleaned in the cleanup timer.
 				RFIFOSKIP(fd,RFIFOW(fd,2));
@@ -2947,7 +3814,11 @@ int parse_frommap(int fd)
 				{
 					struct mmo_charstatus char_dat;
 					memcpy(&char_dat, RFIFOP(fd,13), sizeof(struct mmo_charstatus));
-					mmo_char_tosql(cid, &char_dat);
+					if (char_dat.char_id == cid) {
+						char_save_enqueue(id, aid, &char_dat, RFIFOB(fd,12) != 0); // final save is acked once committed
+						RFIFOSKIP(fd,size);
+						break;
+					}
 				} else {	//This may be valid on char-server reconnection, when re-sending characters that already logged off.
 					ShowError("parse_from_map (save-char): Received data for non-existant/offline character (%d:%d).\n", aid, cid);
 					set_char_online(id, cid, aid);
@@ -2966,6 +3837,64 @@ int parse_frommap(int fd)
 			}
 			break;
 
+			case 0x2b28: // Receive changed parts of character data from map-server for saving
+				if (RFIFOREST(fd) < 4 || RFIFOREST(fd) < RFIFOW(fd,2))
+					return 0;
+			{
+				int aid = RFIFOL(fd,4), cid = RFIFOL(fd,8), size = RFIFOW(fd,2);
+				unsigned int seq = RFIFOL(fd,13), base = RFIFOL(fd,17);
+				struct mmo_charstatus char_dat;
+				struct online_char_data* character = (struct online_char_data*)idb_get(online_char_db, aid);
+
+				if (character != NULL && character->char_id != cid)
+					character = NULL;
+
+				//Check account only if this ain't final save. Final-save goes through because of the char-map reconnect
+				if (!RFIFOB(fd,12) && character == NULL) {
+					ShowError("parse_from_map (save-char): Received data for non-existant/offline character (%d:%d).\n", aid, cid);
+					set_char_online(id, cid, aid);
+					RFIFOSKIP(fd,size);
+					break;
+				}
+
+				if (char_save_delta(cid, base, character ? character->save_seq : 0, (const uint8*)RFIFOP(fd,21), size - 21, &char_dat) < 0) {
+					// Not based on what we have, ask for the complete data (before acking a final save)
+					if (character)
+						character->save_seq = 0;
+					WFIFOHEAD(fd,11);
+					WFIFOW(fd,0) = 0x2b29;
+					WFIFOL(fd,2) = aid;
+					WFIFOL(fd,6) = cid;
+					WFIFOB(fd,10) = RFIFOB(fd,12);
+					WFIFOSET(fd,11);
+					RFIFOSKIP(fd,size);
+					break;
+				}
+				if (character) // next parts build on this save (reset if it fails to commit)
+					character->save_seq = seq;
+				char_save_enqueue(id, aid, &char_dat, RFIFOB(fd,12) != 0); // final save is acked once committed
+				RFIFOSKIP(fd,size);
+			}
+			break;
+
+			case 0x2b2b: // map-server can expand compressed packets, RFIFOL(fd,2) is its own threshold
+				if( RFIFOREST(fd) < 6 )
+					return 0;
+				socket_zip(fd, map_zip_threshold);
+				ShowStatus("Map-server %d link compressed: packets to it from %d bytes on, from it from %d bytes on (%s).\n",
+					id, map_zip_threshold, RFIFOL(fd,2), RFIFOL(fd,2) > 0 ? "on" : "off");
+				RFIFOSKIP(fd,6);
+			break;
+
+			case 0x2b2c: // compressed packets, parse what they expand to
+				if( RFIFOREST(fd) < 4 || RFIFOREST(fd) < RFIFOW(fd,2) )
+					return 0;
+				if( !socket_unzip(fd) ) {
+					set_eof(fd);
+					return 0;
+				}
+			break;
+
 			case 0x2b02: // req char selection
 				if( RFIFOREST(fd) < 18 )
 					return 0;
@@ -3057,8 +3986,11 @@ int parse_frommap(int fd)
 					idb_put(auth_db, RFIFOL(fd,2), node);
 
 					data = idb_ensure(online_char_db, RFIFOL(fd,2), create_online_char_data);
+					if( data->char_id != -1 && data->char_id != char_data->char_id )
+						char_route_set(data->char_id, -1);
 					data->char_id = char_data->char_id;
 					data->server = map_id; //Update server where char is.
+					char_route_set(data->char_id, map_id);
 
 					//Reply with an ack.
 					WFIFOHEAD(fd,30);
@@ -4559,7 +5491,12 @@ int check_connect_login_server(int tid, unsigned int tick, int id, intptr_t data
 
 	ShowInfo("Attempt to connect to login-server...\n");
 
-	if ( (login_fd = make_connection(login_ip, login_port, NULL)) == -1) { //Try again later. [Skotlex]
+	login_fd = -1;
+	if( login_socket[0] != '\0' && (login_fd = make_connection_unix(login_socket, NULL)) == -1 )
+		ShowWarning("Could not connect to the login-server through '"CL_WHITE"%s"CL_RESET"', trying tcp.\n", login_socket);
+	if( login_fd == -1 ) // no socket path, or unix sockets unavailable
+		login_fd = make_connection(login_ip, login_port, NULL);
+	if ( login_fd == -1) { //Try again later. [Skotlex]
 		login_fd = 0;
 		return 0;
 	}
@@ -4823,6 +5760,12 @@ int char_config_read(const char* cfgName)
 			}
 		} else if (strcmpi(w1, "login_port") == 0) {
 			login_port = atoi(w2);
+		} else if (strcmpi(w1, "login_socket") == 0) {
+			safestrncpy(login_socket, w2, sizeof(login_socket));
+		} else if (strcmpi(w1, "char_socket") == 0) {
+			safestrncpy(char_socket, w2, sizeof(char_socket));
+		} else if (strcmpi(w1, "map_zip_threshold") == 0) {
+			map_zip_threshold = max(0, atoi(w2));
 		} else if (strcmpi(w1, "char_ip") == 0) {
 			char_ip = host2ip(w2);
 			if (char_ip) {
@@ -4855,6 +5798,12 @@ int char_config_read(const char* cfgName)
 			autosave_interval = atoi(w2)*1000;
 			if (autosave_interval <= 0)
 				autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
+		} else if (strcmpi(w1, "save_queue_interval") == 0) {
+			save_queue_interval = atoi(w2);
+		} else if (strcmpi(w1, "save_queue_batch") == 0) {
+			save_queue_batch = max(1, atoi(w2));
+		} else if (strcmpi(w1, "guild_save_delay") == 0) {
+			guild_save_delay = max(0, atoi(w2))*1000;
 		} else if (strcmpi(w1, "save_log") == 0) {
 			save_log = config_switch(w2);
 		} else if (strcmpi(w1, "start_point") == 0) {
@@ -4945,6 +5894,7 @@ void do_final(void) {
 
 	HPM->event(HPET_FINAL);
 	
+	char_save_final();
 	set_all_offline(-1);
 	set_all_offline_sql();
 
@@ -4960,6 +5910,7 @@ void do_final(void) {
 
 	char_db_->destroy(char_db_, NULL);
 	online_char_db->destroy(online_char_db, NULL);
+	char_route_final();
 	auth_db->destroy(auth_db, NULL);
 
 	if( char_fd != -1 ) {
@@ -5008,6 +5959,13 @@ void do_shutdown(void)
 }
 
 
+CPCMD(route_stats) {
+	char_route_report();
+}
+CPCMD(guild_queue) {
+	inter_guild_queue_report();
+}
+
 int do_init(int argc, char **argv) {
 	int i;
 	memset(&skillid2idx, 0, sizeof(skillid2idx));
@@ -5033,9 +5991,11 @@ int do_init(int argc, char **argv) {
 	}
 	
 	inter_init_sql((argc > 2) ? argv[2] : inter_cfgName); // inter server configuration
+	char_save_init();
 
 	auth_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	char_route_init();
 
 	HPM->share(sql_handle,"sql_handle");
 	HPM->config_read();
@@ -5095,10 +6055,14 @@ int do_init(int argc, char **argv) {
 		ShowFatalError("Failed to bind to port '"CL_WHITE"%d"CL_RESET"'\n",char_port);
 		exit(EXIT_FAILURE);
 	}
+	if( char_socket[0] != '\0' && make_listen_bind_unix(char_socket) == -1 )
+		ShowWarning("Failed to listen on '"CL_WHITE"%s"CL_RESET"', map-servers will have to connect through tcp.\n", char_socket);
 	
 	Sql_HerculesUpdateCheck(sql_handle);
 #ifdef CONSOLE_INPUT
 	console->setSQL(sql_handle);
+	console->addCommand("route:stats",CPCMD_A(route_stats));
+	console->addCommand("guild:queue",CPCMD_A(guild_queue));
 #endif
 	ShowStatus("The char-server is "CL_GREEN"ready"CL_RESET" (Server is listening on the port %d).\n\n", char_port);
 	
@@ -7,6 +7,7 @@
 #include "../config/core.h"
 #include "../common/core.h" // CORE_ST_LAST
 #include "../common/db.h"
+#include "../common/sql.h" // Sql
 
 enum E_CHARSERVER_ST {
 	CHARSERVER_ST_RUNNING = CORE_ST_LAST,
@@ -41,6 +42,7 @@ struct online_char_data {
 	int waiting_disconnect;
 	short server; // -2: unknown server, -1: not connected, 0+: id of server
 	int pincode_enable;
+	unsigned int save_seq; // last delta save sequence applied (0x2b28), 0 = next save must be complete
 };
 
 DBMap* online_char_db; // int account_id -> struct online_char_data*
@@ -56,12 +58,28 @@ enum {
 	TABLE_GUILD_STORAGE,
 };
 
-int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch);
+int memitemdata_to_sql(Sql* handle, const struct item items[], int max, int id, int tableswitch);
+int memitemdata_slots_to_sql(Sql* handle, const struct item old[], struct item items[], int max, int id, int tableswitch);
 
 int mapif_sendall(unsigned char *buf,unsigned int len);
 int mapif_sendallwos(int fd,unsigned char *buf,unsigned int len);
 int mapif_send(int fd,unsigned char *buf,unsigned int len);
 
+// map-server routing index (where online characters, guilds and parties are)
+enum char_route_type {
+	CHAR_ROUTE_GUILD,
+	CHAR_ROUTE_PARTY,
+	CHAR_ROUTE_NAME,
+	CHAR_ROUTE_MAX
+};
+void char_route_set(int char_id, int map_id);
+void char_route_guild(int char_id, int guild_id);
+void char_route_party(int char_id, int party_id);
+int char_route_find(const char* name);
+int mapif_send_guild(int guild_id, int sfd, unsigned char* buf, unsigned int len);
+int mapif_send_party(int party_id, int sfd, unsigned char* buf, unsigned int len);
+int mapif_send_name(const char* name, unsigned char* buf, unsigned int len);
+
 int char_married(int pl1,int pl2);
 int char_child(int parent_id, int child_id);
 int char_family(int pl1,int pl2,int pl3);
@@ -73,6 +91,7 @@ extern int char_name_option;
 extern char char_name_letters[];
 extern bool char_gm_read;
 extern int autosave_interval;
+extern int guild_save_delay;
 extern int save_log;
 extern char db_path[];
 extern char char_db[256];
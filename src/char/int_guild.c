@@ -46,50 +46,213 @@ int mapif_guild_info(int fd,struct guild *g);
 int guild_break_sub(int key,void *data,va_list ap);
 int inter_guild_tosql(struct guild *g,int flag);
 
-static int guild_save_timer(int tid, unsigned int tick, int id, intptr_t data)
+/// Guilds waiting to be saved or unloaded, oldest first.
+struct guild_queue_entry {
+	int guild_id;
+	unsigned int tick; // when it was queued
+	struct guild_queue_entry *next;
+};
+
+struct guild_queue {
+	struct guild_queue_entry *head, **tail;
+	DBMap* index; // int guild_id -> tick it was last queued
+	unsigned int depth, max_depth;
+};
+
+static struct guild_queue guild_dirty; // guilds with save_flag&GS_MASK
+static struct guild_queue guild_delayed; // guilds with high-frequency changes, moved to guild_dirty after guild_save_delay
+static struct guild_queue guild_expire; // guilds flagged with GS_REMOVE
+
+static struct {
+	unsigned int queued, saves; // guilds queued, saved by the timer
+	unsigned int delayed; // high-frequency changes that waited for guild_save_delay
+	unsigned int unloads; // guilds removed from the cache
+	unsigned int wait_max; // longest a guild waited to be saved (ms)
+	unsigned int report_tick, report_saves; // for the save rate since the last report
+} guild_queue_stats;
+
+static void guild_queue_init(struct guild_queue *queue)
 {
-	static int last_id = 0; //To know in which guild we were.
-	int state = 0; //0: Have not reached last guild. 1: Reached last guild, ready for save. 2: Some guild saved, don't do further saving.
-	DBIterator *iter = db_iterator(guild_db_);
-	DBKey key;
-	struct guild* g;
+	queue->head = NULL;
+	queue->tail = &queue->head;
+	queue->index = idb_alloc(DB_OPT_BASE);
+	queue->depth = queue->max_depth = 0;
+}
 
-	if( last_id == 0 ) //Save the first guild in the list.
-		state = 1;
+static void guild_queue_final(struct guild_queue *queue)
+{
+	struct guild_queue_entry *entry, *next;
 
-	for( g = DB->data2ptr(iter->first(iter, &key)); dbi_exists(iter); g = DB->data2ptr(iter->next(iter, &key)) )
-	{
-		if( state == 0 && g->guild_id == last_id )
-			state++; //Save next guild in the list.
-		else
-		if( state == 1 && g->save_flag&GS_MASK )
-		{
-			inter_guild_tosql(g, g->save_flag&GS_MASK);
-			g->save_flag &= ~GS_MASK;
+	for( entry = queue->head; entry != NULL; entry = next ) {
+		next = entry->next;
+		aFree(entry);
+	}
+	queue->head = NULL;
+	queue->tail = &queue->head;
+	db_destroy(queue->index);
+	queue->depth = 0;
+}
 
-			//Some guild saved.
-			last_id = g->guild_id;
-			state++;
-		}
+/// Appends a guild to the queue, unless it is already waiting in it.
+/// The tick it was queued is updated either way.
+/// Returns true if it was added.
+static bool guild_queue_push(struct guild_queue *queue, int guild_id, unsigned int tick)
+{
+	struct guild_queue_entry *entry;
+	bool queued = idb_exists(queue->index, guild_id);
 
-		if( g->save_flag == GS_REMOVE )
-		{// Nothing to save, guild is ready for removal.
-			if (save_log)
-				ShowInfo("Guild Unloaded (%d - %s)\n", g->guild_id, g->name);
-			db_remove(guild_db_, key);
-		}
+	idb_iput(queue->index, guild_id, (int)tick);
+	if( queued )
+		return false;
+
+	CREATE(entry, struct guild_queue_entry, 1);
+	entry->guild_id = guild_id;
+	entry->tick = tick;
+	*queue->tail = entry;
+	queue->tail = &entry->next;
+	queue->depth++;
+	queue->max_depth = max(queue->max_depth, queue->depth);
+	return true;
+}
+
+/// Takes the oldest guild out of the queue.
+/// Returns false if the queue is empty.
+static bool guild_queue_pop(struct guild_queue *queue, int *guild_id, unsigned int *tick)
+{
+	struct guild_queue_entry *entry = queue->head;
+
+	if( entry == NULL )
+		return false;
+
+	if( (queue->head = entry->next) == NULL )
+		queue->tail = &queue->head;
+	queue->depth--;
+	*guild_id = entry->guild_id;
+	*tick = entry->tick;
+	idb_remove(queue->index, entry->guild_id);
+	aFree(entry);
+	return true;
+}
+
+/// Flags parts of a guild to be saved (GS_MASK) or the guild to be unloaded (GS_REMOVE),
+/// and queues it for the save timer or the expiry timer.
+static void inter_guild_dirty(struct guild *g, int flag)
+{
+	unsigned int tick = timer->gettick();
+
+	g->save_flag |= flag;
+	if( flag&GS_MASK && guild_queue_push(&guild_dirty, g->guild_id, tick) )
+		guild_queue_stats.queued++;
+	if( flag&GS_REMOVE )
+		guild_queue_push(&guild_expire, g->guild_id, tick);
+}
+
+/// Flags parts of a guild that change all the time (guild exp, member exp, online status).
+/// The guild is queued for saving once guild_save_delay has passed, so a burst of
+/// changes (WoE, leveling parties) is written once instead of on every save slot.
+static void inter_guild_dirty_delayed(struct guild *g, int flag)
+{
+	if( guild_save_delay <= 0 ) {
+		inter_guild_dirty(g, flag);
+		return;
 	}
-	dbi_destroy(iter);
+	g->save_flag |= flag&GS_MASK;
+	guild_queue_stats.delayed++;
+	guild_queue_push(&guild_delayed, g->guild_id, timer->gettick());
+}
+
+/// Queues for saving the guilds whose high-frequency changes have waited guild_save_delay.
+static int guild_delayed_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int guild_id;
+	unsigned int queued;
+
+	while( guild_delayed.head != NULL && DIFF_TICK(tick, guild_delayed.head->tick) >= guild_save_delay ) {
+		struct guild* g;
+
+		guild_queue_pop(&guild_delayed, &guild_id, &queued);
+		if( (g = (struct guild*)idb_get(guild_db_, guild_id)) != NULL && g->save_flag&GS_MASK
+		&&  guild_queue_push(&guild_dirty, guild_id, queued) )
+			guild_queue_stats.queued++;
+	}
+	return 0;
+}
+
+/// Saves the guild that has been waiting the longest.
+static int guild_save_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int guild_id, size;
+	unsigned int queued;
+
+	while( guild_queue_pop(&guild_dirty, &guild_id, &queued) ) {
+		struct guild* g = (struct guild*)idb_get(guild_db_, guild_id);
+
+		if( g == NULL || !(g->save_flag&GS_MASK) )
+			continue; // broken, or already saved by other means
+		inter_guild_tosql(g, g->save_flag&GS_MASK);
+		g->save_flag &= ~GS_MASK;
+		guild_queue_stats.saves++;
+		guild_queue_stats.wait_max = max(guild_queue_stats.wait_max, (unsigned int)DIFF_TICK(tick, queued));
+		break;
+	}
+
+	// Same pace as a pass over the whole cache: nothing waits much longer than autosave_interval.
+	size = guild_db_->size(guild_db_);
+	if( size < 1 ) size = 1; //Calculate the time slot for the next save.
+	timer->add(tick + autosave_interval/size, guild_save_timer, 0, 0);
+	return 0;
+}
+
+/// Unloads the guilds that were flagged with GS_REMOVE at least autosave_interval ago
+/// and are still not needed.
+static int guild_expire_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int guild_id;
+	unsigned int queued;
 
-	if( state != 2 ) //Reached the end of the guild db without saving.
-		last_id = 0; //Reset guild saved, return to beginning.
+	while( guild_expire.head != NULL && DIFF_TICK(tick, guild_expire.head->tick) >= autosave_interval ) {
+		unsigned int last = (unsigned int)idb_iget(guild_expire.index, guild_expire.head->guild_id);
+		struct guild* g;
 
-	state = guild_db_->size(guild_db_);
-	if( state < 1 ) state = 1; //Calculate the time slot for the next save.
-	timer->add(tick  + autosave_interval/state, guild_save_timer, 0, 0);
+		guild_queue_pop(&guild_expire, &guild_id, &queued);
+		if( last != queued ) { // flagged again since, wait from then
+			guild_queue_push(&guild_expire, guild_id, last);
+			continue;
+		}
+		if( (g = (struct guild*)idb_get(guild_db_, guild_id)) == NULL || !(g->save_flag&GS_REMOVE) )
+			continue; // broken, or a member came back online
+		if( g->save_flag&GS_MASK ) { // unload it once it is saved
+			guild_queue_push(&guild_expire, guild_id, tick);
+			continue;
+		}
+		if (save_log)
+			ShowInfo("Guild Unloaded (%d - %s)\n", g->guild_id, g->name);
+		idb_remove(guild_db_, guild_id);
+		guild_queue_stats.unloads++;
+	}
 	return 0;
 }
 
+/// Prints the guild save queue depth and save rate.
+void inter_guild_queue_report(void)
+{
+	unsigned int tick = timer->gettick();
+	unsigned int elapsed = (unsigned int)DIFF_TICK(tick, guild_queue_stats.report_tick);
+	unsigned int saves = guild_queue_stats.saves - guild_queue_stats.report_saves;
+
+	ShowInfo("Guild saves: %u waiting (%u at most), %u queued, %u saved, %.1f saves/min in the last %u s, longest wait %u ms\n",
+		guild_dirty.depth, guild_dirty.max_depth, guild_queue_stats.queued, guild_queue_stats.saves,
+		elapsed ? 60000. * saves / elapsed : 0., elapsed / 1000, guild_queue_stats.wait_max);
+	ShowInfo("Guild changes: %u delayed by guild_save_delay, %u guilds waiting for it\n",
+		guild_queue_stats.delayed, guild_delayed.depth);
+	ShowInfo("Guild cache: %u guilds, %u waiting to be unloaded, %u unloaded\n",
+		guild_db_->size(guild_db_), guild_expire.depth, guild_queue_stats.unloads);
+	guild_queue_stats.report_tick = tick;
+	guild_queue_stats.report_saves = guild_queue_stats.saves;
+	guild_dirty.max_depth = guild_dirty.depth;
+	guild_queue_stats.wait_max = 0;
+}
+
 int inter_guild_removemember_tosql(int account_id, int char_id)
 {
 	if( SQL_ERROR == SQL->Query(sql_handle, "DELETE from `%s` where `account_id` = '%d' and `char_id` = '%d'", guild_member_db, account_id, char_id) )
@@ -229,47 +392,79 @@ int inter_guild_tosql(struct guild *g,int flag)
 
 	if (flag&GS_MEMBER)
 	{
-		struct guild_member *m;
+		StringBuf buf, joined;
+		int rows = 0, new_rows = 0;
 
 		strcat(t_info, " members");
-		// Update only needed players
+		StrBuf->Init(&buf);
+		StrBuf->Init(&joined);
+		// Update only needed players, all in one statement
 		for(i=0;i<g->max_member;i++){
-			m = &g->member[i];
-			if (!m->modified)
+			struct guild_member *m = &g->member[i];
+			if (!m->modified || !m->account_id)
 				continue;
-			if(m->account_id) {
-				//Since nothing references guild member table as foreign keys, it's safe to use REPLACE INTO
-				SQL->EscapeStringLen(sql_handle, esc_name, m->name, strnlen(m->name, NAME_LENGTH));
-				if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`account_id`,`char_id`,`hair`,`hair_color`,`gender`,`class`,`lv`,`exp`,`exp_payper`,`online`,`position`,`name`) "
-					"VALUES ('%d','%d','%d','%d','%d','%d','%d','%d','%"PRIu64"','%d','%d','%d','%s')",
-					guild_member_db, g->guild_id, m->account_id, m->char_id,
-					m->hair, m->hair_color, m->gender,
-					m->class_, m->lv, m->exp, m->exp_payper, m->online, m->position, esc_name) )
-					Sql_ShowDebug(sql_handle);
-				if (m->modified&GS_MEMBER_NEW || new_guild == 1)
-				{
-					if( SQL_ERROR == SQL->Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` = '%d'",
-						char_db, g->guild_id, m->char_id) )
-						Sql_ShowDebug(sql_handle);
-				}
-				m->modified = GS_MEMBER_UNMODIFIED;
+			if (rows++ == 0) //Since nothing references guild member table as foreign keys, it's safe to use REPLACE INTO
+				StrBuf->Printf(&buf, "REPLACE INTO `%s` (`guild_id`,`account_id`,`char_id`,`hair`,`hair_color`,`gender`,`class`,`lv`,`exp`,`exp_payper`,`online`,`position`,`name`) VALUES ", guild_member_db);
+			else
+				StrBuf->AppendStr(&buf, ",");
+			SQL->EscapeStringLen(sql_handle, esc_name, m->name, strnlen(m->name, NAME_LENGTH));
+			StrBuf->Printf(&buf, "('%d','%d','%d','%d','%d','%d','%d','%d','%"PRIu64"','%d','%d','%d','%s')",
+				g->guild_id, m->account_id, m->char_id,
+				m->hair, m->hair_color, m->gender,
+				m->class_, m->lv, m->exp, m->exp_payper, m->online, m->position, esc_name);
+			if (m->modified&GS_MEMBER_NEW || new_guild == 1)
+				StrBuf->Printf(&joined, new_rows++ ? ",'%d'" : "'%d'", m->char_id);
+		}
+		if (rows)
+		{
+			bool saved = true;
+
+			if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) ) {
+				Sql_ShowDebug(sql_handle);
+				saved = false;
+			}
+			if( saved && new_rows && SQL_ERROR == SQL->Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` IN (%s)",
+				char_db, g->guild_id, StrBuf->Value(&joined)) ) {
+				Sql_ShowDebug(sql_handle);
+				saved = false;
+			}
+			if( saved ) { // otherwise they stay flagged and the next member save writes them again
+				for(i=0;i<g->max_member;i++)
+					if (g->member[i].account_id)
+						g->member[i].modified = GS_MEMBER_UNMODIFIED;
 			}
 		}
+		StrBuf->Destroy(&buf);
+		StrBuf->Destroy(&joined);
 	}
 
 	if (flag&GS_POSITION){
+		StringBuf buf;
+		int rows = 0;
+
 		strcat(t_info, " positions");
-		//printf("- Insert guild %d to guild_position\n",g->guild_id);
+		StrBuf->Init(&buf);
 		for(i=0;i<MAX_GUILDPOSITION;i++){
 			struct guild_position *p = &g->position[i];
 			if (!p->modified)
 				continue;
+			if (rows++ == 0)
+				StrBuf->Printf(&buf, "REPLACE INTO `%s` (`guild_id`,`position`,`name`,`mode`,`exp_mode`) VALUES ", guild_position_db);
+			else
+				StrBuf->AppendStr(&buf, ",");
 			SQL->EscapeStringLen(sql_handle, esc_name, p->name, strnlen(p->name, NAME_LENGTH));
-			if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`position`,`name`,`mode`,`exp_mode`) VALUES ('%d','%d','%s','%d','%d')",
-				guild_position_db, g->guild_id, i, esc_name, p->mode, p->exp_mode) )
+			StrBuf->Printf(&buf, "('%d','%d','%s','%d','%d')", g->guild_id, i, esc_name, p->mode, p->exp_mode);
+		}
+		if (rows)
+		{
+			if( SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
 				Sql_ShowDebug(sql_handle);
-			p->modified = GS_POSITION_UNMODIFIED;
+			else {
+				for(i=0;i<MAX_GUILDPOSITION;i++)
+					g->position[i].modified = GS_POSITION_UNMODIFIED;
+			}
 		}
+		StrBuf->Destroy(&buf);
 	}
 
 	if (flag&GS_ALLIANCE)
@@ -285,49 +480,71 @@ int inter_guild_tosql(struct guild *g,int flag)
 		}
 		else
 		{
-			//printf("- Insert guild %d to guild_alliance\n",g->guild_id);
+			StringBuf buf;
+			int rows = 0;
+
+			StrBuf->Init(&buf);
 			for(i=0;i<MAX_GUILDALLIANCE;i++)
 			{
 				struct guild_alliance *a=&g->alliance[i];
-				if(a->guild_id>0)
-				{
-					SQL->EscapeStringLen(sql_handle, esc_name, a->name, strnlen(a->name, NAME_LENGTH));
-					if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`opposition`,`alliance_id`,`name`) "
-						"VALUES ('%d','%d','%d','%s')",
-						guild_alliance_db, g->guild_id, a->opposition, a->guild_id, esc_name) )
-						Sql_ShowDebug(sql_handle);
-				}
+				if(a->guild_id<=0)
+					continue;
+				if (rows++ == 0)
+					StrBuf->Printf(&buf, "REPLACE INTO `%s` (`guild_id`,`opposition`,`alliance_id`,`name`) VALUES ", guild_alliance_db);
+				else
+					StrBuf->AppendStr(&buf, ",");
+				SQL->EscapeStringLen(sql_handle, esc_name, a->name, strnlen(a->name, NAME_LENGTH));
+				StrBuf->Printf(&buf, "('%d','%d','%d','%s')", g->guild_id, a->opposition, a->guild_id, esc_name);
 			}
+			if( rows && SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+				Sql_ShowDebug(sql_handle);
+			StrBuf->Destroy(&buf);
 		}
 	}
 
 	if (flag&GS_EXPULSION){
+		StringBuf buf;
+		int rows = 0;
+
 		strcat(t_info, " expulsions");
-		//printf("- Insert guild %d to guild_expulsion\n",g->guild_id);
+		StrBuf->Init(&buf);
 		for(i=0;i<MAX_GUILDEXPULSION;i++){
 			struct guild_expulsion *e=&g->expulsion[i];
-			if(e->account_id>0){
-				char esc_mes[sizeof(e->mes)*2+1];
-
-				SQL->EscapeStringLen(sql_handle, esc_name, e->name, strnlen(e->name, NAME_LENGTH));
-				SQL->EscapeStringLen(sql_handle, esc_mes, e->mes, strnlen(e->mes, sizeof(e->mes)));
-				if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`account_id`,`name`,`mes`) "
-					"VALUES ('%d','%d','%s','%s')", guild_expulsion_db, g->guild_id, e->account_id, esc_name, esc_mes) )
-					Sql_ShowDebug(sql_handle);
-			}
+			char esc_mes[sizeof(e->mes)*2+1];
+
+			if(e->account_id<=0)
+				continue;
+			if (rows++ == 0)
+				StrBuf->Printf(&buf, "REPLACE INTO `%s` (`guild_id`,`account_id`,`name`,`mes`) VALUES ", guild_expulsion_db);
+			else
+				StrBuf->AppendStr(&buf, ",");
+			SQL->EscapeStringLen(sql_handle, esc_name, e->name, strnlen(e->name, NAME_LENGTH));
+			SQL->EscapeStringLen(sql_handle, esc_mes, e->mes, strnlen(e->mes, sizeof(e->mes)));
+			StrBuf->Printf(&buf, "('%d','%d','%s','%s')", g->guild_id, e->account_id, esc_name, esc_mes);
 		}
+		if( rows && SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+			Sql_ShowDebug(sql_handle);
+		StrBuf->Destroy(&buf);
 	}
 
 	if (flag&GS_SKILL){
+		StringBuf buf;
+		int rows = 0;
+
 		strcat(t_info, " skills");
-		//printf("- Insert guild %d to guild_skill\n",g->guild_id);
+		StrBuf->Init(&buf);
 		for(i=0;i<MAX_GUILDSKILL;i++){
-			if (g->skill[i].id>0 && g->skill[i].lv>0){
-				if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`id`,`lv`) VALUES ('%d','%d','%d')",
-					guild_skill_db, g->guild_id, g->skill[i].id, g->skill[i].lv) )
-					Sql_ShowDebug(sql_handle);
-			}
+			if (g->skill[i].id<=0 || g->skill[i].lv<=0)
+				continue;
+			if (rows++ == 0)
+				StrBuf->Printf(&buf, "REPLACE INTO `%s` (`guild_id`,`id`,`lv`) VALUES ", guild_skill_db);
+			else
+				StrBuf->AppendStr(&buf, ",");
+			StrBuf->Printf(&buf, "('%d','%d','%d')", g->guild_id, g->skill[i].id, g->skill[i].lv);
 		}
+		if( rows && SQL_ERROR == SQL->QueryStr(sql_handle, StrBuf->Value(&buf)) )
+			Sql_ShowDebug(sql_handle);
+		StrBuf->Destroy(&buf);
 	}
 
 	if (save_log)
@@ -516,7 +733,7 @@ struct guild * inter_guild_fromsql(int guild_id)
 	SQL->FreeResult(sql_handle);
 
 	idb_put(guild_db_, guild_id, g); //Add to cache
-	g->save_flag |= GS_REMOVE; //But set it to be removed, in case it is not needed for long.
+	inter_guild_dirty(g, GS_REMOVE); //But set it to be removed, in case it is not needed for long.
 
 	if (save_log)
 		ShowInfo("Guild loaded (%d - %s)\n", guild_id, g->name);
@@ -714,7 +931,7 @@ int inter_guild_CharOffline(int char_id, int guild_id)
 
 	// Remove guild from memory if no players online
 	if( online_count == 0 )
-		g->save_flag |= GS_REMOVE;
+		inter_guild_dirty(g, GS_REMOVE);
 
 	return 1;
 }
@@ -729,8 +946,18 @@ int inter_guild_sql_init(void)
 	//Read exp file
 	sv->readdb("db", DBPATH"exp_guild.txt", ',', 1, 1, 100, exp_guild_parse_row);
 
+	guild_queue_init(&guild_dirty);
+	guild_queue_init(&guild_delayed);
+	guild_queue_init(&guild_expire);
+	memset(&guild_queue_stats, 0, sizeof(guild_queue_stats));
+	guild_queue_stats.report_tick = timer->gettick();
+
 	timer->add_func_list(guild_save_timer, "guild_save_timer");
+	timer->add_func_list(guild_delayed_timer, "guild_delayed_timer");
+	timer->add_func_list(guild_expire_timer, "guild_expire_timer");
 	timer->add(timer->gettick() + 10000, guild_save_timer, 0, 0);
+	timer->add_interval(timer->gettick() + 10000, guild_delayed_timer, 0, 0, 1000);
+	timer->add_interval(timer->gettick() + 10000, guild_expire_timer, 0, 0, 1000);
 	return 0;
 }
 
@@ -751,6 +978,9 @@ void inter_guild_sql_final(void)
 {
 	guild_db_->destroy(guild_db_, guild_db_final);
 	db_destroy(castle_db);
+	guild_queue_final(&guild_dirty);
+	guild_queue_final(&guild_delayed);
+	guild_queue_final(&guild_expire);
 	return;
 }
 
@@ -872,7 +1102,7 @@ int guild_calcinfo(struct guild *g)
 	// Check if guild stats has change
 	if(g->max_member != before.max_member || g->guild_lv != before.guild_lv || g->skill_point != before.skill_point	)
 	{
-		g->save_flag |= GS_LEVEL;
+		inter_guild_dirty(g, GS_LEVEL);
 		mapif_guild_info(-1,g);
 		return 1;
 	}
@@ -995,7 +1225,7 @@ int mapif_guild_message(int guild_id,int account_id,char *mes,int len, int sfd)
 	WBUFL(buf,4)=guild_id;
 	WBUFL(buf,8)=account_id;
 	memcpy(WBUFP(buf,12),mes,len);
-	mapif_sendallwos(sfd, buf,len+12);
+	mapif_send_guild(guild_id, sfd, buf, len+12);
 	return 0;
 }
 
@@ -1197,6 +1427,7 @@ int mapif_parse_CreateGuild(int fd,int account_id,char *name,struct guild_member
 
 	//Add to cache
 	idb_put(guild_db_, g->guild_id, g);
+	char_route_guild(master->char_id, g->guild_id);
 
 	// Report to client
 	mapif_guild_created(fd,account_id,g);
@@ -1244,10 +1475,11 @@ int mapif_parse_GuildAddMember(int fd,int guild_id,struct guild_member *m)
 			memcpy(&g->member[i],m,sizeof(struct guild_member));
 			g->member[i].modified = (GS_MEMBER_NEW | GS_MEMBER_MODIFIED);
 			mapif_guild_memberadded(fd,guild_id,m->account_id,m->char_id,0);
+			char_route_guild(m->char_id, guild_id);
 			if (!guild_calcinfo(g)) //Send members if it was not invoked.
 				mapif_guild_info(-1,g);
 
-			g->save_flag |= GS_MEMBER;
+			inter_guild_dirty(g, GS_MEMBER);
 			if (g->save_flag&GS_REMOVE)
 				g->save_flag&=~GS_REMOVE;
 			return 0;
@@ -1302,6 +1534,7 @@ int mapif_parse_GuildLeave(int fd, int guild_id, int account_id, int char_id, in
 
 	mapif_guild_withdraw(guild_id,account_id,char_id,flag,g->member[i].name,mes);
 	inter_guild_removemember_tosql(g->member[i].account_id,g->member[i].char_id);
+	char_route_guild(char_id, 0);
 
 	memset(&g->member[i],0,sizeof(struct guild_member));
 
@@ -1311,7 +1544,7 @@ int mapif_parse_GuildLeave(int fd, int guild_id, int account_id, int char_id, in
 		//Update member info.
 		if (!guild_calcinfo(g))
 			mapif_guild_info(fd,g);
-		g->save_flag |= GS_EXPULSION;
+		inter_guild_dirty(g, GS_EXPULSION);
 	}
 
 	return 0;
@@ -1333,6 +1566,8 @@ int mapif_parse_GuildChangeMemberInfoShort(int fd,int guild_id,int account_id,in
 	if( i < g->max_member )
 	{
 		g->member[i].online = online;
+		if( online )
+			char_route_guild(char_id, guild_id);
 		g->member[i].lv = lv;
 		g->member[i].class_ = class_;
 		g->member[i].modified = GS_MEMBER_MODIFIED;
@@ -1362,11 +1597,11 @@ int mapif_parse_GuildChangeMemberInfoShort(int fd,int guild_id,int account_id,in
 	{
 		g->average_lv = sum / c;
 		if( g->connect_member != prev_count || g->average_lv != prev_alv )
-			g->save_flag |= GS_CONNECT;
+			inter_guild_dirty_delayed(g, GS_CONNECT);
 		if( g->save_flag & GS_REMOVE )
 			g->save_flag &= ~GS_REMOVE;
 	}
-	g->save_flag |= GS_MEMBER; //Update guild member data
+	inter_guild_dirty_delayed(g, GS_MEMBER); //Update guild member data
 	return 0;
 }
 
@@ -1374,6 +1609,7 @@ int mapif_parse_GuildChangeMemberInfoShort(int fd,int guild_id,int account_id,in
 int mapif_parse_BreakGuild(int fd,int guild_id)
 {
 	struct guild * g;
+	int i;
 
 	g = inter_guild_fromsql(guild_id);
 	if(g==NULL)
@@ -1411,6 +1647,10 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 
 	mapif_guild_broken(guild_id,0);
 
+	for( i = 0; i < g->max_member; i++ )
+		if( g->member[i].account_id > 0 )
+			char_route_guild(g->member[i].char_id, 0);
+
 	if(log_inter)
 		inter_log("guild %s (id=%d) broken\n",g->name,guild_id);
 
@@ -1445,7 +1685,7 @@ int mapif_parse_GuildBasicInfoChange(int fd,int guild_id,int type,const char *da
 			else if(dw<0 && g->guild_lv+dw>=1)
 				g->guild_lv+=dw;
 			mapif_guild_info(-1,g);
-			g->save_flag |= GS_LEVEL;
+			inter_guild_dirty(g, GS_LEVEL);
 			return 0;
 		default:
 			ShowError("int_guild: GuildBasicInfoChange: Unknown type %d\n",type);
@@ -1486,7 +1726,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].position=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER;
+			inter_guild_dirty(g, GS_MEMBER);
 			break;
 		  }
 		case GMI_EXP:
@@ -1510,10 +1750,10 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 
 				guild_calcinfo(g);
 				mapif_guild_basicinfochanged(guild_id,GBI_EXP,&g->exp,sizeof(g->exp));
-				g->save_flag |= GS_LEVEL;
+				inter_guild_dirty_delayed(g, GS_LEVEL);
 			}
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER;
+			inter_guild_dirty_delayed(g, GS_MEMBER);
 			break;
 		}
 		case GMI_HAIR:
@@ -1521,7 +1761,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].hair=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			inter_guild_dirty(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_HAIR_COLOR:
@@ -1529,7 +1769,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].hair_color=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			inter_guild_dirty(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_GENDER:
@@ -1537,7 +1777,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].gender=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			inter_guild_dirty(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_CLASS:
@@ -1545,7 +1785,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].class_=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			inter_guild_dirty(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_LEVEL:
@@ -1553,7 +1793,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].lv=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			inter_guild_dirty(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		default:
@@ -1617,7 +1857,7 @@ int mapif_parse_GuildPosition(int fd,int guild_id,int idx,struct guild_position
 	memcpy(&g->position[idx],p,sizeof(struct guild_position));
 	mapif_guild_position(g,idx);
 	g->position[idx].modified = GS_POSITION_MODIFIED;
-	g->save_flag |= GS_POSITION; // Change guild_position
+	inter_guild_dirty(g, GS_POSITION); // Change guild_position
 	return 0;
 }
 
@@ -1638,7 +1878,7 @@ int mapif_parse_GuildSkillUp(int fd,int guild_id,uint16 skill_id,int account_id,
 		if (!guild_calcinfo(g))
 			mapif_guild_info(-1,g);
 		mapif_guild_skillupack(guild_id,skill_id,account_id);
-		g->save_flag |= (GS_LEVEL|GS_SKILL); // Change guild & guild_skill
+		inter_guild_dirty(g, GS_LEVEL|GS_SKILL); // Change guild & guild_skill
 	}
 	return 0;
 }
@@ -1657,7 +1897,7 @@ static int mapif_parse_GuildDeleteAlliance(struct guild *g, int guild_id, int ac
 	g->alliance[i].guild_id=0;
 
 	mapif_guild_alliance(g->guild_id,guild_id,account_id1,account_id2,flag,g->name,name);
-	g->save_flag |= GS_ALLIANCE;
+	inter_guild_dirty(g, GS_ALLIANCE);
 	return 0;
 }
 
@@ -1707,8 +1947,8 @@ int mapif_parse_GuildAlliance(int fd,int guild_id1,int guild_id2,int account_id1
 	mapif_guild_alliance(guild_id1,guild_id2,account_id1,account_id2,flag,g[0]->name,g[1]->name);
 
 	// Mark the two guild to be saved
-	g[0]->save_flag |= GS_ALLIANCE;
-	g[1]->save_flag |= GS_ALLIANCE;
+	inter_guild_dirty(g[0], GS_ALLIANCE);
+	inter_guild_dirty(g[1], GS_ALLIANCE);
 	return 0;
 }
 
@@ -1723,7 +1963,7 @@ int mapif_parse_GuildNotice(int fd,int guild_id,const char *mes1,const char *mes
 
 	memcpy(g->mes1,mes1,MAX_GUILDMES1);
 	memcpy(g->mes2,mes2,MAX_GUILDMES2);
-	g->save_flag |= GS_MES;	//Change mes of guild
+	inter_guild_dirty(g, GS_MES);	//Change mes of guild
 	return mapif_guild_notice(g);
 }
 
@@ -1741,7 +1981,7 @@ int mapif_parse_GuildEmblem(int fd,int len,int guild_id,int dummy,const char *da
 	memcpy(g->emblem_data,data,len);
 	g->emblem_len=len;
 	g->emblem_id++;
-	g->save_flag |= GS_EMBLEM;	//Change guild
+	inter_guild_dirty(g, GS_EMBLEM);	//Change guild
 	return mapif_guild_emblem(g);
 }
 
@@ -1822,7 +2062,7 @@ int mapif_parse_GuildMasterChange(int fd, int guild_id, const char* name, int le
 		g->master[len] = '\0';
 
 	ShowInfo("int_guild: Guildmaster Changed to %s (Guild %d - %s)\n",g->master, guild_id, g->name);
-	g->save_flag |= (GS_BASIC|GS_MEMBER); //Save main data and member data.
+	inter_guild_dirty(g, GS_BASIC|GS_MEMBER); //Save main data and member data.
 	return mapif_guild_master_changed(g, g->member[0].account_id, g->member[0].char_id);
 }
 
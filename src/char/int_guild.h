@@ -33,5 +33,6 @@ int inter_guild_sex_changed(int guild_id,int account_id,int char_id, short gende
 int inter_guild_charname_changed(int guild_id,int account_id, int char_id, char *name);
 int inter_guild_CharOnline(int char_id, int guild_id);
 int inter_guild_CharOffline(int char_id, int guild_id);
+void inter_guild_queue_report(void);
 
 #endif /* _INT_GUILD_SQL_H_ */
@@ -44,12 +44,12 @@ bool mercenary_owner_fromsql(int char_id, struct mmo_charstatus *status)
 	return true;
 }
 
-bool mercenary_owner_tosql(int char_id, struct mmo_charstatus *status)
+bool mercenary_owner_tosql(Sql* handle, int char_id, struct mmo_charstatus *status)
 {
-	if( SQL_ERROR == SQL->Query(sql_handle, "REPLACE INTO `%s` (`char_id`, `merc_id`, `arch_calls`, `arch_faith`, `spear_calls`, `spear_faith`, `sword_calls`, `sword_faith`) VALUES ('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%d')",
+	if( SQL_ERROR == SQL->Query(handle, "REPLACE INTO `%s` (`char_id`, `merc_id`, `arch_calls`, `arch_faith`, `spear_calls`, `spear_faith`, `sword_calls`, `sword_faith`) VALUES ('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%d')",
 		mercenary_owner_db, char_id, status->mer_id, status->arch_calls, status->arch_faith, status->spear_calls, status->spear_faith, status->sword_calls, status->sword_faith) )
 	{
-		Sql_ShowDebug(sql_handle);
+		Sql_ShowDebug(handle);
 		return false;
 	}
 
@@ -4,6 +4,8 @@
 #ifndef _INT_MERCENARY_SQL_H_
 #define _INT_MERCENARY_SQL_H_
 
+#include "../common/sql.h" // Sql
+
 struct s_mercenary;
 
 int inter_mercenary_sql_init(void);
@@ -12,7 +14,7 @@ int inter_mercenary_parse_frommap(int fd);
 
 // Mercenary Owner Database
 bool mercenary_owner_fromsql(int char_id, struct mmo_charstatus *status);
-bool mercenary_owner_tosql(int char_id, struct mmo_charstatus *status);
+bool mercenary_owner_tosql(Sql* handle, int char_id, struct mmo_charstatus *status);
 bool mercenary_owner_delete(int char_id);
 
 bool mapif_mercenary_delete(int merc_id);
@@ -455,7 +455,7 @@ int mapif_party_message(int party_id,int account_id,char *mes,int len, int sfd)
 	WBUFL(buf,4)=party_id;
 	WBUFL(buf,8)=account_id;
 	memcpy(WBUFP(buf,12),mes,len);
-	mapif_sendallwos(sfd, buf,len+12);
+	mapif_send_party(party_id, sfd, buf, len+12);
 	return 0;
 }
 
@@ -507,6 +507,7 @@ int mapif_parse_CreateParty(int fd, char *name, int item, int item2, struct part
 		//Add party to db
 		int_party_calc_state(p);
 		idb_put(party_db_, p->party.party_id, p);
+		char_route_party(leader->char_id, p->party.party_id);
 		mapif_party_info(fd, &p->party, 0);
 		mapif_party_created(fd,leader->account_id,leader->char_id,&p->party);
 	} else { //Failed to create party.
@@ -560,6 +561,7 @@ int mapif_parse_PartyAddMember(int fd, int party_id, struct party_member *member
 		int_party_check_lv(p);
 	}
 
+	char_route_party(member->char_id, party_id);
 	mapif_party_info(-1, &p->party, 0);
 	mapif_party_memberadded(fd, party_id, member->account_id, member->char_id, 0);
 	inter_party_tosql(&p->party, PS_ADDMEMBER, i);
@@ -612,6 +614,7 @@ int mapif_parse_PartyLeave(int fd, int party_id, int account_id, int char_id)
 		return 0; //Member not found?
 
 	mapif_party_withdraw(party_id, account_id, char_id);
+	char_route_party(char_id, 0);
 
 	if (p->party.member[i].leader){
 		p->party.member[i].account_id = 0;
@@ -619,6 +622,7 @@ int mapif_parse_PartyLeave(int fd, int party_id, int account_id, int char_id)
 			if (!p->party.member[j].account_id)
 				continue;
 			mapif_party_withdraw(party_id, p->party.member[j].account_id, p->party.member[j].char_id);
+			char_route_party(p->party.member[j].char_id, 0);
 			p->party.member[j].account_id = 0;
 		}
 		//Party gets deleted on the check_empty call below.
@@ -655,6 +659,9 @@ int mapif_parse_PartyChangeMap(int fd, int party_id, int account_id, int char_id
 
 	if (i == MAX_PARTY) return 0;
 
+	if (online)
+		char_route_party(char_id, party_id);
+
 	if (p->party.member[i].online != online)
 	{
 		p->party.member[i].online = online;
@@ -700,11 +707,15 @@ int mapif_parse_PartyChangeMap(int fd, int party_id, int account_id, int char_id
 int mapif_parse_BreakParty(int fd,int party_id)
 {
 	struct party_data *p;
+	int i;
 
 	p = inter_party_fromsql(party_id);
 
 	if(!p)
 		return 0;
+	for( i = 0; i < MAX_PARTY; i++ )
+		if( p->party.member[i].account_id > 0 )
+			char_route_party(p->party.member[i].char_id, 0);
 	inter_party_tosql(&p->party,PS_BREAK,0);
 	mapif_party_broken(fd,party_id);
 	return 0;
@@ -3,6 +3,7 @@
 // Portions Copyright (c) Athena Dev Teams
 
 #include "../common/mmo.h"
+#include "../common/db.h"
 #include "../common/malloc.h"
 #include "../common/showmsg.h"
 #include "../common/socket.h"
@@ -18,10 +19,13 @@
 
 #define STORAGE_MEMINC	16
 
+/// Guild storages as last loaded or saved, so saves only write the slots that changed
+static DBMap* guild_storage_db_; // int guild_id -> struct guild_storage*
+
 /// Save storage data to sql
 int storage_tosql(int account_id, struct storage_data* p)
 {
-	memitemdata_to_sql(p->items, MAX_STORAGE, account_id, TABLE_STORAGE);
+	memitemdata_to_sql(sql_handle, p->items, MAX_STORAGE, account_id, TABLE_STORAGE);
 	return 0;
 }
 
@@ -73,10 +77,29 @@ int storage_fromsql(int account_id, struct storage_data* p)
 	return 1;
 }
 
+/// Remembers what the guild storage table holds for the guild
+void guild_storage_cache(int guild_id, const struct guild_storage* p)
+{
+	struct guild_storage *gs = (struct guild_storage*)idb_get(guild_storage_db_, guild_id);
+
+	if( gs == NULL ) {
+		CREATE(gs, struct guild_storage, 1);
+		idb_put(guild_storage_db_, guild_id, gs);
+	}
+	memcpy(gs, p, sizeof(struct guild_storage));
+}
+
 /// Save guild_storage data to sql
 int guild_storage_tosql(int guild_id, struct guild_storage* p)
 {
-	memitemdata_to_sql(p->items, MAX_GUILD_STORAGE, guild_id, TABLE_GUILD_STORAGE);
+	struct guild_storage *gs = (struct guild_storage*)idb_get(guild_storage_db_, guild_id);
+
+	if( memitemdata_slots_to_sql(sql_handle, gs ? gs->items : NULL, p->items, MAX_GUILD_STORAGE, guild_id, TABLE_GUILD_STORAGE) ) {
+		// the table may hold anything now, next save compares with it
+		idb_remove(guild_storage_db_, guild_id);
+		return 1;
+	}
+	guild_storage_cache(guild_id, p);
 	ShowInfo ("guild storage save to DB - guild: %d\n", guild_id);
 	return 0;
 }
@@ -125,6 +148,7 @@ int guild_storage_fromsql(int guild_id, struct guild_storage* p)
 	}
 	p->storage_amount = i;
 	SQL->FreeResult(sql_handle);
+	guild_storage_cache(guild_id, p);
 
 	ShowInfo("guild storage load complete from DB - id: %d (total: %d)\n", guild_id, p->storage_amount);
 	return 0;
@@ -134,11 +158,13 @@ int guild_storage_fromsql(int guild_id, struct guild_storage* p)
 // storage data initialize
 int inter_storage_sql_init(void)
 {
+	guild_storage_db_ = idb_alloc(DB_OPT_RELEASE_DATA);
 	return 1;
 }
 // storage data finalize
 void inter_storage_sql_final(void)
 {
+	guild_storage_db_->destroy(guild_storage_db_, NULL);
 	return;
 }
 
@@ -151,6 +177,7 @@ int inter_storage_delete(int account_id)
 }
 int inter_guild_storage_delete(int guild_id)
 {
+	idb_remove(guild_storage_db_, guild_id);
 	if( SQL_ERROR == SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id`='%d'", guild_storage_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
 	return 0;
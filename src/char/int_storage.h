@@ -18,5 +18,6 @@ int inter_storage_parse_frommap(int fd);
 int storage_fromsql(int account_id, struct storage_data* p);
 int storage_tosql(int account_id,struct storage_data *p);
 int guild_storage_tosql(int guild_id, struct guild_storage *p);
+void guild_storage_cache(int guild_id, const struct guild_storage* p);
 
 #endif /* _INT_STORAGE_SQL_H_ */
@@ -800,6 +800,26 @@ int inter_log(char* fmt, ...) {
 	return ret;
 }
 
+/// Opens a new connection to the character database.
+/// Returns NULL if it can't connect.
+Sql* inter_sql_connect(void)
+{
+	Sql* handle = SQL->Malloc();
+
+	if( SQL_ERROR == SQL->Connect(handle, char_server_id, char_server_pw, char_server_ip, (uint16)char_server_port, char_server_db) )
+	{
+		Sql_ShowDebug(handle);
+		SQL->Free(handle);
+		return NULL;
+	}
+
+	if( *default_codepage ) {
+		if( SQL_ERROR == SQL->SetEncoding(handle, default_codepage) )
+			Sql_ShowDebug(handle);
+	}
+	return handle;
+}
+
 // initialize
 int inter_init_sql(const char *file)
 {
@@ -808,19 +828,9 @@ int inter_init_sql(const char *file)
 	inter_config_read(file);
 
 	//DB connection initialized
-	sql_handle = SQL->Malloc();
 	ShowInfo("Connect Character DB server.... (Character Server)\n");
-	if( SQL_ERROR == SQL->Connect(sql_handle, char_server_id, char_server_pw, char_server_ip, (uint16)char_server_port, char_server_db) )
-	{
-		Sql_ShowDebug(sql_handle);
-		SQL->Free(sql_handle);
+	if( (sql_handle = inter_sql_connect()) == NULL )
 		exit(EXIT_FAILURE);
-	}
-
-	if( *default_codepage ) {
-		if( SQL_ERROR == SQL->SetEncoding(sql_handle, default_codepage) )
-			Sql_ShowDebug(sql_handle);
-	}
 
 	wis_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	inter_guild_sql_init();
@@ -900,7 +910,7 @@ int mapif_wis_message(struct WisData *wd)
 	memcpy(WBUFP(buf, 8), wd->src, NAME_LENGTH);
 	memcpy(WBUFP(buf,32), wd->dst, NAME_LENGTH);
 	memcpy(WBUFP(buf,56), wd->msg, wd->len);
-	wd->count = mapif_sendall(buf,WBUFW(buf,2));
+	wd->count = mapif_send_name((const char*)wd->dst, buf, WBUFW(buf,2));
 
 	return 0;
 }
@@ -26,6 +26,8 @@ extern unsigned int party_share_level;
 extern Sql* sql_handle;
 extern Sql* lsql_handle;
 
+Sql* inter_sql_connect(void);
+
 int inter_accreg_tosql(int account_id, int char_id, struct accreg *reg, int type);
 
 uint64 inter_chk_lastuid(int8 flag, uint64 value);
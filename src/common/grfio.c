@@ -15,6 +15,11 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <zlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 //----------------------------
 //	file entry table struct
@@ -55,6 +60,16 @@ char** gentry_table		= NULL;
 int gentry_entrys		= 0;
 int gentry_maxentry		= 0;
 
+// grf files mapped into memory, same index as gentry_table (data == NULL: read with stdio)
+struct grf_mapping {
+	unsigned char* data;
+	size_t size;
+};
+struct grf_mapping* gentry_maps = NULL;
+
+// scratch buffer of grfio_reads (main thread)
+struct grfio_buffer grfio_reads_buf = { NULL, 0, NULL, 0 };
+
 // the path to the data directory
 char data_dir[1024] = "";
 
@@ -390,6 +405,146 @@ static void grfio_localpath_create(char* buffer, size_t size, const char* filena
 }
 
 
+/// Grows a grfio_buffer area to at least 'size' bytes.
+/// Uses the system allocator, the memory manager is not thread-safe.
+static unsigned char* grfio_buffer_reserve(unsigned char** area, size_t* area_size, size_t size)
+{
+	if( *area_size < size ) {
+		unsigned char* p = (unsigned char*)realloc(*area, size);
+		if( p == NULL )
+			return NULL;
+		*area = p;
+		*area_size = size;
+	}
+	return *area;
+}
+
+
+/// Releases the areas of a grfio_buffer.
+void grfio_buffer_free(struct grfio_buffer* buf)
+{
+	free(buf->data);
+	free(buf->work);
+	memset(buf, 0, sizeof(*buf));
+}
+
+
+/// Whether a grf entry holds its file as is: same size as the file and no zlib header.
+static bool grfio_entrystored(const FILELIST* entry, const unsigned char* src)
+{
+	if( entry->srclen != entry->declen || (entry->type & (FILELIST_TYPE_ENCRYPT_MIXED|FILELIST_TYPE_ENCRYPT_HEADER)) )
+		return false;
+	return !( entry->srclen >= 2 && (src[0]&0x0f) == Z_DEFLATED && ((src[0]<<8)|src[1]) % 31 == 0 );
+}
+
+
+/// Locates the data of a grf entry and decrypts it.
+/// Mapped plaintext entries are used in place, anything else is read or copied into buf->work.
+static const unsigned char* grfio_entrysource(const FILELIST* entry, struct grfio_buffer* buf)
+{
+	int gentry = ( entry->gentry < 0 ) ? -entry->gentry : entry->gentry;
+	struct grf_mapping* gm = &gentry_maps[gentry - 1];
+	unsigned char* work;
+
+	if( gm->data != NULL && ((size_t)entry->srcpos > gm->size || (size_t)entry->srclen_aligned > gm->size - entry->srcpos) ) {
+		ShowError("grfio: %s is outside of %s\n", entry->fn, gentry_table[gentry - 1]);
+		return NULL;
+	}
+	if( gm->data != NULL && !(entry->type & (FILELIST_TYPE_ENCRYPT_MIXED|FILELIST_TYPE_ENCRYPT_HEADER)) )
+		return gm->data + entry->srcpos;
+
+	if( (work = grfio_buffer_reserve(&buf->work, &buf->work_size, entry->srclen_aligned)) == NULL )
+		return NULL;
+	if( gm->data != NULL )
+		memcpy(work, gm->data + entry->srcpos, entry->srclen_aligned);
+	else {
+		FILE* in = fopen(gentry_table[gentry - 1], "rb");
+		if( in == NULL ) {
+			ShowError("grfio_reads: %s not found (GRF file: %s)\n", entry->fn, gentry_table[gentry - 1]);
+			return NULL;
+		}
+		fseek(in, entry->srcpos, 0);
+		if(fread(work, 1, entry->srclen_aligned, in) != (size_t)entry->srclen_aligned) ShowError("An error occured in fread in grfio_reads, grfname=%s\n",gentry_table[gentry - 1]);
+		fclose(in);
+	}
+	grf_decode(work, entry->srclen_aligned, entry->type, entry->srclen);
+	return work;
+}
+
+
+/// Inflates a grf entry into dest (entry->declen bytes).
+static bool grfio_entryinflate(const FILELIST* entry, const unsigned char* src, unsigned char* dest)
+{
+	uLongf len = entry->declen;
+
+	decode_zip(dest, &len, src, entry->srclen);
+	if (len != (uLong)entry->declen) {
+		ShowError("decode_zip size mismatch err: %d != %d\n", (int)len, entry->declen);
+		return false;
+	}
+	return true;
+}
+
+
+/// Reads a local file into buf->data.
+static const unsigned char* grfio_localread(const char* lfname, int* size, struct grfio_buffer* buf)
+{
+	FILE* in = fopen(lfname, "rb");
+	unsigned char* data;
+	int declen;
+
+	if( in == NULL )
+		return NULL;
+	fseek(in,0,SEEK_END);
+	declen = ftell(in);
+	fseek(in,0,SEEK_SET);
+	if( (data = grfio_buffer_reserve(&buf->data, &buf->data_size, declen+1)) != NULL ) {
+		if(fread(data, 1, declen, in) != (size_t)declen) ShowError("An error occured in fread grfio_reads, fname=%s \n",lfname);
+		data[declen] = '\0';
+		if( size )
+			*size = declen;
+	}
+	fclose(in);
+	return data;
+}
+
+
+/// Reads a file (from grf or data directory) without allocating it.
+/// The result stays valid until the next call with the same buffer. Files that
+/// grfs keep as is are returned from the mapped grf; the others are decoded into
+/// buf, which can be reused for any number of files and is freed with
+/// grfio_buffer_free. Only reads the shared index, so any number of threads
+/// can extract files at once, each with its own buffer.
+const unsigned char* grfio_view(const char* fname, int* size, struct grfio_buffer* buf)
+{
+	FILELIST* entry = filelist_find(fname);
+	const unsigned char* src;
+	unsigned char* data;
+
+	if( entry == NULL || entry->gentry <= 0 ) {// LocalFileCheck
+		char lfname[256];
+		grfio_localpath_create(lfname, sizeof(lfname), ( entry && entry->fnd ) ? entry->fnd : fname);
+		if( (src = grfio_localread(lfname, size, buf)) != NULL )
+			return src;
+		if( entry == NULL || entry->gentry == 0 ) {
+			ShowError("grfio_view: %s not found (local file: %s)\n", fname, lfname);
+			return NULL;
+		}
+	}
+
+	if( (src = grfio_entrysource(entry, buf)) == NULL )
+		return NULL;
+	if( size )
+		*size = entry->declen;
+	if( grfio_entrystored(entry, src) )
+		return src;
+	if( (data = grfio_buffer_reserve(&buf->data, &buf->data_size, entry->declen+1)) == NULL || !grfio_entryinflate(entry, src, data) )
+		return NULL;
+	data[entry->declen] = '\0';
+	return data;
+}
+
+
 /// Reads a file into a newly allocated buffer (from grf or data directory).
 void* grfio_reads(const char* fname, int* size)
 {
@@ -424,40 +579,20 @@ void* grfio_reads(const char* fname, int* size)
 	}
 
 	if( entry != NULL && entry->gentry > 0 ) {// Archive[GRF] File Read
-		char* grfname = gentry_table[entry->gentry - 1];
-		FILE* in = fopen(grfname, "rb");
-		if( in != NULL ) {
-			int fsize = entry->srclen_aligned;
-			unsigned char *buf = (unsigned char *)aMalloc(fsize);
-			fseek(in, entry->srcpos, 0);
-			if(fread(buf, 1, fsize, in) != (size_t)fsize) ShowError("An error occured in fread in grfio_reads, grfname=%s\n",grfname);
-			fclose(in);
-
-			buf2 = (unsigned char *)aMalloc(entry->declen+1);  // +1 for resnametable zero-termination
-			if( entry->type & FILELIST_TYPE_FILE )
-			{// file
-				uLongf len;
-				grf_decode(buf, fsize, entry->type, entry->srclen);
-				len = entry->declen;
-				decode_zip(buf2, &len, buf, entry->srclen);
-				if (len != (uLong)entry->declen) {
-					ShowError("decode_zip size mismatch err: %d != %d\n", (int)len, entry->declen);
-					aFree(buf);
-					aFree(buf2);
-					return NULL;
-				}
-			} else {// directory?
-				memcpy(buf2, buf, entry->declen);
-			}
-
-			if( size )
-				*size = entry->declen;
+		const unsigned char* src = grfio_entrysource(entry, &grfio_reads_buf);
+		if( src == NULL )
+			return NULL;
 
-			aFree(buf);
-		} else {
-			ShowError("grfio_reads: %s not found (GRF file: %s)\n", fname, grfname);
+		buf2 = (unsigned char *)aMalloc(entry->declen+1);  // +1 for resnametable zero-termination
+		if( grfio_entrystored(entry, src) )
+			memcpy(buf2, src, entry->declen);
+		else if( !grfio_entryinflate(entry, src, buf2) ) {
+			aFree(buf2);
 			return NULL;
 		}
+
+		if( size )
+			*size = entry->declen;
 	}
 
 	return buf2;
@@ -741,10 +876,28 @@ static int grfio_add(const char* fname)
 		gentry_maxentry += GENTRY_ADDS;
 		gentry_table = (char**)aRealloc(gentry_table, gentry_maxentry * sizeof(char*));
 		memset(gentry_table + (gentry_maxentry - GENTRY_ADDS), 0, sizeof(char*) * GENTRY_ADDS);
+		gentry_maps = (struct grf_mapping*)aRealloc(gentry_maps, gentry_maxentry * sizeof(struct grf_mapping));
+		memset(gentry_maps + (gentry_maxentry - GENTRY_ADDS), 0, sizeof(struct grf_mapping) * GENTRY_ADDS);
 	}
 
 	gentry_table[gentry_entrys++] = aStrdup(fname);
 
+#ifndef _WIN32
+	{// map the grf, its files are then read without any system call
+		struct stat st;
+		int fd = open(fname, O_RDONLY);
+		if( fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0 ) {
+			void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if( data != MAP_FAILED ) {
+				gentry_maps[gentry_entrys - 1].data = (unsigned char*)data;
+				gentry_maps[gentry_entrys - 1].size = (size_t)st.st_size;
+			}
+		}
+		if( fd >= 0 )
+			close(fd);
+	}
+#endif
+
 	return grfio_entryread(fname, gentry_entrys - 1);
 }
 
@@ -772,7 +925,19 @@ void grfio_final(void)
 		aFree(gentry_table);
 		gentry_table = NULL;
 	}
+	if (gentry_maps != NULL) {
+#ifndef _WIN32
+		int i;
+		for (i = 0; i < gentry_entrys; i++)
+			if (gentry_maps[i].data != NULL)
+				munmap(gentry_maps[i].data, gentry_maps[i].size);
+#endif
+		aFree(gentry_maps);
+		gentry_maps = NULL;
+	}
 	gentry_entrys = gentry_maxentry = 0;
+
+	grfio_buffer_free(&grfio_reads_buf);
 }
 
 
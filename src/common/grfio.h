@@ -4,9 +4,19 @@
 #ifndef	_GRFIO_H_
 #define	_GRFIO_H_
 
+// Reusable buffers of grfio_view, one per thread
+struct grfio_buffer {
+	unsigned char* data; // decoded file
+	size_t data_size;
+	unsigned char* work; // encrypted or not mapped grf data
+	size_t work_size;
+};
+
 void grfio_init(const char* fname);
 void grfio_final(void);
 void* grfio_reads(const char* fname, int* size);
+const unsigned char* grfio_view(const char* fname, int* size, struct grfio_buffer* buf);
+void grfio_buffer_free(struct grfio_buffer* buf);
 char* grfio_find_file(const char* fname);
 #define grfio_read(fn) grfio_reads(fn, NULL)
 
@@ -203,6 +203,7 @@ static struct block* block_malloc(unsigned short hash);
 static void          block_free(struct block* p);
 static size_t        memmgr_usage_bytes;
 static size_t        memmgr_usage_bytes_t;
+static struct malloc_counters memmgr_counters;
 
 
 #define block2unit(p, n) ((struct unit_head*)(&(p)->data[ p->unit_size * (n) ]))
@@ -244,6 +245,8 @@ void* _mmalloc(size_t size, const char *file, int line, const char *func )
 		return NULL;
 	}
 	memmgr_usage_bytes += size;
+	memmgr_counters.allocs++;
+	memmgr_counters.bytes += size;
 
 	/* To ensure the area that exceeds the length of the block, using malloc () to */
 	/* At that time, the distinction by assigning NULL to unit_head.block */
@@ -407,6 +410,7 @@ void _mfree(void *ptr, const char *file, int line, const char *func )
 			}
 			memmgr_usage_bytes -= head_large->size;
 			memmgr_usage_bytes_t -= head_large->size + sizeof(struct unit_head_large);
+			memmgr_counters.frees++;
 #ifdef DEBUG_MEMMGR
 			// set freed memory to 0xfd
 			memset(ptr, 0xfd, head_large->size);
@@ -424,6 +428,7 @@ void _mfree(void *ptr, const char *file, int line, const char *func )
 			ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", ptr, file, line);
 		} else {
 			memmgr_usage_bytes -= head->size;
+			memmgr_counters.frees++;
 			head->block         = NULL;
 #ifdef DEBUG_MEMMGR
 			memset(ptr, 0xfd, block->unit_size - sizeof(struct unit_head) + sizeof(long) );
@@ -773,6 +778,14 @@ bool malloc_verify_ptr(void* ptr) {
 }
 
 
+void malloc_counters (struct malloc_counters *out) {
+#ifdef USE_MEMMGR
+	*out = memmgr_counters;
+#else
+	memset(out, 0, sizeof(*out));
+#endif
+}
+
 size_t malloc_usage (void) {
 #ifdef USE_MEMMGR
 	return memmgr_usage ();
@@ -813,6 +826,7 @@ void malloc_defaults(void) {
 	iMalloc->final = malloc_final;
 	iMalloc->memory_check = malloc_memory_check;
 	iMalloc->usage = malloc_usage;
+	iMalloc->counters = malloc_counters;
 	iMalloc->verify_ptr = malloc_verify_ptr;
 
 // Athena's built-in Memory Manager
@@ -66,6 +66,13 @@
 
 void malloc_defaults(void);
 
+// Activity of the built-in memory manager since start (all zero without it)
+struct malloc_counters {
+	uint64 allocs; // blocks handed out (aMalloc, aCalloc, aStrdup and growing aRealloc)
+	uint64 frees;  // blocks released
+	uint64 bytes;  // bytes handed out
+};
+
 struct malloc_interface {
 	void	(*init) (void);
 	void	(*final) (void);
@@ -79,6 +86,7 @@ struct malloc_interface {
 	void	(*memory_check)(void);
 	bool	(*verify_ptr)(void* ptr);
 	size_t	(*usage) (void);
+	void	(*counters) (struct malloc_counters *out);
 	/* */
 	void (*post_shutdown) (void);
 };
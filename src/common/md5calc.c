@@ -16,9 +16,6 @@
 #define UINT_MAX 4294967295U
 #endif
 
-// Global variable
-static unsigned int *pX;
-
 // String Table
 static const unsigned int T[] = {
    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, //0
@@ -60,31 +57,31 @@ static unsigned int I(unsigned int X, unsigned int Y, unsigned int Z)
    return Y ^ (X | ~Z);
 }
 
-static unsigned int Round(unsigned int a, unsigned int b, unsigned int FGHI,
+static unsigned int Round(const unsigned int *X, unsigned int a, unsigned int b, unsigned int FGHI,
                      unsigned int k, unsigned int s, unsigned int i)
 {
-   return b + ROTATE_LEFT(a + FGHI + pX[k] + T[i], s);
+   return b + ROTATE_LEFT(a + FGHI + X[k] + T[i], s);
 }
 
-static void Round1(unsigned int *a, unsigned int b, unsigned int c,
+static void Round1(const unsigned int *X, unsigned int *a, unsigned int b, unsigned int c,
 		unsigned int d,unsigned int k, unsigned int s, unsigned int i)
 {
-	*a = Round(*a, b, F(b,c,d), k, s, i);
+	*a = Round(X, *a, b, F(b,c,d), k, s, i);
 }
-static void Round2(unsigned int *a, unsigned int b, unsigned int c,
+static void Round2(const unsigned int *X, unsigned int *a, unsigned int b, unsigned int c,
 		unsigned int d,unsigned int k, unsigned int s, unsigned int i)
 {
-	*a = Round(*a, b, G(b,c,d), k, s, i);
+	*a = Round(X, *a, b, G(b,c,d), k, s, i);
 }
-static void Round3(unsigned int *a, unsigned int b, unsigned int c,
+static void Round3(const unsigned int *X, unsigned int *a, unsigned int b, unsigned int c,
 		unsigned int d,unsigned int k, unsigned int s, unsigned int i)
 {
-	*a = Round(*a, b, H(b,c,d), k, s, i);
+	*a = Round(X, *a, b, H(b,c,d), k, s, i);
 }
-static void Round4(unsigned int *a, unsigned int b, unsigned int c,
+static void Round4(const unsigned int *X, unsigned int *a, unsigned int b, unsigned int c,
 		unsigned int d,unsigned int k, unsigned int s, unsigned int i)
 {
-	*a = Round(*a, b, I(b,c,d), k, s, i);
+	*a = Round(X, *a, b, I(b,c,d), k, s, i);
 }
 
 static void MD5_Round_Calculate(const unsigned char *block,
@@ -98,9 +95,6 @@ static void MD5_Round_Calculate(const unsigned char *block,
 	unsigned int A=*A2, B=*B2, C=*C2, D=*D2;
 	unsigned int AA = A,BB = B,CC = C,DD = D;
 
-	//It is a large region variable reluctantly because of calculation of a round. . . for Round1...4
-	pX = X;
-
 	//Copy block(padding_message) i into X
 	for (j=0,k=0; j<64; j+=4,k++)
 		X[k] = ( (unsigned int )block[j] )         // 8byte*4 -> 32byte conversion
@@ -110,28 +104,28 @@ static void MD5_Round_Calculate(const unsigned char *block,
 
 
    //Round 1
-   Round1(&A,B,C,D,  0, 7,  0); Round1(&D,A,B,C,  1, 12,  1); Round1(&C,D,A,B,  2, 17,  2); Round1(&B,C,D,A,  3, 22,  3);
-   Round1(&A,B,C,D,  4, 7,  4); Round1(&D,A,B,C,  5, 12,  5); Round1(&C,D,A,B,  6, 17,  6); Round1(&B,C,D,A,  7, 22,  7);
-   Round1(&A,B,C,D,  8, 7,  8); Round1(&D,A,B,C,  9, 12,  9); Round1(&C,D,A,B, 10, 17, 10); Round1(&B,C,D,A, 11, 22, 11);
-   Round1(&A,B,C,D, 12, 7, 12); Round1(&D,A,B,C, 13, 12, 13); Round1(&C,D,A,B, 14, 17, 14); Round1(&B,C,D,A, 15, 22, 15);
+   Round1(X,&A,B,C,D,  0, 7,  0); Round1(X,&D,A,B,C,  1, 12,  1); Round1(X,&C,D,A,B,  2, 17,  2); Round1(X,&B,C,D,A,  3, 22,  3);
+   Round1(X,&A,B,C,D,  4, 7,  4); Round1(X,&D,A,B,C,  5, 12,  5); Round1(X,&C,D,A,B,  6, 17,  6); Round1(X,&B,C,D,A,  7, 22,  7);
+   Round1(X,&A,B,C,D,  8, 7,  8); Round1(X,&D,A,B,C,  9, 12,  9); Round1(X,&C,D,A,B, 10, 17, 10); Round1(X,&B,C,D,A, 11, 22, 11);
+   Round1(X,&A,B,C,D, 12, 7, 12); Round1(X,&D,A,B,C, 13, 12, 13); Round1(X,&C,D,A,B, 14, 17, 14); Round1(X,&B,C,D,A, 15, 22, 15);
 
    //Round 2
-   Round2(&A,B,C,D,  1, 5, 16); Round2(&D,A,B,C,  6, 9, 17); Round2(&C,D,A,B, 11, 14, 18); Round2(&B,C,D,A,  0, 20, 19);
-   Round2(&A,B,C,D,  5, 5, 20); Round2(&D,A,B,C, 10, 9, 21); Round2(&C,D,A,B, 15, 14, 22); Round2(&B,C,D,A,  4, 20, 23);
-   Round2(&A,B,C,D,  9, 5, 24); Round2(&D,A,B,C, 14, 9, 25); Round2(&C,D,A,B,  3, 14, 26); Round2(&B,C,D,A,  8, 20, 27);
-   Round2(&A,B,C,D, 13, 5, 28); Round2(&D,A,B,C,  2, 9, 29); Round2(&C,D,A,B,  7, 14, 30); Round2(&B,C,D,A, 12, 20, 31);
+   Round2(X,&A,B,C,D,  1, 5, 16); Round2(X,&D,A,B,C,  6, 9, 17); Round2(X,&C,D,A,B, 11, 14, 18); Round2(X,&B,C,D,A,  0, 20, 19);
+   Round2(X,&A,B,C,D,  5, 5, 20); Round2(X,&D,A,B,C, 10, 9, 21); Round2(X,&C,D,A,B, 15, 14, 22); Round2(X,&B,C,D,A,  4, 20, 23);
+   Round2(X,&A,B,C,D,  9, 5, 24); Round2(X,&D,A,B,C, 14, 9, 25); Round2(X,&C,D,A,B,  3, 14, 26); Round2(X,&B,C,D,A,  8, 20, 27);
+   Round2(X,&A,B,C,D, 13, 5, 28); Round2(X,&D,A,B,C,  2, 9, 29); Round2(X,&C,D,A,B,  7, 14, 30); Round2(X,&B,C,D,A, 12, 20, 31);
 
    //Round 3
-   Round3(&A,B,C,D,  5, 4, 32); Round3(&D,A,B,C,  8, 11, 33); Round3(&C,D,A,B, 11, 16, 34); Round3(&B,C,D,A, 14, 23, 35);
-   Round3(&A,B,C,D,  1, 4, 36); Round3(&D,A,B,C,  4, 11, 37); Round3(&C,D,A,B,  7, 16, 38); Round3(&B,C,D,A, 10, 23, 39);
-   Round3(&A,B,C,D, 13, 4, 40); Round3(&D,A,B,C,  0, 11, 41); Round3(&C,D,A,B,  3, 16, 42); Round3(&B,C,D,A,  6, 23, 43);
-   Round3(&A,B,C,D,  9, 4, 44); Round3(&D,A,B,C, 12, 11, 45); Round3(&C,D,A,B, 15, 16, 46); Round3(&B,C,D,A,  2, 23, 47);
+   Round3(X,&A,B,C,D,  5, 4, 32); Round3(X,&D,A,B,C,  8, 11, 33); Round3(X,&C,D,A,B, 11, 16, 34); Round3(X,&B,C,D,A, 14, 23, 35);
+   Round3(X,&A,B,C,D,  1, 4, 36); Round3(X,&D,A,B,C,  4, 11, 37); Round3(X,&C,D,A,B,  7, 16, 38); Round3(X,&B,C,D,A, 10, 23, 39);
+   Round3(X,&A,B,C,D, 13, 4, 40); Round3(X,&D,A,B,C,  0, 11, 41); Round3(X,&C,D,A,B,  3, 16, 42); Round3(X,&B,C,D,A,  6, 23, 43);
+   Round3(X,&A,B,C,D,  9, 4, 44); Round3(X,&D,A,B,C, 12, 11, 45); Round3(X,&C,D,A,B, 15, 16, 46); Round3(X,&B,C,D,A,  2, 23, 47);
 
    //Round 4
-   Round4(&A,B,C,D,  0, 6, 48); Round4(&D,A,B,C,  7, 10, 49); Round4(&C,D,A,B, 14, 15, 50); Round4(&B,C,D,A,  5, 21, 51);
-   Round4(&A,B,C,D, 12, 6, 52); Round4(&D,A,B,C,  3, 10, 53); Round4(&C,D,A,B, 10, 15, 54); Round4(&B,C,D,A,  1, 21, 55);
-   Round4(&A,B,C,D,  8, 6, 56); Round4(&D,A,B,C, 15, 10, 57); Round4(&C,D,A,B,  6, 15, 58); Round4(&B,C,D,A, 13, 21, 59);
-   Round4(&A,B,C,D,  4, 6, 60); Round4(&D,A,B,C, 11, 10, 61); Round4(&C,D,A,B,  2, 15, 62); Round4(&B,C,D,A,  9, 21, 63);
+   Round4(X,&A,B,C,D,  0, 6, 48); Round4(X,&D,A,B,C,  7, 10, 49); Round4(X,&C,D,A,B, 14, 15, 50); Round4(X,&B,C,D,A,  5, 21, 51);
+   Round4(X,&A,B,C,D, 12, 6, 52); Round4(X,&D,A,B,C,  3, 10, 53); Round4(X,&C,D,A,B, 10, 15, 54); Round4(X,&B,C,D,A,  1, 21, 55);
+   Round4(X,&A,B,C,D,  8, 6, 56); Round4(X,&D,A,B,C, 15, 10, 57); Round4(X,&C,D,A,B,  6, 15, 58); Round4(X,&B,C,D,A, 13, 21, 59);
+   Round4(X,&A,B,C,D,  4, 6, 60); Round4(X,&D,A,B,C, 11, 10, 61); Round4(X,&C,D,A,B,  2, 15, 62); Round4(X,&B,C,D,A,  9, 21, 63);
 
    // Then perform the following additions. (let's add)
    *A2 = A + AA;
@@ -140,7 +134,7 @@ static void MD5_Round_Calculate(const unsigned char *block,
    *D2 = D + DD;
 
    //The clearance of confidential information
-   memset(pX, 0, sizeof(X));
+   memset(X, 0, sizeof(X));
 }
 
 static void MD5_String2binary(const char * string, unsigned char * output)
@@ -147,6 +147,9 @@
 #define MAX_FRIENDS 40
 #define MAX_MEMOPOINTS 3
 
+// Version of the delta character save between map-server and char-server (packet 0x2b28)
+#define CHARSAVE_DELTA_VERSION 1
+
 // Size of the fame list arrays.
 #define MAX_FAME_LIST 10
 
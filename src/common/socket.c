@@ -9,6 +9,7 @@
 #include "../common/showmsg.h"
 #include "../common/strlib.h"
 #include "../config/core.h"
+#include "../common/grfio.h"
 #include "../common/HPM.h"
 #include "socket.h"
 
@@ -22,6 +23,7 @@
 #else
 	#include <errno.h>
 	#include <sys/socket.h>
+	#include <sys/un.h>
 	#include <netinet/in.h>
 	#include <netinet/tcp.h>
 	#include <net/if.h>
@@ -581,6 +583,177 @@ int make_connection(uint32 ip, uint16 port, struct hSockOpt *opt) {
 	return fd;
 }
 
+/*======================================
+ *	CORE : Local (unix domain) links
+ *--------------------------------------
+ * Co-located servers can link through a unix domain socket instead of
+ * tcp loopback. Sessions are created the same way, so the fifos and the
+ * packet framing are unchanged; the peer address is reported as 127.0.0.1.
+ */
+#ifndef WIN32
+/// Unix domain sockets listened on, their files are removed when they close
+struct unix_listener {
+	int fd;
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+};
+static struct unix_listener* unix_listeners = NULL;
+static int unix_listener_count = 0;
+
+/// Removes the socket file of fd, if it is a unix domain socket listened on.
+static void unix_listener_close(int fd)
+{
+	int i;
+
+	ARR_FIND(0, unix_listener_count, i, unix_listeners[i].fd == fd);
+	if( i == unix_listener_count )
+		return;
+	unlink(unix_listeners[i].path);
+	unix_listeners[i] = unix_listeners[--unix_listener_count];
+	if( unix_listener_count == 0 ) {
+		aFree(unix_listeners);
+		unix_listeners = NULL;
+	}
+}
+
+static bool unix_address(struct sockaddr_un* addr, const char* path)
+{
+	if( strlen(path) >= sizeof(addr->sun_path) ) {
+		ShowError("unix_address: path '%s' is too long (max %d characters)!\n", path, (int)sizeof(addr->sun_path) - 1);
+		return false;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	safestrncpy(addr->sun_path, path, sizeof(addr->sun_path));
+	return true;
+}
+
+int connect_client_unix(int listen_fd) {
+	int fd;
+
+	fd = sAccept(listen_fd, NULL, NULL);
+	if ( fd == -1 ) {
+		ShowError("connect_client_unix: accept failed (%s)!\n", error_msg());
+		return -1;
+	}
+	if( fd == 0 || fd >= FD_SETSIZE ) {
+		ShowError("connect_client_unix: Invalid socket #%d (FD_SETSIZE %d)!\n", fd, FD_SETSIZE);
+		sClose(fd);
+		return -1;
+	}
+
+	set_nonblocking(fd, 1);
+
+	if( fd_max <= fd ) fd_max = fd + 1;
+	sFD_SET(fd,&readfds);
+
+	create_session(fd, recv_to_fifo, send_from_fifo, default_func_parse);
+	session[fd]->client_addr = INADDR_LOOPBACK; // local peer, not subject to ip rules
+
+	return fd;
+}
+#endif
+
+/// Listens on a unix domain socket at path (replacing a stale socket file).
+/// The socket file is removed again when the listener is closed (do_close, socket_final).
+/// @return listening fd, or -1
+int make_listen_bind_unix(const char* path)
+{
+#ifdef WIN32
+	ShowError("make_listen_bind_unix: unix domain sockets are not supported on this platform (%s).\n", path);
+	return -1;
+#else
+	struct sockaddr_un addr;
+	int fd;
+
+	if( !unix_address(&addr, path) )
+		return -1;
+
+	fd = sSocket(AF_UNIX, SOCK_STREAM, 0);
+	if( fd == -1 ) {
+		ShowError("make_listen_bind_unix: socket creation failed (%s)!\n", error_msg());
+		return -1;
+	}
+	if( fd == 0 || fd >= FD_SETSIZE ) {
+		ShowError("make_listen_bind_unix: Invalid socket #%d (FD_SETSIZE %d)!\n", fd, FD_SETSIZE);
+		sClose(fd);
+		return -1;
+	}
+
+	set_nonblocking(fd, 1);
+	unlink(path); // left behind by a previous run
+	if( sBind(fd, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ) {
+		ShowError("make_listen_bind_unix: bind to '%s' failed (%s)!\n", path, error_msg());
+		sClose(fd);
+		return -1;
+	}
+	if( sListen(fd,5) == SOCKET_ERROR ) {
+		ShowError("make_listen_bind_unix: listen failed (socket #%d, %s)!\n", fd, error_msg());
+		sClose(fd);
+		return -1;
+	}
+
+	if(fd_max <= fd) fd_max = fd + 1;
+	sFD_SET(fd, &readfds);
+
+	create_session(fd, connect_client_unix, null_send, null_parse);
+	session[fd]->client_addr = 0; // just listens
+	session[fd]->rdata_tick = 0; // disable timeouts on this socket
+
+	RECREATE(unix_listeners, struct unix_listener, unix_listener_count + 1);
+	unix_listeners[unix_listener_count].fd = fd;
+	safestrncpy(unix_listeners[unix_listener_count].path, path, sizeof(unix_listeners[unix_listener_count].path));
+	unix_listener_count++;
+
+	return fd;
+#endif
+}
+
+/// Connects to a unix domain socket at path.
+/// @return connected fd, or -1
+int make_connection_unix(const char* path, struct hSockOpt *opt)
+{
+#ifdef WIN32
+	ShowError("make_connection_unix: unix domain sockets are not supported on this platform (%s).\n", path);
+	return -1;
+#else
+	struct sockaddr_un addr;
+	int fd;
+
+	if( !unix_address(&addr, path) )
+		return -1;
+
+	fd = sSocket(AF_UNIX, SOCK_STREAM, 0);
+	if( fd == -1 ) {
+		ShowError("make_connection_unix: socket creation failed (%s)!\n", error_msg());
+		return -1;
+	}
+	if( fd == 0 || fd >= FD_SETSIZE ) {
+		ShowError("make_connection_unix: Invalid socket #%d (FD_SETSIZE %d)!\n", fd, FD_SETSIZE);
+		sClose(fd);
+		return -1;
+	}
+
+	if( !( opt && opt->silent ) )
+		ShowStatus("Connecting to %s\n", path);
+
+	if( sConnect(fd, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ) {
+		if( !( opt && opt->silent ) )
+			ShowError("make_connection_unix: connect to '%s' failed (%s)!\n", path, error_msg());
+		sClose(fd);
+		return -1;
+	}
+	set_nonblocking(fd, 1);
+
+	if (fd_max <= fd) fd_max = fd + 1;
+	sFD_SET(fd,&readfds);
+
+	create_session(fd, recv_to_fifo, send_from_fifo, default_func_parse);
+	session[fd]->client_addr = INADDR_LOOPBACK;
+
+	return fd;
+#endif
+}
+
 static int create_session(int fd, RecvFunc func_recv, SendFunc func_send, ParseFunc func_parse)
 {
 	CREATE(session[fd], struct socket_data, 1);
@@ -610,6 +783,8 @@ static void delete_session(int fd)
 		aFree(session[fd]->wdata);
 		if( session[fd]->session_data )
 			aFree(session[fd]->session_data);
+		if( session[fd]->zip )
+			aFree(session[fd]->zip);
 		for(i = 0; i < session[fd]->hdatac; i++) {
 			if( session[fd]->hdata[i]->flag.free ) {
 				aFree(session[fd]->hdata[i]->data);
@@ -689,6 +864,127 @@ int RFIFOSKIP(int fd, size_t len)
 	return 0;
 }
 
+/*======================================
+ *	Inter-server packet compression
+ *--------------------------------------*/
+// Sessions with a socket_zip attached compress every outgoing block of at least
+// zip->threshold bytes into a 0x2b2c packet (<cmd>.W <len>.W <raw len>.W <zlib data>),
+// as long as that makes it smaller. The peer expands it back in its read fifo with
+// socket_unzip, so the parse functions see the original packets.
+
+/// microseconds, only used to measure the time spent (de)compressing
+static uint64 socket_zip_clock(void)
+{
+#ifdef WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if( freq.QuadPart == 0 )
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64)(now.QuadPart * 1000000 / freq.QuadPart);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/// Enables compression of the packets sent on fd that are at least threshold bytes long.
+/// A threshold of 0 disables it again (the counters are kept).
+void socket_zip(int fd, size_t threshold)
+{
+	if( !session_isValid(fd) )
+		return;
+	if( session[fd]->zip == NULL )
+		CREATE(session[fd]->zip, struct socket_zip, 1);
+	session[fd]->zip->threshold = threshold;
+}
+
+/// Compresses the len bytes about to be set in the write fifo, in place.
+/// Blocks longer than 0xFFFF bytes don't fit the length fields and are sent as they are.
+/// @return the number of bytes to set
+static size_t socket_zip_packet(int fd, size_t len)
+{
+	static uint8 buf[0x10000 + 0x100]; // compressBound(0xFFFF)
+	struct socket_zip* zip = session[fd]->zip;
+	unsigned long zlen = sizeof(buf);
+	uint64 start;
+
+	if( len > 0xFFFF ) {
+		zip->raw_packets++;
+		return len;
+	}
+
+	start = socket_zip_clock();
+	if( encode_zip(buf, &zlen, WFIFOP(fd,0), (unsigned long)len) != 0 || zlen + 6 >= len ) {
+		zip->raw_packets++;
+		zip->zip_usec += socket_zip_clock() - start;
+		return len; // not worth it
+	}
+
+	WFIFOW(fd,4) = (uint16)len;
+	WFIFOW(fd,0) = 0x2b2c;
+	WFIFOW(fd,2) = (uint16)(zlen + 6);
+	memcpy(WFIFOP(fd,6), buf, zlen);
+
+	zip->zip_packets++;
+	zip->raw_bytes += len;
+	zip->zip_bytes += zlen + 6;
+	zip->zip_usec += socket_zip_clock() - start;
+	return zlen + 6;
+}
+
+/// Replaces the 0x2b2c packet at the start of the read fifo with its contents.
+/// The whole packet must have been received.
+/// @return false if the data is corrupt
+bool socket_unzip(int fd)
+{
+	static uint8 buf[0x10000];
+	struct socket_data* s = session[fd];
+	size_t plen = RFIFOW(fd,2);
+	unsigned long len = RFIFOW(fd,4);
+	uint64 start = socket_zip_clock();
+
+	if( plen < 6 || decode_zip(buf, &len, RFIFOP(fd,6), (unsigned long)(plen - 6)) != 0 || len != RFIFOW(fd,4) ) {
+		ShowError("socket_unzip: Corrupt compressed packet on session #%d (%u bytes).\n", fd, (unsigned int)plen);
+		return false;
+	}
+
+	RFIFOSKIP(fd, plen);
+	RFIFOFLUSH(fd);
+	if( s->rdata_size + len > s->max_rdata )
+		realloc_fifo(fd, (unsigned int)(s->rdata_size + len), (unsigned int)s->max_wdata);
+	memmove(s->rdata + len, s->rdata, s->rdata_size);
+	memcpy(s->rdata, buf, len);
+	s->rdata_size += len;
+#ifdef SHOW_SERVER_STATS
+	socket_data_qi += len;
+#endif
+
+	if( s->zip == NULL )
+		CREATE(s->zip, struct socket_zip, 1);
+	s->zip->unzip_packets++;
+	s->zip->unzip_bytes += len;
+	s->zip->unzip_usec += socket_zip_clock() - start;
+	return true;
+}
+
+/// Prints the compression counters of fd.
+void socket_zip_report(int fd, const char* name)
+{
+	struct socket_zip* zip;
+
+	if( !session_isValid(fd) || (zip = session[fd]->zip) == NULL ) {
+		ShowInfo("%s: no compressed traffic.\n", name);
+		return;
+	}
+	ShowInfo("%s: sent %u compressed packets (%"PRIu64" -> %"PRIu64" bytes, %.1f%%) and %u over the threshold raw, %"PRIu64" us spent compressing (%.2f us/KB).\n",
+		name, zip->zip_packets, zip->raw_bytes, zip->zip_bytes, zip->raw_bytes ? 100. * zip->zip_bytes / zip->raw_bytes : 0.,
+		zip->raw_packets, zip->zip_usec, zip->raw_bytes ? zip->zip_usec * 1024. / zip->raw_bytes : 0.);
+	ShowInfo("%s: received %u compressed packets (%"PRIu64" bytes expanded), %"PRIu64" us spent expanding (%.2f us/KB).\n",
+		name, zip->unzip_packets, zip->unzip_bytes, zip->unzip_usec, zip->unzip_bytes ? zip->unzip_usec * 1024. / zip->unzip_bytes : 0.);
+}
+
 /// advance the WFIFO cursor (marking 'len' bytes for sending)
 int WFIFOSET(int fd, size_t len)
 {
@@ -738,6 +1034,8 @@ int WFIFOSET(int fd, size_t len)
 		}
 
 	}
+	if( s->zip && s->zip->threshold && len >= s->zip->threshold )
+		len = socket_zip_packet(fd, len);
 	s->wdata_size += len;
 #ifdef SHOW_SERVER_STATS
 	socket_data_qo += len;
@@ -1238,6 +1536,9 @@ void do_close(int fd)
 	sShutdown(fd, SHUT_RDWR); // Disallow further reads/writes
 	sClose(fd); // We don't really care if these closing functions return an error, we are just shutting down and not reusing this socket.
 	if (session[fd]) delete_session(fd);
+#ifndef WIN32
+	unix_listener_close(fd);
+#endif
 }
 
 /// Retrieve local ips in host byte order.
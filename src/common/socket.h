@@ -77,6 +77,18 @@ typedef int (*RecvFunc)(int fd);
 typedef int (*SendFunc)(int fd);
 typedef int (*ParseFunc)(int fd);
 
+/// Compression state and counters of an inter-server link (see socket_zip).
+struct socket_zip {
+	size_t threshold;           // compress written blocks of at least this many bytes (0: off)
+	unsigned int zip_packets;   // blocks sent compressed
+	unsigned int raw_packets;   // blocks over the threshold sent raw because they did not shrink
+	uint64 raw_bytes, zip_bytes; // size of the compressed blocks before/after
+	uint64 zip_usec;            // time spent compressing
+	unsigned int unzip_packets; // compressed packets received
+	uint64 unzip_bytes;         // bytes they expanded to
+	uint64 unzip_usec;          // time spent expanding
+};
+
 struct socket_data
 {
 	struct {
@@ -98,6 +110,7 @@ struct socket_data
 	ParseFunc func_parse;
 
 	void* session_data; // stores application-specific data related to the session
+	struct socket_zip* zip; // inter-server compression, NULL when never enabled
 	
 	struct HPluginData **hdata;
 	unsigned int hdatac;
@@ -127,6 +140,8 @@ extern bool session_isActive(int fd);
 
 int make_listen_bind(uint32 ip, uint16 port);
 int make_connection(uint32 ip, uint16 port, struct hSockOpt *opt);
+int make_listen_bind_unix(const char* path);
+int make_connection_unix(const char* path, struct hSockOpt *opt);
 int realloc_fifo(int fd, unsigned int rfifo_size, unsigned int wfifo_size);
 int realloc_writefifo(int fd, size_t addition);
 int WFIFOSET(int fd, size_t len);
@@ -161,6 +176,11 @@ void set_eof(int fd);
 /* [Ind/Hercules] - socket_datasync */
 void socket_datasync(int fd, bool send);
 
+// inter-server compression (0x2b2c)
+void socket_zip(int fd, size_t threshold);
+bool socket_unzip(int fd);
+void socket_zip_report(int fd, const char* name);
+
 /// Use a shortlist of sockets instead of iterating all sessions for sockets 
 /// that have data to send or need eof handling.
 /// Adapted to use a static array instead of a linked list.
@@ -190,6 +190,18 @@ static int Sql_P_KeepaliveTimer(int tid, unsigned int tick, int id, intptr_t dat
 
 
 
+/// Stops the periodic keepalive ping of the connection.
+void Sql_StopKeepalive(Sql* self)
+{
+	if( self && self->keepalive != INVALID_TIMER )
+	{
+		timer->delete(self->keepalive, Sql_P_KeepaliveTimer);
+		self->keepalive = INVALID_TIMER;
+	}
+}
+
+
+
 /// Establishes keepalive (periodic ping) on the connection.
 ///
 /// @return the keepalive timer id, or INVALID_TIMER
@@ -337,6 +349,16 @@ uint64 Sql_NumRows(Sql* self)
 
 
 
+/// Returns the number of rows changed, deleted or inserted by the last query.
+uint64 Sql_NumAffectedRows(Sql* self)
+{
+	if( self )
+		return (uint64)mysql_affected_rows(&self->handle);
+	return 0;
+}
+
+
+
 /// Fetches the next row.
 int Sql_NextRow(Sql* self) {
 	if( self && self->result ) {
@@ -1104,6 +1126,7 @@ void sql_defaults(void) {
 	SQL->GetColumnNames = Sql_GetColumnNames;
 	SQL->SetEncoding = Sql_SetEncoding;
 	SQL->Ping = Sql_Ping;
+	SQL->StopKeepalive = Sql_StopKeepalive;
 	SQL->EscapeString = Sql_EscapeString;
 	SQL->EscapeStringLen = Sql_EscapeStringLen;
 	SQL->Query = Sql_Query;
@@ -1112,6 +1135,7 @@ void sql_defaults(void) {
 	SQL->LastInsertId = Sql_LastInsertId;
 	SQL->NumColumns = Sql_NumColumns;
 	SQL->NumRows = Sql_NumRows;
+	SQL->NumAffectedRows = Sql_NumAffectedRows;
 	SQL->NextRow = Sql_NextRow;
 	SQL->GetData = Sql_GetData;
 	SQL->FreeResult = Sql_FreeResult;
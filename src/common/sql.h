@@ -84,6 +84,9 @@ struct sql_interface {
 	///
 	/// @return SQL_SUCCESS or SQL_ERROR
 	int (*Ping) (Sql* self);
+	/// Stops the periodic keepalive ping of the connection.
+	/// For handles used by another thread, which must then ping the connection itself.
+	void (*StopKeepalive) (Sql* self);
 	/// Escapes a string.
 	/// The output buffer must be at least strlen(from)*2+1 in size.
 	///
@@ -124,6 +127,10 @@ struct sql_interface {
 	///
 	/// @return Number of rows
 	uint64 (*NumRows) (Sql* self);
+	/// Returns the number of rows changed, deleted or inserted by the last query.
+	///
+	/// @return Number of affected rows
+	uint64 (*NumAffectedRows) (Sql* self);
 	/// Fetches the next row.
 	/// The data of the previous row is no longer valid.
 	///
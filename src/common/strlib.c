@@ -12,6 +12,19 @@
 #include <stdlib.h>
 #include <errno.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SSE2 is part of the x86-64 baseline, no build flag or cpu check needed
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SV_SCAN_SSE2
+#endif
+
 
 #define J_MAX_MALLOC_SIZE 65535
 
@@ -598,6 +611,117 @@ int sv_parse_next(struct s_svstate* svstate)
 }
 
 
+#ifdef SV_SCAN_SSE2
+/// Index of the lowest set bit of a non-zero mask.
+static inline int sv_ctz(unsigned int mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	int n = 0;
+	while( !(mask&1) ) {
+		mask >>= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+#endif
+
+/// Finds the characters that may end a field or start an escape sequence:
+/// the delimiter, '\n' (SV_TERMINATE_LF), '\r' (SV_TERMINATE_CR/CRLF) or '\\' (SV_ESCAPE_C).
+struct s_svscan {
+	const char* str;
+	int len;
+	char delim, lf, cr, esc; // characters looked for (unused ones are the delimiter)
+	int next; // first character not scanned yet
+#ifdef SV_SCAN_SSE2
+	int base; // start of the last scanned block
+	unsigned int mask; // characters found in that block and not returned yet
+#endif
+};
+
+static void sv_scan_init(struct s_svscan* sc, const char* str, int len, int startoff, char delim, enum e_svopt opt) {
+	sc->str = str;
+	sc->len = len;
+	sc->delim = delim;
+	sc->lf = (opt&SV_TERMINATE_LF) ? '\n' : delim;
+	sc->cr = (opt&(SV_TERMINATE_CR|SV_TERMINATE_CRLF)) ? '\r' : delim;
+	sc->esc = (opt&SV_ESCAPE_C) ? '\\' : delim;
+	sc->next = startoff;
+#ifdef SV_SCAN_SSE2
+	sc->base = startoff;
+	sc->mask = 0;
+#endif
+}
+
+/// Returns the position of the next character found, or the end of the string (len) if there is none.
+static int sv_scan_next(struct s_svscan* sc) {
+#ifdef SV_SCAN_SSE2
+	// compare 16 characters at a time and remember all the matches of the block
+	for(;;) {
+		__m128i v;
+		if( sc->mask != 0 ) {
+			int pos = sc->base + sv_ctz(sc->mask);
+			sc->mask &= sc->mask - 1;
+			return pos;
+		}
+		if( sc->next + 16 > sc->len )
+			break;
+		v = _mm_loadu_si128((const __m128i*)(sc->str + sc->next));
+		sc->mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(sc->delim)), _mm_cmpeq_epi8(v, _mm_set1_epi8(sc->lf))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(sc->cr)), _mm_cmpeq_epi8(v, _mm_set1_epi8(sc->esc)))));
+		sc->base = sc->next;
+		sc->next += 16;
+	}
+#endif
+	for( ; sc->next < sc->len; ++sc->next ) {
+		char c = sc->str[sc->next];
+		if( c == sc->delim || c == sc->lf || c == sc->cr || c == sc->esc )
+			return sc->next++;
+	}
+	return sc->next;
+}
+
+/// sv_parse for lines without escape sequences, jumps from delimiter to delimiter with sv_scan_next.
+/// Gives the same results as sv_parse_next but returns -2 when it finds an escape sequence,
+/// the line has to be parsed by sv_parse_next then.
+static int sv_parse_fast(const char* str, int len, int startoff, char delim, int* out_pos, int npos, enum e_svopt opt) {
+	struct s_svscan sc;
+	int count = 0;
+	int start = startoff; // start of the current field
+	int i;
+
+	sv_scan_init(&sc, str, len, startoff, delim, opt);
+	if( npos > 0 ) out_pos[0] = startoff;
+	for(;;) {
+		i = sv_scan_next(&sc);
+		if( i < len && str[i] != delim ) {
+			if( str[i] == '\\' && (opt&SV_ESCAPE_C) )
+				return -2;
+			if( !(str[i] == '\n' && (opt&SV_TERMINATE_LF))
+			 && !(str[i] == '\r' && ((opt&SV_TERMINATE_CR) || ((opt&SV_TERMINATE_CRLF) && i+1 < len && str[i+1] == '\n'))) )
+				continue; // '\r' not followed by '\n'
+		}
+
+		++count;
+		if( npos > count*2 ) out_pos[count*2] = start;
+		if( npos > count*2+1 ) out_pos[count*2+1] = i;
+
+		if( i >= len || str[i] != delim )
+			break; // end of string or line terminator
+		start = ++i; // delim
+		if( i >= len )
+			break;
+	}
+	if( npos > 1 ) out_pos[1] = i;
+	return count;
+}
+
 /// Parses a delim-separated string.
 /// Starts parsing at startoff and fills the pos array with position pairs.
 /// out_pos[0] and out_pos[1] are the start and end of line.
@@ -626,6 +750,15 @@ int sv_parse(const char* str, int len, int startoff, char delim, int* out_pos, i
 	if( out_pos == NULL ) npos = 0;
 	for( count = 0; count < npos; ++count )
 		out_pos[count] = -1;
+
+	// lines without escape sequences don't need the state machine
+	if( str != NULL && delim != '\n' && delim != '\r' ) {
+		if( (count = sv_parse_fast(str, len, startoff, delim, out_pos, npos, opt)) != -2 )
+			return count;
+		for( count = 0; count < npos; ++count )
+			out_pos[count] = -1;
+	}
+
 	svstate.str = str;
 	svstate.len = len;
 	svstate.off = startoff;
@@ -908,30 +1041,194 @@ const char* skip_escaped_c(const char* p) {
 }
 
 
-/// Opens and parses a file containing delim-separated columns, feeding them to the specified callback function row by row.
-/// Tracks the progress of the operation (current line number, number of successfully processed rows).
-/// Returns 'true' if it was able to process the specified file, or 'false' if it could not be read.
+// rows with more fields than this are only usable by sv_parserows if they are rejected anyway (maxcols)
+#define SV_READROWS_MAXFIELDS 512
+
+/// Releases the memory of rows filled by sv_readrows.
+void sv_freerows(struct s_svrows* rows) {
+	free(rows->buf);
+	free(rows->rows);
+	free(rows->fields);
+	memset(rows, 0, sizeof(*rows));
+}
+
+/// Releases the contents returned by sv_readrows_load.
+static void sv_readrows_release(const char* data, size_t len, bool mapped) {
+#ifndef _WIN32
+	if( mapped ) {
+		munmap((void*)data, len);
+		return;
+	}
+#endif
+	free((void*)data);
+}
+
+/// Reads a whole file for sv_readrows, mapping it when possible.
+/// Returns false if the file could not be opened (*out_data is NULL for an empty file).
+static bool sv_readrows_load(const char* path, const char** out_data, size_t* out_len, bool* out_mapped) {
+#ifndef _WIN32
+	struct stat st;
+	void* data;
+	int fd;
+
+	*out_data = NULL;
+	*out_len = 0;
+	*out_mapped = false;
+	if( (fd = open(path, O_RDONLY)) < 0 )
+		return false;
+	if( fstat(fd, &st) != 0 ) {
+		close(fd);
+		return false;
+	}
+	if( !S_ISREG(st.st_mode) || st.st_size == 0 ) {// nothing to read, as with fgets
+		close(fd);
+		return true;
+	}
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( data == MAP_FAILED )
+		return false;
+	*out_data = (const char*)data;
+	*out_len = (size_t)st.st_size;
+	*out_mapped = true;
+	return true;
+#else
+	char* data = NULL;
+	size_t len = 0, size = 0;
+	FILE* fp;
+
+	*out_data = NULL;
+	*out_len = 0;
+	*out_mapped = false;
+	if( (fp = fopen(path, "r")) == NULL )
+		return false;
+
+	// read everything, the text mode conversion makes the file size useless
+	for(;;) {
+		size_t n;
+		if( len == size ) {
+			char* p = (char*)realloc(data, size = size*2 + 65536);
+			if( p == NULL )
+				break;
+			data = p;
+		}
+		if( (n = fread(data + len, 1, size - len, fp)) == 0 )
+			break;
+		len += n;
+	}
+	fclose(fp);
+	if( len == size ) {// out of memory
+		free(data);
+		return false;
+	}
+	*out_data = data;
+	*out_len = len;
+	return true;
+#endif
+}
+
+/// Reads a file containing delim-separated columns and splits it into rows.
+/// Lines are cut at 1023 characters and comments are stripped the same way
+/// sv_readdb always did. Only uses the system allocator (not thread-safe
+/// memory manager), so files can be read by worker threads.
 ///
-/// @param directory Directory
-/// @param filename File to process
+/// @param path File to read
 /// @param delim Field delimiter
+/// @param out Rows of the file, to be released with sv_freerows
+/// @return true on success, false if the file could not be read
+bool sv_readrows(const char* path, char delim, struct s_svrows* out) {
+	char* tmp[SV_READROWS_MAXFIELDS];
+	const char* data;
+	size_t len, pos, o;
+	bool mapped;
+	int line = 0;
+
+	memset(out, 0, sizeof(*out));
+	if( !sv_readrows_load(path, &data, &len, &mapped) )
+		return false;
+
+	// each line gets its terminator, so there is at most one extra byte per character
+	if( (out->buf = (char*)malloc(len*2 + 1)) == NULL ) {
+		sv_readrows_release(data, len, mapped);
+		return false;
+	}
+	out->found = true;
+
+	for( pos = 0, o = 0; pos < len; ) {
+		char* row = out->buf + o;
+		const char* eol;
+		char* match;
+		size_t n;
+		int columns, count;
+
+		// one fgets into a 1024 bytes buffer
+		n = min(len - pos, 1023);
+		if( (eol = (const char*)memchr(data + pos, '\n', n)) != NULL )
+			n = eol - (data + pos) + 1;
+		memcpy(row, data + pos, n);
+		row[n] = '\0';
+		pos += n;
+		o += n + 1;
+		line++;
+
+		if( ( match = strstr(row, "//") ) != NULL ) {// strip comments
+			match[0] = 0;
+		}
+
+		//TODO: strip trailing whitespace
+		if( row[0] == '\0' || row[0] == '\n' || row[0] == '\r')
+			continue;
+
+		columns = sv_split(row, (int)strlen(row), 0, delim, tmp, ARRAYLENGTH(tmp), (e_svopt)(SV_TERMINATE_LF|SV_TERMINATE_CRLF));
+		count = columns < 0 ? 0 : min(columns, SV_READROWS_MAXFIELDS-1) + 1;
+
+		if( out->count == out->max || out->fields_count + count > out->fields_max ) {
+			struct s_svrow* rows = out->rows;
+			char** fields = out->fields;
+			if( out->count == out->max && (rows = (struct s_svrow*)realloc(out->rows, (out->max*2 + 256)*sizeof(struct s_svrow))) != NULL ) {
+				out->rows = rows;
+				out->max = out->max*2 + 256;
+			}
+			if( out->fields_count + count > out->fields_max && (fields = (char**)realloc(out->fields, (out->fields_max*2 + count + 4096)*sizeof(char*))) != NULL ) {
+				out->fields = fields;
+				out->fields_max = out->fields_max*2 + count + 4096;
+			}
+			if( rows == NULL || fields == NULL ) {// out of memory
+				sv_readrows_release(data, len, mapped);
+				sv_freerows(out);
+				return false;
+			}
+		}
+		out->rows[out->count].line = line;
+		out->rows[out->count].columns = columns;
+		out->rows[out->count].first = out->fields_count;
+		out->count++;
+		if( count ) {
+			memcpy(out->fields + out->fields_count, tmp, count*sizeof(char*));
+			out->fields_count += count;
+		}
+	}
+
+	sv_readrows_release(data, len, mapped);
+	return true;
+}
+
+/// Feeds the rows read by sv_readrows to the specified callback function, one by one.
+/// Tracks the progress of the operation (current line number, number of successfully processed rows).
+///
+/// @param rows Rows of the file
+/// @param path File the rows were read from, for the messages
 /// @param mincols Minimum number of columns of a valid row
 /// @param maxcols Maximum number of columns of a valid row
+/// @param maxrows Maximum number of rows
 /// @param parseproc User-supplied row processing function
-/// @return true on success, false if file could not be opened
-bool sv_readdb(const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current)) {
-	FILE* fp;
-	int lines = 0;
+/// @return true on success, false if file could not be read
+bool sv_parserows(struct s_svrows* rows, const char* path, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current)) {
 	int entries = 0;
 	char** fields; // buffer for fields ([0] is reserved)
-	int columns, fields_length;
-	char path[1024], line[1024];
-	char* match;
-
-	snprintf(path, sizeof(path), "%s/%s", directory, filename);
+	int fields_length, i;
 
-	// open file
-	if( (fp = fopen(path, "r")) == NULL ) {
+	if( !rows->found ) {
 		ShowError("sv_readdb: can't read %s\n", path);
 		return false;
 	}
@@ -941,25 +1238,17 @@ bool sv_readdb(const char* directory, const char* filename, char delim, int minc
 	fields = (char**)aMalloc(fields_length*sizeof(char*));
 
 	// process rows one by one
-	while( fgets(line, sizeof(line), fp) ) {
-		lines++;
-
-		if( ( match = strstr(line, "//") ) != NULL ) {// strip comments
-			match[0] = 0;
-		}
-
-		//TODO: strip trailing whitespace
-		if( line[0] == '\0' || line[0] == '\n' || line[0] == '\r')
-			continue;
-
-		columns = sv_split(line, strlen(line), 0, delim, fields, fields_length, (e_svopt)(SV_TERMINATE_LF|SV_TERMINATE_CRLF));
+	for( i = 0; i < rows->count; i++ ) {
+		const struct s_svrow* row = &rows->rows[i];
+		int columns = row->columns, c;
+		char* end;
 
 		if( columns < mincols ) {
-			ShowError("sv_readdb: Insufficient columns in line %d of \"%s\" (found %d, need at least %d).\n", lines, path, columns, mincols);
+			ShowError("sv_readdb: Insufficient columns in line %d of \"%s\" (found %d, need at least %d).\n", row->line, path, columns, mincols);
 			continue; // not enough columns
 		}
-		if( columns > maxcols ) {
-			ShowError("sv_readdb: Too many columns in line %d of \"%s\" (found %d, maximum is %d).\n", lines, path, columns, maxcols );
+		if( columns > maxcols || columns >= SV_READROWS_MAXFIELDS ) {
+			ShowError("sv_readdb: Too many columns in line %d of \"%s\" (found %d, maximum is %d).\n", row->line, path, columns, maxcols );
 			continue; // too many columns
 		}
 		if( entries == maxrows ) {
@@ -967,9 +1256,15 @@ bool sv_readdb(const char* directory, const char* filename, char delim, int minc
 			break;
 		}
 
+		// as sv_split fills them: unused fields point to the end of the last one
+		memcpy(fields, rows->fields + row->first, (columns+1)*sizeof(char*));
+		end = fields[columns] + strlen(fields[columns]);
+		for( c = columns+1; c < fields_length; c++ )
+			fields[c] = end;
+
 		// parse this row
 		if( !parseproc(fields+1, columns, entries) ) {
-			ShowError("sv_readdb: Could not process contents of line %d of \"%s\".\n", lines, path);
+			ShowError("sv_readdb: Could not process contents of line %d of \"%s\".\n", row->line, path);
 			continue; // invalid row contents
 		}
 
@@ -978,12 +1273,36 @@ bool sv_readdb(const char* directory, const char* filename, char delim, int minc
 	}
 
 	aFree(fields);
-	fclose(fp);
 	ShowStatus("Done reading '"CL_WHITE"%d"CL_RESET"' entries in '"CL_WHITE"%s"CL_RESET"'.\n", entries, path);
 
 	return true;
 }
 
+/// Opens and parses a file containing delim-separated columns, feeding them to the specified callback function row by row.
+/// Tracks the progress of the operation (current line number, number of successfully processed rows).
+/// Returns 'true' if it was able to process the specified file, or 'false' if it could not be read.
+///
+/// @param directory Directory
+/// @param filename File to process
+/// @param delim Field delimiter
+/// @param mincols Minimum number of columns of a valid row
+/// @param maxcols Maximum number of columns of a valid row
+/// @param parseproc User-supplied row processing function
+/// @return true on success, false if file could not be opened
+bool sv_readdb(const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current)) {
+	struct s_svrows rows;
+	char path[1024];
+	bool ret;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, filename);
+
+	sv->readrows(path, delim, &rows);
+	ret = sv->parserows(&rows, path, mincols, maxcols, maxrows, parseproc);
+	sv->freerows(&rows);
+
+	return ret;
+}
+
 
 /////////////////////////////////////////////////////////////////////
 // StringBuf - dynamic string
@@ -1150,4 +1469,7 @@ void strlib_defaults(void) {
 	sv->unescape_c = sv_unescape_c;
 	sv->skip_escaped_c = skip_escaped_c;
 	sv->readdb = sv_readdb;
+	sv->readrows = sv_readrows;
+	sv->parserows = sv_parserows;
+	sv->freerows = sv_freerows;
 }
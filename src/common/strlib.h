@@ -41,6 +41,23 @@ typedef enum e_svopt {
 
 /// Parse state.
 /// The field is [start,end[
+/// Row of a file read by sv_readrows
+struct s_svrow {
+	int line; //< line number in the file
+	int columns; //< number of fields, -1 if the line could not be split
+	int first; //< index of the row's fields in s_svrows::fields ([0] is the start of the next line)
+};
+
+/// A delim-separated file read and split into rows, ready for sv_parserows
+struct s_svrows {
+	bool found; //< whether the file could be read
+	char* buf; //< lines of the file, split in place
+	struct s_svrow* rows;
+	int count, max;
+	char** fields;
+	int fields_count, fields_max;
+};
+
 struct s_svstate {
 	const char* str; //< string to parse
 	int len; //< string length
@@ -160,6 +177,16 @@ struct sv_interface {
 	/// Tracks the progress of the operation (current line number, number of successfully processed rows).
 	/// Returns 'true' if it was able to process the specified file, or 'false' if it could not be read.
 	bool (*readdb) (const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current));
+
+	/// Reads a file containing delim-separated columns and splits it into rows for parserows.
+	/// Only uses the system allocator, so it can run on other threads than the main one.
+	bool (*readrows) (const char* path, char delim, struct s_svrows* out);
+
+	/// Feeds the rows of a file read by readrows to the specified callback function, as readdb does.
+	bool (*parserows) (struct s_svrows* rows, const char* path, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current));
+
+	/// Releases the memory of rows filled by readrows.
+	void (*freerows) (struct s_svrows* rows);
 } sv_s;
 
 struct sv_interface *sv;
@@ -133,6 +133,13 @@ struct AccountDB
 	/// @param self Database
 	/// @return Iterator
 	AccountDBIterator* (*iterator)(AccountDB* self);
+
+	/// Forgets what is cached about an account, so that the next load reads it again.
+	/// Anything waiting to be written is written first.
+	///
+	/// @param self Database
+	/// @param account_id Target account id
+	void (*invalidate)(AccountDB* self, const int account_id);
 };
 
 Sql *account_db_sql_up(AccountDB* self);
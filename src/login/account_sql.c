@@ -2,6 +2,7 @@
 // See the LICENSE file
 // Portions Copyright (c) Athena Dev Teams
 
+#include "../common/db.h"
 #include "../common/malloc.h"
 #include "../common/mmo.h"
 #include "../common/showmsg.h"
@@ -41,9 +42,32 @@ typedef struct AccountDB_SQL
 	bool case_sensitive;
 	char account_db[32];
 	char accreg_db[32];
+	// account cache
+	int cache_size;              // max accounts cached (0 = no cache)
+	int cache_ttl;               // seconds an account is trusted before it is read again
+	int negative_ttl;            // seconds an unknown userid is remembered as unknown
+	int writebehind_interval;    // seconds logincount/lastlogin/last_ip may wait to be written (0 = right away)
+	DBMap* cache;                // int account_id -> struct account_cache_entry*
+	DBMap* cache_userid;         // userid key -> struct account_cache_entry*, userids matching one row only
+	DBMap* unknown_userid;       // userid key -> tick it was found unknown
+	struct account_cache_entry* lru_head; // most recently used
+	struct account_cache_entry* lru_tail; // least recently used
+	int cache_count;
+	int flush_tid;
 
 } AccountDB_SQL;
 
+/// internal structure
+struct account_cache_entry
+{
+	struct mmo_account acc;      // as in the table, plus the fields waiting to be written
+	char key[NAME_LENGTH];       // userid as looked up (lowercase unless case sensitive)
+	unsigned int tick;           // when it was read from the table
+	bool dirty;                  // logincount/lastlogin/last_ip not written yet
+	struct account_cache_entry* prev;
+	struct account_cache_entry* next;
+};
+
 /// internal structure
 typedef struct AccountDBIterator_SQL
 {
@@ -67,9 +91,18 @@ static AccountDBIterator* account_db_sql_iterator(AccountDB* self);
 static void account_db_sql_iter_destroy(AccountDBIterator* self);
 static bool account_db_sql_iter_next(AccountDBIterator* self, struct mmo_account* acc);
 
+static void account_db_sql_invalidate(AccountDB* self, const int account_id);
+
 static bool mmo_auth_fromsql(AccountDB_SQL* db, struct mmo_account* acc, int account_id);
 static bool mmo_auth_tosql(AccountDB_SQL* db, const struct mmo_account* acc, bool is_new);
 
+static void account_cache_key(AccountDB_SQL* db, char* key, const char* userid);
+static struct account_cache_entry* account_cache_get(AccountDB_SQL* db, int account_id);
+static void account_cache_put(AccountDB_SQL* db, const struct mmo_account* acc);
+static void account_cache_drop(AccountDB_SQL* db, struct account_cache_entry* entry);
+static bool account_cache_flush(AccountDB_SQL* db, struct account_cache_entry* entry);
+static int account_cache_flush_timer(int tid, unsigned int tick, int id, intptr_t data);
+
 /// public constructor
 AccountDB* account_db_sql(void)
 {
@@ -86,6 +119,7 @@ AccountDB* account_db_sql(void)
 	db->vtable.load_num     = &account_db_sql_load_num;
 	db->vtable.load_str     = &account_db_sql_load_str;
 	db->vtable.iterator     = &account_db_sql_iterator;
+	db->vtable.invalidate   = &account_db_sql_invalidate;
 
 	// initialize to default values
 	db->accounts = NULL;
@@ -107,6 +141,11 @@ AccountDB* account_db_sql(void)
 	db->case_sensitive = false;
 	safestrncpy(db->account_db, "login", sizeof(db->account_db));
 	safestrncpy(db->accreg_db, "global_reg_value", sizeof(db->accreg_db));
+	db->cache_size = 4096;
+	db->cache_ttl = 600;
+	db->negative_ttl = 30;
+	db->writebehind_interval = 10;
+	db->flush_tid = INVALID_TIMER;
 
 	return &db->vtable;
 }
@@ -160,6 +199,15 @@ static bool account_db_sql_init(AccountDB* self)
 	if( codepage[0] != '\0' && SQL_ERROR == SQL->SetEncoding(sql_handle, codepage) )
 		Sql_ShowDebug(sql_handle);
 
+	db->cache = idb_alloc(DB_OPT_BASE);
+	db->cache_userid = strdb_alloc(DB_OPT_BASE, NAME_LENGTH);
+	db->unknown_userid = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY, NAME_LENGTH);
+	if( db->writebehind_interval > 0 )
+	{
+		timer->add_func_list(account_cache_flush_timer, "account_cache_flush_timer");
+		db->flush_tid = timer->add_interval(timer->gettick() + db->writebehind_interval*1000, account_cache_flush_timer, 0, (intptr_t)db, db->writebehind_interval*1000);
+	}
+
 	return true;
 }
 
@@ -168,6 +216,17 @@ static void account_db_sql_destroy(AccountDB* self)
 {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
 
+	if( db->flush_tid != INVALID_TIMER )
+		timer->delete(db->flush_tid, account_cache_flush_timer);
+	while( db->lru_head != NULL ) // writes what is still waiting
+		account_cache_drop(db, db->lru_head);
+	if( db->cache )
+	{
+		db->cache->destroy(db->cache, NULL);
+		db->cache_userid->destroy(db->cache_userid, NULL);
+		db->unknown_userid->destroy(db->unknown_userid, NULL);
+	}
+
 	SQL->Free(db->accounts);
 	db->accounts = NULL;
 	aFree(db);
@@ -252,6 +311,18 @@ static bool account_db_sql_get_property(AccountDB* self, const char* key, char*
 		else
 		if( strcmpi(key, "accreg_db") == 0 )
 			safesnprintf(buf, buflen, "%s", db->accreg_db);
+		else
+		if( strcmpi(key, "cache_size") == 0 )
+			safesnprintf(buf, buflen, "%d", db->cache_size);
+		else
+		if( strcmpi(key, "cache_ttl") == 0 )
+			safesnprintf(buf, buflen, "%d", db->cache_ttl);
+		else
+		if( strcmpi(key, "negative_ttl") == 0 )
+			safesnprintf(buf, buflen, "%d", db->negative_ttl);
+		else
+		if( strcmpi(key, "writebehind_interval") == 0 )
+			safesnprintf(buf, buflen, "%d", db->writebehind_interval);
 		else
 			return false;// not found
 		return true;
@@ -323,6 +394,18 @@ static bool account_db_sql_set_property(AccountDB* self, const char* key, const
 		else
 		if( strcmpi(key, "accreg_db") == 0 )
 			safestrncpy(db->accreg_db, value, sizeof(db->accreg_db));
+		else
+		if( strcmpi(key, "cache_size") == 0 )
+			db->cache_size = max(0, atoi(value));
+		else
+		if( strcmpi(key, "cache_ttl") == 0 )
+			db->cache_ttl = max(0, atoi(value));
+		else
+		if( strcmpi(key, "negative_ttl") == 0 )
+			db->negative_ttl = max(0, atoi(value));
+		else
+		if( strcmpi(key, "writebehind_interval") == 0 )
+			db->writebehind_interval = max(0, atoi(value));
 		else
 			return false;// not found
 		return true;
@@ -381,7 +464,16 @@ static bool account_db_sql_create(AccountDB* self, struct mmo_account* acc)
 
 	// insert the data into the database
 	acc->account_id = account_id;
-	return mmo_auth_tosql(db, acc, true);
+	if( !mmo_auth_tosql(db, acc, true) )
+		return false;
+
+	if( db->unknown_userid != NULL )
+	{// no longer unknown
+		char key[NAME_LENGTH];
+		account_cache_key(db, key, acc->userid);
+		strdb_remove(db->unknown_userid, key);
+	}
+	return true;
 }
 
 /// delete an existing account entry + its regs
@@ -391,6 +483,8 @@ static bool account_db_sql_remove(AccountDB* self, const int account_id)
 	Sql* sql_handle = db->accounts;
 	bool result = false;
 
+	account_db_sql_invalidate(self, account_id);
+
 	if( SQL_SUCCESS != SQL->QueryStr(sql_handle, "START TRANSACTION")
 	||  SQL_SUCCESS != SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `account_id` = %d", db->account_db, account_id)
 	||  SQL_SUCCESS != SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `account_id` = %d", db->accreg_db, account_id) )
@@ -404,17 +498,57 @@ static bool account_db_sql_remove(AccountDB* self, const int account_id)
 }
 
 /// update an existing account with the provided new data (both account and regs)
+/// If only logincount, lastlogin and last_ip changed, they are written later (write-behind).
 static bool account_db_sql_save(AccountDB* self, const struct mmo_account* acc)
 {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
-	return mmo_auth_tosql(db, acc, false);
+	struct account_cache_entry* entry = account_cache_get(db, acc->account_id);
+
+	if( entry != NULL && db->writebehind_interval > 0 )
+	{
+		struct mmo_account tmp;
+		memcpy(&tmp, acc, sizeof(tmp));
+		tmp.logincount = entry->acc.logincount;
+		memcpy(tmp.lastlogin, entry->acc.lastlogin, sizeof(tmp.lastlogin));
+		memcpy(tmp.last_ip, entry->acc.last_ip, sizeof(tmp.last_ip));
+		if( memcmp(&tmp, &entry->acc, sizeof(tmp)) == 0 )
+		{// login bookkeeping only
+			memcpy(&entry->acc, acc, sizeof(entry->acc));
+			entry->dirty = true;
+			return true;
+		}
+	}
+
+	if( !mmo_auth_tosql(db, acc, false) )
+	{
+		if( entry != NULL )
+		{// don't know what the table holds now
+			entry->dirty = false;
+			account_cache_drop(db, entry);
+		}
+		return false;
+	}
+	if( entry != NULL )
+		entry->dirty = false; // written with the rest
+	account_cache_put(db, acc);
+	return true;
 }
 
 /// retrieve data from db and store it in the provided data structure
 static bool account_db_sql_load_num(AccountDB* self, struct mmo_account* acc, const int account_id)
 {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
-	return mmo_auth_fromsql(db, acc, account_id);
+	struct account_cache_entry* entry = account_cache_get(db, account_id);
+
+	if( entry != NULL )
+	{
+		memcpy(acc, &entry->acc, sizeof(struct mmo_account));
+		return true;
+	}
+	if( !mmo_auth_fromsql(db, acc, account_id) )
+		return false;
+	account_cache_put(db, acc);
+	return true;
 }
 
 /// retrieve data from db and store it in the provided data structure
@@ -423,9 +557,27 @@ static bool account_db_sql_load_str(AccountDB* self, struct mmo_account* acc, co
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
 	Sql* sql_handle = db->accounts;
 	char esc_userid[2*NAME_LENGTH+1];
+	char key[NAME_LENGTH];
 	int account_id;
 	char* data;
 
+	if( db->cache_size > 0 )
+	{
+		struct account_cache_entry* entry;
+		unsigned int tick;
+
+		account_cache_key(db, key, userid);
+		if( (entry = (struct account_cache_entry*)strdb_get(db->cache_userid, key)) != NULL )
+			return account_db_sql_load_num(self, acc, entry->acc.account_id);
+		if( strdb_exists(db->unknown_userid, key) )
+		{
+			tick = strdb_uiget(db->unknown_userid, key);
+			if( DIFF_TICK(timer->gettick(), tick) < db->negative_ttl*1000 )
+				return false;// still unknown
+			strdb_remove(db->unknown_userid, key);
+		}
+	}
+
 	SQL->EscapeString(sql_handle, esc_userid, userid);
 
 	// get the list of account IDs for this user ID
@@ -440,19 +592,36 @@ static bool account_db_sql_load_str(AccountDB* self, struct mmo_account* acc, co
 	{// serious problem - duplicit account
 		ShowError("account_db_sql_load_str: multiple accounts found when retrieving data for account '%s'!\n", userid);
 		SQL->FreeResult(sql_handle);
+		if( db->cache_size > 0 )
+			strdb_remove(db->cache_userid, key);
 		return false;
 	}
 
 	if( SQL_SUCCESS != SQL->NextRow(sql_handle) )
 	{// no such entry
 		SQL->FreeResult(sql_handle);
+		if( db->cache_size > 0 && db->negative_ttl > 0 )
+		{
+			if( db_size(db->unknown_userid) >= db->cache_size )
+				db_clear(db->unknown_userid);// someone is trying lots of names, start over
+			strdb_uiput(db->unknown_userid, key, timer->gettick());
+		}
 		return false;
 	}
 
 	SQL->GetData(sql_handle, 0, &data, NULL);
 	account_id = atoi(data);
+	SQL->FreeResult(sql_handle);
 
-	return account_db_sql_load_num(self, acc, account_id);
+	if( !account_db_sql_load_num(self, acc, account_id) )
+		return false;
+	if( db->cache_size > 0 )
+	{// the only row with this userid, later lookups can skip the query
+		struct account_cache_entry* entry = (struct account_cache_entry*)idb_get(db->cache, account_id);
+		if( entry != NULL && strcmp(entry->key, key) == 0 )
+			strdb_put(db->cache_userid, entry->key, entry);
+	}
+	return true;
 }
 
 
@@ -687,6 +856,151 @@ static bool mmo_auth_tosql(AccountDB_SQL* db, const struct mmo_account* acc, boo
 
 	return result;
 }
+/// drops the cached account, writing what is waiting first
+/// so the next load reads the table (e.g. before applying a change from a char-server)
+static void account_db_sql_invalidate(AccountDB* self, const int account_id)
+{
+	AccountDB_SQL* db = (AccountDB_SQL*)self;
+	struct account_cache_entry* entry;
+
+	if( db->cache != NULL && (entry = (struct account_cache_entry*)idb_get(db->cache, account_id)) != NULL )
+		account_cache_drop(db, entry);
+}
+
+/// key under which a userid is cached
+static void account_cache_key(AccountDB_SQL* db, char* key, const char* userid)
+{
+	int i;
+
+	for( i = 0; i < NAME_LENGTH-1 && userid[i] != '\0'; ++i )
+		key[i] = db->case_sensitive ? userid[i] : TOLOWER(userid[i]);
+	key[i] = '\0';
+}
+
+/// returns the cached account, if it is still trusted
+static struct account_cache_entry* account_cache_get(AccountDB_SQL* db, int account_id)
+{
+	struct account_cache_entry* entry;
+
+	if( db->cache == NULL || (entry = (struct account_cache_entry*)idb_get(db->cache, account_id)) == NULL )
+		return NULL;
+
+	if( DIFF_TICK(timer->gettick(), entry->tick) >= db->cache_ttl*1000 )
+	{// may have been changed by other tools, read it again
+		account_cache_drop(db, entry);
+		return NULL;
+	}
+
+	if( entry != db->lru_head )
+	{// move to front
+		entry->prev->next = entry->next;
+		if( entry->next )
+			entry->next->prev = entry->prev;
+		else
+			db->lru_tail = entry->prev;
+		entry->prev = NULL;
+		entry->next = db->lru_head;
+		db->lru_head->prev = entry;
+		db->lru_head = entry;
+	}
+	return entry;
+}
+
+/// caches an account as the table holds it
+/// (found by userid only once load_str saw that no other row has it)
+static void account_cache_put(AccountDB_SQL* db, const struct mmo_account* acc)
+{
+	struct account_cache_entry* entry;
+
+	if( db->cache_size <= 0 || db->cache == NULL )
+		return;
+
+	if( (entry = account_cache_get(db, acc->account_id)) != NULL )
+	{
+		memcpy(&entry->acc, acc, sizeof(entry->acc));
+		if( strncmp(entry->acc.userid, entry->key, NAME_LENGTH) != 0 )
+		{// userid changed, not known to be unique until load_str checks it
+			if( strdb_get(db->cache_userid, entry->key) == entry )
+				strdb_remove(db->cache_userid, entry->key);
+			account_cache_key(db, entry->key, acc->userid);
+		}
+		return;
+	}
+
+	while( db->cache_count >= db->cache_size )
+		account_cache_drop(db, db->lru_tail);
+
+	CREATE(entry, struct account_cache_entry, 1);
+	memcpy(&entry->acc, acc, sizeof(entry->acc));
+	account_cache_key(db, entry->key, acc->userid);
+	entry->tick = timer->gettick();
+	entry->next = db->lru_head;
+	if( db->lru_head )
+		db->lru_head->prev = entry;
+	else
+		db->lru_tail = entry;
+	db->lru_head = entry;
+	db->cache_count++;
+
+	idb_put(db->cache, acc->account_id, entry);
+}
+
+/// removes an account from the cache, writing what is waiting first
+static void account_cache_drop(AccountDB_SQL* db, struct account_cache_entry* entry)
+{
+	if( entry->dirty )
+		account_cache_flush(db, entry);
+
+	if( entry->prev )
+		entry->prev->next = entry->next;
+	else
+		db->lru_head = entry->next;
+	if( entry->next )
+		entry->next->prev = entry->prev;
+	else
+		db->lru_tail = entry->prev;
+	db->cache_count--;
+
+	idb_remove(db->cache, entry->acc.account_id);
+	if( strdb_get(db->cache_userid, entry->key) == entry )
+		strdb_remove(db->cache_userid, entry->key);
+	aFree(entry);
+}
+
+/// writes the login bookkeeping of a cached account
+static bool account_cache_flush(AccountDB_SQL* db, struct account_cache_entry* entry)
+{
+	const struct mmo_account* acc = &entry->acc;
+	SqlStmt* stmt = SQL->StmtMalloc(db->accounts);
+	bool result = true;
+
+	if( SQL_SUCCESS != SQL->StmtPrepare(stmt, "UPDATE `%s` SET `logincount`=?,`lastlogin`=?,`last_ip`=? WHERE `account_id` = '%d'", db->account_db, acc->account_id)
+	||  SQL_SUCCESS != SQL->StmtBindParam(stmt, 0, SQLDT_UINT,   (void*)&acc->logincount, sizeof(acc->logincount))
+	||  SQL_SUCCESS != SQL->StmtBindParam(stmt, 1, SQLDT_STRING, (void*)&acc->lastlogin,  strlen(acc->lastlogin))
+	||  SQL_SUCCESS != SQL->StmtBindParam(stmt, 2, SQLDT_STRING, (void*)&acc->last_ip,    strlen(acc->last_ip))
+	||  SQL_SUCCESS != SQL->StmtExecute(stmt)
+	) {
+		SqlStmt_ShowDebug(stmt);
+		result = false;
+	}
+	SQL->StmtFree(stmt);
+
+	entry->dirty = false;
+	return result;
+}
+
+/// writes the login bookkeeping waiting in the cache
+static int account_cache_flush_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	AccountDB_SQL* db = (AccountDB_SQL*)data;
+	struct account_cache_entry* entry;
+
+	for( entry = db->lru_head; entry != NULL; entry = entry->next )
+		if( entry->dirty )
+			account_cache_flush(db, entry);
+	return 0;
+}
+
 Sql* account_db_sql_up(AccountDB* self) {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
 	Sql_HerculesUpdateCheck(db->accounts);
@@ -5,6 +5,7 @@
 #define __IPBAN_H_INCLUDED__
 
 #include "../common/cbasetypes.h"
+#include "../common/sql.h"
 
 // initialize
 void ipban_init(void);
@@ -12,11 +13,15 @@ void ipban_init(void);
 // finalize
 void ipban_final(void);
 
+// opens a connection to the ipban database (NULL if ipban is disabled)
+Sql* ipban_connect(void);
+
 // check ip against ban list
 bool ipban_check(uint32 ip);
 
 // increases failure count for the specified IP
 void ipban_log(uint32 ip);
+bool ipban_log_sql(Sql* handle, Sql* log_handle, uint32 ip);
 
 // parses configuration option
 bool ipban_config_read(const char* key, const char* value);
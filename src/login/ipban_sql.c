@@ -12,8 +12,10 @@
 #include "login.h"
 #include "ipban.h"
 #include "loginlog.h"
+#include "loginworker.h"
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // global sql settings
 static char   global_db_hostname[32] = "127.0.0.1";
@@ -36,11 +38,23 @@ static Sql* sql_handle = NULL;
 static int cleanup_timer_id = INVALID_TIMER;
 static bool ipban_inited = false;
 
+// in-memory copy of the active bans, one table per banned prefix
+// ('a.*.*.*', 'a.b.*.*', 'a.b.c.*', 'a.b.c.d'); key: masked ip, data: expiration time
+static DBMap* ban_db[4] = { NULL, NULL, NULL, NULL };
+static unsigned int ban_sync_time = 0; // database time of the last refresh
+static int ban_refresh_count = 0;
+
+#define IPBAN_FULL_RELOAD 10 // every n-th refresh reloads the whole list (picks up removed or edited bans)
+#define IPBAN_REFRESH_INTERVAL 60 // refresh interval (in seconds) when periodic cleanups are disabled
+#define ipban_mask(n) ( 0xFFFFFFFFu << (32 - 8*(n)) )
+
 int ipban_cleanup(int tid, unsigned int tick, int id, intptr_t data);
+static void ipban_refresh(bool full);
+static void ipban_purge(void);
 
 
-// initialize
-void ipban_init(void)
+// opens a connection to the ipban database (NULL if ipban is disabled)
+Sql* ipban_connect(void)
 {
 	const char* username;
 	const char* password;
@@ -48,11 +62,10 @@ void ipban_init(void)
 	uint16      port;
 	const char* database;
 	const char* codepage;
-
-	ipban_inited = true;
+	Sql* handle;
 
 	if( !login_config.ipban )
-		return;// ipban disabled
+		return NULL;// ipban disabled
 
 	if( ipban_db_hostname[0] != '\0' )
 	{// local settings
@@ -74,35 +87,62 @@ void ipban_init(void)
 	}
 
 	// establish connections
-	sql_handle = SQL->Malloc();
-	if( SQL_ERROR == SQL->Connect(sql_handle, username, password, hostname, port, database) )
+	handle = SQL->Malloc();
+	if( SQL_ERROR == SQL->Connect(handle, username, password, hostname, port, database) )
 	{
-		Sql_ShowDebug(sql_handle);
-		SQL->Free(sql_handle);
+		Sql_ShowDebug(handle);
+		SQL->Free(handle);
 		exit(EXIT_FAILURE);
 	}
-	if( codepage[0] != '\0' && SQL_ERROR == SQL->SetEncoding(sql_handle, codepage) )
-		Sql_ShowDebug(sql_handle);
+	if( codepage[0] != '\0' && SQL_ERROR == SQL->SetEncoding(handle, codepage) )
+		Sql_ShowDebug(handle);
 
-	if( login_config.ipban_cleanup_interval > 0 )
-	{ // set up periodic cleanup of connection history and active bans
-		timer->add_func_list(ipban_cleanup, "ipban_cleanup");
-		cleanup_timer_id = timer->add_interval(timer->gettick()+10, ipban_cleanup, 0, 0, login_config.ipban_cleanup_interval*1000);
-	} else // make sure it gets cleaned up on login-server start regardless of interval-based cleanups
-		ipban_cleanup(0,0,0,0);
+	return handle;
+}
+
+// initialize
+void ipban_init(void)
+{
+	int i;
+
+	ipban_inited = true;
+
+	if( !login_config.ipban )
+		return;// ipban disabled
+
+	sql_handle = ipban_connect();
+
+	for( i = 0; i < ARRAYLENGTH(ban_db); ++i )
+		ban_db[i] = uidb_alloc(DB_OPT_BASE|DB_OPT_ALLOW_NULL_KEY);
+
+	if( login_config.ipban_cleanup_interval == 0 ) // make sure it gets cleaned up on login-server start regardless of interval-based cleanups
+		ipban_purge();
+	ipban_refresh(true);
+
+	// set up periodic cleanup of connection history and active bans, which also refreshes the ban list
+	timer->add_func_list(ipban_cleanup, "ipban_cleanup");
+	cleanup_timer_id = timer->add_interval(timer->gettick()+10, ipban_cleanup, 0, 0,
+		( login_config.ipban_cleanup_interval > 0 ? login_config.ipban_cleanup_interval : IPBAN_REFRESH_INTERVAL )*1000);
 }
 
 // finalize
 void ipban_final(void)
 {
+	int i;
+
 	if( !login_config.ipban )
 		return;// ipban disabled
 
-	if( login_config.ipban_cleanup_interval > 0 )
-		// release data
-		timer->delete(cleanup_timer_id, ipban_cleanup);
+	// release data
+	timer->delete(cleanup_timer_id, ipban_cleanup);
 	
-	ipban_cleanup(0,0,0,0); // always clean up on login-server stop
+	ipban_purge(); // always clean up on login-server stop
+
+	for( i = 0; i < ARRAYLENGTH(ban_db); ++i )
+	{
+		db_destroy(ban_db[i]);
+		ban_db[i] = NULL;
+	}
 
 	// close connections
 	SQL->Free(sql_handle);
@@ -198,62 +238,200 @@ bool ipban_config_read(const char* key, const char* value)
 	return false;// not found
 }
 
-// check ip against active bans list
-bool ipban_check(uint32 ip)
+// parses a ban list entry ('a.*.*.*', 'a.b.*.*', 'a.b.c.*' or 'a.b.c.d')
+// returns the number of fixed octets, 0 if the entry isn't one of these forms
+static int ipban_parse(const char* str, uint32* ip)
 {
-	uint8* p = (uint8*)&ip;
-	char* data = NULL;
-	int matches;
+	int i, n = 0;
 
-	if( !login_config.ipban )
-		return false;// ipban disabled
+	*ip = 0;
+	for( i = 0; i < 4; ++i )
+	{
+		unsigned long octet;
+		char* end;
+
+		if( i > 0 && *str++ != '.' )
+			return 0;
+		if( *str == '*' )
+		{
+			++str;
+			continue;
+		}
+		if( n < i || !ISDIGIT(*str) )
+			return 0;// octet after a wildcard
+		octet = strtoul(str, &end, 10);
+		if( octet > 255 )
+			return 0;
+		*ip |= (uint32)octet << (24 - 8*i);
+		str = end;
+		++n;
+	}
 
-	if( SQL_ERROR == SQL->Query(sql_handle, "SELECT count(*) FROM `%s` WHERE `rtime` > NOW() AND (`list` = '%u.*.*.*' OR `list` = '%u.%u.*.*' OR `list` = '%u.%u.%u.*' OR `list` = '%u.%u.%u.%u')",
-		ipban_table, p[3], p[3], p[2], p[3], p[2], p[1], p[3], p[2], p[1], p[0]) )
+	return ( *str == '\0' ) ? n : 0;
+}
+
+// adds a ban on the first n octets of ip, lasting until rtime
+static void ipban_add(uint32 ip, int n, unsigned int rtime)
+{
+	uint32 key = ip & ipban_mask(n);
+
+	if( uidb_uiget(ban_db[n-1], key) < rtime )
+		uidb_uiput(ban_db[n-1], key, rtime);
+}
+
+// loads bans from the database; a full refresh replaces the whole list,
+// otherwise only the bans added since the last refresh are read
+static void ipban_refresh(bool full)
+{
+	unsigned int now;
+	char* data;
+	int i;
+
+	if( SQL_ERROR == SQL->Query(sql_handle, "SELECT UNIX_TIMESTAMP(NOW())") || SQL_SUCCESS != SQL->NextRow(sql_handle) )
 	{
 		Sql_ShowDebug(sql_handle);
-		// close connection because we can't verify their connectivity.
-		return true;
+		return;
 	}
+	SQL->GetData(sql_handle, 0, &data, NULL);
+	now = (unsigned int)strtoul(data, NULL, 10);
+	SQL->FreeResult(sql_handle);
 
-	if( SQL_ERROR == SQL->NextRow(sql_handle) )
-		return true;// Shouldn't happen, but just in case...
+	if( full )
+	{
+		if( SQL_ERROR == SQL->Query(sql_handle, "SELECT `list`, UNIX_TIMESTAMP(`rtime`) FROM `%s` WHERE `rtime` > NOW()", ipban_table) )
+		{
+			Sql_ShowDebug(sql_handle);
+			return;
+		}
+		for( i = 0; i < ARRAYLENGTH(ban_db); ++i )
+			db_clear(ban_db[i]);
+	}
+	else if( SQL_ERROR == SQL->Query(sql_handle, "SELECT `list`, UNIX_TIMESTAMP(`rtime`) FROM `%s` WHERE `rtime` > NOW() AND `btime` >= FROM_UNIXTIME(%u)", ipban_table, ban_sync_time) )
+	{
+		Sql_ShowDebug(sql_handle);
+		return;
+	}
 
-	SQL->GetData(sql_handle, 0, &data, NULL);
-	matches = atoi(data);
+	while( SQL_SUCCESS == SQL->NextRow(sql_handle) )
+	{
+		uint32 ip;
+		int n;
+
+		SQL->GetData(sql_handle, 0, &data, NULL);
+		if( (n = ipban_parse(data, &ip)) == 0 )
+			continue;// never matched by the old queries either
+		SQL->GetData(sql_handle, 1, &data, NULL);
+		ipban_add(ip, n, (unsigned int)strtoul(data, NULL, 10));
+	}
 	SQL->FreeResult(sql_handle);
 
-	return( matches > 0 );
+	ban_sync_time = now;
 }
 
-// log failed attempt
-void ipban_log(uint32 ip)
+// check ip against active bans list
+bool ipban_check(uint32 ip)
 {
-	unsigned long failures;
+	unsigned int now;
+	int n;
 
 	if( !login_config.ipban )
-		return;// ipban disabled
+		return false;// ipban disabled
+
+	now = (unsigned int)time(NULL);
+	for( n = 1; n <= 4; ++n )
+		if( uidb_uiget(ban_db[n-1], ip & ipban_mask(n)) > now )
+			return true;
 
-	failures = loginlog_failedattempts(ip, login_config.dynamic_pass_failure_ban_interval);// how many times failed account? in one ip.
+	return false;
+}
 
+// add a temporary ban entry if the ip failed too many times
+// returns whether the ip got banned
+static bool ipban_log_failures(Sql* handle, uint32 ip, unsigned long failures)
+{
 	// if over the limit, add a temporary ban entry
 	if( failures >= login_config.dynamic_pass_failure_ban_limit )
 	{
 		uint8* p = (uint8*)&ip;
-		if( SQL_ERROR == SQL->Query(sql_handle, "INSERT INTO `%s`(`list`,`btime`,`rtime`,`reason`) VALUES ('%u.%u.%u.*', NOW() , NOW() +  INTERVAL %d MINUTE ,'Password error ban')",
+		if( SQL_ERROR == SQL->Query(handle, "INSERT INTO `%s`(`list`,`btime`,`rtime`,`reason`) VALUES ('%u.%u.%u.*', NOW() , NOW() +  INTERVAL %d MINUTE ,'Password error ban')",
 			ipban_table, p[3], p[2], p[1], login_config.dynamic_pass_failure_ban_duration) )
-			Sql_ShowDebug(sql_handle);
+			Sql_ShowDebug(handle);
+		return true;
 	}
+	return false;
 }
 
-// remove expired bans
-int ipban_cleanup(int tid, unsigned int tick, int id, intptr_t data)
+// log failed attempt, using the given connections
+// returns whether the ip got banned
+bool ipban_log_sql(Sql* handle, Sql* log_handle, uint32 ip)
+{
+	if( !login_config.ipban || handle == NULL )
+		return false;// ipban disabled
+
+	return ipban_log_failures(handle, ip, loginlog_failedattempts_sql(log_handle, ip, login_config.dynamic_pass_failure_ban_interval));
+}
+
+// the in-memory ban list mirrors the auto-ban right away
+static void ipban_log_banned(uint32 ip)
+{
+	ipban_add(ip, 3, (unsigned int)time(NULL) + login_config.dynamic_pass_failure_ban_duration*60);
+}
+
+struct ipban_log_entry {
+	uint32 ip;
+	bool banned;
+};
+
+static void ipban_log_job(struct loginworker_ctx* ctx, void* data)
+{
+	struct ipban_log_entry* entry = (struct ipban_log_entry*)data;
+	entry->banned = ipban_log_sql(ctx->ipban, ctx->log, entry->ip);
+}
+
+static void ipban_log_done(void* data)
+{
+	struct ipban_log_entry* entry = (struct ipban_log_entry*)data;
+	if( entry->banned && ban_db[0] != NULL )
+		ipban_log_banned(entry->ip);
+	aFree(entry);
+}
+
+// log failed attempt
+void ipban_log(uint32 ip)
 {
 	if( !login_config.ipban )
-		return 0;// ipban disabled
+		return;// ipban disabled
+
+	if( loginworker_running() )
+	{// off the main thread
+		struct ipban_log_entry* entry;
+		CREATE(entry, struct ipban_log_entry, 1);
+		entry->ip = ip;
+		loginworker_submit(ipban_log_job, ipban_log_done, entry);
+		return;
+	}
 
+	if( ipban_log_failures(sql_handle, ip, loginlog_failedattempts(ip, login_config.dynamic_pass_failure_ban_interval)) )// how many times failed account? in one ip.
+		ipban_log_banned(ip);
+}
+
+// remove expired bans from the database
+static void ipban_purge(void)
+{
 	if( SQL_ERROR == SQL->Query(sql_handle, "DELETE FROM `%s` WHERE `rtime` <= NOW()", ipban_table) )
 		Sql_ShowDebug(sql_handle);
+}
+
+// remove expired bans and pick up new ones
+int ipban_cleanup(int tid, unsigned int tick, int id, intptr_t data)
+{
+	if( !login_config.ipban )
+		return 0;// ipban disabled
+
+	if( login_config.ipban_cleanup_interval > 0 )
+		ipban_purge();
+
+	ipban_refresh( ++ban_refresh_count % IPBAN_FULL_RELOAD == 0 );
 
 	return 0;
 }
@@ -16,6 +16,7 @@
 #include "ipban.h"
 #include "login.h"
 #include "loginlog.h"
+#include "loginworker.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -50,6 +51,12 @@ struct s_subnet {
 int subnet_count = 0;
 
 int mmo_auth_new(const char* userid, const char* pass, const char sex, const char* last_ip);
+int parse_login(int fd);
+void login_auth_ok(struct login_session_data* sd);
+void login_auth_failed(struct login_session_data* sd, int result);
+
+// identifies login sessions across asynchronous jobs
+static unsigned int login_session_serial = 0;
 
 //-----------------------------------------------------
 // Auth database
@@ -471,6 +478,7 @@ int parse_fromchar(int fd)
 			int account_id = RFIFOL(fd,2);
 			safestrncpy(email, (char*)RFIFOP(fd,6), 40); remove_control_chars(email);
 			RFIFOSKIP(fd,46);
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 
 			if( e_mail_check(email) == 0 )
 				ShowNotice("Char-server '%s': Attempt to create an e-mail on an account with a default e-mail REFUSED - e-mail is invalid (account: %d, ip: %s)\n", server[id].name, account_id, ip);
@@ -549,6 +557,7 @@ int parse_fromchar(int fd)
 			safestrncpy(actual_email, (char*)RFIFOP(fd,6), 40);
 			safestrncpy(new_email, (char*)RFIFOP(fd,46), 40);
 			RFIFOSKIP(fd, 86);
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 
 			if( e_mail_check(actual_email) == 0 )
 				ShowNotice("Char-server '%s': Attempt to modify an e-mail on an account (@email GM command), but actual email is invalid (account: %d, ip: %s)\n", server[id].name, account_id, ip);
@@ -582,6 +591,7 @@ int parse_fromchar(int fd)
 			int account_id = RFIFOL(fd,2);
 			unsigned int state = RFIFOL(fd,6);
 			RFIFOSKIP(fd,10);
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 
 			if( !accounts->load_num(accounts, &acc, account_id) )
 				ShowNotice("Char-server '%s': Error of Status change (account: %d not found, suggested status %d, ip: %s).\n", server[id].name, account_id, state, ip);
@@ -622,6 +632,7 @@ int parse_fromchar(int fd)
 			int min = (short)RFIFOW(fd,14);
 			int sec = (short)RFIFOW(fd,16);
 			RFIFOSKIP(fd,18);
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 
 			if( !accounts->load_num(accounts, &acc, account_id) )
 				ShowNotice("Char-server '%s': Error of ban request (account: %d not found, ip: %s).\n", server[id].name, account_id, ip);
@@ -677,6 +688,7 @@ int parse_fromchar(int fd)
 			int account_id = RFIFOL(fd,2);
 			RFIFOSKIP(fd,6);
 
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 			if( !accounts->load_num(accounts, &acc, account_id) )
 				ShowNotice("Char-server '%s': Error of sex change (account: %d not found, ip: %s).\n", server[id].name, account_id, ip);
 			else
@@ -710,6 +722,7 @@ int parse_fromchar(int fd)
 
 			int account_id = RFIFOL(fd,4);
 
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 			if( !accounts->load_num(accounts, &acc, account_id) )
 				ShowStatus("Char-server '%s': receiving (from the char-server) of account_reg2 (account: %d not found, ip: %s).\n", server[id].name, account_id, ip);
 			else
@@ -750,6 +763,7 @@ int parse_fromchar(int fd)
 			int account_id = RFIFOL(fd,2);
 			RFIFOSKIP(fd,6);
 
+			accounts->invalidate(accounts, account_id); // work on what the table holds, not the cache
 			if( !accounts->load_num(accounts, &acc, account_id) )
 				ShowNotice("Char-server '%s': Error of UnBan request (account: %d not found, ip: %s).\n", server[id].name, account_id, ip);
 			else
@@ -856,6 +870,7 @@ int parse_fromchar(int fd)
 			else {
 				struct mmo_account acc;
 				
+				accounts->invalidate(accounts, RFIFOL(fd,2)); // work on what the table holds, not the cache
 				if( accounts->load_num(accounts, &acc, RFIFOL(fd,2) ) ) {
 					strncpy( acc.pincode, (char*)RFIFOP(fd,6), 5 );
 					acc.pincode_change = ((unsigned int)time( NULL ));
@@ -955,15 +970,12 @@ int mmo_auth_new(const char* userid, const char* pass, const char sex, const cha
 }
 
 //-----------------------------------------------------
-// Check/authentication of a connection
+// Checks done before the password can be compared;
+// loads the account into acc (-1: continue, otherwise: error code)
 //-----------------------------------------------------
-int mmo_auth(struct login_session_data* sd, bool isServer) {
-	struct mmo_account acc;
+static int mmo_auth_prepare(struct login_session_data* sd, struct mmo_account* acc, const char* ip) {
 	int len;
 
-	char ip[16];
-	ip2str(session[sd->fd]->client_addr, ip);
-
 	// DNS Blacklist check
 	if( login_config.use_dnsbl ) {
 		char r_ip[16];
@@ -1007,31 +1019,39 @@ int mmo_auth(struct login_session_data* sd, bool isServer) {
 		}
 	}
 	
-	if( !accounts->load_str(accounts, &acc, sd->userid) ) {
+	if( !accounts->load_str(accounts, acc, sd->userid) ) {
 		ShowNotice("Unknown account (account: %s, received pass: %s, ip: %s)\n", sd->userid, sd->passwd, ip);
 		return 0; // 0 = Unregistered ID
 	}
 
-	if( !check_password(sd->md5key, sd->passwdenc, sd->passwd, acc.pass) ) {
-		ShowNotice("Invalid password (account: '%s', pass: '%s', received pass: '%s', ip: %s)\n", sd->userid, acc.pass, sd->passwd, ip);
+	return -1;
+}
+
+//-----------------------------------------------------
+// Checks done once the password has been compared;
+// updates the session and the account on success
+//-----------------------------------------------------
+static int mmo_auth_finish(struct login_session_data* sd, struct mmo_account* acc, bool isServer, bool password_ok, const char* ip) {
+	if( !password_ok ) {
+		ShowNotice("Invalid password (account: '%s', pass: '%s', received pass: '%s', ip: %s)\n", sd->userid, acc->pass, sd->passwd, ip);
 		return 1; // 1 = Incorrect Password
 	}
 
-	if( acc.expiration_time != 0 && acc.expiration_time < time(NULL) ) {
+	if( acc->expiration_time != 0 && acc->expiration_time < time(NULL) ) {
 		ShowNotice("Connection refused (account: %s, pass: %s, expired ID, ip: %s)\n", sd->userid, sd->passwd, ip);
 		return 2; // 2 = This ID is expired
 	}
 
-	if( acc.unban_time != 0 && acc.unban_time > time(NULL) ) {
+	if( acc->unban_time != 0 && acc->unban_time > time(NULL) ) {
 		char tmpstr[24];
-		timestamp2string(tmpstr, sizeof(tmpstr), acc.unban_time, login_config.date_format);
+		timestamp2string(tmpstr, sizeof(tmpstr), acc->unban_time, login_config.date_format);
 		ShowNotice("Connection refused (account: %s, pass: %s, banned until %s, ip: %s)\n", sd->userid, sd->passwd, tmpstr, ip);
 		return 6; // 6 = Your are Prohibited to log in until %s
 	}
 
-	if( acc.state != 0 ) {
-		ShowNotice("Connection refused (account: %s, pass: %s, state: %d, ip: %s)\n", sd->userid, sd->passwd, acc.state, ip);
-		return acc.state - 1;
+	if( acc->state != 0 ) {
+		ShowNotice("Connection refused (account: %s, pass: %s, state: %d, ip: %s)\n", sd->userid, sd->passwd, acc->state, ip);
+		return acc->state - 1;
 	}
 	
 	if( login_config.client_hash_check && !isServer ) {
@@ -1039,12 +1059,12 @@ int mmo_auth(struct login_session_data* sd, bool isServer) {
 		bool match = false;
 
 		if( !sd->has_client_hash ) {
-			ShowNotice("Client doesn't sent client hash (account: %s, pass: %s, ip: %s)\n", sd->userid, sd->passwd, acc.state, ip);
+			ShowNotice("Client doesn't sent client hash (account: %s, pass: %s, ip: %s)\n", sd->userid, sd->passwd, acc->state, ip);
 			return 5;
 		}
 
 		while( node ) {
-			if( node->group_id <= acc.group_id && memcmp(node->hash, sd->client_hash, 16) == 0 ) {
+			if( node->group_id <= acc->group_id && memcmp(node->hash, sd->client_hash, 16) == 0 ) {
 				match = true;
 				break;
 			}
@@ -1064,23 +1084,23 @@ int mmo_auth(struct login_session_data* sd, bool isServer) {
 		}
 	}
 
-	ShowNotice("Authentication accepted (account: %s, id: %d, ip: %s)\n", sd->userid, acc.account_id, ip);
+	ShowNotice("Authentication accepted (account: %s, id: %d, ip: %s)\n", sd->userid, acc->account_id, ip);
 
 	// update session data
-	sd->account_id = acc.account_id;
+	sd->account_id = acc->account_id;
 	sd->login_id1 = rnd() + 1;
 	sd->login_id2 = rnd() + 1;
-	safestrncpy(sd->lastlogin, acc.lastlogin, sizeof(sd->lastlogin));
-	sd->sex = acc.sex;
-	sd->group_id = (uint8)acc.group_id;
+	safestrncpy(sd->lastlogin, acc->lastlogin, sizeof(sd->lastlogin));
+	sd->sex = acc->sex;
+	sd->group_id = (uint8)acc->group_id;
 
 	// update account data
-	timestamp2string(acc.lastlogin, sizeof(acc.lastlogin), time(NULL), "%Y-%m-%d %H:%M:%S");
-	safestrncpy(acc.last_ip, ip, sizeof(acc.last_ip));
-	acc.unban_time = 0;
-	acc.logincount++;
+	timestamp2string(acc->lastlogin, sizeof(acc->lastlogin), time(NULL), "%Y-%m-%d %H:%M:%S");
+	safestrncpy(acc->last_ip, ip, sizeof(acc->last_ip));
+	acc->unban_time = 0;
+	acc->logincount++;
 
-	accounts->save(accounts, &acc);
+	accounts->save(accounts, acc);
 
 	if( sd->sex != 'S' && sd->account_id < START_ACCOUNT_NUM )
 		ShowWarning("Account %s has account id %d! Account IDs must be over %d to work properly!\n", sd->userid, sd->account_id, START_ACCOUNT_NUM);
@@ -1088,6 +1108,108 @@ int mmo_auth(struct login_session_data* sd, bool isServer) {
 	return -1; // account OK
 }
 
+//-----------------------------------------------------
+// Check/authentication of a connection
+//-----------------------------------------------------
+int mmo_auth(struct login_session_data* sd, bool isServer) {
+	struct mmo_account acc;
+	int result;
+
+	char ip[16];
+	ip2str(session[sd->fd]->client_addr, ip);
+
+	if( (result = mmo_auth_prepare(sd, &acc, ip)) != -1 )
+		return result;
+
+	return mmo_auth_finish(sd, &acc, isServer, check_password(sd->md5key, sd->passwdenc, sd->passwd, acc.pass), ip);
+}
+
+/// Client login whose password check runs on a worker.
+struct login_auth_job {
+	int fd;
+	unsigned int serial;
+	struct mmo_account acc;
+	char md5key[20];
+	int passwdenc;
+	char passwd[PASSWD_LEN];
+	bool password_ok;
+};
+
+/// Identifies a login session across an asynchronous job;
+/// the connection may have been closed (and the fd reused) in the meantime.
+static struct login_session_data* login_session_get(int fd, unsigned int serial)
+{
+	struct login_session_data* sd;
+
+	if( !session_isActive(fd) || session[fd]->func_parse != parse_login )
+		return NULL;
+	sd = (struct login_session_data*)session[fd]->session_data;
+	if( sd == NULL || sd->serial != serial )
+		return NULL;
+	return sd;
+}
+
+static void login_auth_job_check(struct loginworker_ctx* ctx, void* data)
+{
+	struct login_auth_job* job = (struct login_auth_job*)data;
+	job->password_ok = check_password(job->md5key, job->passwdenc, job->passwd, job->acc.pass);
+}
+
+static void login_auth_job_done(void* data)
+{
+	struct login_auth_job* job = (struct login_auth_job*)data;
+	struct login_session_data* sd = login_session_get(job->fd, job->serial);
+
+	if( sd != NULL ) {
+		char ip[16];
+		int result;
+
+		sd->auth_pending = false;
+		ip2str(session[sd->fd]->client_addr, ip);
+		result = mmo_auth_finish(sd, &job->acc, false, job->password_ok, ip);
+		if( result == -1 )
+			login_auth_ok(sd);
+		else
+			login_auth_failed(sd, result);
+	}
+	aFree(job);
+}
+
+//-----------------------------------------------------
+// Client authentication; the password check is handed
+// to a worker when the pool is running
+//-----------------------------------------------------
+static void login_auth_client(struct login_session_data* sd) {
+	struct login_auth_job* job;
+	int result;
+	char ip[16];
+
+	if( !loginworker_running() ) {
+		result = mmo_auth(sd, false);
+		if( result == -1 )
+			login_auth_ok(sd);
+		else
+			login_auth_failed(sd, result);
+		return;
+	}
+
+	ip2str(session[sd->fd]->client_addr, ip);
+	CREATE(job, struct login_auth_job, 1);
+	if( (result = mmo_auth_prepare(sd, &job->acc, ip)) != -1 ) {
+		aFree(job);
+		login_auth_failed(sd, result);
+		return;
+	}
+
+	job->fd = sd->fd;
+	job->serial = sd->serial;
+	memcpy(job->md5key, sd->md5key, sizeof(job->md5key));
+	job->passwdenc = sd->passwdenc;
+	safestrncpy(job->passwd, sd->passwd, sizeof(job->passwd));
+	sd->auth_pending = true;
+	loginworker_submit(login_auth_job_check, login_auth_job_done, job);
+}
+
 void login_auth_ok(struct login_session_data* sd)
 {
 	int fd = sd->fd;
@@ -1328,8 +1450,12 @@ int parse_login(int fd)
 		CREATE(session[fd]->session_data, struct login_session_data, 1);
 		sd = (struct login_session_data*)session[fd]->session_data;
 		sd->fd = fd;
+		sd->serial = ++login_session_serial;
 	}
 
+	if( sd->auth_pending )
+		return 0;// waiting for a worker
+
 	while( RFIFOREST(fd) >= 2 ) {
 		uint16 command = RFIFOW(fd,0);
 
@@ -1448,12 +1574,9 @@ int parse_login(int fd)
 				return 0;
 			}
 			
-			result = mmo_auth(sd, false);
-
-			if( result == -1 )
-				login_auth_ok(sd);
-			else
-				login_auth_failed(sd, result);
+			login_auth_client(sd);
+			if( sd->auth_pending )
+				return 0;// the rest of the packets wait for the result
 		}
 		break;
 
@@ -1574,6 +1697,9 @@ void login_set_defaults()
 
 	login_config.client_hash_check = 0;
 	login_config.client_hash_nodes = NULL;
+
+	login_config.auth_workers = 4;
+	login_config.login_socket[0] = '\0';
 }
 
 //-----------------------------------
@@ -1646,6 +1772,10 @@ int login_config_read(const char* cfgName)
 			login_config.ipban_cleanup_interval = (unsigned int)atoi(w2);
 		else if(!strcmpi(w1, "ip_sync_interval"))
 			login_config.ip_sync_interval = (unsigned int)1000*60*atoi(w2); //w2 comes in minutes.
+		else if(!strcmpi(w1, "auth_workers"))
+			login_config.auth_workers = max(0, atoi(w2));
+		else if(!strcmpi(w1, "login_socket"))
+			safestrncpy(login_config.login_socket, w2, sizeof(login_config.login_socket));
 		else if(!strcmpi(w1, "client_hash_check"))
 			login_config.client_hash_check = config_switch(w2);
 		else if(!strcmpi(w1, "client_hash")) {
@@ -1710,6 +1840,9 @@ void do_final(void)
 
 	login_log(0, "login server", 100, "login server shutdown");
 
+	// finish the queued jobs while the connections are still open
+	loginworker_final();
+
 	if( login_config.log_login )
 		loginlog_final();
 
@@ -1826,6 +1959,10 @@ int do_init(int argc, char** argv)
 		}
 	}
 
+	// auth workers (password checks, ipban and loginlog queries)
+	if( !loginworker_init(login_config.auth_workers) )
+		ShowWarning("do_init: authentication workers unavailable, authenticating on the main thread.\n");
+
 	HPM->share(account_db_sql_up(accounts),"sql_handle");
 	HPM->config_read();
 	HPM->event(HPET_INIT);
@@ -1835,6 +1972,8 @@ int do_init(int argc, char** argv)
 		ShowFatalError("Failed to bind to port '"CL_WHITE"%d"CL_RESET"'\n",login_config.login_port);
 		exit(EXIT_FAILURE);
 	}
+	if( login_config.login_socket[0] != '\0' && make_listen_bind_unix(login_config.login_socket) == -1 )
+		ShowWarning("Failed to listen on '"CL_WHITE"%s"CL_RESET"', char-servers will have to connect through tcp.\n", login_config.login_socket);
 	
 	if( runflag != CORE_ST_STOP ) {
 		shutdown_callback = do_shutdown;
@@ -42,6 +42,8 @@ struct login_session_data {
 	int has_client_hash;
 
 	int fd;
+	unsigned int serial; // identifies the session in asynchronous jobs
+	bool auth_pending;   // a worker is checking this session, incoming packets wait
 };
 
 struct mmo_char_server {
@@ -87,6 +89,9 @@ struct Login_Config {
 
 	int client_hash_check;							// flags for checking client md5
 	struct client_hash_node *client_hash_nodes;		// linked list containg md5 hash for each gm group
+
+	int auth_workers;                               // threads running password checks and ipban/loginlog queries (0: main thread)
+	char login_socket[256];                         // unix domain socket co-located char-servers can connect to (empty: none)
 };
 
 #define sex_num2str(num) ( (num ==  SEX_FEMALE  ) ? 'F' : (num ==  SEX_MALE  ) ? 'M' : 'S' )
@@ -4,9 +4,13 @@
 #ifndef __LOGINLOG_H_INCLUDED__
 #define __LOGINLOG_H_INCLUDED__
 
+#include "../common/sql.h"
 
 unsigned long loginlog_failedattempts(uint32 ip, unsigned int minutes);
+unsigned long loginlog_failedattempts_sql(Sql* handle, uint32 ip, unsigned int minutes);
 void login_log(uint32 ip, const char* username, int rcode, const char* message);
+void login_log_sql(Sql* handle, uint32 ip, const char* username, int rcode, const char* message);
+Sql* loginlog_connect(void);
 bool loginlog_init(void);
 bool loginlog_final(void);
 bool loginlog_config_read(const char* w1, const char* w2);
@@ -3,10 +3,14 @@
 // Portions Copyright (c) Athena Dev Teams
 
 #include "../common/cbasetypes.h"
+#include "../common/malloc.h"
 #include "../common/mmo.h"
 #include "../common/socket.h"
 #include "../common/sql.h"
 #include "../common/strlib.h"
+#include "login.h"
+#include "loginlog.h"
+#include "loginworker.h"
 #include <string.h>
 #include <stdlib.h> // exit
 
@@ -30,53 +34,101 @@ static Sql* sql_handle = NULL;
 static bool enabled = false;
 
 
-// Returns the number of failed login attemps by the ip in the last minutes.
-unsigned long loginlog_failedattempts(uint32 ip, unsigned int minutes)
+// Returns the number of failed login attemps by the ip in the last minutes, using the given connection.
+unsigned long loginlog_failedattempts_sql(Sql* handle, uint32 ip, unsigned int minutes)
 {
 	unsigned long failures = 0;
+	char ip_str[16];
 
-	if( !enabled )
+	if( handle == NULL )
 		return 0;
 
-	if( SQL_ERROR == SQL->Query(sql_handle, "SELECT count(*) FROM `%s` WHERE `ip` = '%s' AND `rcode` = '1' AND `time` > NOW() - INTERVAL %d MINUTE",
-		log_login_db, ip2str(ip,NULL), minutes) )// how many times failed account? in one ip.
-		Sql_ShowDebug(sql_handle);
+	if( SQL_ERROR == SQL->Query(handle, "SELECT count(*) FROM `%s` WHERE `ip` = '%s' AND `rcode` = '1' AND `time` > NOW() - INTERVAL %d MINUTE",
+		log_login_db, ip2str(ip,ip_str), minutes) )// how many times failed account? in one ip.
+		Sql_ShowDebug(handle);
 
-	if( SQL_SUCCESS == SQL->NextRow(sql_handle) )
+	if( SQL_SUCCESS == SQL->NextRow(handle) )
 	{
 		char* data;
-		SQL->GetData(sql_handle, 0, &data, NULL);
+		SQL->GetData(handle, 0, &data, NULL);
 		failures = strtoul(data, NULL, 10);
-		SQL->FreeResult(sql_handle);
+		SQL->FreeResult(handle);
 	}
 	return failures;
 }
 
+// Returns the number of failed login attemps by the ip in the last minutes.
+unsigned long loginlog_failedattempts(uint32 ip, unsigned int minutes)
+{
+	if( !enabled )
+		return 0;
+
+	return loginlog_failedattempts_sql(sql_handle, ip, minutes);
+}
+
 
 /*=============================================
- * Records an event in the login log
+ * Records an event in the login log, using the given connection
  *---------------------------------------------*/
-void login_log(uint32 ip, const char* username, int rcode, const char* message)
+void login_log_sql(Sql* handle, uint32 ip, const char* username, int rcode, const char* message)
 {
 	char esc_username[NAME_LENGTH*2+1];
 	char esc_message[255*2+1];
+	char ip_str[16];
 	int retcode;
 
-	if( !enabled )
+	if( handle == NULL )
 		return;
 
-	SQL->EscapeStringLen(sql_handle, esc_username, username, strnlen(username, NAME_LENGTH));
-	SQL->EscapeStringLen(sql_handle, esc_message, message, strnlen(message, 255));
+	SQL->EscapeStringLen(handle, esc_username, username, strnlen(username, NAME_LENGTH));
+	SQL->EscapeStringLen(handle, esc_message, message, strnlen(message, 255));
 
-	retcode = SQL->Query(sql_handle,
+	retcode = SQL->Query(handle,
 		"INSERT INTO `%s`(`time`,`ip`,`user`,`rcode`,`log`) VALUES (NOW(), '%s', '%s', '%d', '%s')",
-		log_login_db, ip2str(ip,NULL), esc_username, rcode, esc_message);
+		log_login_db, ip2str(ip,ip_str), esc_username, rcode, esc_message);
 
 	if( retcode != SQL_SUCCESS )
-		Sql_ShowDebug(sql_handle);
+		Sql_ShowDebug(handle);
 }
 
-bool loginlog_init(void)
+struct login_log_entry {
+	uint32 ip;
+	char username[NAME_LENGTH];
+	int rcode;
+	char message[256];
+};
+
+static void login_log_job(struct loginworker_ctx* ctx, void* data)
+{
+	struct login_log_entry* entry = (struct login_log_entry*)data;
+	login_log_sql(ctx->log, entry->ip, entry->username, entry->rcode, entry->message);
+}
+
+/*=============================================
+ * Records an event in the login log
+ *---------------------------------------------*/
+void login_log(uint32 ip, const char* username, int rcode, const char* message)
+{
+	if( !enabled )
+		return;
+
+	if( loginworker_running() )
+	{// the insert is done by a worker
+		struct login_log_entry* entry;
+		CREATE(entry, struct login_log_entry, 1);
+		entry->ip = ip;
+		safestrncpy(entry->username, username, sizeof(entry->username));
+		entry->rcode = rcode;
+		safestrncpy(entry->message, message, sizeof(entry->message));
+		loginworker_submit(login_log_job, NULL, entry);
+		return;
+	}
+
+	login_log_sql(sql_handle, ip, username, rcode, message);
+}
+
+// Opens a connection to the log database (NULL if logging is disabled).
+Sql* loginlog_connect(void)
 {
 	const char* username;
 	const char* password;
@@ -84,6 +136,10 @@ bool loginlog_init(void)
 	uint16      port;
 	const char* database;
 	const char* codepage;
+	Sql* handle;
+
+	if( !login_config.log_login )
+		return NULL;
 
 	if( log_db_hostname[0] != '\0' )
 	{// local settings
@@ -104,19 +160,25 @@ bool loginlog_init(void)
 		codepage = global_codepage;
 	}
 
-	sql_handle = SQL->Malloc();
+	handle = SQL->Malloc();
 
-	if( SQL_ERROR == SQL->Connect(sql_handle, username, password, hostname, port, database) )
+	if( SQL_ERROR == SQL->Connect(handle, username, password, hostname, port, database) )
 	{
-		Sql_ShowDebug(sql_handle);
-		SQL->Free(sql_handle);
+		Sql_ShowDebug(handle);
+		SQL->Free(handle);
 		exit(EXIT_FAILURE);
 	}
 
-	if( codepage[0] != '\0' && SQL_ERROR == SQL->SetEncoding(sql_handle, codepage) )
-		Sql_ShowDebug(sql_handle);
+	if( codepage[0] != '\0' && SQL_ERROR == SQL->SetEncoding(handle, codepage) )
+		Sql_ShowDebug(handle);
 
-	enabled = true;
+	return handle;
+}
+
+bool loginlog_init(void)
+{
+	sql_handle = loginlog_connect();
+	enabled = ( sql_handle != NULL );
 
 	return true;
 }
@@ -0,0 +1,313 @@
+// Copyright (c) Hercules Dev Team, licensed under GNU GPL.
+// See the LICENSE file
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/mutex.h"
+#include "../common/showmsg.h"
+#include "../common/sql.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
+#include "login.h"
+#include "ipban.h"
+#include "loginlog.h"
+#include "loginworker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOGINWORKER_MAX 32
+// idle workers ping their connections at this interval (in seconds);
+// the main thread keepalive timer is stopped for them since it would race with the jobs
+#define LOGINWORKER_PING_INTERVAL 300
+
+struct loginworker_job {
+	LoginWorkerJob work;
+	LoginWorkerDone done;
+	void* data;
+	struct loginworker_job* next;
+};
+
+struct loginworker {
+	struct loginworker_ctx ctx;
+	rAthread thread;
+	time_t last_ping;
+};
+
+static struct loginworker workers[LOGINWORKER_MAX];
+static int worker_count = 0;
+static volatile bool workers_stop = false;
+
+// queues (guarded by queue_lock)
+static ramutex queue_lock = NULL;
+static racond queue_cond = NULL;
+static struct loginworker_job* pending_head = NULL;
+static struct loginworker_job* pending_tail = NULL;
+static struct loginworker_job* done_head = NULL;
+static struct loginworker_job* done_tail = NULL;
+
+// main thread only
+static int jobs_outstanding = 0;
+static int drain_tid = INVALID_TIMER;
+
+// the memory manager is not thread-safe; while the workers run every
+// allocation goes through a lock (calloc/realloc/strdup are built on these two)
+static ramutex malloc_lock = NULL;
+static void* (*malloc_orig)(size_t size, const char *file, int line, const char *func) = NULL;
+static void  (*free_orig)(void *p, const char *file, int line, const char *func) = NULL;
+
+int loginworker_drain(int tid, unsigned int tick, int id, intptr_t data);
+
+
+static void* loginworker_malloc(size_t size, const char *file, int line, const char *func)
+{
+	void* p;
+	ramutex_lock(malloc_lock);
+	p = malloc_orig(size, file, line, func);
+	ramutex_unlock(malloc_lock);
+	return p;
+}
+
+static void loginworker_free(void *p, const char *file, int line, const char *func)
+{
+	ramutex_lock(malloc_lock);
+	free_orig(p, file, line, func);
+	ramutex_unlock(malloc_lock);
+}
+
+/// Keeps the worker's connections alive while no jobs come in.
+static void loginworker_ping(struct loginworker* w)
+{
+	time_t now = time(NULL);
+
+	if( now - w->last_ping < LOGINWORKER_PING_INTERVAL )
+		return;
+	w->last_ping = now;
+	if( w->ctx.ipban )
+		SQL->Ping(w->ctx.ipban);
+	if( w->ctx.log )
+		SQL->Ping(w->ctx.log);
+}
+
+/// Worker thread entry point.
+static void* loginworker_main(void* param)
+{
+	struct loginworker* w = (struct loginworker*)param;
+
+	ramutex_lock(queue_lock);
+	while( true )
+	{
+		struct loginworker_job* job;
+
+		if( pending_head == NULL )
+		{
+			if( workers_stop )
+				break;// queue drained
+			racond_wait(queue_cond, queue_lock, LOGINWORKER_PING_INTERVAL*1000);
+			if( pending_head == NULL )
+			{
+				ramutex_unlock(queue_lock);
+				loginworker_ping(w);
+				ramutex_lock(queue_lock);
+			}
+			continue;
+		}
+
+		job = pending_head;
+		pending_head = job->next;
+		if( pending_head == NULL )
+			pending_tail = NULL;
+		ramutex_unlock(queue_lock);
+
+		job->work(&w->ctx, job->data);
+		w->last_ping = time(NULL);
+
+		ramutex_lock(queue_lock);
+		job->next = NULL;
+		if( done_tail )
+			done_tail->next = job;
+		else
+			done_head = job;
+		done_tail = job;
+	}
+	ramutex_unlock(queue_lock);
+
+	return NULL;
+}
+
+/// Runs the completion callbacks of finished jobs.
+/// @return number of jobs completed
+static int loginworker_complete(void)
+{
+	struct loginworker_job* job;
+	int n = 0;
+
+	ramutex_lock(queue_lock);
+	job = done_head;
+	done_head = done_tail = NULL;
+	ramutex_unlock(queue_lock);
+
+	while( job )
+	{
+		struct loginworker_job* next = job->next;
+		if( job->done )
+			job->done(job->data);
+		else
+			aFree(job->data);
+		aFree(job);
+		job = next;
+		++n;
+	}
+
+	jobs_outstanding -= n;
+	return n;
+}
+
+/// Timer that hands finished jobs back to the main thread.
+/// Re-armed for as long as jobs are outstanding.
+int loginworker_drain(int tid, unsigned int tick, int id, intptr_t data)
+{
+	drain_tid = INVALID_TIMER;
+	loginworker_complete();
+	if( jobs_outstanding > 0 )
+		drain_tid = timer->add(timer->gettick()+1, loginworker_drain, 0, 0);
+	return 0;
+}
+
+bool loginworker_running(void)
+{
+	return ( worker_count > 0 );
+}
+
+void loginworker_submit(LoginWorkerJob work, LoginWorkerDone done, void* data)
+{
+	struct loginworker_job* job;
+
+	if( worker_count == 0 )
+	{// callers are expected to check loginworker_running()
+		ShowError("loginworker_submit: worker pool is not running, dropping job.\n");
+		if( done )
+			done(data);
+		else
+			aFree(data);
+		return;
+	}
+
+	CREATE(job, struct loginworker_job, 1);
+	job->work = work;
+	job->done = done;
+	job->data = data;
+
+	ramutex_lock(queue_lock);
+	if( pending_tail )
+		pending_tail->next = job;
+	else
+		pending_head = job;
+	pending_tail = job;
+	racond_signal(queue_cond);
+	ramutex_unlock(queue_lock);
+
+	++jobs_outstanding;
+	if( drain_tid == INVALID_TIMER )
+		drain_tid = timer->add(timer->gettick()+1, loginworker_drain, 0, 0);
+}
+
+bool loginworker_init(int count)
+{
+	int i;
+
+	if( count <= 0 )
+		return true;// inline mode
+	if( count > LOGINWORKER_MAX )
+	{
+		ShowWarning("loginworker_init: %d workers requested, using %d.\n", count, LOGINWORKER_MAX);
+		count = LOGINWORKER_MAX;
+	}
+
+	timer->add_func_list(loginworker_drain, "loginworker_drain");
+
+	malloc_lock = ramutex_create();
+	queue_lock = ramutex_create();
+	queue_cond = racond_create();
+	malloc_orig = iMalloc->malloc;
+	free_orig = iMalloc->free;
+	iMalloc->malloc = loginworker_malloc;
+	iMalloc->free = loginworker_free;
+	workers_stop = false;
+
+	for( i = 0; i < count; ++i )
+	{
+		struct loginworker* w = &workers[i];
+
+		// connections are opened here since Sql_Connect registers a timer
+		w->ctx.id = i;
+		w->ctx.ipban = ipban_connect();
+		w->ctx.log = loginlog_connect();
+		if( w->ctx.ipban )
+			SQL->StopKeepalive(w->ctx.ipban);
+		if( w->ctx.log )
+			SQL->StopKeepalive(w->ctx.log);
+		w->last_ping = time(NULL);
+
+		w->thread = rathread_create(loginworker_main, w);
+		if( w->thread == NULL )
+		{
+			ShowError("loginworker_init: failed to start worker #%d.\n", i);
+			if( w->ctx.ipban )
+				SQL->Free(w->ctx.ipban);
+			if( w->ctx.log )
+				SQL->Free(w->ctx.log);
+			break;
+		}
+		worker_count = i + 1;
+	}
+
+	if( worker_count == 0 )
+	{
+		loginworker_final();
+		return false;
+	}
+
+	ShowStatus("Started "CL_WHITE"%d"CL_RESET" authentication worker(s).\n", worker_count);
+	return true;
+}
+
+void loginworker_final(void)
+{
+	int i;
+
+	if( queue_lock == NULL )
+		return;// not started
+
+	ramutex_lock(queue_lock);
+	workers_stop = true;
+	racond_broadcast(queue_cond);
+	ramutex_unlock(queue_lock);
+
+	for( i = 0; i < worker_count; ++i )
+	{
+		rathread_wait(workers[i].thread, NULL);
+		if( workers[i].ctx.ipban )
+			SQL->Free(workers[i].ctx.ipban);
+		if( workers[i].ctx.log )
+			SQL->Free(workers[i].ctx.log);
+		memset(&workers[i], 0, sizeof(workers[i]));
+	}
+	worker_count = 0;
+
+	if( drain_tid != INVALID_TIMER )
+	{
+		timer->delete(drain_tid, loginworker_drain);
+		drain_tid = INVALID_TIMER;
+	}
+	loginworker_complete();
+
+	iMalloc->malloc = malloc_orig;
+	iMalloc->free = free_orig;
+	racond_destroy(queue_cond);
+	ramutex_destroy(queue_lock);
+	ramutex_destroy(malloc_lock);
+	queue_cond = NULL;
+	queue_lock = NULL;
+	malloc_lock = NULL;
+}
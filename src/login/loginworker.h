@@ -0,0 +1,36 @@
+// Copyright (c) Hercules Dev Team, licensed under GNU GPL.
+// See the LICENSE file
+
+#ifndef __LOGINWORKER_H_INCLUDED__
+#define __LOGINWORKER_H_INCLUDED__
+
+#include "../common/cbasetypes.h"
+#include "../common/sql.h"
+
+/// State owned by a single worker thread, handed to every job it runs.
+struct loginworker_ctx {
+	int id;
+	Sql* ipban; // connection to the ipban database (NULL when ipban is disabled)
+	Sql* log;   // connection to the loginlog database (NULL when logging is disabled)
+};
+
+/// Runs on a worker thread; must not touch sessions, timers or the account engine.
+typedef void (*LoginWorkerJob)(struct loginworker_ctx* ctx, void* data);
+/// Runs on the main thread once the job is done; responsible for freeing data.
+/// When NULL, data is released with aFree.
+typedef void (*LoginWorkerDone)(void* data);
+
+// starts count worker threads (0 keeps everything on the main thread)
+bool loginworker_init(int count);
+
+// waits for the queued jobs, then stops the workers
+void loginworker_final(void);
+
+// whether jobs are run by the worker threads
+bool loginworker_running(void);
+
+// queues a job; data must be allocated with aMalloc
+void loginworker_submit(LoginWorkerJob job, LoginWorkerDone done, void* data);
+
+
+#endif // __LOGINWORKER_H_INCLUDED__
@@ -3450,7 +3450,9 @@ ACMD(partyrecall)
  *------------------------------------------*/
 ACMD(reloaditemdb)
 {
+	map->phase_begin("@reloaditemdb");
 	itemdb->reload();
+	map->phase_end();
 	clif->message(fd, msg_txt(97)); // Item database has been reloaded.
 	
 	return true;
@@ -3460,12 +3462,14 @@ ACMD(reloaditemdb)
  *
  *------------------------------------------*/
 ACMD(reloadmobdb) {
+	map->phase_begin("@reloadmobdb");
 	mob->reload();
 	pet->read_db();
 	homun->reload();
 	mercenary->read_db();
 	mercenary->read_skilldb();
 	elemental->reload_db();
+	map->phase_end();
 	clif->message(fd, msg_txt(98)); // Monster database has been reloaded.
 	
 	return true;
@@ -3607,9 +3611,17 @@ ACMD(reloadscript) {
 	mapit->free(iter);
 	
 	flush_fifos();
+	map->phase_begin("@reloadscript");
+	map->phase_begin("npc file list");
 	map->reloadnpc(true); // reload config files seeking for npcs
+	map->phase_end();
+	map->phase_begin("script engine");
 	script->reload();
+	map->phase_end();
+	map->phase_begin("npcs");
 	npc->reload();
+	map->phase_end();
+	map->phase_end();
 	
 	clif->message(fd, msg_txt(100)); // Scripts have been reloaded.
 	
@@ -86,6 +86,11 @@ struct chrif_interface chrif_s;
 //2b25: Incoming, chrif_deadopt -> 'Removes baby from Father ID and Mother ID'
 //2b26: Outgoing, chrif_authreq -> 'client authentication request'
 //2b27: Incoming, chrif_authfail -> 'client authentication failed'
+//2b28: Outgoing, chrif_save_status -> 'charsave of char XY account XY (changed parts of the struct)'
+//2b29: Incoming, chrif_save_resend -> 'a 2b28 could not be applied, send the complete struct'
+//2b2a: Incoming, chrif_save_protocol -> 'char-server supports 2b28 of version XY'
+//2b2b: Incoming/Outgoing, chrif_zip_protocol -> 'sender can expand 2b2c, will compress packets from XY bytes on'
+//2b2c: Incoming/Outgoing, socket_unzip -> 'compressed packets'
 
 //This define should spare writing the check in every function. [Skotlex]
 #define chrif_check(a) { if(!chrif->isconnected()) return a; }
@@ -272,14 +277,9 @@ int chrif_save(struct map_session_data *sd, int flag) {
 	if (sd->state.reg_dirty&1)
 		intif->saveregistry(sd, 1); //Save account2 regs
 
-	WFIFOHEAD(chrif->fd, sizeof(sd->status) + 13);
-	WFIFOW(chrif->fd,0) = 0x2b01;
-	WFIFOW(chrif->fd,2) = sizeof(sd->status) + 13;
-	WFIFOL(chrif->fd,4) = sd->status.account_id;
-	WFIFOL(chrif->fd,8) = sd->status.char_id;
-	WFIFOB(chrif->fd,12) = (flag==1)?1:0; //Flag to tell char-server this character is quitting.
-	memcpy(WFIFOP(chrif->fd,13), &sd->status, sizeof(sd->status));
-	WFIFOSET(chrif->fd, WFIFOW(chrif->fd,2));
+	chrif->save_status(sd, (flag==1)?1:0); //Flag to tell char-server this character is quitting.
+	sd->autosave.tick = timer->gettick(); // saved, pc_autosave starts counting again
+	sd->autosave.dirty = 0;
 
 	if( sd->status.pet_id > 0 && sd->pd )
 		intif->save_petdata(sd->status.account_id,&sd->pd->pet);
@@ -295,6 +295,167 @@ int chrif_save(struct map_session_data *sd, int flag) {
 	return 0;
 }
 
+/// Parts of struct mmo_charstatus compared by chrif_save_status.
+/// Sections of several elements are compared (and sent) element by element.
+static const struct {
+	size_t offset; // offset in struct mmo_charstatus
+	size_t size;   // size of an element
+	int count;     // number of elements
+} chrif_save_sections[] = {
+	{ 0, offsetof(struct mmo_charstatus, inventory), 1 }, // status
+	{ offsetof(struct mmo_charstatus, inventory), sizeof(struct item), MAX_INVENTORY },
+	{ offsetof(struct mmo_charstatus, cart), sizeof(struct item), MAX_CART },
+	{ offsetof(struct mmo_charstatus, storage), offsetof(struct storage_data, items), 1 },
+	{ offsetof(struct mmo_charstatus, storage.items), sizeof(struct item), MAX_STORAGE },
+	{ offsetof(struct mmo_charstatus, skill), sizeof(struct s_skill), MAX_SKILL },
+	{ offsetof(struct mmo_charstatus, friends), sizeof(struct s_friend) * MAX_FRIENDS, 1 },
+#ifdef HOTKEY_SAVING
+	{ offsetof(struct mmo_charstatus, hotkeys), sizeof(struct hotkey) * MAX_HOTKEYS, 1 },
+#endif
+	{ offsetof(struct mmo_charstatus, show_equip), sizeof(struct mmo_charstatus) - offsetof(struct mmo_charstatus, show_equip), 1 }, // status
+};
+
+/*==========================================
+ * Sends the character data to the char-server.
+ * If the char-server supports it, only the parts that changed since the
+ * last save are sent (2b28), else the complete struct (2b01).
+ * Flag = 1: Character is quitting
+ *------------------------------------------*/
+void chrif_save_status(struct map_session_data *sd, int flag) {
+	const unsigned char *cur, *base;
+	int fd = chrif->fd, len, max_len, i, j, k;
+
+	nullpo_retv(sd);
+	cur = (const unsigned char *)&sd->status;
+
+	if (chrif->save_version != CHARSAVE_DELTA_VERSION) {
+		WFIFOHEAD(fd, sizeof(sd->status) + 13);
+		WFIFOW(fd,0) = 0x2b01;
+		WFIFOW(fd,2) = sizeof(sd->status) + 13;
+		WFIFOL(fd,4) = sd->status.account_id;
+		WFIFOL(fd,8) = sd->status.char_id;
+		WFIFOB(fd,12) = flag;
+		memcpy(WFIFOP(fd,13), &sd->status, sizeof(sd->status));
+		WFIFOSET(fd, WFIFOW(fd,2));
+		return;
+	}
+
+	if (sd->save_base != NULL && sd->save_epoch != chrif->save_epoch) {
+		// char-server reconnected, what it knows is unknown
+		aFree(sd->save_base);
+		sd->save_base = NULL;
+	}
+
+	// A delta is never larger than the complete struct as a single part
+	max_len = 21 + 6 + sizeof(sd->status);
+	WFIFOHEAD(fd, max_len);
+	WFIFOW(fd,0) = 0x2b28;
+	WFIFOL(fd,4) = sd->status.account_id;
+	WFIFOL(fd,8) = sd->status.char_id;
+	WFIFOB(fd,12) = flag;
+	len = 21;
+
+	if ((base = (const unsigned char *)sd->save_base) != NULL) {
+		for (i = 0; i < ARRAYLENGTH(chrif_save_sections) && len >= 0; i++) {
+			size_t offset = chrif_save_sections[i].offset, size = chrif_save_sections[i].size;
+			int count = chrif_save_sections[i].count;
+
+			for (j = 0; j < count; j = k) {
+				size_t run;
+				if (memcmp(base + offset + j*size, cur + offset + j*size, size) == 0) {
+					k = j + 1;
+					continue;
+				}
+				// send consecutive changed elements as one part
+				for (k = j + 1; k < count && memcmp(base + offset + k*size, cur + offset + k*size, size) != 0; k++);
+				run = (k - j) * size;
+				if (len + 6 + (int)run >= max_len) {
+					len = -1; // not worth it, send everything
+					break;
+				}
+				WFIFOL(fd,len) = (uint32)(offset + j*size);
+				WFIFOW(fd,len+4) = (uint16)run;
+				memcpy(WFIFOP(fd,len+6), cur + offset + j*size, run);
+				len += 6 + run;
+			}
+		}
+		if (len == 21 && !flag)
+			return; // nothing changed, nothing to save
+	}
+
+	if (base == NULL || len < 0) {
+		len = 21;
+		WFIFOL(fd,len) = 0;
+		WFIFOW(fd,len+4) = (uint16)sizeof(sd->status);
+		memcpy(WFIFOP(fd,len+6), cur, sizeof(sd->status));
+		len += 6 + sizeof(sd->status);
+		if (sd->save_base == NULL)
+			CREATE(sd->save_base, struct mmo_charstatus, 1);
+		sd->save_epoch = chrif->save_epoch;
+		WFIFOL(fd,17) = 0; // no base, complete struct
+	} else {
+		WFIFOL(fd,17) = sd->save_seq;
+	}
+
+	if (++sd->save_seq == 0)
+		sd->save_seq = 1;
+	WFIFOW(fd,2) = len;
+	WFIFOL(fd,13) = sd->save_seq;
+	WFIFOSET(fd, len);
+
+	memcpy(sd->save_base, &sd->status, sizeof(sd->status));
+}
+
+/// The char-server could not apply a 2b28, send the complete struct instead.
+void chrif_save_resend(int fd) {
+	int account_id = RFIFOL(fd,2), char_id = RFIFOL(fd,6);
+	struct auth_node *node = chrif->search(account_id);
+	struct map_session_data *sd;
+
+	if (node && node->char_id == char_id && node->sd)
+		sd = node->sd; // quitting or changing map-servers
+	else
+		sd = map->charid2sd(char_id);
+
+	if (sd == NULL || sd->status.account_id != account_id) {
+		ShowError("chrif_save_resend: Character %d:%d is gone, its last changes are lost.\n", account_id, char_id);
+		return;
+	}
+
+	if (sd->save_base) {
+		aFree(sd->save_base);
+		sd->save_base = NULL;
+	}
+	chrif->save_status(sd, RFIFOB(fd,10));
+}
+
+/// The char-server tells which delta save version it supports.
+void chrif_save_protocol(int fd) {
+	int version = RFIFOW(fd,2);
+
+	chrif->save_version = (version == CHARSAVE_DELTA_VERSION) ? version : 0;
+	chrif->save_epoch++;
+	if (version != CHARSAVE_DELTA_VERSION)
+		ShowWarning("chrif_save_protocol: char-server delta save version %d is not supported (expected %d), saving complete characters.\n", version, CHARSAVE_DELTA_VERSION);
+}
+
+/// The char-server can expand compressed packets (2b2b), tell it we can too
+/// and compress our own packets from the configured size on.
+void chrif_zip_protocol(int fd) {
+	int threshold = RFIFOL(fd,2);
+
+	if (chrif->zip_threshold > 0)
+		socket_zip(fd, chrif->zip_threshold);
+
+	WFIFOHEAD(fd,6);
+	WFIFOW(fd,0) = 0x2b2b;
+	WFIFOL(fd,2) = chrif->zip_threshold;
+	WFIFOSET(fd,6);
+
+	ShowStatus("Compressing char-server link: packets to the char-server from %d bytes on (%s), from the char-server from %d bytes on (%s).\n",
+		chrif->zip_threshold, chrif->zip_threshold > 0 ? "on" : "off", threshold, threshold > 0 ? "on" : "off");
+}
+
 // connects to char-server (plaintext)
 int chrif_connect(int fd) {
 	ShowStatus("Logging in to char server...\n", chrif->fd);
@@ -1139,10 +1300,9 @@ int chrif_save_scdata(struct map_session_data *sd) { //parses the sc_data of the
 
 #ifdef ENABLE_SC_SAVING
 	int i, count=0;
-	unsigned int tick;
+	unsigned int tick, due;
 	struct status_change_data data;
 	struct status_change *sc = &sd->sc;
-	const struct TimerData *td;
 
 	chrif_check(-1);
 	tick = timer->gettick();
@@ -1156,10 +1316,9 @@ int chrif_save_scdata(struct map_session_data *sd) { //parses the sc_data of the
 		if (!sc->data[i])
 			continue;
 		if (sc->data[i]->timer != INVALID_TIMER) {
-			td = timer->get(sc->data[i]->timer);
-			if (td == NULL || td->func != status->change_timer || DIFF_TICK(td->tick,tick) < 0)
+			if (!status->change_timer_gettick(sc->data[i], &due) || DIFF_TICK(due,tick) < 0)
 				continue;
-			data.tick = DIFF_TICK(td->tick,tick); //Duration that is left before ending.
+			data.tick = DIFF_TICK(due,tick); //Duration that is left before ending.
 		} else
 			data.tick = -1; //Infinite duration
 		data.type = i;
@@ -1379,6 +1538,8 @@ int chrif_parse(int fd) {
 	}
 
 	if ( session[fd]->flag.eof ) {
+		if ( session[fd]->zip )
+			socket_zip_report(fd, "char-server link");
 		do_close(fd);
 		chrif->fd = -1;
 		chrif->on_disconnect();
@@ -1450,6 +1611,15 @@ int chrif_parse(int fd) {
 			case 0x2b24: chrif->keepalive_ack(fd); break;
 			case 0x2b25: chrif->deadopt(RFIFOL(fd,2), RFIFOL(fd,6), RFIFOL(fd,10)); break;
 			case 0x2b27: chrif->authfail(fd); break;
+			case 0x2b29: chrif->save_resend(fd); break;
+			case 0x2b2a: chrif->save_protocol(fd); break;
+			case 0x2b2b: chrif->zip_protocol(fd); break;
+			case 0x2b2c: // compressed packets, parse what they expand to
+				if ( !socket_unzip(fd) ) {
+					set_eof(fd);
+					return 0;
+				}
+				continue;
 			default:
 				ShowError("chrif_parse : unknown packet (session #%d): 0x%x. Disconnecting.\n", fd, cmd);
 				set_eof(fd);
@@ -1518,8 +1688,14 @@ int check_connect_char_server(int tid, unsigned int tick, int id, intptr_t data)
 		}
 
 		chrif->state = 0;
+		chrif->save_version = 0; // until the char-server announces it again
 		
-		if ( ( chrif->fd = make_connection(chrif->ip, chrif->port,NULL) ) == -1) //Attempt to connect later. [Skotlex]
+		chrif->fd = -1;
+		if( chrif->socket_path[0] != '\0' && (chrif->fd = make_connection_unix(chrif->socket_path, NULL)) == -1 )
+			ShowWarning("Could not connect to the char-server through '"CL_WHITE"%s"CL_RESET"', trying tcp.\n", chrif->socket_path);
+		if( chrif->fd == -1 ) // no socket path, or unix sockets unavailable
+			chrif->fd = make_connection(chrif->ip, chrif->port, NULL);
+		if ( chrif->fd == -1) //Attempt to connect later. [Skotlex]
 			return 0;
 
 		session[chrif->fd]->func_parse = chrif->parse;
@@ -1644,6 +1820,7 @@ void chrif_defaults(void) {
 		11,10,10, 0,11, 0,266,10,	// 2b10-2b17: U->2b10, U->2b11, U->2b12, F->2b13, U->2b14, F->2b15, U->2b16, U->2b17
 		2,10, 2,-1,-1,-1, 2, 7,		// 2b18-2b1f: U->2b18, U->2b19, U->2b1a, U->2b1b, U->2b1c, U->2b1d, U->2b1e, U->2b1f
 		-1,10, 8, 2, 2,14,19,19,	// 2b20-2b27: U->2b20, U->2b21, U->2b22, U->2b23, U->2b24, U->2b25, U->2b26, U->2b27
+		-1,11, 4, 6,-1,				// 2b28-2b2c: U->2b28, U->2b29, U->2b2a, U->2b2b, U->2b2c
 	};
 
 	chrif = &chrif_s;
@@ -1658,9 +1835,13 @@ void chrif_defaults(void) {
 	memset(chrif->ip_str,0,sizeof(chrif->ip_str));
 	chrif->ip = 0;
 	chrif->port = 6121;
+	memset(chrif->socket_path,0,sizeof(chrif->socket_path));
 	memset(chrif->userid,0,sizeof(chrif->userid));
 	memset(chrif->passwd,0,sizeof(chrif->passwd));
 	chrif->state = 0;
+	chrif->save_version = 0;
+	chrif->save_epoch = 0;
+	chrif->zip_threshold = 1024;
 	
 	/* */
 	chrif->auth_db = NULL;
@@ -1688,6 +1869,10 @@ void chrif_defaults(void) {
 	chrif->authok = chrif_authok;
 	chrif->scdata_request = chrif_scdata_request;
 	chrif->save = chrif_save;
+	chrif->save_status = chrif_save_status;
+	chrif->save_resend = chrif_save_resend;
+	chrif->save_protocol = chrif_save_protocol;
+	chrif->zip_protocol = chrif_zip_protocol;
 	chrif->charselectreq = chrif_charselectreq;
 	chrif->changemapserver = chrif_changemapserver;
 	
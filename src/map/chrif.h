@@ -59,8 +59,12 @@ struct chrif_interface {
 	char ip_str[128];
 	uint32 ip;
 	uint16 port;
+	char socket_path[256]; // unix domain socket of a co-located char-server (empty: tcp)
 	char userid[NAME_LENGTH], passwd[NAME_LENGTH];
 	int state;
+	int save_version; // delta save protocol version announced by the char-server, 0 = full saves only
+	unsigned int save_epoch; // bumped on every announcement, older save_base copies are void
+	int zip_threshold; // compress packets to the char-server of at least this size once it supports it (0: never)
 	/* */
 	int (*final) (void);
 	int (*init) (void);
@@ -83,6 +87,10 @@ struct chrif_interface {
 	void (*authok) (int fd);
 	int (*scdata_request) (int account_id, int char_id);
 	int (*save) (struct map_session_data* sd, int flag);
+	void (*save_status) (struct map_session_data *sd, int flag);
+	void (*save_resend) (int fd);
+	void (*save_protocol) (int fd);
+	void (*zip_protocol) (int fd);
 	int (*charselectreq) (struct map_session_data* sd, uint32 s_ip);
 	int (*changemapserver) (struct map_session_data* sd, uint32 ip, uint16 port);
 	
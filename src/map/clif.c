@@ -13679,6 +13679,7 @@ void clif_parse_GMChangeMapType(int fd, struct map_session_data *sd) {
 	type = RFIFOW(fd,6);
 
 	map->setgatcell(sd->bl.m,x,y,type);
+	map->list[sd->bl.m].cell_custom = true;
 	clif->changemapcell(0,sd->bl.m,x,y,type,ALL_SAMEMAP);
 	//FIXME: once players leave the map, the client 'forgets' this information.
 }
@@ -181,6 +181,8 @@ int instance_add_map(const char *name, int instance_id, bool usebasename, const
 		map->cellfromcache(&map->list[m]);
 
 	memcpy( &map->list[im], &map->list[m], sizeof(struct map_data) ); // Copy source map
+	map->list[im].path_cache = NULL;
+	map->list[im].cellbits = NULL;
 	if( map_name != NULL ) {
 		snprintf(map->list[im].name, MAP_NAME_LENGTH, "%s", map_name);
 		map->list[im].custom_name = true;
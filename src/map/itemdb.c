@@ -1829,6 +1829,103 @@ int itemdb_readdb(void) {
 
 	return 0;
 }
+/*==========================================
+ * [Hercules] Database snapshot, see map_snapshot_open.
+ * Each item is stored as its struct item_data followed by the scripts it has
+ * (script, equip_script, unequip_script), those of itemdb->array first, then
+ * those of itemdb->other. Combos, groups and packages are not stored, they
+ * are read after the items as usual.
+ *------------------------------------------*/
+static void itemdb_write_snapshot_sub(FILE *fp, struct item_data *id) {
+	hwrite(id, sizeof(struct item_data), 1, fp);
+	if( id->script )
+		script->write_code(fp, id->script);
+	if( id->equip_script )
+		script->write_code(fp, id->equip_script);
+	if( id->unequip_script )
+		script->write_code(fp, id->unequip_script);
+}
+int itemdb_write_snapshot(FILE *fp) {
+	DBIterator *iter;
+	struct item_data *id;
+	int i, count = 0;
+
+	for( i = 0; i < ARRAYLENGTH(itemdb->array); i++ ) {
+		id = itemdb->array[i];
+		if( id == NULL || id == &itemdb->dummy )
+			continue;
+		itemdb_write_snapshot_sub(fp, id);
+		count++;
+	}
+
+	iter = db_iterator(itemdb->other);
+	for( id = dbi_first(iter); dbi_exists(iter); id = dbi_next(iter) ) {
+		if( id == &itemdb->dummy )
+			continue;
+		itemdb_write_snapshot_sub(fp, id);
+		count++;
+	}
+	dbi_destroy(iter);
+
+	return count;
+}
+bool itemdb_read_snapshot(void) {
+	const unsigned char *p, *end;
+	uint32 count, size, i;
+
+	if( (p = map->snapshot_section(DBS_ITEM, &count, &size)) == NULL )
+		return false;
+	end = p + size;
+
+	for( i = 0; i < count; i++ ) {
+		struct item_data entry, *id;
+
+		if( end - p < sizeof(entry) )
+			break;
+		memcpy(&entry, p, sizeof(entry));
+		p += sizeof(entry);
+		if( entry.nameid <= 0 )
+			break;
+		if( entry.nameid < ARRAYLENGTH(itemdb->array) ) {
+			if( itemdb->array[entry.nameid] )
+				break;
+			id = itemdb->array[entry.nameid] = itemdb->create_item_data(entry.nameid);
+		} else {
+			if( idb_exists(itemdb->other, entry.nameid) )
+				break;
+			id = itemdb->create_item_data(entry.nameid);
+			idb_put(itemdb->other, entry.nameid, id);
+		}
+
+		memcpy(id, &entry, sizeof(struct item_data));
+		id->script = id->equip_script = id->unequip_script = NULL;
+		id->combos = NULL;
+		id->combos_count = 0;
+		id->group = NULL;
+		id->package = NULL;
+		if( (entry.script && (id->script = script->read_code(&p, end)) == NULL)
+		 || (entry.equip_script && (id->equip_script = script->read_code(&p, end)) == NULL)
+		 || (entry.unequip_script && (id->unequip_script = script->read_code(&p, end)) == NULL) )
+			break; // a script did not fit
+	}
+
+	if( i < count || p != end ) {
+		ShowError("itemdb_read_snapshot: The item section of the database snapshot is corrupted, reading the item db.\n");
+		for( i = 0; i < ARRAYLENGTH(itemdb->array); i++ ) {
+			if( itemdb->array[i] ) {
+				itemdb->destroy_item_data(itemdb->array[i], 1);
+				itemdb->array[i] = NULL;
+			}
+		}
+		itemdb->other->clear(itemdb->other, itemdb->final_sub);
+		map->snapshot_save = true;
+		return false;
+	}
+
+	ShowStatus("Done reading '"CL_WHITE"%u"CL_RESET"' entries in '"CL_WHITE"%s"CL_RESET"' ("CL_GREEN"C"CL_RESET").\n", count, DBPATH"item_db.txt");
+	return true;
+}
+
 /*======================================
  * item_db table reading
  *======================================*/
@@ -1928,9 +2025,10 @@ void itemdb_read(void) {
 	int i;
 	DBData prev;
 	
+	map->phase_begin("item_db");
 	if (map->db_use_sql_item_db)
 		itemdb->read_sqldb();
-	else
+	else if( !itemdb->read_snapshot() )
 		itemdb->readdb();
 	
 	for( i = 0; i < ARRAYLENGTH(itemdb->array); ++i ) {
@@ -1941,18 +2039,24 @@ void itemdb_read(void) {
 			}
 		}
 	}
+	map->phase_count(db_size(itemdb->names) + db_size(itemdb->other));
+	map->phase_end();
 	
+	map->phase_begin("item combos, groups, chains, packages");
 	itemdb->read_combos();
 	itemdb->read_groups();
 	itemdb->read_chains();
 	itemdb->read_packages();
+	map->phase_end();
 	
+	map->phase_begin("item txt databases");
 	sv->readdb(map->db_path, "item_avail.txt",             ',', 2, 2, -1, itemdb->read_itemavail);
 	sv->readdb(map->db_path, DBPATH"item_trade.txt",       ',', 3, 3, -1, itemdb->read_itemtrade);
 	sv->readdb(map->db_path, DBPATH"item_delay.txt",             ',', 2, 2, -1, itemdb->read_itemdelay);
 	sv->readdb(map->db_path, "item_stack.txt",             ',', 3, 3, -1, itemdb->read_stack);
 	sv->readdb(map->db_path, DBPATH"item_buyingstore.txt", ',', 1, 1, -1, itemdb->read_buyingstore);
 	sv->readdb(map->db_path, "item_nouse.txt",             ',', 3, 3, -1, itemdb->read_nouse);
+	map->phase_end();
 	
 	itemdb->uid_load();
 }
@@ -2209,6 +2313,8 @@ void itemdb_defaults(void) {
 	/* */
 	itemdb->write_cached_packages = itemdb_write_cached_packages;
 	itemdb->read_cached_packages = itemdb_read_cached_packages;
+	itemdb->write_snapshot = itemdb_write_snapshot;
+	itemdb->read_snapshot = itemdb_read_snapshot;
 	/* */
 	itemdb->name2id = itemdb_name2id;
 	itemdb->search_name = itemdb_searchname;
@@ -285,6 +285,8 @@ struct itemdb_interface {
 	/* */
 	void (*write_cached_packages) (const char *config_filename);
 	bool (*read_cached_packages) (const char *config_filename);
+	int (*write_snapshot) (FILE *fp);
+	bool (*read_snapshot) (void);
 	/* */
 	struct item_data* (*name2id) (const char *str);
 	struct item_data* (*search_name) (const char *name);
@@ -17,6 +17,8 @@
 #include "../common/conf.h"
 #include "../common/console.h"
 #include "../common/HPM.h"
+#include "../common/mutex.h"
+#include "../common/thread.h"
 
 #include "map.h"
 #include "path.h"
@@ -58,6 +60,11 @@
 #include <string.h>
 #include <stdarg.h>
 #include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #ifndef _WIN32
 #include <unistd.h>
 #endif
@@ -154,6 +161,8 @@ void map_addblcell(struct block_list *bl) {
 	              || bl->y < 0 || bl->y >= map->list[bl->m].ys
 	              || !(bl->type&BL_CHAR) )
 		return;
+	if( map->list[bl->m].cell == (struct mapcell *)0xdeadbeaf )
+		map->cellfromcache(&map->list[bl->m]);
 	map->list[bl->m].cell[bl->x+bl->y*map->list[bl->m].xs].cell_bl++;
 #else
 	return;
@@ -199,6 +208,9 @@ int map_addblock(struct block_list* bl)
 		return 1;
 	}
 
+	if( map->list[m].block == NULL ) // released while the map was idle
+		map->blockgrid_alloc(&map->list[m]);
+
 	pos = x/BLOCK_SIZE+(y/BLOCK_SIZE)*map->list[m].bxs;
 
 	if (bl->type == BL_MOB) {
@@ -379,7 +391,7 @@ int map_count_oncell(int16 m, int16 x, int16 y, int type) {
 	struct block_list *bl;
 	int count = 0;
 
-	if (x < 0 || y < 0 || (x >= map->list[m].xs) || (y >= map->list[m].ys))
+	if (x < 0 || y < 0 || (x >= map->list[m].xs) || (y >= map->list[m].ys) || map->list[m].block == NULL)
 		return 0;
 
 	bx = x/BLOCK_SIZE;
@@ -407,7 +419,7 @@ struct skill_unit* map_find_skill_unit_oncell(struct block_list* target,int16 x,
 	struct skill_unit *su;
 	m = target->m;
 
-	if (x < 0 || y < 0 || (x >= map->list[m].xs) || (y >= map->list[m].ys))
+	if (x < 0 || y < 0 || (x >= map->list[m].xs) || (y >= map->list[m].ys) || map->list[m].block == NULL)
 		return NULL;
 
 	bx = x/BLOCK_SIZE;
@@ -477,7 +489,7 @@ static int map_vforeachinmap(int (*func)(struct block_list*, va_list), int16 m,
 	struct block_list *bl;
 	int blockcount = map->bl_list_count;
 
-	if (m < 0)
+	if (m < 0 || map->list[m].block == NULL)
 		return 0;
 
 	bsize = map->list[m].bxs * map->list[m].bys;
@@ -592,7 +604,7 @@ static int bl_getall_area(int type, int m, int x0, int y0, int x1, int y1, int (
 	struct block_list *bl;
 	int found = 0;
 
-	if (m < 0)
+	if (m < 0 || map->list[m].block == NULL)
 		return 0;
 
 	if (x1 < x0) swap(x0, x1);
@@ -2504,6 +2516,14 @@ void map_cellfromcache(struct map_data *m) {
 
 		// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
 		decode_zip(decode_buffer, &size, m->cellPos+sizeof(struct map_cache_map_info), info->len);
+#ifndef _WIN32
+		if( map->cache_mapped ) { // the compressed cells are not needed until the next load, let them leave memory
+			size_t page = (size_t)sysconf(_SC_PAGESIZE);
+			uintptr_t start = (uintptr_t)m->cellPos & ~(uintptr_t)(page-1);
+			uintptr_t end = (uintptr_t)m->cellPos + sizeof(struct map_cache_map_info) + info->len;
+			madvise((void *)start, end - start, MADV_DONTNEED);
+		}
+#endif
 		CREATE(m->cell, struct mapcell, size);
 
 		for( xy = 0; xy < size; ++xy )
@@ -2518,6 +2538,190 @@ void map_cellfromcache(struct map_data *m) {
 	}
 }
 
+/*==========================================
+ * Cell bitmaps (see struct map_cellbits)
+ *------------------------------------------*/
+void map_cellbits_update(struct map_data *m, int16 x, int16 y) {
+	struct map_cellbits *cb = m->cellbits;
+	struct mapcell cell = m->cell[x + y*m->xs];
+	uint64 rbit = (uint64)1<<(x&63), cbit = (uint64)1<<(y&63);
+	int r = y*cb->stride_x + (x>>6), c = x*cb->stride_y + (y>>6);
+
+	if( cell.walkable ) {
+		cb->walk_row[r] |= rbit;
+		cb->walk_col[c] |= cbit;
+	} else {
+		cb->walk_row[r] &= ~rbit;
+		cb->walk_col[c] &= ~cbit;
+	}
+	if( cell.walkable || cell.shootable ) {
+		cb->shoot_row[r] |= rbit;
+		cb->shoot_col[c] |= cbit;
+	} else {
+		cb->shoot_row[r] &= ~rbit;
+		cb->shoot_col[c] &= ~cbit;
+	}
+}
+
+/// Builds the cell bitmaps of a map, its cells must be loaded.
+void map_cellbits_build(struct map_data *m) {
+	struct map_cellbits *cb;
+	int16 x, y;
+
+	if( m->cell == (struct mapcell *)0xdeadbeaf )
+		map->cellfromcache(m);
+	map->cellbits_free(m);
+	CREATE(cb, struct map_cellbits, 1);
+	cb->stride_x = (m->xs + 63)/64;
+	cb->stride_y = (m->ys + 63)/64;
+	CREATE(cb->walk_row, uint64, cb->stride_x * m->ys);
+	CREATE(cb->shoot_row, uint64, cb->stride_x * m->ys);
+	CREATE(cb->walk_col, uint64, cb->stride_y * m->xs);
+	CREATE(cb->shoot_col, uint64, cb->stride_y * m->xs);
+	m->cellbits = cb;
+
+	for( y = 0; y < m->ys; y++ )
+		for( x = 0; x < m->xs; x++ )
+			map->cellbits_update(m, x, y);
+}
+
+void map_cellbits_free(struct map_data *m) {
+	struct map_cellbits *cb = m->cellbits;
+
+	if( cb == NULL )
+		return;
+	aFree(cb->walk_row);
+	aFree(cb->walk_col);
+	aFree(cb->shoot_row);
+	aFree(cb->shoot_col);
+	aFree(cb);
+	m->cellbits = NULL;
+}
+
+/*==========================================
+ * Idle map eviction
+ * Maps nobody used for idle_timeout seconds give their cells back, they
+ * are decoded from the cache again on the next getcellp/setcell. Maps with
+ * nothing at all on them give their block grids back too.
+ *------------------------------------------*/
+
+/// Checks whether a map may be released: no players, mobs, skill units,
+/// items or other objects besides NPCs, and no cell changes the cache
+/// cannot restore. NPC touch cells are set again by cellfromcache.
+bool map_idle_check(struct map_data *m, bool *has_npc) {
+	struct block_list *bl;
+	int i, bsize;
+
+	*has_npc = false;
+	if( m->users > 0 || m->instance_id >= 0 || m->iwall_num > 0 || m->cell_custom )
+		return false;
+	if( m->block == NULL )
+		return true;
+
+	bsize = m->bxs * m->bys;
+	for( i = 0; i < bsize; i++ ) {
+		if( m->block_mob[i] != NULL )
+			return false;
+		for( bl = m->block[i]; bl != NULL; bl = bl->next ) {
+			if( bl->type != BL_NPC )
+				return false;
+			*has_npc = true;
+		}
+	}
+	return true;
+}
+
+/// Releases the cells (when they can be read from the cache again), the
+/// cell bitmaps and path cache, and the block grids if 'grids' is set.
+void map_idle_release(struct map_data *m, bool grids) {
+	if( m->cellPos != NULL && m->cell != NULL && m->cell != (struct mapcell *)0xdeadbeaf ) {
+		aFree(m->cell);
+		m->cell = (struct mapcell *)0xdeadbeaf;
+		m->getcellp = map->sub_getcellp;
+		m->setcell  = map->sub_setcell;
+	}
+	map->cellbits_free(m);
+	if( m->path_cache != NULL ) {
+		aFree(m->path_cache);
+		m->path_cache = NULL;
+	}
+	m->path_gen++;
+
+	if( grids && m->block != NULL ) {
+		aFree(m->block);
+		aFree(m->block_mob);
+		m->block = NULL;
+		m->block_mob = NULL;
+	}
+}
+
+void map_blockgrid_alloc(struct map_data *m) {
+	size_t size = m->bxs * m->bys * sizeof(struct block_list*);
+
+	m->block = (struct block_list**)aCalloc(size, 1);
+	m->block_mob = (struct block_list**)aCalloc(size, 1);
+}
+
+int map_idle_timer(int tid, unsigned int tick, int id, intptr_t data) {
+	int i;
+
+	for( i = 0; i < map->count; i++ ) {
+		struct map_data *m = &map->list[i];
+		bool has_npc, cells, grids;
+
+		if( !map->idle_check(m, &has_npc) ) {
+			m->idle_tick = 0;
+			continue;
+		}
+		cells = ( m->cellPos != NULL && m->cell != NULL && m->cell != (struct mapcell *)0xdeadbeaf );
+		grids = ( m->block != NULL && !has_npc );
+		if( !cells && !grids ) { // nothing to give back
+			m->idle_tick = 0;
+			continue;
+		}
+		if( m->idle_tick == 0 ) {
+			m->idle_tick = tick ? tick : 1;
+			continue;
+		}
+		if( DIFF_TICK(tick, m->idle_tick) < map->idle_timeout*1000 )
+			continue;
+
+		map->idle_release(m, grids);
+		m->idle_tick = 0;
+		map->idle_evicted++;
+	}
+
+	return 0;
+}
+
+/// Reports the memory held by the cells, block grids, cell bitmaps and path caches of the maps.
+void map_memory_report(void) {
+	unsigned long cells = 0, grids = 0, bits = 0, paths = 0;
+	int i, cell_maps = 0, grid_maps = 0;
+
+	for( i = 0; i < map->count; i++ ) {
+		struct map_data *m = &map->list[i];
+
+		if( m->cell != NULL && m->cell != (struct mapcell *)0xdeadbeaf ) {
+			cells += (unsigned long)m->xs * m->ys * sizeof(struct mapcell);
+			cell_maps++;
+		}
+		if( m->block != NULL ) {
+			grids += 2UL * m->bxs * m->bys * sizeof(struct block_list*);
+			grid_maps++;
+		}
+		if( m->cellbits != NULL )
+			bits += 2UL * (m->cellbits->stride_x * m->ys + m->cellbits->stride_y * m->xs) * sizeof(uint64);
+		if( m->path_cache != NULL )
+			paths += PATH_CACHE_SIZE * sizeof(struct path_cache_entry);
+	}
+
+	ShowInfo("Maps: %d loaded, %d with cells in memory ("CL_WHITE"%lu"CL_RESET" KB), %d with block grids (%lu KB)\n",
+		map->count, cell_maps, cells / 1024, grid_maps, grids / 1024);
+	ShowInfo("Maps: cell bitmaps %lu KB, path caches %lu KB; %u released while idle (map_idle_timeout: %d)\n",
+		bits / 1024, paths / 1024, map->idle_evicted, map->idle_timeout);
+}
+
 /*==========================================
  * Confirm if celltype in (m,x,y) match the one given in cellchk
  *------------------------------------------*/
@@ -2616,8 +2820,16 @@ void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag) {
 	j = x + y*map->list[m].xs;
 
 	switch( cell ) {
-	case CELL_WALKABLE:      map->list[m].cell[j].walkable = flag;      break;
-	case CELL_SHOOTABLE:     map->list[m].cell[j].shootable = flag;     break;
+	case CELL_WALKABLE:
+	case CELL_SHOOTABLE:
+		if( cell == CELL_WALKABLE )
+			map->list[m].cell[j].walkable = flag;
+		else
+			map->list[m].cell[j].shootable = flag;
+		map->list[m].path_gen++;
+		if( map->list[m].cellbits )
+			map->cellbits_update(&map->list[m], x, y);
+		break;
 	case CELL_WATER:         map->list[m].cell[j].water = flag;         break;
 
 	case CELL_NPC:           map->list[m].cell[j].npc = flag;           break;
@@ -2648,12 +2860,18 @@ void map_setgatcell(int16 m, int16 x, int16 y, int gat) {
 	if( m < 0 || m >= map->count || x < 0 || x >= map->list[m].xs || y < 0 || y >= map->list[m].ys )
 		return;
 
+	if( map->list[m].cell == (struct mapcell *)0xdeadbeaf )
+		map->cellfromcache(&map->list[m]);
+
 	j = x + y*map->list[m].xs;
 
 	cell = map->gat2cell(gat);
 	map->list[m].cell[j].walkable = cell.walkable;
 	map->list[m].cell[j].shootable = cell.shootable;
 	map->list[m].cell[j].water = cell.water;
+	map->list[m].path_gen++;
+	if( map->list[m].cellbits )
+		map->cellbits_update(&map->list[m], x, y);
 }
 
 /*==========================================
@@ -2836,8 +3054,16 @@ int map_eraseipport(unsigned short mapindex, uint32 ip, uint16 port) {
 
 /*==========================================
  * [Shinryo]: Init the mapcache
+ * Version 2 caches are mapped from the file, so the maps that are never
+ * loaded are never read; version 1 caches are read into memory and
+ * indexed once.
  *------------------------------------------*/
+static int map_cache_dir_cmp(const void *a, const void *b) {
+	return strncmp(((const struct map_cache_dir_entry *)a)->name, ((const struct map_cache_dir_entry *)b)->name, MAP_NAME_LENGTH);
+}
+
 char *map_init_mapcache(FILE *fp) {
+	struct map_cache_header_v2 header;
 	size_t size = 0;
 	char *buffer;
 
@@ -2849,6 +3075,35 @@ char *map_init_mapcache(FILE *fp) {
 	size = ftell(fp);
 	fseek(fp, 0, SEEK_SET);
 
+	if( size >= sizeof(header) && fread(&header, sizeof(header), 1, fp) == 1
+	 && memcmp(header.magic, MAP_CACHE_MAGIC, 4) == 0 ) {
+		if( header.file_size != size || sizeof(header) + (size_t)header.map_count * sizeof(struct map_cache_dir_entry) > size ) {
+			ShowError("map_init_mapcache: Map cache is truncated (%u bytes expected, %u found)\n", header.file_size, (unsigned int)size);
+			return NULL;
+		}
+#ifndef _WIN32
+		buffer = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+		if( buffer == MAP_FAILED ) {
+			ShowError("map_init_mapcache: Could not map the mapcache file (%s)\n", strerror(errno));
+			return NULL;
+		}
+		map->cache_mapped = true;
+#else
+		CREATE(buffer, char, size);
+		fseek(fp, 0, SEEK_SET);
+		if( fread(buffer, sizeof(char), size, fp) != size ) {
+			ShowError("map_init_mapcache: Could not read entire mapcache file\n");
+			aFree(buffer);
+			return NULL;
+		}
+#endif
+		map->cache_size = size;
+		map->cache_dir = (struct map_cache_dir_entry *)(buffer + sizeof(header));
+		map->cache_count = header.map_count;
+		return buffer;
+	}
+	fseek(fp, 0, SEEK_SET);
+
 	// Allocate enough space
 	CREATE(buffer, char, size);
 
@@ -2858,54 +3113,641 @@ char *map_init_mapcache(FILE *fp) {
 	// Read file into buffer..
 	if(fread(buffer, sizeof(char), size, fp) != size) {
 		ShowError("map_init_mapcache: Could not read entire mapcache file\n");
+		aFree(buffer);
 		return NULL;
 	}
+	map->cache_size = size;
+
+	// Version 1: index the maps
+	{
+		struct map_cache_main_header *header1 = (struct map_cache_main_header *)buffer;
+		size_t offset = sizeof(struct map_cache_main_header);
+		int i;
+
+		CREATE(map->cache_dir, struct map_cache_dir_entry, header1->map_count);
+		for( i = 0; i < header1->map_count && offset + sizeof(struct map_cache_map_info) <= size; i++ ) {
+			struct map_cache_map_info *info = (struct map_cache_map_info *)(buffer + offset);
+
+			memcpy(map->cache_dir[i].name, info->name, MAP_NAME_LENGTH);
+			map->cache_dir[i].xs = info->xs;
+			map->cache_dir[i].ys = info->ys;
+			map->cache_dir[i].offset = (uint32)offset;
+			offset += sizeof(struct map_cache_map_info) + info->len;
+		}
+		map->cache_count = i;
+		qsort(map->cache_dir, map->cache_count, sizeof(struct map_cache_dir_entry), map_cache_dir_cmp);
+		ShowNotice("map_init_mapcache: Using an old map cache, rebuild it with the mapcache tool to have it mapped instead of loaded.\n");
+	}
 
 	return buffer;
 }
 
+/// Releases the map cache.
+void map_final_mapcache(void) {
+	if( map->cache_buffer == NULL )
+		return;
+#ifndef _WIN32
+	if( map->cache_mapped )
+		munmap(map->cache_buffer, map->cache_size);
+	else
+#endif
+	{
+		if( (char *)map->cache_dir < map->cache_buffer || (char *)map->cache_dir >= map->cache_buffer + map->cache_size )
+			aFree(map->cache_dir); // built for a version 1 cache
+		aFree(map->cache_buffer);
+	}
+	map->cache_buffer = NULL;
+	map->cache_size = 0;
+	map->cache_mapped = false;
+	map->cache_dir = NULL;
+	map->cache_count = 0;
+}
+
 /*==========================================
- * Map cache reading
- * [Shinryo]: Optimized some behaviour to speed this up
- *==========================================*/
-int map_readfromcache(struct map_data *m, char *buffer) {
+ * Database snapshot
+ * The item, skill and mob databases as they are once parsed, scripts
+ * included, so the next boot can skip parsing them. The key covers:
+ * - the size and contents of the files in map_snapshot_sources,
+ * - the battle config the databases were adjusted with,
+ * - the server binary (HCache->recompile_time),
+ * - the name, size and modification time of each loaded plugin.
+ * The snapshot is rebuilt whenever one of them changes. Anything else that
+ * changes these databases (e.g. a plugin reading its own files) is not
+ * noticed: disable db_snapshot or delete the snapshot in that case.
+ *------------------------------------------*/
+/// Source files of the snapshot, keep in sync with itemdb_read, skill_readdb and mob_load.
+static const char *map_snapshot_sources[] = {
+	"const.txt",
+	DBPATH"item_db.txt", "item_db2.txt", "item_avail.txt", DBPATH"item_trade.txt", DBPATH"item_delay.txt",
+	"item_stack.txt", DBPATH"item_buyingstore.txt", "item_nouse.txt",
+	DBPATH"skill_db.txt", DBPATH"skill_require_db.txt",
+#ifdef RENEWAL_CAST
+	"re/skill_cast_db.txt",
+#else
+	"pre-re/skill_cast_db.txt",
+#endif
+	DBPATH"skill_castnodex_db.txt", DBPATH"skill_unit_db.txt",
+	"mob_item_ratio.txt", "mob_chat_db.txt", DBPATH"mob_db.txt", "mob_db2.txt", DBPATH"mob_skill_db.txt", "mob_skill_db2.txt",
+	"mob_avail.txt", DBPATH"mob_branch.txt", DBPATH"mob_poring.txt", DBPATH"mob_boss.txt", "mob_pouch.txt",
+	"mob_classchange.txt", DBPATH"mob_race2_db.txt",
+};
+
+uint32 map_snapshot_calckey(void) {
+	uint32 key[ARRAYLENGTH(map_snapshot_sources)*2 + 4];
+	int i, n = 0;
+
+	for( i = 0; i < ARRAYLENGTH(map_snapshot_sources); i++ ) {
+		char path[256];
+		unsigned char *data = NULL;
+		size_t size = 0;
+		FILE *fp;
+
+		snprintf(path, sizeof(path), "%s/%s", map->db_path, map_snapshot_sources[i]);
+		if( (fp = fopen(path, "rb")) != NULL ) {
+			fseek(fp, 0, SEEK_END);
+			size = ftell(fp);
+			fseek(fp, 0, SEEK_SET);
+			CREATE(data, unsigned char, size+1);
+			if( fread(data, 1, size, fp) != size )
+				size = 0;
+			fclose(fp);
+		}
+		key[n++] = fp ? (uint32)size : UINT32_MAX; // missing files count too
+		key[n++] = data ? (uint32)grfio_crc32(data, (unsigned int)size) : 0;
+		if( data )
+			aFree(data);
+	}
+
+	key[n++] = (uint32)grfio_crc32((const unsigned char *)&battle_config, sizeof(battle_config));
+	key[n++] = (uint32)HCache->recompile_time;
+	key[n++] = HPM->plugin_count;
+	key[n] = 0;
+	for( i = 0; i < HPM->plugin_count; i++ ) {
+		const char *filename = HPM->plugins[i]->filename;
+		struct stat st;
+		uint32 plugin[3];
+
+		plugin[0] = (uint32)grfio_crc32((const unsigned char *)filename, (unsigned int)strlen(filename));
+		if( stat(filename, &st) == 0 ) {
+			plugin[1] = (uint32)st.st_size;
+			plugin[2] = (uint32)st.st_mtime;
+		} else
+			plugin[1] = plugin[2] = UINT32_MAX;
+		key[n] ^= (uint32)grfio_crc32((const unsigned char *)plugin, sizeof(plugin));
+	}
+	n++;
+
+	return (uint32)grfio_crc32((const unsigned char *)key, n * sizeof(key[0]));
+}
+
+/// Opens the snapshot of the databases if it is usable, otherwise schedules writing a new one.
+void map_snapshot_open(void) {
+	const struct db_snapshot_header *header;
+	char path[256];
+	size_t size;
+	FILE *fp;
 	int i;
-	struct map_cache_main_header *header = (struct map_cache_main_header *)buffer;
-	struct map_cache_map_info *info = NULL;
-	char *p = buffer + sizeof(struct map_cache_main_header);
 
-	for(i = 0; i < header->map_count; i++) {
-		info = (struct map_cache_map_info *)p;
+	if( !map->db_snapshot || !HCache->enabled || map->db_use_sql_item_db || map->db_use_sql_mob_db || map->db_use_sql_mob_skill_db )
+		return;
 
-		if( strcmp(m->name, info->name) == 0 )
-			break; // Map found
+	map->snapshot_key = map->snapshot_calckey();
+	map->snapshot_save = true;
 
-		// Jump to next entry..
-		p += sizeof(struct map_cache_map_info) + info->len;
+	snprintf(path, sizeof(path), "./cache/%s", DB_SNAPSHOT_FILE);
+	if( (fp = fopen(path, "rb")) == NULL )
+		return;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	if( size < 20 + sizeof(struct db_snapshot_header) ) { // 20: HCache prefix
+		fclose(fp);
+		return;
+	}
+#ifndef _WIN32
+	map->snapshot_buffer = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if( map->snapshot_buffer == MAP_FAILED ) {
+		ShowError("map_snapshot_open: Could not map '%s' (%s)\n", path, strerror(errno));
+		map->snapshot_buffer = NULL;
+		fclose(fp);
+		return;
+	}
+	map->snapshot_mapped = true;
+#else
+	CREATE(map->snapshot_buffer, unsigned char, size);
+	fseek(fp, 0, SEEK_SET);
+	if( fread(map->snapshot_buffer, 1, size, fp) != size ) {
+		aFree(map->snapshot_buffer);
+		map->snapshot_buffer = NULL;
+		fclose(fp);
+		return;
 	}
+#endif
+	fclose(fp);
+	map->snapshot_size = size;
+
+	header = (const struct db_snapshot_header *)(map->snapshot_buffer + 20);
+	if( memcmp(header->magic, DB_SNAPSHOT_MAGIC, 4) != 0 || header->version != DB_SNAPSHOT_VERSION
+	 || header->file_size != size || header->key != map->snapshot_key
+	 || header->record_size[DBS_ITEM] != sizeof(struct item_data)
+	 || header->record_size[DBS_SKILL] != sizeof(struct s_skill_db)
+	 || header->record_size[DBS_MOB] != sizeof(struct mob_db) ) {
+		ShowInfo("Database snapshot '"CL_WHITE"%s"CL_RESET"' is out of date, it will be rebuilt.\n", path);
+		map->snapshot_close();
+		return;
+	}
+	for( i = 0; i < DBS_MAX; i++ ) {
+		if( header->offset[i] < 20 + sizeof(struct db_snapshot_header) || header->offset[i] > size || header->size[i] > size - header->offset[i] ) {
+			ShowError("map_snapshot_open: '%s' is corrupted, it will be rebuilt.\n", path);
+			map->snapshot_close();
+			return;
+		}
+	}
+
+	map->snapshot_save = false;
+	ShowStatus("Loading the item, skill and mob databases from '"CL_WHITE"%s"CL_RESET"'.\n", path);
+}
 
-	if( info && i < header->map_count ) {
-		unsigned long size;
+/// Returns the records of a section of the snapshot in use, NULL if there is none.
+const unsigned char* map_snapshot_section(enum db_snapshot_section type, uint32 *count, uint32 *size) {
+	const struct db_snapshot_header *header;
 
-		if( info->xs <= 0 || info->ys <= 0 )
-			return 0;// Invalid
+	if( map->snapshot_buffer == NULL || type < 0 || type >= DBS_MAX )
+		return NULL;
 
-		m->xs = info->xs;
-		m->ys = info->ys;
-		size = (unsigned long)info->xs*(unsigned long)info->ys;
+	header = (const struct db_snapshot_header *)(map->snapshot_buffer + 20);
+	*count = header->count[type];
+	*size = header->size[type];
+	return map->snapshot_buffer + header->offset[type];
+}
 
-		if(size > MAX_MAP_SIZE) {
-			ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", info->name, MAX_MAP_SIZE);
-			return 0; // Say not found to remove it from list.. [Shinryo]
+/// Releases the snapshot once the databases were loaded from it.
+void map_snapshot_close(void) {
+	if( map->snapshot_buffer == NULL )
+		return;
+#ifndef _WIN32
+	if( map->snapshot_mapped )
+		munmap(map->snapshot_buffer, map->snapshot_size);
+	else
+#endif
+		aFree(map->snapshot_buffer);
+	map->snapshot_buffer = NULL;
+	map->snapshot_size = 0;
+	map->snapshot_mapped = false;
+}
+
+/// Writes the databases just parsed to a new snapshot.
+/// Written aside and renamed over the old one, which other map-servers may have mapped.
+void map_snapshot_write(void) {
+	struct db_snapshot_header header;
+	char path[256], tmp_path[256];
+	uint32 start;
+	FILE *fp;
+
+	if( !map->snapshot_save )
+		return;
+	map->snapshot_save = false;
+
+	snprintf(path, sizeof(path), "./cache/%s", DB_SNAPSHOT_FILE);
+	snprintf(tmp_path, sizeof(tmp_path), "./cache/%s.tmp", DB_SNAPSHOT_FILE);
+	if( !(fp = HCache->open(DB_SNAPSHOT_FILE".tmp", "wb")) ) {
+		ShowWarning("map_snapshot_write: Could not create '%s', the databases will be parsed again next time.\n", tmp_path);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DB_SNAPSHOT_MAGIC, 4);
+	header.version = DB_SNAPSHOT_VERSION;
+	header.key = map->snapshot_key;
+	header.record_size[DBS_ITEM] = sizeof(struct item_data);
+	header.record_size[DBS_SKILL] = sizeof(struct s_skill_db);
+	header.record_size[DBS_MOB] = sizeof(struct mob_db);
+	hwrite(&header, sizeof(header), 1, fp);
+
+	header.offset[DBS_ITEM] = start = (uint32)ftell(fp);
+	header.count[DBS_ITEM] = itemdb->write_snapshot(fp);
+	header.size[DBS_ITEM] = (uint32)ftell(fp) - start;
+
+	header.offset[DBS_SKILL] = start = (uint32)ftell(fp);
+	header.count[DBS_SKILL] = skill->write_snapshot(fp);
+	header.size[DBS_SKILL] = (uint32)ftell(fp) - start;
+
+	header.offset[DBS_MOB] = start = (uint32)ftell(fp);
+	header.count[DBS_MOB] = mob->write_snapshot(fp);
+	header.size[DBS_MOB] = (uint32)ftell(fp) - start;
+
+	header.file_size = (uint32)ftell(fp);
+	fseek(fp, 20, SEEK_SET);
+	hwrite(&header, sizeof(header), 1, fp);
+
+	if( ferror(fp) ) {
+		ShowWarning("map_snapshot_write: Could not write '%s'.\n", tmp_path);
+		fclose(fp);
+		remove(tmp_path);
+		return;
+	}
+	fclose(fp);
+#ifdef _WIN32
+	remove(path);
+#endif
+	if( rename(tmp_path, path) != 0 ) {
+		ShowWarning("map_snapshot_write: Could not rename '%s' to '%s'.\n", tmp_path, path);
+		remove(tmp_path);
+		return;
+	}
+	ShowStatus("Done writing the database snapshot '"CL_WHITE"%s"CL_RESET"' ("CL_WHITE"%u"CL_RESET" bytes).\n", path, header.file_size);
+}
+
+/*==========================================
+ * Parallel reading of the txt databases
+ * The files are queued before the maps are loaded and read by worker
+ * threads meanwhile. Their rows are still parsed on the main thread by the
+ * sv->readdb call of each database, in the usual order: the parse functions
+ * are not thread-safe (memory manager, DBMaps, script engine).
+ *------------------------------------------*/
+/// Files read with sv->readdb during boot, in the order they are parsed
+static const char *map_dbload_files[] = {
+	// itemdb
+	"item_avail.txt", DBPATH"item_trade.txt", DBPATH"item_delay.txt", "item_stack.txt", DBPATH"item_buyingstore.txt", "item_nouse.txt",
+	// skill
+	DBPATH"skill_db.txt", DBPATH"skill_require_db.txt",
+#ifdef RENEWAL_CAST
+	"re/skill_cast_db.txt",
+#else
+	"pre-re/skill_cast_db.txt",
+#endif
+	DBPATH"skill_castnodex_db.txt", DBPATH"skill_unit_db.txt",
+	"produce_db.txt", "create_arrow_db.txt", "abra_db.txt", "spellbook_db.txt", "magicmushroom_db.txt",
+	"skill_reproduce_db.txt", "skill_improvise_db.txt", "skill_changematerial_db.txt",
+	// mob
+	"mob_item_ratio.txt", DBPATH"mob_db.txt", "mob_db2.txt", DBPATH"mob_skill_db.txt", "mob_skill_db2.txt", "mob_avail.txt", DBPATH"mob_race2_db.txt",
+	// pc
+#if defined(RENEWAL_DROP) || defined(RENEWAL_EXP)
+	"re/level_penalty.txt",
+#endif
+	// status
+#ifdef RENEWAL_ASPD
+	"re/job_db1.txt",
+#else
+	"pre-re/job_db1.txt",
+#endif
+	"job_db2.txt", "size_fix.txt", DBPATH"refine_db.txt", "sc_config.txt",
+	// guild
+	"castle_db.txt", "guild_skill_tree.txt",
+	// homunculus
+	"homunculus_db.txt", "homunculus_db2.txt", "homun_skill_tree.txt",
+	// mercenary
+	"mercenary_db.txt", "mercenary_skill_db.txt",
+};
+
+static struct db_load_task *dbload_tasks = NULL;
+static int dbload_count = 0;
+static int dbload_next = 0; // first task that may still be queued
+static rAthread dbload_threads[DB_LOAD_THREADS_MAX];
+static int dbload_thread_count = 0;
+static ramutex dbload_mutex = NULL;
+static racond dbload_cond = NULL; // signaled each time a task is done
+static bool (*dbload_readdb_orig) (const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current)) = NULL;
+static unsigned int dbload_wait = 0; // ms the main thread spent waiting for the workers
+
+/// Queues the txt databases and starts the threads reading them.
+void map_dbload_start(void) {
+	int i;
+
+	if( dbload_tasks != NULL || map->db_load_threads <= 0 )
+		return;
+
+	dbload_count = ARRAYLENGTH(map_dbload_files);
+	dbload_next = 0;
+	dbload_wait = 0;
+	CREATE(dbload_tasks, struct db_load_task, dbload_count);
+	for( i = 0; i < dbload_count; i++ ) {
+		snprintf(dbload_tasks[i].path, sizeof(dbload_tasks[i].path), "%s/%s", map->db_path, map_dbload_files[i]);
+		dbload_tasks[i].state = DBL_QUEUED;
+	}
+
+	dbload_mutex = ramutex_create();
+	dbload_cond = racond_create();
+
+	dbload_readdb_orig = sv->readdb;
+	sv->readdb = map->dbload_readdb;
+
+	for( i = 0; i < map->db_load_threads; i++ ) {
+		if( (dbload_threads[dbload_thread_count] = rathread_create(map->dbload_worker, NULL)) == NULL ) {
+			ShowWarning("map_dbload_start: Could not start thread %d, the databases not read yet will be read when needed.\n", i+1);
+			break;
 		}
+		dbload_thread_count++;
+	}
+}
 
-		m->cellPos = p;
-		m->cell = (struct mapcell *)0xdeadbeaf;
+/// Worker thread, reads the queued files in order until none is left.
+void* map_dbload_worker(void *param) {
+	for(;;) {
+		struct db_load_task *task;
 
-		return 1;
+		ramutex_lock(dbload_mutex);
+		while( dbload_next < dbload_count && dbload_tasks[dbload_next].state != DBL_QUEUED )
+			dbload_next++;
+		if( dbload_next == dbload_count ) {
+			ramutex_unlock(dbload_mutex);
+			break;
+		}
+		task = &dbload_tasks[dbload_next++];
+		task->state = DBL_RUNNING;
+		ramutex_unlock(dbload_mutex);
+
+		sv->readrows(task->path, ',', &task->rows);
+
+		ramutex_lock(dbload_mutex);
+		task->state = DBL_DONE;
+		racond_broadcast(dbload_cond);
+		ramutex_unlock(dbload_mutex);
+	}
+
+	return NULL;
+}
+
+/// sv->readdb while the databases are being loaded: parses the rows read by the workers.
+/// Files that were not queued are read as usual.
+bool map_dbload_readdb(const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current)) {
+	struct db_load_task *task;
+	char path[1024];
+	bool ret;
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, filename);
+
+	ARR_FIND(0, dbload_count, i, strcmp(dbload_tasks[i].path, path) == 0);
+	if( delim != ',' || i == dbload_count )
+		return dbload_readdb_orig(directory, filename, delim, mincols, maxcols, maxrows, parseproc);
+	task = &dbload_tasks[i];
+
+	ramutex_lock(dbload_mutex);
+	if( task->state == DBL_USED ) {// read twice
+		ramutex_unlock(dbload_mutex);
+		return dbload_readdb_orig(directory, filename, delim, mincols, maxcols, maxrows, parseproc);
 	}
+	if( task->state == DBL_QUEUED ) {// needed before a worker got to it
+		task->state = DBL_RUNNING;
+		ramutex_unlock(dbload_mutex);
+		sv->readrows(task->path, ',', &task->rows);
+		ramutex_lock(dbload_mutex);
+		task->state = DBL_DONE;
+	} else if( task->state == DBL_RUNNING ) {
+		unsigned int tick = timer->gettick_nocache();
+		while( task->state != DBL_DONE )
+			racond_wait(dbload_cond, dbload_mutex, -1);
+		dbload_wait += DIFF_TICK(timer->gettick_nocache(), tick);
+	}
+	ramutex_unlock(dbload_mutex);
+
+	ret = sv->parserows(&task->rows, path, mincols, maxcols, maxrows, parseproc);
+	sv->freerows(&task->rows);
+	ramutex_lock(dbload_mutex);
+	task->state = DBL_USED;
+	ramutex_unlock(dbload_mutex);
+
+	return ret;
+}
+
+/// Waits for the workers and releases the files no database asked for.
+void map_dbload_final(void) {
+	int i, used = 0;
+
+	if( dbload_tasks == NULL )
+		return;
+
+	ramutex_lock(dbload_mutex);
+	dbload_next = dbload_count; // nothing left to claim
+	ramutex_unlock(dbload_mutex);
+	for( i = 0; i < dbload_thread_count; i++ )
+		rathread_wait(dbload_threads[i], NULL);
+
+	for( i = 0; i < dbload_count; i++ ) {
+		if( dbload_tasks[i].state == DBL_USED )
+			used++;
+		else if( dbload_tasks[i].state == DBL_DONE )
+			sv->freerows(&dbload_tasks[i].rows);
+	}
+
+	ShowInfo("Read '"CL_WHITE"%d"CL_RESET"' database files with '"CL_WHITE"%d"CL_RESET"' threads (main thread waited %u ms).\n", used, dbload_thread_count, dbload_wait);
 
-	return 0; // Not found
+	if( sv->readdb == map->dbload_readdb )
+		sv->readdb = dbload_readdb_orig;
+	racond_destroy(dbload_cond);
+	ramutex_destroy(dbload_mutex);
+	dbload_cond = NULL;
+	dbload_mutex = NULL;
+	aFree(dbload_tasks);
+	dbload_tasks = NULL;
+	dbload_count = dbload_next = dbload_thread_count = 0;
+}
+
+/*==========================================
+ * Phase profiler
+ * Boot and the reload commands are split in nested phases, each one records
+ * the time it took, what it allocated through the memory manager and how
+ * many items it processed. When the outermost phase ends the phases are
+ * printed as a table and appended to phase_log as one json object per line.
+ *------------------------------------------*/
+static struct map_phase map_phases[MAP_PHASE_MAX];
+static int map_phase_total = 0; // recorded phases
+static int map_phase_stack[MAP_PHASE_DEPTH]; // open phases (-1 when not recorded)
+static int map_phase_depth = 0;
+
+/// Starts a phase inside the current one, or a new report if none is open.
+void map_phase_begin(const char *name) {
+	struct map_phase *p;
+
+	if( map_phase_depth == 0 )
+		map_phase_total = 0;
+	if( map_phase_depth == MAP_PHASE_DEPTH ) {// too deep, merged into its parent
+		map_phase_depth++;
+		return;
+	}
+	if( map_phase_depth > MAP_PHASE_DEPTH || map_phase_total == MAP_PHASE_MAX ) {
+		if( map_phase_depth < MAP_PHASE_DEPTH )
+			map_phase_stack[map_phase_depth] = -1;
+		map_phase_depth++;
+		return;
+	}
+
+	p = &map_phases[map_phase_total];
+	p->name = name;
+	p->depth = map_phase_depth;
+	p->count = 0;
+	p->ended = false;
+	iMalloc->counters(&p->mem);
+	p->tick = timer->gettick_nocache();
+	map_phase_stack[map_phase_depth++] = map_phase_total++;
+}
+
+/// Adds items processed to the current phase.
+void map_phase_count(int count) {
+	int i;
+
+	if( map_phase_depth == 0 )
+		return;
+	i = map_phase_stack[min(map_phase_depth, MAP_PHASE_DEPTH) - 1];
+	if( i >= 0 )
+		map_phases[i].count += count;
+}
+
+/// Ends the current phase, reports them all when it is the outermost one.
+void map_phase_end(void) {
+	struct malloc_counters mem;
+	struct map_phase *p;
+	int i;
+
+	if( map_phase_depth == 0 )
+		return;
+	if( --map_phase_depth >= MAP_PHASE_DEPTH || (i = map_phase_stack[map_phase_depth]) < 0 )
+		return;
+
+	p = &map_phases[i];
+	p->tick = (unsigned int)DIFF_TICK(timer->gettick_nocache(), p->tick);
+	iMalloc->counters(&mem);
+	p->mem.allocs = mem.allocs - p->mem.allocs;
+	p->mem.frees = mem.frees - p->mem.frees;
+	p->mem.bytes = mem.bytes - p->mem.bytes;
+	p->ended = true;
+
+	if( map_phase_depth == 0 ) {
+		map->phase_report();
+		map_phase_total = 0;
+	}
+}
+
+/// Writes a phase and the phases inside it as a json object.
+void map_phase_json(FILE *fp, int index) {
+	const struct map_phase *p = &map_phases[index];
+	const char *c;
+	int i, n = 0;
+
+	fputs("{\"name\":\"", fp);
+	for( c = p->name; *c; c++ ) {
+		if( *c == '"' || *c == '\\' )
+			fputc('\\', fp);
+		fputc(*c, fp);
+	}
+	fprintf(fp, "\",\"ms\":%u,\"allocs\":%"PRIu64",\"frees\":%"PRIu64",\"bytes\":%"PRIu64",\"count\":%d",
+		p->tick, p->mem.allocs, p->mem.frees, p->mem.bytes, p->count);
+	for( i = index + 1; i < map_phase_total && map_phases[i].depth > p->depth; i++ ) {
+		if( map_phases[i].depth != p->depth + 1 )
+			continue;
+		fputs(n++ ? "," : ",\"phases\":[", fp);
+		map->phase_json(fp, i);
+	}
+	fputs(n ? "]}" : "}", fp);
+}
+
+/// Prints the recorded phases and appends them to phase_log.
+void map_phase_report(void) {
+	FILE *fp;
+	int i;
+
+	if( map_phase_total == 0 || !map_phases[0].ended )
+		return;
+
+	ShowInfo("Phases of '"CL_WHITE"%s"CL_RESET"':\n", map_phases[0].name);
+	ShowMessage("\t%-34s %8s %10s %10s %8s\n", "phase", "ms", "allocs", "KB", "items");
+	for( i = 0; i < map_phase_total; i++ ) {
+		const struct map_phase *p = &map_phases[i];
+		if( !p->ended )
+			continue;
+		ShowMessage("\t%*s%-*s %8u %10"PRIu64" %10"PRIu64" %8d\n", p->depth*2, "", 34 - p->depth*2, p->name,
+			p->tick, p->mem.allocs, p->mem.bytes / 1024, p->count);
+	}
+
+	if( map->phase_log[0] == '\0' )
+		return;
+	if( (fp = fopen(map->phase_log, "a")) == NULL ) {
+		ShowError("map_phase_report: Could not open '%s' (%s).\n", map->phase_log, strerror(errno));
+		return;
+	}
+	fprintf(fp, "{\"report\":\"%s\",\"time\":%ld,\"git\":\"%s\",\"svn\":\"%s\",\"phases\":", map_phases[0].name, (long)time(NULL), get_git_hash(), get_svn_revision());
+	map->phase_json(fp, 0);
+	fputs("}\n", fp);
+	fclose(fp);
+}
+
+/*==========================================
+ * Map cache reading
+ * [Shinryo]: Optimized some behaviour to speed this up
+ *==========================================*/
+int map_readfromcache(struct map_data *m, char *buffer) {
+	struct map_cache_dir_entry key, *entry;
+	unsigned long size;
+
+	memset(key.name, 0, MAP_NAME_LENGTH);
+	safestrncpy(key.name, m->name, MAP_NAME_LENGTH);
+	entry = (struct map_cache_dir_entry *)bsearch(&key, map->cache_dir, map->cache_count, sizeof(struct map_cache_dir_entry), map_cache_dir_cmp);
+	if( entry == NULL )
+		return 0; // Not found
+
+	if( entry->xs <= 0 || entry->ys <= 0 )
+		return 0;// Invalid
+
+	if( entry->offset + sizeof(struct map_cache_map_info) > map->cache_size
+	 || entry->offset + sizeof(struct map_cache_map_info) + ((struct map_cache_map_info *)(buffer + entry->offset))->len > map->cache_size ) {
+		ShowWarning("map_readfromcache: %s is outside of the map cache\n", m->name);
+		return 0;
+	}
+
+	m->xs = entry->xs;
+	m->ys = entry->ys;
+	size = (unsigned long)entry->xs*(unsigned long)entry->ys;
+
+	if(size > MAX_MAP_SIZE) {
+		ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", m->name, MAX_MAP_SIZE);
+		return 0; // Say not found to remove it from list.. [Shinryo]
+	}
+
+	m->cellPos = buffer + entry->offset;
+	m->cell = (struct mapcell *)0xdeadbeaf;
+
+	return 1;
 }
 
 
@@ -3009,6 +3851,8 @@ void map_clean(int i) {
 	if(map->list[i].cell && map->list[i].cell != (struct mapcell *)0xdeadbeaf) aFree(map->list[i].cell);
 	if(map->list[i].block) aFree(map->list[i].block);
 	if(map->list[i].block_mob) aFree(map->list[i].block_mob);
+	if(map->list[i].path_cache) aFree(map->list[i].path_cache);
+	map->cellbits_free(&map->list[i]);
 
 	if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
 		int j;
@@ -3062,6 +3906,8 @@ void do_final_maps(void) {
 		if(map->list[i].cell && map->list[i].cell != (struct mapcell *)0xdeadbeaf ) aFree(map->list[i].cell);
 		if(map->list[i].block) aFree(map->list[i].block);
 		if(map->list[i].block_mob) aFree(map->list[i].block_mob);
+		if(map->list[i].path_cache) aFree(map->list[i].path_cache);
+		map->cellbits_free(&map->list[i]);
 
 		if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
 			int j;
@@ -3293,8 +4139,6 @@ int map_readallmaps (void) {
 	}
 
 	for(i = 0; i < map->count; i++) {
-		size_t size;
-
 		// show progress
 		if(map->enable_grf)
 			ShowStatus("Loading maps [%i/%i]: %s"CL_CLL"\r", i, map->count, map->list[i].name);
@@ -3334,9 +4178,7 @@ int map_readallmaps (void) {
 		map->list[i].bxs = (map->list[i].xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
 		map->list[i].bys = (map->list[i].ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-		size = map->list[i].bxs * map->list[i].bys * sizeof(struct block_list*);
-		map->list[i].block = (struct block_list**)aCalloc(size, 1);
-		map->list[i].block_mob = (struct block_list**)aCalloc(size, 1);
+		map->blockgrid_alloc(&map->list[i]);
 
 		map->list[i].getcellp = map->sub_getcellp;
 		map->list[i].setcell  = map->sub_setcell;
@@ -3404,6 +4246,10 @@ int map_config_read(char *cfgName) {
 			map->char_ip_set = chrif->setip(w2);
 		else if (strcmpi(w1, "char_port") == 0)
 			chrif->setport(atoi(w2));
+		else if (strcmpi(w1, "char_socket") == 0)
+			safestrncpy(chrif->socket_path, w2, sizeof(chrif->socket_path));
+		else if (strcmpi(w1, "char_zip_threshold") == 0)
+			chrif->zip_threshold = max(0, atoi(w2));
 		else if (strcmpi(w1, "map_ip") == 0)
 			map->ip_set = clif->setip(w2);
 		else if (strcmpi(w1, "bind_ip") == 0)
@@ -3443,6 +4289,14 @@ int map_config_read(char *cfgName) {
 			map->enable_spy = config_switch(w2);
 		else if (strcmpi(w1, "use_grf") == 0)
 			map->enable_grf = config_switch(w2);
+		else if (strcmpi(w1, "map_idle_timeout") == 0)
+			map->idle_timeout = max(0, atoi(w2));
+		else if (strcmpi(w1, "db_snapshot") == 0)
+			map->db_snapshot = config_switch(w2);
+		else if (strcmpi(w1, "db_load_threads") == 0)
+			map->db_load_threads = cap_value(atoi(w2), 0, DB_LOAD_THREADS_MAX);
+		else if (strcmpi(w1, "phase_log") == 0)
+			safestrncpy(map->phase_log, strcmpi(w2, "none") == 0 ? "" : w2, sizeof(map->phase_log));
 		else if (strcmpi(w1, "console_msg_log") == 0)
 			console_msg_log = atoi(w2);//[Ind]
 		else if (strcmpi(w1, "import") == 0)
@@ -4422,6 +5276,7 @@ void map_zone_init(void) {
 	char empty[1] = "\0";
 	int i,k,j;
 
+	map->phase_begin("map_zone_init");
 	zone = &map->zone_all;
 
 	for(i = 0; i < zone->mapflags_count; i++) {
@@ -4468,6 +5323,8 @@ void map_zone_init(void) {
 		}
 	}
 
+	map->phase_count(map->count);
+	map->phase_end();
 }
 unsigned short map_zone_str2itemid(const char *name) {
 	struct item_data *data;
@@ -5081,6 +5938,7 @@ void do_final(void)
 	skill->final();
 	status->final();
 	unit->final();
+	path->final();
 	bg->final();
 	duel->final();
 	elemental->final();
@@ -5111,7 +5969,7 @@ void do_final(void)
 	aFree(map->list);
 
 	if( !map->enable_grf )
-		aFree(map->cache_buffer);
+		map->final_mapcache();
 
 	HPM->event(HPET_POST_FINAL);
 	
@@ -5257,6 +6115,46 @@ CPCMD(gm_use) {
 	map->cpsd->fd = 0;
 
 }
+CPCMD(path_record) {
+	if( line == NULL ) {
+		path->record(NULL);
+		ShowInfo("HCP: path search recording stopped\n");
+	} else if( path->record(line) )
+		ShowInfo("HCP: recording path searches to '"CL_WHITE"%s"CL_RESET"'\n",line);
+}
+CPCMD(path_bench) {
+	char file[256];
+	int rounds = 1;
+
+	if( line == NULL || sscanf(line, "%255s %d",file,&rounds) < 1 ) {
+		ShowError("path:bench invalid syntax. use '"CL_WHITE"path:bench file <rounds>"CL_RESET"'\n");
+		return;
+	}
+	path->bench(file,rounds);
+}
+CPCMD(path_stats) {
+	unsigned int total = path->cache_hits + path->cache_misses;
+	ShowInfo("HCP: path cache %s, %u hits, %u misses (%.1f%% hit rate)\n",
+		path->cache_enabled ? "enabled" : "disabled", path->cache_hits, path->cache_misses,
+		total ? 100. * path->cache_hits / total : 0.);
+	ShowInfo("HCP: chase flow fields %s, %u computed, %u paths taken from them\n",
+		path->flowfield_enabled ? "enabled" : "disabled", path->flowfield_builds, path->flowfield_hits);
+}
+CPCMD(autosave_stats) {
+	ShowInfo("HCP: autosave, %u characters online, saved %u urgent, %u changed, %u unchanged; %u examined but not due, %u runs out of budget\n",
+		pc->autosave_stats.users, pc->autosave_stats.urgent, pc->autosave_stats.dirty, pc->autosave_stats.clean,
+		pc->autosave_stats.skipped, pc->autosave_stats.deferred);
+}
+CPCMD(zip_stats) {
+	if( !chrif->isconnected() ) {
+		ShowInfo("HCP: not connected to the char-server\n");
+		return;
+	}
+	socket_zip_report(chrif->fd, "HCP: char-server link");
+}
+CPCMD(map_memory) {
+	map->memory_report();
+}
 /* Hercules Console Parser */
 void map_cp_defaults(void) {
 #ifdef CONSOLE_INPUT
@@ -5269,6 +6167,12 @@ void map_cp_defaults(void) {
 
 	console->addCommand("gm:info",CPCMD_A(gm_position));
 	console->addCommand("gm:use",CPCMD_A(gm_use));
+	console->addCommand("path:record",CPCMD_A(path_record));
+	console->addCommand("path:bench",CPCMD_A(path_bench));
+	console->addCommand("path:stats",CPCMD_A(path_stats));
+	console->addCommand("autosave:stats",CPCMD_A(autosave_stats));
+	console->addCommand("zip:stats",CPCMD_A(zip_stats));
+	console->addCommand("map:memory",CPCMD_A(map_memory));
 #endif
 }
 /* Hercules Plugin Mananger */
@@ -5438,6 +6342,8 @@ int do_init(int argc, char *argv[])
 		}
 	}
 
+	map->phase_begin("boot");
+	map->phase_begin("configuration");
 	map_load_defaults();
 	map->config_read(map->MAP_CONF_NAME);
 	CREATE(map->list,struct map_data,map->count);
@@ -5489,6 +6395,9 @@ int do_init(int argc, char *argv[])
 	map->flooritem_ers = ers_new(sizeof(struct flooritem_data),"map.c::map_flooritem_ers",ERS_OPT_NONE);
 	ers_chunk_size(map->flooritem_ers, 100);
 	
+	map->phase_end();
+
+	map->phase_begin("sql and grf");
 	map->sql_init();
 	if (logs->config.sql_logs)
 		logs->sql_init();
@@ -5497,46 +6406,92 @@ int do_init(int argc, char *argv[])
 	if(map->enable_grf)
 		grfio_init(map->GRF_PATH_FILENAME);
 
+	map->phase_end();
+
+	map->dbload_start();
+
+	map->phase_begin("maps");
 	map->readallmaps();
+	map->phase_count(map->count);
+	map->phase_end();
 
 	timer->add_func_list(map->freeblock_timer, "map_freeblock_timer");
 	timer->add_func_list(map->clearflooritem_timer, "map_clearflooritem_timer");
 	timer->add_func_list(map->removemobs_timer, "map_removemobs_timer");
+	timer->add_func_list(map->idle_timer, "map_idle_timer");
 	timer->add_interval(timer->gettick()+1000, map->freeblock_timer, 0, 0, 60*1000);
+	if( map->idle_timeout > 0 )
+		timer->add_interval(timer->gettick()+1000, map->idle_timer, 0, 0, min(map->idle_timeout, 60)*1000);
 
+	map->phase_begin("plugins");
 	HPM->load_sub = HPM_map_plugin_load_sub;
 	HPM->symbol_defaults_sub = map_hp_symbols;
 	HPM->config_read();
 	HPM->event(HPET_INIT);
+	map->phase_end();
 
+	map->phase_begin("core modules");
 	atcommand->init();
 	battle->init();
 	instance->init();
 	chrif->init();
 	clif->init();
 	ircbot->init();
+	map->phase_end();
+	map->phase_begin("script engine");
 	script->init();
+	map->phase_end();
+	map->snapshot_open();
+	map->phase_begin("item db");
 	itemdb->init();
+	map->phase_end();
+	map->phase_begin("skill db");
 	skill->init();
+	map->phase_end();
+	map->phase_begin("zone db");
 	map->read_zone_db();/* read after item and skill initalization */
+	map->phase_end();
+	map->phase_begin("mob db");
 	mob->init();
+	map->phase_end();
+	map->snapshot_close();
+	map->phase_begin("db snapshot");
+	map->snapshot_write();
+	map->phase_end();
+	map->phase_begin("pc db");
 	pc->init();
+	map->phase_end();
+	map->phase_begin("status db");
 	status->init();
+	map->phase_end();
+	map->phase_begin("party, guild, pet");
 	party->init();
 	guild->init();
 	gstorage->init();
 	pet->init();
+	map->phase_end();
+	map->phase_begin("homun, merc, elemental");
 	homun->init();
 	mercenary->init();
 	elemental->init();
+	map->phase_end();
+	map->phase_begin("quest db");
 	quest->init();
+	map->phase_end();
+	map->phase_begin("npcs");
 	npc->init();
+	map->phase_end();
+	map->dbload_final();
+	map->phase_begin("other modules");
 	unit->init();
 	bg->init();
 	duel->init();
 	vending->init();
+	map->phase_end();
 
+	map->phase_begin("OnInit events");
 	npc->event_do_oninit();	// Init npcs (OnInit)
+	map->phase_end();
 
 	if (battle_config.pk_mode)
 		ShowNotice("Server is running on '"CL_WHITE"PK Mode"CL_RESET"'.\n");
@@ -5547,6 +6502,8 @@ int do_init(int argc, char *argv[])
 	console->setSQL(map->mysql_handle);
 #endif
 	
+	map->phase_end(); // boot
+
 	ShowStatus("Server is '"CL_GREEN"ready"CL_RESET"' and listening on port '"CL_WHITE"%d"CL_RESET"'.\n\n", map->port);
 
 	if( runflag != CORE_ST_STOP ) {
@@ -5622,6 +6579,11 @@ void map_defaults(void) {
 	map->ip_set = 0;
 	map->char_ip_set = 0;
 	map->enable_grf = 0;
+	map->idle_timeout = 0;
+	map->idle_evicted = 0;
+	map->db_snapshot = 1;
+	map->db_load_threads = 4;
+	safestrncpy(map->phase_log, "log/map-phases.json", sizeof(map->phase_log));
 	
 	memset(&map->index2mapid, -1, sizeof(map->index2mapid));
 	
@@ -5652,6 +6614,11 @@ void map_defaults(void) {
 	
 	map->iterator_ers = NULL;
 	map->cache_buffer = NULL;
+	map->snapshot_buffer = NULL;
+	map->snapshot_size = 0;
+	map->snapshot_mapped = false;
+	map->snapshot_save = false;
+	map->snapshot_key = 0;
 	
 	map->flooritem_ers = NULL;
 	/* */
@@ -5667,6 +6634,28 @@ void map_defaults(void) {
 	map->setgatcell = map_setgatcell;
 
 	map->cellfromcache = map_cellfromcache;
+	map->idle_check = map_idle_check;
+	map->idle_release = map_idle_release;
+	map->blockgrid_alloc = map_blockgrid_alloc;
+	map->idle_timer = map_idle_timer;
+	map->memory_report = map_memory_report;
+	map->snapshot_calckey = map_snapshot_calckey;
+	map->snapshot_open = map_snapshot_open;
+	map->snapshot_section = map_snapshot_section;
+	map->snapshot_close = map_snapshot_close;
+	map->snapshot_write = map_snapshot_write;
+	map->dbload_start = map_dbload_start;
+	map->dbload_worker = map_dbload_worker;
+	map->dbload_readdb = map_dbload_readdb;
+	map->dbload_final = map_dbload_final;
+	map->phase_begin = map_phase_begin;
+	map->phase_count = map_phase_count;
+	map->phase_end = map_phase_end;
+	map->phase_report = map_phase_report;
+	map->phase_json = map_phase_json;
+	map->cellbits_build = map_cellbits_build;
+	map->cellbits_update = map_cellbits_update;
+	map->cellbits_free = map_cellbits_free;
 	// users
 	map->setusers = map_setusers;
 	map->getusers = map_getusers;
@@ -5793,6 +6782,7 @@ void map_defaults(void) {
 	map->create_map_data_other_server = create_map_data_other_server;
 	map->eraseallipport_sub = map_eraseallipport_sub;
 	map->init_mapcache = map_init_mapcache;
+	map->final_mapcache = map_final_mapcache;
 	map->readfromcache = map_readfromcache;
 	map->addmap = map_addmap;
 	map->delmapid = map_delmapid;
@@ -12,12 +12,25 @@
 #include "../common/db.h"
 #include "../config/core.h"
 #include "../common/sql.h"
+#include "../common/malloc.h" // struct malloc_counters
+#include "../common/strlib.h" // struct s_svrows
 #include "atcommand.h"
 #include <stdarg.h>
 
 struct npc_data;
 struct item_data;
 struct hChSysCh;
+struct path_cache_entry;
+
+/// Packed passability of every cell of a map, one bit per cell, laid out both
+/// by row and by column so that runs of cells along either axis can be tested
+/// a 64-bit word at a time. Kept in sync with the cells by map->setcell/setgatcell.
+struct map_cellbits {
+	int stride_x; // words per row
+	int stride_y; // words per column
+	uint64 *walk_row, *walk_col; // set = walkable
+	uint64 *shoot_row, *shoot_col; // set = not a wall (walkable or shootable)
+};
 
 enum E_MAPSERVER_ST {
 	MAPSERVER_ST_RUNNING = CORE_ST_LAST,
@@ -686,6 +699,15 @@ struct map_data {
 
 	bool custom_name; ///< Whether the instanced map is using a custom name
 
+	/* path search cache and cell bitmaps, see path.c */
+	struct path_cache_entry *path_cache;
+	struct map_cellbits *cellbits;
+	unsigned int path_gen; // bumped whenever a cell changes walkability or shootability
+
+	/* idle map eviction, see map_idle_timer */
+	unsigned int idle_tick; // tick the map was found unused first, 0 while in use
+	bool cell_custom; // cells were changed by a script or GM and cannot be rebuilt from the cache
+
 	/* */
 	int (*getcellp)(struct map_data* m,int16 x,int16 y,cell_chk cellchk);
 	void (*setcell) (int16 m, int16 x, int16 y, cell_t cell, bool flag);
@@ -769,6 +791,72 @@ struct map_cache_map_info {
 	int32 len;
 };
 
+// Version 2 of the map cache starts with this header, followed by a directory of
+// map_count entries sorted by name, then the maps (map_cache_map_info + compressed cells)
+#define MAP_CACHE_MAGIC "MCv2"
+struct map_cache_header_v2 {
+	char magic[4]; // MAP_CACHE_MAGIC
+	uint32 file_size;
+	uint32 map_count;
+	uint32 crc_offset; // source CRCs written by the mapcache tool for incremental builds (0: none)
+};
+
+// Directory entry of the map cache (read from v2 files, built when loading v1 files)
+struct map_cache_dir_entry {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint32 offset; // of the map's map_cache_map_info, from the start of the file
+};
+
+// Snapshot of the parsed item, skill and mob databases (./cache/DB_SNAPSHOT_FILE),
+// reused on boot while the sources it was built from are unchanged
+#define DB_SNAPSHOT_FILE "db_snapshot.bin"
+#define DB_SNAPSHOT_MAGIC "HDBS"
+#define DB_SNAPSHOT_VERSION 2
+enum db_snapshot_section {
+	DBS_ITEM,  // struct item_data followed by its scripts, see itemdb_write_snapshot
+	DBS_SKILL, // skill->db
+	DBS_MOB,   // int32 class followed by struct mob_db
+	DBS_MAX
+};
+struct db_snapshot_header {
+	char magic[4]; // DB_SNAPSHOT_MAGIC
+	uint32 version;
+	uint32 file_size;
+	uint32 key; // see map_snapshot_calckey
+	uint32 record_size[DBS_MAX]; // size of the structs stored in each section
+	uint32 count[DBS_MAX];
+	uint32 offset[DBS_MAX];
+	uint32 size[DBS_MAX];
+};
+
+// Txt databases read by worker threads during boot (see map_dbload_start)
+#define DB_LOAD_THREADS_MAX 32
+enum db_load_state {
+	DBL_QUEUED,  // waiting for a worker
+	DBL_RUNNING, // being read
+	DBL_DONE,    // rows ready to be parsed
+	DBL_USED,    // parsed by its sv->readdb call, rows released
+};
+struct db_load_task {
+	char path[256];
+	enum db_load_state state;
+	struct s_svrows rows;
+};
+
+// Phases timed by map->phase_begin/phase_end, reported when the outermost one ends
+#define MAP_PHASE_MAX 256
+#define MAP_PHASE_DEPTH 16
+struct map_phase {
+	const char *name;
+	int depth; // 0 for the outermost phase
+	unsigned int tick; // start, then duration in ms once ended
+	struct malloc_counters mem; // memory manager counters at the start, then the difference once ended
+	int count; // items processed, see map->phase_count
+	bool ended;
+};
+
 
 /*=====================================
 * Interface : map.h 
@@ -829,6 +917,11 @@ struct map_interface {
 	int port;
 	int users;
 	int enable_grf;	//To enable/disable reading maps from GRF files, bypassing mapcache [blackhole89]
+	int idle_timeout; // seconds an unused map keeps its cells and block grids (0: forever)
+	unsigned int idle_evicted; // maps released by the idle map timer
+	int db_snapshot; // load the item, skill and mob databases from a snapshot when possible
+	int db_load_threads; // threads reading the txt databases during boot (0: read by the main thread when needed)
+	char phase_log[256]; // file the phase reports are appended to as json (empty: none)
 	int ip_set;
 	int char_ip_set;
 
@@ -857,7 +950,16 @@ struct map_interface {
 	struct map_data *list;
 	/* [Ind/Hercules] */
 	struct eri *iterator_ers;
-	char *cache_buffer; // Has the uncompressed gat data of all maps, so just one allocation has to be made
+	char *cache_buffer; // Has the compressed gat data of all maps (mapped from the file when possible)
+	size_t cache_size;  // size of cache_buffer
+	bool cache_mapped;  // whether cache_buffer is mapped from the file instead of allocated
+	struct map_cache_dir_entry *cache_dir; // maps in cache_buffer, sorted by name
+	int cache_count;    // entries in cache_dir
+	unsigned char *snapshot_buffer; // db snapshot in use during boot (mapped from the file when possible)
+	size_t snapshot_size;
+	bool snapshot_mapped;
+	bool snapshot_save;  // whether the databases are to be written to a new snapshot once loaded
+	uint32 snapshot_key;
 	/* */
 	struct eri *flooritem_ers;
 	/* */
@@ -873,6 +975,28 @@ struct map_interface {
 	void (*setgatcell) (int16 m, int16 x, int16 y, int gat);
 
 	void (*cellfromcache) (struct map_data *m);
+	bool (*idle_check) (struct map_data *m, bool *has_npc);
+	void (*idle_release) (struct map_data *m, bool grids);
+	void (*blockgrid_alloc) (struct map_data *m);
+	int (*idle_timer) (int tid, unsigned int tick, int id, intptr_t data);
+	void (*memory_report) (void);
+	uint32 (*snapshot_calckey) (void);
+	void (*snapshot_open) (void);
+	const unsigned char* (*snapshot_section) (enum db_snapshot_section type, uint32 *count, uint32 *size);
+	void (*snapshot_close) (void);
+	void (*snapshot_write) (void);
+	void (*dbload_start) (void);
+	void* (*dbload_worker) (void *param);
+	bool (*dbload_readdb) (const char* directory, const char* filename, char delim, int mincols, int maxcols, int maxrows, bool (*parseproc)(char* fields[], int columns, int current));
+	void (*dbload_final) (void);
+	void (*phase_begin) (const char *name);
+	void (*phase_count) (int count);
+	void (*phase_end) (void);
+	void (*phase_report) (void);
+	void (*phase_json) (FILE *fp, int index);
+	void (*cellbits_build) (struct map_data *m);
+	void (*cellbits_update) (struct map_data *m, int16 x, int16 y);
+	void (*cellbits_free) (struct map_data *m);
 	// users
 	void (*setusers) (int);
 	int (*getusers) (void);
@@ -1000,6 +1124,7 @@ struct map_interface {
 	DBData (*create_map_data_other_server) (DBKey key, va_list args);
 	int (*eraseallipport_sub) (DBKey key, DBData *data, va_list va);
 	char* (*init_mapcache) (FILE *fp);
+	void (*final_mapcache) (void);
 	int (*readfromcache) (struct map_data *m, char *buffer);
 	int (*addmap) (char *mapname);
 	void (*delmapid) (int id);
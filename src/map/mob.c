@@ -4540,21 +4540,76 @@ bool mob_readdb_itemratio(char* str[], int columns, int current)
 	return true;
 }
 
+/*==========================================
+ * [Hercules] Database snapshot, see map_snapshot_open.
+ * Each monster is stored as its class followed by its struct mob_db,
+ * drops and skills included.
+ *------------------------------------------*/
+int mob_write_snapshot(FILE *fp) {
+	int i, count = 0;
+
+	for( i = 0; i < MAX_MOB_DB; i++ ) {
+		int32 class_ = i;
+
+		if( mob->db_data[i] == NULL || mob->is_clone(i) )
+			continue;
+		hwrite(&class_, sizeof(class_), 1, fp);
+		hwrite(mob->db_data[i], sizeof(struct mob_db), 1, fp);
+		count++;
+	}
+
+	return count;
+}
+bool mob_read_snapshot(void) {
+	const unsigned char *p;
+	uint32 count, size, i;
+
+	if( (p = map->snapshot_section(DBS_MOB, &count, &size)) == NULL )
+		return false;
+	if( size != count * (sizeof(int32) + sizeof(struct mob_db)) ) {
+		ShowError("mob_read_snapshot: The mob section of the database snapshot is corrupted, reading the mob db.\n");
+		map->snapshot_save = true;
+		return false;
+	}
+
+	for( i = 0; i < count; i++, p += sizeof(int32) + sizeof(struct mob_db) ) {
+		int32 class_;
+
+		memcpy(&class_, p, sizeof(class_));
+		if( class_ < 0 || class_ >= MAX_MOB_DB || mob->is_clone(class_) )
+			continue;
+		if( mob->db_data[class_] == NULL )
+			mob->db_data[class_] = (struct mob_db*)aMalloc(sizeof(struct mob_db));
+		memcpy(mob->db_data[class_], p + sizeof(int32), sizeof(struct mob_db));
+	}
+
+	ShowStatus("Done reading '"CL_WHITE"%u"CL_RESET"' entries in '"CL_WHITE"%s"CL_RESET"' ("CL_GREEN"C"CL_RESET").\n", count, DBPATH"mob_db.txt");
+	return true;
+}
+
 /**
  * read all mob-related databases
  */
 void mob_load(void) {
+	int i, count = 0;
+
 	sv->readdb(map->db_path, "mob_item_ratio.txt", ',', 2, 2+MAX_ITEMRATIO_MOBS, -1, mob->readdb_itemratio); // must be read before mobdb
 	mob->readchatdb();
+	map->phase_begin("mob_db, mob_skill_db");
 	if (map->db_use_sql_mob_db) {
 		mob->read_sqldb();
 	}
 	if (map->db_use_sql_mob_skill_db) {
 		mob->read_sqlskilldb();
-	} else {
+	} else if( !mob->read_snapshot() ) {
 		mob->readdb();
 		mob->readskilldb();
 	}
+	for( i = 1; i < MAX_MOB_DB; i++ )
+		if( mob->db_data[i] )
+			count++;
+	map->phase_count(count);
+	map->phase_end();
 	sv->readdb(map->db_path, "mob_avail.txt", ',', 2, 12, -1, mob->readdb_mobavail);
 	mob->read_randommonster();
 	sv->readdb(map->db_path, DBPATH"mob_race2_db.txt", ',', 2, 20, -1, mob->readdb_race2);
@@ -4753,6 +4808,8 @@ void mob_defaults(void) {
 	mob->parse_dbrow = mob_parse_dbrow;
 	mob->readdb_sub = mob_readdb_sub;
 	mob->readdb = mob_readdb;
+	mob->write_snapshot = mob_write_snapshot;
+	mob->read_snapshot = mob_read_snapshot;
 	mob->read_sqldb = mob_read_sqldb;
 	mob->readdb_mobavail = mob_readdb_mobavail;
 	mob->read_randommonster = mob_read_randommonster;
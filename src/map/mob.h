@@ -344,6 +344,8 @@ struct mob_interface {
 	bool (*parse_dbrow) (char **str);
 	bool (*readdb_sub) (char *fields[], int columns, int current);
 	void (*readdb) (void);
+	int (*write_snapshot) (FILE *fp);
+	bool (*read_snapshot) (void);
 	int (*read_sqldb) (void);
 	bool (*readdb_mobavail) (char *str[], int columns, int current);
 	int (*read_randommonster) (void);
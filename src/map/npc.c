@@ -3772,10 +3772,13 @@ int npc_reload(void) {
 
 	//TODO: the following code is copy-pasted from do_init_npc(); clean it up
 	// Reloading npcs now
+	map->phase_begin("npc files");
 	for (nsl = npc->src_files; nsl; nsl = nsl->next) {
 		ShowStatus("Loading NPC file: %s"CL_CLL"\r", nsl->name);
 		npc->parsesrcfile(nsl->name,false);
+		map->phase_count(1);
 	}
+	map->phase_end();
 	ShowInfo ("Done loading '"CL_WHITE"%d"CL_RESET"' NPCs:"CL_CLL"\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Warps\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Shops\n"
@@ -3924,10 +3927,13 @@ int do_init_npc(void)
 	
 	// process all npc files
 	ShowStatus("Loading NPCs...\r");
+	map->phase_begin("npc files");
 	for( file = npc->src_files; file != NULL; file = file->next ) {
 		ShowStatus("Loading NPC file: %s"CL_CLL"\r", file->name);
 		npc->parsesrcfile(file->name,false);
+		map->phase_count(1);
 	}
+	map->phase_end();
 	ShowInfo ("Done loading '"CL_WHITE"%d"CL_RESET"' NPCs:"CL_CLL"\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Warps\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Shops\n"
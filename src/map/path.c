@@ -8,6 +8,7 @@
 #include "../common/nullpo.h"
 #include "../common/random.h"
 #include "../common/showmsg.h"
+#include "../common/timer.h"
 
 #include "path.h"
 #include "map.h"
@@ -37,11 +38,19 @@ struct path_node {
 	short g_cost; ///< Actual cost from start to this node
 	short f_cost; ///< g_cost + heuristic(this, goal)
 	short flag; ///< SET_OPEN / SET_CLOSED
+	unsigned int search_id; ///< search this node belongs to (nodes of older searches are free)
 };
 
 /// Binary heap of path nodes
 BHEAP_STRUCT_DECL(node_heap, struct path_node*);
 
+/// Node storage shared by every A* search, so no search has to clear or allocate anything.
+/// A node is in use only if its search_id matches the current search.
+static struct path_node path_nodes[MAX_WALKPATH * MAX_WALKPATH];
+static unsigned int path_search_id = 0;
+/// 'Open' set; grows as needed and keeps its storage for the next searches (freed by path->final)
+static struct node_heap path_open_set = { 0, 0, NULL };
+
 /// Comparator for binary heap of path nodes (minimum cost at top)
 #define NODE_MINTOPCMP(i,j) ((i)->f_cost - (j)->f_cost)
 
@@ -107,6 +116,116 @@ int path_blownpos(int16 m,int16 x0,int16 y0,int16 dx,int16 dy,int count)
 	return (x0<<16)|y0; //TODO: use 'struct point' here instead?
 }
 
+/// Returns whether cells a..b (inclusive) of a bitmap line are all set, a word at a time.
+/// A word holds 64 cells and a run of a line of sight is no longer than the range
+/// of the attack (about AREA_SIZE cells), so it is one or two masked tests: wider
+/// (SSE2) loads would only add setup. A* tests single cells (path_cell_blocked).
+static inline bool path_bits_all_set(const uint64 *line, int a, int b)
+{
+	int wa = a>>6, wb = b>>6, w;
+	uint64 ma = ~(uint64)0 << (a&63);
+	uint64 mb = ~(uint64)0 >> (63 - (b&63));
+
+	if (wa == wb)
+		return (line[wa] & (ma & mb)) == (ma & mb);
+	if ((line[wa] & ma) != ma)
+		return false;
+	for (w = wa + 1; w < wb; w++)
+		if (line[w] != ~(uint64)0)
+			return false;
+	return (line[wb] & mb) == mb;
+}
+
+/// Selects the bitmaps able to answer a cell check, if any.
+static bool path_cellbits(struct map_data *md, cell_chk cell, const uint64 **row, const uint64 **col)
+{
+	switch (cell) {
+#ifndef CELL_NOSTACK
+		case CELL_CHKNOPASS:
+#endif
+		case CELL_CHKNOREACH:
+			if (md->cellbits == NULL)
+				map->cellbits_build(md);
+			*row = md->cellbits->walk_row;
+			*col = md->cellbits->walk_col;
+			return true;
+		case CELL_CHKWALL:
+			if (md->cellbits == NULL)
+				map->cellbits_build(md);
+			*row = md->cellbits->shoot_row;
+			*col = md->cellbits->shoot_col;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Line of sight test of path_search_long on the cell bitmaps.
+/// Walks the same cells as the Bresenham loop of path_search_long, but tests
+/// each straight run of cells along the major axis as one bit range.
+/// Returns 1 if the line is clear, 0 if it is blocked and -1 if the bitmaps
+/// can't answer (cell check not represented, or line touching the map border,
+/// where map->getcellp has special rules).
+static int path_search_long_bits(struct map_data *md, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	const uint64 *row, *col;
+	int dx, dy, wx = 0, wy = 0, weight;
+	int run_start, run_line; // current run: first cell on the major axis, line on the minor axis
+	bool xmajor;
+
+	if (x0 > x1) {
+		swap(x0, x1);
+		swap(y0, y1);
+	}
+	if (x0 < 0 || x1 >= md->xs-1 || min(y0,y1) < 0 || max(y0,y1) >= md->ys-1)
+		return -1;
+	if (!path_cellbits(md, cell, &row, &col))
+		return -1;
+
+	dx = x1 - x0;
+	dy = y1 - y0;
+	xmajor = (dx > abs(dy));
+	weight = xmajor ? dx : abs(dy);
+	run_start = xmajor ? x0 : y0;
+	run_line = xmajor ? y0 : x0;
+
+	while (x0 != x1 || y0 != y1) {
+		wx += dx;
+		wy += dy;
+		if (wx >= weight) {
+			wx -= weight;
+			x0++;
+		}
+		if (wy >= weight) {
+			wy -= weight;
+			y0++;
+		} else if (wy < 0) {
+			wy += weight;
+			y0--;
+		}
+		if ((xmajor ? y0 : x0) != run_line) {
+			// the line moved on the minor axis, test the finished run
+			if (xmajor) {
+				if (!path_bits_all_set(row + run_line*md->cellbits->stride_x, run_start, x0 - 1))
+					return 0;
+				run_start = x0;
+				run_line = y0;
+			} else {
+				int prev = (dy > 0) ? y0 - 1 : y0 + 1;
+				if (!path_bits_all_set(col + run_line*md->cellbits->stride_y, min(run_start, prev), max(run_start, prev)))
+					return 0;
+				run_start = y0;
+				run_line = x0;
+			}
+		}
+	}
+
+	// last run, up to and including the destination cell
+	if (xmajor)
+		return path_bits_all_set(row + run_line*md->cellbits->stride_x, run_start, x1) ? 1 : 0;
+	return path_bits_all_set(col + run_line*md->cellbits->stride_y, min(run_start, y1), max(run_start, y1)) ? 1 : 0;
+}
+
 /*==========================================
  * is ranged attack from (x0,y0) to (x1,y1) possible?
  *------------------------------------------*/
@@ -141,6 +260,12 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 	if (md->getcellp(md,x1,y1,cell))
 		return false;
 
+	if (spd == &s_spd) { // only the result is wanted, try the bitmaps
+		int clear = path_search_long_bits(md, x0, y0, x1, y1, cell);
+		if (clear >= 0)
+			return (clear == 1);
+	}
+
 	if (dx > abs(dy)) {
 		weight = dx;
 		spd->ry = 1;
@@ -182,10 +307,11 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 
 /// Pushes path_node to the binary node_heap.
 /// Ensures there is enough space in array to store new element.
-static void heap_push_node(struct node_heap *heap, struct path_node *node)
+static int heap_push_node(struct node_heap *heap, struct path_node *node)
 {
 	BHEAP_ENSURE(*heap, 1, 256);
 	BHEAP_PUSH(*heap, node, NODE_MINTOPCMP, swap_ptr);
+	return 0;
 }
 
 /// Updates path_node in the binary node_heap.
@@ -208,14 +334,15 @@ static int add_path(struct node_heap *heap, struct path_node *tp, int16 x, int16
 {
 	int i = calc_index(x, y);
 
-	if (tp[i].x == x && tp[i].y == y) { // We processed this node before
+	if (tp[i].search_id == path_search_id && tp[i].x == x && tp[i].y == y) { // We processed this node before
 		if (g_cost < tp[i].g_cost) { // New path to this node is better than old one
 			// Update costs and parent
 			tp[i].g_cost = g_cost;
 			tp[i].parent = parent; 
 			tp[i].f_cost = g_cost + h_cost;
 			if (tp[i].flag == SET_CLOSED) {
-				heap_push_node(heap, &tp[i]); // Put it in open set again
+				if (heap_push_node(heap, &tp[i])) // Put it in open set again
+					return 1;
 			}
 			else if (heap_update_node(heap, &tp[i])) {
 				return 1;
@@ -225,21 +352,172 @@ static int add_path(struct node_heap *heap, struct path_node *tp, int16 x, int16
 		return 0;
 	}
 
-	if (tp[i].x || tp[i].y) // Index is already taken; see `tp` array FIXME for details
+	if (tp[i].search_id == path_search_id) // Index is already taken; see `tp` array FIXME for details
 		return 1;
 
 	// New node
+	tp[i].search_id = path_search_id;
 	tp[i].x = x;
 	tp[i].y = y;
 	tp[i].g_cost = g_cost;
 	tp[i].parent = parent;
 	tp[i].f_cost = g_cost + h_cost;
 	tp[i].flag = SET_OPEN;
-	heap_push_node(heap, &tp[i]);
-	return 0;
+	return heap_push_node(heap, &tp[i]);
 }
 ///@}
 
+/// map->getcellp for A* searches, answered from a row bitmap when one is given.
+static inline int path_cell_blocked(struct map_data *md, const uint64 *bits, int16 x, int16 y, cell_chk cell)
+{
+	if (bits == NULL)
+		return md->getcellp(md, x, y, cell);
+	//NOTE: same override of the last row and column as map->getcellp
+	if (x < 0 || x >= md->xs-1 || y < 0 || y >= md->ys-1)
+		return (cell == CELL_CHKNOPASS);
+	return !(bits[y*md->cellbits->stride_x + (x>>6)] & ((uint64)1 << (x&63)));
+}
+
+/// A* (A-star) pathfinding from (x0,y0) to (x1,y1), see path_search.
+static bool path_search_astar(struct walkpath_data *wpd, struct map_data *md, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	struct node_heap *open_set = &path_open_set; // 'Open' set
+
+	// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
+	// can be found without node collision: calc_index(node1) = calc_index(node2).
+	// Figure out more proper size or another way to keep track of known nodes.
+	struct path_node *tp = path_nodes;
+	struct path_node *current, *it;
+	int i, j, x, y, dx, dy;
+	int xs = md->xs - 1;
+	int ys = md->ys - 1;
+	int len = 0;
+	const uint64 *bits = NULL, *col;
+
+	if (!path_cellbits(md, cell, &bits, &col))
+		bits = NULL; // not representable, ask map->getcellp
+
+	// Start a new search: nodes of previous searches become free
+	if (++path_search_id == 0) { // wrapped around, stale ids could match again
+		memset(path_nodes, 0, sizeof(path_nodes));
+		path_search_id = 1;
+	}
+	BHEAP_LENGTH(*open_set) = 0;
+
+	// Start node
+	i = calc_index(x0, y0);
+	tp[i].search_id = path_search_id;
+	tp[i].parent = NULL;
+	tp[i].x      = x0;
+	tp[i].y      = y0;
+	tp[i].g_cost = 0;
+	tp[i].f_cost = heuristic(x0, y0, x1, y1);
+	tp[i].flag   = SET_OPEN;
+
+	heap_push_node(open_set, &tp[i]); // Put start node to 'open' set
+	for(;;)
+	{
+		int e = 0; // error flag
+
+		// Saves allowed directions for the current cell. Diagonal directions
+		// are only allowed if both directions around it are allowed. This is
+		// to prevent cutting corner of nearby wall.
+		// For example, you can only go NW from the current cell, if you can
+		// go N *and* you can go W. Otherwise you need to walk around the
+		// (corner of the) non-walkable cell.
+		int allowed_dirs = 0;
+
+		int g_cost;
+
+		if (BHEAP_LENGTH(*open_set) == 0)
+			return false;
+
+		current = BHEAP_PEEK(*open_set); // Look for the lowest f_cost node in the 'open' set
+		BHEAP_POP(*open_set, NODE_MINTOPCMP, swap_ptr); // Remove it from 'open' set
+
+		x      = current->x;
+		y      = current->y;
+		g_cost = current->g_cost;
+
+		current->flag = SET_CLOSED; // Add current node to 'closed' set
+
+		if (x == x1 && y == y1)
+			break;
+
+		if (y < ys && !path_cell_blocked(md, bits, x, y+1, cell)) allowed_dirs |= DIR_NORTH;
+		if (y >  0 && !path_cell_blocked(md, bits, x, y-1, cell)) allowed_dirs |= DIR_SOUTH;
+		if (x < xs && !path_cell_blocked(md, bits, x+1, y, cell)) allowed_dirs |= DIR_EAST;
+		if (x >  0 && !path_cell_blocked(md, bits, x-1, y, cell)) allowed_dirs |= DIR_WEST;
+
+#define chk_dir(d) ((allowed_dirs & (d)) == (d))
+		// Process neighbors of current node
+		// TODO: Processing order affects chosen path if there is more than one path with same cost.
+		// In few cases path found by server will be different than path found by game client.
+		if (chk_dir(DIR_SOUTH))
+			e += add_path(open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
+		if (chk_dir(DIR_SOUTH|DIR_WEST) && !path_cell_blocked(md, bits, x-1, y-1, cell))
+			e += add_path(open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
+		if (chk_dir(DIR_WEST))
+			e += add_path(open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
+		if (chk_dir(DIR_NORTH|DIR_WEST) && !path_cell_blocked(md, bits, x-1, y+1, cell))
+			e += add_path(open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
+		if (chk_dir(DIR_NORTH))
+			e += add_path(open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
+		if (chk_dir(DIR_NORTH|DIR_EAST) && !path_cell_blocked(md, bits, x+1, y+1, cell))
+			e += add_path(open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
+		if (chk_dir(DIR_EAST))
+			e += add_path(open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
+		if (chk_dir(DIR_SOUTH|DIR_EAST) && !path_cell_blocked(md, bits, x+1, y-1, cell))
+			e += add_path(open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
+#undef chk_dir
+		if (e)
+			return false;
+	}
+
+	for (it = current; it->parent != NULL; it = it->parent, len++);
+	if (len > sizeof(wpd->path)) {
+		return false;
+	}
+
+	// Recreate path
+	wpd->path_len = len;
+	wpd->path_pos = 0;
+	for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
+		dx = it->x - it->parent->x;
+		dy = it->y - it->parent->y;
+		wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	}
+	return true;
+}
+
+/// Cells the path cache may be used for; they must only depend on cell data
+/// that bumps map_data::path_gen when modified (see map->setcell).
+static bool path_cache_cellchk(cell_chk cell)
+{
+	switch (cell) {
+#ifndef CELL_NOSTACK
+		case CELL_CHKNOPASS:
+#endif
+		case CELL_CHKNOREACH:
+		case CELL_CHKWALL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Returns the cache slot of the given search in the map's path cache.
+static struct path_cache_entry *path_cache_slot(struct map_data *md, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	unsigned int hash;
+
+	if (md->path_cache == NULL)
+		CREATE(md->path_cache, struct path_cache_entry, PATH_CACHE_SIZE);
+
+	hash = (unsigned int)x0 * 73856093u ^ (unsigned int)y0 * 19349663u ^ (unsigned int)x1 * 83492791u ^ (unsigned int)y1 * 2654435761u ^ (unsigned int)cell;
+	return &md->path_cache[(hash ^ (hash >> 16)) & (PATH_CACHE_SIZE - 1)];
+}
+
 /*==========================================
  * path search (x0,y0)->(x1,y1)
  * wpd: path info will be written here
@@ -248,9 +526,11 @@ static int add_path(struct node_heap *heap, struct path_node *tp, int16 x, int16
  *------------------------------------------*/
 bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int flag, cell_chk cell)
 {
-	register int i, j, x, y, dx, dy;
+	register int i, x, y, dx, dy;
 	struct map_data *md;
 	struct walkpath_data s_wpd;
+	struct path_cache_entry *entry;
+	bool found;
 
 	if (wpd == NULL)
 		wpd = &s_wpd; // use dummy output variable
@@ -259,6 +539,9 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 		return false;
 	md = &map->list[m];
 
+	if (path->record_fp != NULL)
+		fprintf(path->record_fp, "%s %d %d %d %d %d %d\n", md->name, x0, y0, x1, y1, flag, (int)cell);
+
 #ifdef CELL_NOSTACK
 	//Do not check starting cell as that would get you stuck.
 	if (x0 < 0 || x0 >= md->xs || y0 < 0 || y0 >= md->ys)
@@ -308,117 +591,204 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 
 		return false; // easy path unsuccessful 
 	}
-	else { // !(flag&1)
-		// A* (A-star) pathfinding
-		// We always use A* for finding walkpaths because it is what game client uses.
-		// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it.
-		
-		BHEAP_STRUCT_VAR(node_heap, open_set); // 'Open' set
-
-		// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
-		// can be found without node collision: calc_index(node1) = calc_index(node2).
-		// Figure out more proper size or another way to keep track of known nodes.
-		struct path_node tp[MAX_WALKPATH * MAX_WALKPATH];
-		struct path_node *current, *it;
-		int xs = md->xs - 1;
-		int ys = md->ys - 1;
-		int len = 0;
-		memset(tp, 0, sizeof(tp));
-
-		// Start node
-		i = calc_index(x0, y0);
-		tp[i].parent = NULL;
-		tp[i].x      = x0;
-		tp[i].y      = y0;
-		tp[i].g_cost = 0;
-		tp[i].f_cost = heuristic(x0, y0, x1, y1);
-		tp[i].flag   = SET_OPEN;
-
-		heap_push_node(&open_set, &tp[i]); // Put start node to 'open' set
-		for(;;)
-		{
-			int e = 0; // error flag
 
-			// Saves allowed directions for the current cell. Diagonal directions
-			// are only allowed if both directions around it are allowed. This is
-			// to prevent cutting corner of nearby wall.
-			// For example, you can only go NW from the current cell, if you can
-			// go N *and* you can go W. Otherwise you need to walk around the
-			// (corner of the) non-walkable cell.
-			int allowed_dirs = 0;
+	// We always use A* for finding walkpaths because it is what game client uses.
+	// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it.
+	// Results only depend on the cells of the map, so they are cached until one of them changes.
+	if (!path->cache_enabled || !path_cache_cellchk(cell))
+		return path_search_astar(wpd, md, x0, y0, x1, y1, cell);
+
+	entry = path_cache_slot(md, x0, y0, x1, y1, cell);
+	if (entry->gen == md->path_gen + 1 && entry->x0 == x0 && entry->y0 == y0
+	 && entry->x1 == x1 && entry->y1 == y1 && entry->cell == cell) {
+		path->cache_hits++;
+		if (entry->found)
+			memcpy(wpd, &entry->wpd, sizeof(*wpd));
+		return entry->found;
+	}
+	path->cache_misses++;
+
+	found = path_search_astar(wpd, md, x0, y0, x1, y1, cell);
+
+	entry->gen = md->path_gen + 1;
+	entry->x0 = x0;
+	entry->y0 = y0;
+	entry->x1 = x1;
+	entry->y1 = y1;
+	entry->cell = cell;
+	entry->found = found;
+	if (found)
+		memcpy(&entry->wpd, wpd, sizeof(*wpd));
+	return found;
+}
 
-			int g_cost;
+/// @name Flow fields for chased units
+/// @{
 
-			if (BHEAP_LENGTH(open_set) == 0) {
-				BHEAP_CLEAR(open_set);
-				return false;
-			}
+/// Heap of (cost << 16 | cell index) keys, cells may be in it more than once
+BHEAP_STRUCT_DECL(flow_heap, uint32);
+static uint32 path_flow_buf[PATH_FLOWFIELD_SIZE * PATH_FLOWFIELD_SIZE * 8];
+static struct flow_heap path_flow_open = { ARRAYLENGTH(path_flow_buf), 0, path_flow_buf };
+static struct path_flowfield path_flowfields[PATH_FLOWFIELD_COUNT];
 
-			current = BHEAP_PEEK(open_set); // Look for the lowest f_cost node in the 'open' set
-			BHEAP_POP(open_set, NODE_MINTOPCMP, swap_ptr); // Remove it from 'open' set
+/// Comparator for the flow field heap (minimum cost at top)
+#define FLOW_MINTOPCMP(i,j) ((i) < (j) ? -1 : ((i) > (j) ? 1 : 0))
+#define FLOW_UNKNOWN 0xffff
 
-			x      = current->x;
-			y      = current->y;
-			g_cost = current->g_cost;
+/// Neighbours in the order A* processes them
+static const int8 flow_dx[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+static const int8 flow_dy[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
 
-			current->flag = SET_CLOSED; // Add current node to 'closed' set
+/// Returns whether a step from (x,y) to (x+dx,y+dy) is allowed, using the same rules as A*.
+static inline bool path_flow_step(struct map_data *md, const uint64 *bits, int16 x, int16 y, int dx, int dy)
+{
+	if (path_cell_blocked(md, bits, x+dx, y+dy, CELL_CHKNOPASS))
+		return false;
+	if (dx && dy) // no cutting corners of non-walkable cells
+		return !path_cell_blocked(md, bits, x+dx, y, CELL_CHKNOPASS) && !path_cell_blocked(md, bits, x, y+dy, CELL_CHKNOPASS);
+	return true;
+}
 
-			if (x == x1 && y == y1) {
-				BHEAP_CLEAR(open_set);
-				break;
-			}
+/// Computes the walking cost from every cell within PATH_FLOWFIELD_RANGE of the
+/// chased unit to the nearest free cell next to it (Dijkstra with A* move costs).
+static void path_flowfield_build(struct path_flowfield *ff, struct map_data *md, const uint64 *bits)
+{
+	struct flow_heap *open = &path_flow_open;
+	int bx = ff->x - PATH_FLOWFIELD_RANGE;
+	int by = ff->y - PATH_FLOWFIELD_RANGE;
+	int i;
 
-			if (y < ys && !md->getcellp(md, x, y+1, cell)) allowed_dirs |= DIR_NORTH;
-			if (y >  0 && !md->getcellp(md, x, y-1, cell)) allowed_dirs |= DIR_SOUTH;
-			if (x < xs && !md->getcellp(md, x+1, y, cell)) allowed_dirs |= DIR_EAST;
-			if (x >  0 && !md->getcellp(md, x-1, y, cell)) allowed_dirs |= DIR_WEST;
+	memset(ff->cost, 0xff, sizeof(ff->cost));
+	BHEAP_LENGTH(*open) = 0;
 
-#define chk_dir(d) ((allowed_dirs & (d)) == (d))
-			// Process neighbors of current node
-			// TODO: Processing order affects chosen path if there is more than one path with same cost.
-			// In few cases path found by server will be different than path found by game client.
-			if (chk_dir(DIR_SOUTH))
-				e += add_path(&open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
-			if (chk_dir(DIR_SOUTH|DIR_WEST) && !md->getcellp(md, x-1, y-1, cell))
-				e += add_path(&open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
-			if (chk_dir(DIR_WEST))
-				e += add_path(&open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
-			if (chk_dir(DIR_NORTH|DIR_WEST) && !md->getcellp(md, x-1, y+1, cell))
-				e += add_path(&open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
-			if (chk_dir(DIR_NORTH))
-				e += add_path(&open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
-			if (chk_dir(DIR_NORTH|DIR_EAST) && !md->getcellp(md, x+1, y+1, cell))
-				e += add_path(&open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
-			if (chk_dir(DIR_EAST))
-				e += add_path(&open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
-			if (chk_dir(DIR_SOUTH|DIR_EAST) && !md->getcellp(md, x+1, y-1, cell))
-				e += add_path(&open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
-#undef chk_dir
-			if (e) {
-				BHEAP_CLEAR(open_set);
-				return false;
-			}
+	for (i = 0; i < 8; i++) { // goals
+		int x = ff->x + flow_dx[i], y = ff->y + flow_dy[i];
+		int idx = (y - by) * PATH_FLOWFIELD_SIZE + (x - bx);
+		if (path_cell_blocked(md, bits, x, y, CELL_CHKNOPASS))
+			continue;
+		ff->cost[idx] = 0;
+		BHEAP_PUSH(*open, (uint32)idx, FLOW_MINTOPCMP, swap);
+	}
+
+	while (BHEAP_LENGTH(*open) > 0) {
+		uint32 key = BHEAP_PEEK(*open);
+		int idx = key & 0xffff, cost = key >> 16;
+		int x = bx + idx % PATH_FLOWFIELD_SIZE;
+		int y = by + idx / PATH_FLOWFIELD_SIZE;
+
+		BHEAP_POP(*open, FLOW_MINTOPCMP, swap);
+		if (cost != ff->cost[idx])
+			continue; // cheaper path was found after this was queued
+
+		// Relax every cell that can step into (x,y)
+		for (i = 0; i < 8; i++) {
+			int px = x - flow_dx[i], py = y - flow_dy[i];
+			int pidx, pcost;
+			if (px < bx || px >= bx + PATH_FLOWFIELD_SIZE || py < by || py >= by + PATH_FLOWFIELD_SIZE)
+				continue;
+			if (path_cell_blocked(md, bits, px, py, CELL_CHKNOPASS) || !path_flow_step(md, bits, px, py, flow_dx[i], flow_dy[i]))
+				continue;
+			pidx = (py - by) * PATH_FLOWFIELD_SIZE + (px - bx);
+			pcost = cost + ((flow_dx[i] && flow_dy[i]) ? MOVE_DIAGONAL_COST : MOVE_COST);
+			if (pcost >= ff->cost[pidx])
+				continue;
+			ff->cost[pidx] = pcost;
+			BHEAP_PUSH(*open, (uint32)pcost << 16 | (uint32)pidx, FLOW_MINTOPCMP, swap);
 		}
+	}
+	path->flowfield_builds++;
+}
 
-		for (it = current; it->parent != NULL; it = it->parent, len++);
-		if (len > sizeof(wpd->path)) {
-			return false;
+/*==========================================
+ * Walkable path search from (x0,y0) to a free cell next to (x1,y1),
+ * the position of unit target_id, chased by unit src_id.
+ * Once several units ask for the same position, the walking costs
+ * around it are computed once and every chaser follows them.
+ * The path is a shortest path with A* move costs, but its steps can
+ * differ from path->search, so it only answers reachability checks
+ * (unit->can_reach_bl): walk paths sent to clients (clif->move) always
+ * come from path->search, clients compute them again with their own A*.
+ * Returns false if the flow field can't answer, then path->search is needed.
+ *------------------------------------------*/
+bool path_search_chase(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int src_id, int target_id, int16 x1, int16 y1, int16 *to_x, int16 *to_y, cell_chk cell)
+{
+	struct path_flowfield *ff;
+	struct map_data *md;
+	struct walkpath_data s_wpd;
+	const uint64 *bits, *col;
+	int bx, by, x, y, len;
+
+	if (!path->flowfield_enabled || m < 0 || m >= map->count || !map->list[m].cell)
+		return false;
+	md = &map->list[m];
+
+	if (abs(x0 - x1) > PATH_FLOWFIELD_RANGE || abs(y0 - y1) > PATH_FLOWFIELD_RANGE)
+		return false;
+	// The field only knows walkable cells
+	if (cell == CELL_CHKWALL || !path_cellbits(md, cell, &bits, &col))
+		return false;
+
+	ff = &path_flowfields[target_id & (PATH_FLOWFIELD_COUNT - 1)];
+	if (ff->target_id != target_id || ff->m != m || ff->x != x1 || ff->y != y1) {
+		// Chased unit moved (or a different one), start counting chasers again
+		ff->target_id = target_id;
+		ff->m = m;
+		ff->x = x1;
+		ff->y = y1;
+		ff->gen = 0;
+		ff->last_id = src_id;
+		ff->requests = 1;
+		return false;
+	}
+	if (ff->gen != md->path_gen + 1) {
+		if (ff->last_id != src_id) {
+			ff->last_id = src_id;
+			ff->requests++;
 		}
+		if (ff->gen == 0 && ff->requests < PATH_FLOWFIELD_CHASERS)
+			return false;
+		path_flowfield_build(ff, md, bits);
+		ff->gen = md->path_gen + 1;
+	}
+
+	if (wpd == NULL)
+		wpd = &s_wpd; // use dummy output variable
 
-		// Recreate path
-		wpd->path_len = len;
-		wpd->path_pos = 0;
-		for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
-			dx = it->x - it->parent->x;
-			dy = it->y - it->parent->y;
-			wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	// Follow the costs down to a goal
+	bx = x1 - PATH_FLOWFIELD_RANGE;
+	by = y1 - PATH_FLOWFIELD_RANGE;
+	x = x0;
+	y = y0;
+	len = 0;
+	while (ff->cost[(y - by) * PATH_FLOWFIELD_SIZE + (x - bx)] != 0) {
+		int i, best = -1, best_cost = FLOW_UNKNOWN;
+		for (i = 0; i < 8; i++) {
+			int nx = x + flow_dx[i], ny = y + flow_dy[i], c;
+			if (nx < bx || nx >= bx + PATH_FLOWFIELD_SIZE || ny < by || ny >= by + PATH_FLOWFIELD_SIZE)
+				continue;
+			if ((c = ff->cost[(ny - by) * PATH_FLOWFIELD_SIZE + (nx - bx)]) == FLOW_UNKNOWN || !path_flow_step(md, bits, x, y, flow_dx[i], flow_dy[i]))
+				continue;
+			c += (flow_dx[i] && flow_dy[i]) ? MOVE_DIAGONAL_COST : MOVE_COST;
+			if (c < best_cost) {
+				best_cost = c;
+				best = i;
+			}
 		}
-		return true;
-	} // A* end
+		if (best < 0 || len >= ARRAYLENGTH(wpd->path))
+			return false; // no path within the field, or too long to walk
+		wpd->path[len++] = walk_choices[-flow_dy[best] + 1][flow_dx[best] + 1];
+		x += flow_dx[best];
+		y += flow_dy[best];
+	}
 
-	return false;
+	wpd->path_len = len;
+	wpd->path_pos = 0;
+	if (to_x) *to_x = x;
+	if (to_y) *to_y = y;
+	path->flowfield_hits++;
+	return true;
 }
-
+/// @}
 
 //Distance functions, taken from http://www.flipcode.com/articles/article_fastdistance.shtml
 int check_distance(int dx, int dy, int distance)
@@ -461,12 +831,124 @@ unsigned int distance(int dx, int dy)
 	return (dx<dy?dy:dx);
 #endif
 }
+/*==========================================
+ * Path search recording and benchmark
+ *------------------------------------------*/
+bool path_record(const char *file)
+{
+	if (path->record_fp != NULL) {
+		fclose(path->record_fp);
+		path->record_fp = NULL;
+	}
+	if (file == NULL)
+		return true;
+	if ((path->record_fp = fopen(file, "w")) == NULL) {
+		ShowError("path_record: can't open '%s' for writing\n", file);
+		return false;
+	}
+	return true;
+}
+
+/// Runs every query of a path->record file 'rounds' times, without and then with the cache.
+void path_bench(const char *file, int rounds)
+{
+	struct path_bench_query {
+		int16 m, x0, y0, x1, y1;
+		int flag;
+		cell_chk cell;
+	} *query = NULL;
+	int count = 0, max = 0, skipped = 0, found[2] = { 0, 0 };
+	int i, j, pass;
+	unsigned int ticks[2];
+	bool cache_enabled = path->cache_enabled;
+	char line[256];
+	FILE *fp;
+
+	if ((fp = fopen(file, "r")) == NULL) {
+		ShowError("path_bench: can't open '%s'\n", file);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		char mapname[MAP_NAME_LENGTH_EXT];
+		int x0, y0, x1, y1, flag, cell;
+		int16 m;
+
+		if (sscanf(line, "%15s %d %d %d %d %d %d", mapname, &x0, &y0, &x1, &y1, &flag, &cell) != 7)
+			continue;
+		if ((m = map->mapname2mapid(mapname)) < 0) {
+			skipped++;
+			continue;
+		}
+		if (count == max) {
+			max += 1024;
+			RECREATE(query, struct path_bench_query, max);
+		}
+		query[count].m = m;
+		query[count].x0 = x0;
+		query[count].y0 = y0;
+		query[count].x1 = x1;
+		query[count].y1 = y1;
+		query[count].flag = flag;
+		query[count].cell = (cell_chk)cell;
+		count++;
+	}
+	fclose(fp);
+
+	if (count == 0) {
+		ShowWarning("path_bench: no usable queries in '%s' (%d on unknown maps)\n", file, skipped);
+		aFree(query);
+		return;
+	}
+	if (rounds < 1)
+		rounds = 1;
+
+	for (pass = 0; pass < 2; pass++) {
+		unsigned int start;
+
+		path->cache_enabled = (pass == 1);
+		for (i = 0; i < map->count; i++) // start every pass cold
+			map->list[i].path_gen++;
+		path->cache_hits = path->cache_misses = 0;
+
+		start = timer->gettick_nocache();
+		for (j = 0; j < rounds; j++) {
+			for (i = 0; i < count; i++) {
+				if (path->search(NULL, query[i].m, query[i].x0, query[i].y0, query[i].x1, query[i].y1, query[i].flag, query[i].cell))
+					found[pass]++;
+			}
+		}
+		ticks[pass] = timer->gettick_nocache() - start;
+	}
+	path->cache_enabled = cache_enabled;
+
+	ShowInfo("path_bench: %d queries x %d rounds (%d skipped)\n", count, rounds, skipped);
+	ShowInfo("path_bench: uncached %ums, cached %ums (hits %u, misses %u)\n", ticks[0], ticks[1], path->cache_hits, path->cache_misses);
+	if (found[0] != found[1])
+		ShowError("path_bench: results differ: %d paths found uncached, %d cached\n", found[0], found[1]);
+	aFree(query);
+}
+
+void path_final(void) {
+	BHEAP_CLEAR(path_open_set);
+	path->record(NULL);
+}
+
 void path_defaults(void) {
 	path = &path_s;
 	
+	path->cache_enabled = true;
+	path->cache_hits = path->cache_misses = 0;
+	path->flowfield_enabled = true;
+	path->flowfield_builds = path->flowfield_hits = 0;
+	path->record_fp = NULL;
+
 	path->blownpos = path_blownpos;
 	path->search_long = path_search_long;
 	path->search = path_search;
+	path->search_chase = path_search_chase;
 	path->check_distance = check_distance;
 	path->distance = distance;
+	path->record = path_record;
+	path->bench = path_bench;
+	path->final = path_final;
 }
@@ -12,6 +12,13 @@
 
 #define MAX_WALKPATH 32
 
+#define PATH_CACHE_SIZE 256 // path search results cached per map, must be a power of two
+
+#define PATH_FLOWFIELD_RANGE 16 // cells around the chased unit covered by a flow field
+#define PATH_FLOWFIELD_SIZE (PATH_FLOWFIELD_RANGE*2+1)
+#define PATH_FLOWFIELD_COUNT 64 // flow fields kept at once, must be a power of two
+#define PATH_FLOWFIELD_CHASERS 3 // chasers asking for a target position before its flow field is computed
+
 struct walkpath_data {
 	unsigned char path_len,path_pos;
 	unsigned char path[MAX_WALKPATH];
@@ -23,6 +30,26 @@ struct shootpath_data {
 	int y[MAX_WALKPATH];
 };
 
+/// Cached A* search result, valid while the map's path_gen is unchanged
+struct path_cache_entry {
+	unsigned int gen; // map_data::path_gen + 1 at the time of the search, 0 = unused
+	int16 x0, y0, x1, y1;
+	cell_chk cell;
+	bool found;
+	struct walkpath_data wpd;
+};
+
+/// Walking costs towards a chased unit, shared by every unit chasing it.
+/// Valid while the unit stays on its cell and the map's path_gen is unchanged.
+struct path_flowfield {
+	int target_id;
+	int16 m, x, y;     // position of the chased unit
+	unsigned int gen;  // map_data::path_gen + 1 when computed, 0 = not computed yet
+	int last_id;       // last unit that asked for this position
+	int requests;      // number of times the asking unit changed
+	unsigned short cost[PATH_FLOWFIELD_SIZE*PATH_FLOWFIELD_SIZE]; // cost of walking next to the chased unit, 0xffff = unknown
+};
+
 #define check_distance_bl(bl1, bl2, distance) path->check_distance((bl1)->x - (bl2)->x, (bl1)->y - (bl2)->y, distance)
 #define check_distance_blxy(bl, x1, y1, distance) path->check_distance((bl)->x-(x1), (bl)->y-(y1), distance)
 #define check_distance_xy(x0, y0, x1, y1, distance) path->check_distance((x0)-(x1), (y0)-(y1), distance)
@@ -32,14 +59,31 @@ struct shootpath_data {
 #define distance_xy(x0, y0, x1, y1) path->distance((x0)-(x1), (y0)-(y1))
 
 struct path_interface {
+	/* path search cache */
+	bool cache_enabled;
+	unsigned int cache_hits, cache_misses;
+	/* flow fields for chased units */
+	bool flowfield_enabled;
+	unsigned int flowfield_builds, flowfield_hits;
+	/* query recording for path->bench */
+	FILE *record_fp;
+	/* */
 	// calculates destination cell for knockback
 	int (*blownpos) (int16 m, int16 x0, int16 y0, int16 dx, int16 dy, int count);
 	// tries to find a walkable path
 	bool (*search) (struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int flag, cell_chk cell);
 	// tries to find a shootable path
 	bool (*search_long) (struct shootpath_data *spd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell);
+	// tries to find a walkable path next to a unit chased by several others, using a shared flow field (reachability checks only)
+	bool (*search_chase) (struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int src_id, int target_id, int16 x1, int16 y1, int16 *to_x, int16 *to_y, cell_chk cell);
 	int (*check_distance) (int dx, int dy, int distance);
 	unsigned int (*distance) (int dx, int dy);
+	// starts (file != NULL) or stops recording every path search to a file
+	bool (*record) (const char *file);
+	// replays recorded path searches with and without the cache and reports timings
+	void (*bench) (const char *file, int rounds);
+	// frees the storage kept between searches and stops recording
+	void (*final) (void);
 };
 
 struct path_interface *path;
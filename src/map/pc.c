@@ -1231,6 +1231,7 @@ int pc_reg_received(struct map_session_data *sd)
 	if (sd->state.active)
 		return 0;
 	sd->state.active = 1;
+	pc->autosave_link(sd);
 
 	if (sd->status.party_id)
 		party->member_joined(sd);
@@ -3694,6 +3695,7 @@ int pc_payzeny(struct map_session_data *sd,int zeny, enum e_log_pick_type type,
 
 	if(!tsd) tsd = sd;
 	logs->zeny(sd, type, tsd, -zeny);
+	pc->autosave_mark(sd, 1 + zeny / PC_AUTOSAVE_ZENY);
 	if( zeny > 0 && sd->state.showzeny ) {
 		char output[255];
 		sprintf(output, "Removed %dz.", zeny);
@@ -3822,6 +3824,7 @@ int pc_getzeny(struct map_session_data *sd,int zeny, enum e_log_pick_type type,
 
 	if(!tsd) tsd = sd;
 	logs->zeny(sd, type, tsd, zeny);
+	pc->autosave_mark(sd, 1 + zeny / PC_AUTOSAVE_ZENY);
 	if( zeny > 0 && sd->state.showzeny ) {
 		char output[255];
 		sprintf(output, "Gained %dz.", zeny);
@@ -3917,6 +3920,7 @@ int pc_additem(struct map_session_data *sd,struct item *item_data,int amount,e_l
 		sd->status.inventory[i].unique_id = itemdb->unique_id(0,0);
 #endif
 	logs->pick_pc(sd, log_type, amount, &sd->status.inventory[i],sd->inventory_data[i]);
+	pc->autosave_mark(sd, pc->autosave_itemscore(&sd->status.inventory[i],sd->inventory_data[i]));
 
 	sd->weight += w;
 	clif->updatestatus(sd,SP_WEIGHT);
@@ -3957,6 +3961,7 @@ int pc_delitem(struct map_session_data *sd,int n,int amount,int type, short reas
 		return 1;
 
 	logs->pick_pc(sd, log_type, -amount, &sd->status.inventory[n],sd->inventory_data[n]);
+	pc->autosave_mark(sd, pc->autosave_itemscore(&sd->status.inventory[n],sd->inventory_data[n]));
 
 	sd->status.inventory[n].amount -= amount;
 	sd->weight -= sd->inventory_data[n]->weight*amount ;
@@ -4478,6 +4483,7 @@ int pc_cart_additem(struct map_session_data *sd,struct item *item_data,int amoun
 	}
 	sd->status.cart[i].favorite = 0;/* clear */
 	logs->pick_pc(sd, log_type, amount, &sd->status.cart[i],data);
+	pc->autosave_mark(sd, pc->autosave_itemscore(&sd->status.cart[i],data));
 
 	sd->cart_weight += w;
 	clif->updatestatus(sd,SP_CARTINFO);
@@ -4499,6 +4505,7 @@ int pc_cart_delitem(struct map_session_data *sd,int n,int amount,int type,e_log_
 		return 1;
 
 	logs->pick_pc(sd, log_type, -amount, &sd->status.cart[n],data);
+	pc->autosave_mark(sd, pc->autosave_itemscore(&sd->status.cart[n],data));
 
 	sd->status.cart[n].amount -= amount;
 	sd->cart_weight -= data->weight*amount ;
@@ -4829,9 +4836,7 @@ int pc_setpos(struct map_session_data* sd, unsigned short mapindex, int x, int y
 			status_change_end(&sd->bl, SC_MIRACLE, INVALID_TIMER);
 			if (sd->sc.data[SC_KNOWLEDGE]) {
 				struct status_change_entry *sce = sd->sc.data[SC_KNOWLEDGE];
-				if (sce->timer != INVALID_TIMER)
-					timer->delete(sce->timer, status->change_timer);
-				sce->timer = timer->add(timer->gettick() + skill->get_time(SG_KNOWLEDGE, sce->val1), status->change_timer, sd->bl.id, SC_KNOWLEDGE);
+				status->change_timer_add(&sd->bl, SC_KNOWLEDGE, timer->gettick() + skill->get_time(SG_KNOWLEDGE, sce->val1));
 			}
 			status_change_end(&sd->bl, SC_PROPERTYWALK, INVALID_TIMER);
 			status_change_end(&sd->bl, SC_CLOAKING, INVALID_TIMER);
@@ -5874,6 +5879,8 @@ int pc_gainexp(struct map_session_data *sd, struct block_list *src, unsigned int
 		}
 	}
 
+	pc->autosave_mark(sd, 1);
+
 	//Cap exp to the level up requirement of the previous level when you are at max level, otherwise cap at UINT_MAX (this is required for some S. Novice bonuses). [Skotlex]
 	if (base_exp) {
 		nextb = nextb?UINT_MAX:pc->thisbaseexp(sd);
@@ -9224,44 +9231,124 @@ int pc_setsavepoint(struct map_session_data *sd, short mapindex,int x,int y)
 }
 
 /*==========================================
- * Save 1 player data  at autosave intervalle
+ * Autosave scheduler
+ * Online characters are kept in a ring that pc_autosave walks a few at a
+ * time. A character is due once autosave_interval passed since its last
+ * save; not every change is tracked by pc_autosave_mark, so characters
+ * without tracked changes are due as well, and chrif_save_status sends
+ * nothing for those that really did not change. Characters with valuable
+ * changes are moved in front of the walk and saved sooner.
+ * At most one character is saved per minsave_interval on average.
  *------------------------------------------*/
-int pc_autosave(int tid, unsigned int tick, int id, intptr_t data)
-{
-	int interval;
-	struct s_mapiterator* iter;
-	struct map_session_data* sd;
-	static int last_save_id = 0, save_flag = 0;
+static struct map_session_data *autosave_cursor = NULL; // next character pc_autosave examines
+static int autosave_budget = 0; // ms of save budget left
+
+/// Inserts 'sd' in the ring right before the cursor (examined last).
+static void pc_autosave_insert(struct map_session_data *sd) {
+	if( autosave_cursor == NULL ) {
+		sd->autosave.prev = sd->autosave.next = sd;
+		autosave_cursor = sd;
+		return;
+	}
+	sd->autosave.next = autosave_cursor;
+	sd->autosave.prev = autosave_cursor->autosave.prev;
+	sd->autosave.prev->autosave.next = sd;
+	autosave_cursor->autosave.prev = sd;
+}
 
-	if(save_flag == 2) //Someone was saved on last call, normal cycle
-		save_flag = 0;
-	else
-		save_flag = 1; //Noone was saved, so save first found char.
+/// Removes 'sd' from the ring.
+static void pc_autosave_remove(struct map_session_data *sd) {
+	if( sd->autosave.next == sd )
+		autosave_cursor = NULL;
+	else {
+		if( autosave_cursor == sd )
+			autosave_cursor = sd->autosave.next;
+		sd->autosave.prev->autosave.next = sd->autosave.next;
+		sd->autosave.next->autosave.prev = sd->autosave.prev;
+	}
+	sd->autosave.prev = sd->autosave.next = NULL;
+}
 
-	iter = mapit_getallusers();
-	for( sd = (TBL_PC*)mapit->first(iter); mapit->exists(iter); sd = (TBL_PC*)mapit->next(iter) )
-	{
-		if(sd->bl.id == last_save_id && save_flag != 1) {
-			save_flag = 1;
-			continue;
-		}
+void pc_autosave_link(struct map_session_data *sd) {
+	nullpo_retv(sd);
+	if( sd->autosave.next != NULL )
+		return;
+	sd->autosave.tick = timer->gettick();
+	pc_autosave_insert(sd);
+	pc->autosave_stats.users++;
+}
 
-		if(save_flag != 1) //Not our turn to save yet.
-			continue;
+void pc_autosave_unlink(struct map_session_data *sd) {
+	nullpo_retv(sd);
+	if( sd->autosave.next == NULL )
+		return;
+	pc_autosave_remove(sd);
+	pc->autosave_stats.users--;
+}
 
-		//Save char.
-		last_save_id = sd->bl.id;
-		save_flag = 2;
+/// Notes that 'sd' changed; the more 'dirty', the sooner it is saved.
+void pc_autosave_mark(struct map_session_data *sd, unsigned int dirty) {
+	bool urgent;
 
-		chrif->save(sd,0);
-		break;
+	nullpo_retv(sd);
+	urgent = ( sd->autosave.dirty < PC_AUTOSAVE_URGENT );
+	sd->autosave.dirty = ( dirty > UINT_MAX - sd->autosave.dirty ) ? UINT_MAX : sd->autosave.dirty + dirty;
+	if( urgent && sd->autosave.dirty >= PC_AUTOSAVE_URGENT && sd->autosave.next != NULL && autosave_cursor != sd ) {
+		// just became urgent, examine it next
+		pc_autosave_remove(sd);
+		pc_autosave_insert(sd);
+		autosave_cursor = sd;
 	}
-	mapit->free(iter);
+}
+
+/// How much gaining or losing item 'it' makes its owner dirty.
+unsigned int pc_autosave_itemscore(const struct item *it, struct item_data *data) {
+	if( data == NULL && (data = itemdb->exists(it->nameid)) == NULL )
+		return 1;
+	if( data->type == IT_CARD || data->value_buy >= PC_AUTOSAVE_RARE_VALUE || it->refine >= PC_AUTOSAVE_RARE_REFINE
+	 || (it->card[0] > 0 && !itemdb_isspecial(it->card[0])) ) // rare or has cards in it
+		return PC_AUTOSAVE_URGENT;
+	return 1;
+}
+
+/*==========================================
+ * Saves the characters that are due, within the save budget
+ *------------------------------------------*/
+int pc_autosave(int tid, unsigned int tick, int id, intptr_t data) {
+	int cost = max(1, map->minsave_interval); // budget a save takes
+	int scan;
+
+	autosave_budget = min(autosave_budget + PC_AUTOSAVE_TICK, max(1000, cost)); // up to one second worth of saves
+
+	for( scan = 0; scan < PC_AUTOSAVE_SCAN && autosave_cursor != NULL; scan++ ) {
+		struct map_session_data *sd = autosave_cursor;
+		int interval;
 
-	interval = map->autosave_interval/(map->usercount()+1);
-	if(interval < map->minsave_interval)
-		interval = map->minsave_interval;
-	timer->add(timer->gettick()+interval,pc->autosave,0,0);
+		if( sd->autosave.dirty >= PC_AUTOSAVE_URGENT )
+			interval = min(PC_AUTOSAVE_URGENT_INTERVAL, map->autosave_interval);
+		else
+			interval = map->autosave_interval;
+
+		if( DIFF_TICK(tick, sd->autosave.tick) < interval ) {
+			pc->autosave_stats.skipped++;
+			autosave_cursor = sd->autosave.next;
+			continue;
+		}
+		if( autosave_budget < cost ) { // out of budget, resume here next time
+			pc->autosave_stats.deferred++;
+			break;
+		}
+
+		autosave_budget -= cost;
+		if( sd->autosave.dirty >= PC_AUTOSAVE_URGENT )
+			pc->autosave_stats.urgent++;
+		else if( sd->autosave.dirty )
+			pc->autosave_stats.dirty++;
+		else
+			pc->autosave_stats.clean++;
+		autosave_cursor = sd->autosave.next;
+		chrif->save(sd,0);
+	}
 
 	return 0;
 }
@@ -10161,7 +10248,7 @@ void do_init_pc(void) {
 	timer->add_func_list(pc->endautobonus, "pc_endautobonus");
 	timer->add_func_list(pc->charm_timer, "pc_charm_timer");
 
-	timer->add(timer->gettick() + map->autosave_interval, pc->autosave, 0, 0);
+	timer->add_interval(timer->gettick() + PC_AUTOSAVE_TICK, pc->autosave, 0, 0, PC_AUTOSAVE_TICK);
 
 	// 0=day, 1=night [Yor]
 	map->night_flag = battle_config.night_at_start ? 1 : 0;
@@ -10448,6 +10535,10 @@ void pc_defaults(void) {
 	pc->charm_timer = pc_charm_timer;
 	pc->readdb_levelpenalty = pc_readdb_levelpenalty;
 	pc->autosave = pc_autosave;
+	pc->autosave_link = pc_autosave_link;
+	pc->autosave_unlink = pc_autosave_unlink;
+	pc->autosave_mark = pc_autosave_mark;
+	pc->autosave_itemscore = pc_autosave_itemscore;
 	pc->follow_timer = pc_follow_timer;
 	pc->read_skill_tree = pc_read_skill_tree;
 	pc->isUseitem = pc_isUseitem;
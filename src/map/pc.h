@@ -30,6 +30,15 @@
 #define MAX_PC_FEELHATE 3
 #define PVP_CALCRANK_INTERVAL 1000	// PVP calculation interval
 
+// Autosave scheduler (see pc_autosave)
+#define PC_AUTOSAVE_TICK 100 // how often the scheduler runs (ms)
+#define PC_AUTOSAVE_SCAN 64 // characters examined per run at most
+#define PC_AUTOSAVE_URGENT 100 // dirtiness that gets a character saved ahead of the others
+#define PC_AUTOSAVE_URGENT_INTERVAL 10000 // ...but not more often than this (ms)
+#define PC_AUTOSAVE_ZENY 10000 // each this much zeny gained or paid adds 1 to the dirtiness
+#define PC_AUTOSAVE_RARE_VALUE 100000 // items bought for at least this are rare
+#define PC_AUTOSAVE_RARE_REFINE 7 // as are items refined to at least this
+
 //Equip indexes constants. (eg: sd->equip_index[EQI_AMMO] returns the index
 //where the arrows are equipped)
 enum equip_index {
@@ -193,6 +202,13 @@ struct map_session_data {
 	unsigned int extra_temp_permissions; /* permissions from @addperm */
 	
 	struct mmo_charstatus status;
+	struct mmo_charstatus *save_base; // status as last sent to the char-server (see chrif_save_status), NULL = send everything
+	unsigned int save_seq, save_epoch;
+	struct {
+		struct map_session_data *prev, *next; // ring of characters walked by pc_autosave, NULL = not in it
+		unsigned int tick; // last save
+		unsigned int dirty; // how much changed since then (see pc_autosave_mark)
+	} autosave;
 	struct registry save_reg;
 	struct item_data* inventory_data[MAX_INVENTORY]; // direct pointers to itemdb entries (faster than doing item_id lookups)
 	short equip_index[EQI_MAX];
@@ -727,6 +743,13 @@ struct pc_interface {
 	struct sg_data sg_info[MAX_PC_FEELHATE];
 	/* */
 	struct eri *sc_display_ers;
+	/* autosave scheduler */
+	struct {
+		unsigned int users; // characters in the ring
+		unsigned int urgent, dirty, clean; // characters saved, by why they were due
+		unsigned int skipped; // characters examined that weren't due
+		unsigned int deferred; // runs that stopped because the budget was spent
+	} autosave_stats;
 	/* funcs */
 	void (*init) (void);
 	void (*final) (void);
@@ -954,6 +977,10 @@ struct pc_interface {
 	int (*charm_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	bool (*readdb_levelpenalty) (char* fields[], int columns, int current);
 	int (*autosave) (int tid, unsigned int tick, int id, intptr_t data);
+	void (*autosave_link) (struct map_session_data *sd);
+	void (*autosave_unlink) (struct map_session_data *sd);
+	void (*autosave_mark) (struct map_session_data *sd, unsigned int dirty);
+	unsigned int (*autosave_itemscore) (const struct item *it, struct item_data *data);
 	int (*follow_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	void (*read_skill_tree) (void);
 	int (*isUseitem) (struct map_session_data *sd,int n);
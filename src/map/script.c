@@ -2621,6 +2621,104 @@ void script_free_code(struct script_code* code)
 	aFree( code );
 }
 
+/// Returns the position of the next script->str_data reference (C_NAME operand)
+/// of the compiled script at or after pos, or -1 when there are no more.
+int script_code_nextref(struct script_code* code, int pos)
+{
+	while( pos < code->script_size ) {
+		switch( script->get_com(code->script_buf, &pos) ) {
+			case C_INT:
+				script->get_num(code->script_buf, &pos);
+				break;
+			case C_POS:
+			case C_USERFUNC_POS:
+				pos += 3;
+				break;
+			case C_NAME:
+				return pos;
+			case C_STR:
+				while( pos < code->script_size && code->script_buf[pos++] );
+				break;
+			default:
+				break;
+		}
+	}
+	return -1;
+}
+
+/// Writes a compiled script to fp (db snapshots).
+/// The ids of script->str_data only hold for this run, so the references
+/// are stored by name and linked again by script_read_code.
+void script_write_code(FILE* fp, struct script_code* code)
+{
+	uint32 size = (uint32)code->script_size, refs = 0;
+	int pos;
+
+	for( pos = script->code_nextref(code, 0); pos >= 0; pos = script->code_nextref(code, pos+3) )
+		refs++;
+
+	hwrite(&size, sizeof(size), 1, fp);
+	hwrite(&refs, sizeof(refs), 1, fp);
+	hwrite(code->script_buf, size, 1, fp);
+	for( pos = script->code_nextref(code, 0); pos >= 0; pos = script->code_nextref(code, pos+3) ) {
+		uint32 upos = (uint32)pos;
+		const char* name = script->get_str(GETVALUE(code->script_buf, pos));
+
+		hwrite(&upos, sizeof(upos), 1, fp);
+		hwrite(name, strlen(name)+1, 1, fp);
+	}
+}
+
+/// Reads a compiled script written by script_write_code from *data, which is
+/// moved past it. Returns NULL if the script does not end before end.
+struct script_code* script_read_code(const unsigned char** data, const unsigned char* end)
+{
+	const unsigned char* p = *data;
+	struct script_code* code;
+	uint32 size, refs, i;
+
+	if( end - p < 8 )
+		return NULL;
+	memcpy(&size, p, sizeof(size));
+	memcpy(&refs, p+4, sizeof(refs));
+	p += 8;
+	if( (size_t)(end - p) < size )
+		return NULL;
+
+	CREATE(code, struct script_code, 1);
+	CREATE(code->script_buf, unsigned char, size);
+	memcpy(code->script_buf, p, size);
+	code->script_size = (int)size;
+	code->script_vars = NULL;
+	p += size;
+
+	for( i = 0; i < refs; i++ ) {
+		const unsigned char* name_end;
+		uint32 pos;
+		int l;
+
+		if( end - p < 5 || (name_end = memchr(p+4, '\0', end-p-4)) == NULL ) {
+			script->free_code(code);
+			return NULL;
+		}
+		memcpy(&pos, p, sizeof(pos));
+		if( pos + 3 > size ) {
+			script->free_code(code);
+			return NULL;
+		}
+		l = script->add_str((const char*)p+4);
+		if( script->str_data[l].type == C_NOP ) {// first use, default to a variable like parse_script does
+			script->str_data[l].type = C_NAME;
+			script->str_data[l].label = l;
+		}
+		SETVALUE(code->script_buf, pos, l);
+		p = name_end + 1;
+	}
+
+	*data = p;
+	return code;
+}
+
 /// Creates a new script state.
 ///
 /// @param script Script code
@@ -9501,11 +9599,11 @@ BUILDIN(getstatus)
 		case 4:  script_pushint(st, sd->sc.data[id]->val4);	break;
 		case 5:
 		{
-			struct TimerData* td = (struct TimerData*)timer->get(sd->sc.data[id]->timer);
+			unsigned int due;
 			
-			if( td ) {
+			if( status->change_timer_gettick(sd->sc.data[id], &due) ) {
 				// return the amount of time remaining
-				script_pushint(st, td->tick - timer->gettick());
+				script_pushint(st, due - timer->gettick());
 			}
 		}
 			break;
@@ -15263,6 +15361,7 @@ BUILDIN(setcell) {
 	for( y = y1; y <= y2; ++y )
 		for( x = x1; x <= x2; ++x )
 			map->list[m].setcell(m, x, y, type, flag);
+	map->list[m].cell_custom = true; // keep the cells of this map in memory
 	
 	return true;
 }
@@ -18221,6 +18320,9 @@ void script_defaults(void) {
 	script->set_var = set_var;
 	script->stop_instances = script_stop_instances;
 	script->free_code = script_free_code;
+	script->code_nextref = script_code_nextref;
+	script->write_code = script_write_code;
+	script->read_code = script_read_code;
 	script->free_vars = script_free_vars;
 	script->alloc_state = script_alloc_state;
 	script->free_state = script_free_state;
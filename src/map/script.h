@@ -539,6 +539,9 @@ struct script_interface {
 	int (*set_var) (struct map_session_data *sd, char *name, void *val);
 	void (*stop_instances) (struct script_code *code);
 	void (*free_code) (struct script_code* code);
+	int (*code_nextref) (struct script_code* code, int pos);
+	void (*write_code) (FILE* fp, struct script_code* code);
+	struct script_code* (*read_code) (const unsigned char** data, const unsigned char* end);
 	void (*free_vars) (struct DBMap *var_storage);
 	struct script_state* (*alloc_state) (struct script_code* rootscript, int pos, int rid, int oid);
 	void (*free_state) (struct script_state* st);
@@ -2286,9 +2286,7 @@ int skill_attack (int attack_type, struct block_list* src, struct block_list *ds
 				if (pc->famerank(sd->status.char_id,MAPID_TAEKWON)) {//Extend combo time.
 					sce->val1 = skill_id; //Update combo-skill
 					sce->val3 = skill_id;
-					if( sce->timer != INVALID_TIMER )
-						timer->delete(sce->timer, status->change_timer);
-					sce->timer = timer->add(tick+sce->val4, status->change_timer, src->id, SC_COMBOATTACK);
+					status->change_timer_add(src, SC_COMBOATTACK, tick+sce->val4);
 					break;
 				}
 				unit->cancel_combo(src); // Cancel combo wait
@@ -4783,8 +4781,8 @@ int skill_castend_id(int tid, unsigned int tick, int id, intptr_t data)
 			case CR_GRANDCROSS:
 			case NPC_GRANDDARKNESS:
 				if( (sc = status->get_sc(src)) && sc->data[SC_NOEQUIPSHIELD] ) {
-					const struct TimerData *td = timer->get(sc->data[SC_NOEQUIPSHIELD]->timer);
-					if( td && td->func == status->change_timer && DIFF_TICK(td->tick,timer->gettick()+skill->get_time(ud->skill_id, ud->skill_lv)) > 0 )
+					unsigned int due;
+					if( status->change_timer_gettick(sc->data[SC_NOEQUIPSHIELD], &due) && DIFF_TICK(due,timer->gettick()+skill->get_time(ud->skill_id, ud->skill_lv)) > 0 )
 						break;
 				}
 				sc_start2(src, SC_NOEQUIPSHIELD, 100, 0, 1, skill->get_time(ud->skill_id, ud->skill_lv));
@@ -11000,9 +10998,9 @@ int skill_unit_onplace (struct skill_unit *src, struct block_list *bl, unsigned
 			} else if( sc && battle->check_target(&sg->unit->bl,bl,sg->target_flag) > 0 ) {
 				int sec = skill->get_time2(sg->skill_id,sg->skill_lv);
 				if( status->change_start(bl,type,10000,sg->skill_lv,1,sg->group_id,0,sec,8) ) {
-					const struct TimerData* td = sc->data[type]?timer->get(sc->data[type]->timer):NULL;
-					if( td )
-						sec = DIFF_TICK(td->tick, tick);
+					unsigned int due;
+					if( sc->data[type] && status->change_timer_gettick(sc->data[type], &due) )
+						sec = DIFF_TICK(due, tick);
 					map->moveblock(bl, src->bl.x, src->bl.y, tick);
 					clif->fixpos(bl);
 					sg->val2 = bl->id;
@@ -11112,8 +11110,7 @@ int skill_unit_onplace (struct skill_unit *src, struct block_list *bl, unsigned
 			else if (sce->val4 == 1) {
 				//Readjust timers since the effect will not last long.
 				sce->val4 = 0;
-				timer->delete(sce->timer, status->change_timer);
-				sce->timer = timer->add(tick+sg->limit, status->change_timer, bl->id, type);
+				status->change_timer_add(bl, type, tick+sg->limit);
 			}
 			break;
 
@@ -11369,9 +11366,9 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 			if( sg->val2 == 0 && tsc && (sg->unit_id == UNT_ANKLESNARE || bl->id != sg->src_id) ) {
 				int sec = skill->get_time2(sg->skill_id,sg->skill_lv);
 				if( status->change_start(bl,type,10000,sg->skill_lv,sg->group_id,0,0,sec, 8) ) {
-					const struct TimerData* td = tsc->data[type]?timer->get(tsc->data[type]->timer):NULL;
-					if( td )
-						sec = DIFF_TICK(td->tick, tick);
+					unsigned int due;
+					if( tsc->data[type] && status->change_timer_gettick(tsc->data[type], &due) )
+						sec = DIFF_TICK(due, tick);
 					if( sg->unit_id == UNT_MANHOLE || battle_config.skill_trap_type || !map_flag_gvg2(src->bl.m) ) {
 						unit->movepos(bl, src->bl.x, src->bl.y, 0, 0);
 						clif->fixpos(bl);
@@ -11704,9 +11701,9 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 				if( !sg->val2 ) {
 					int sec = skill->get_time2(sg->skill_id, sg->skill_lv);
 					if( sc_start(bl, type, 100, sg->skill_lv, sec) ) {
-						const struct TimerData* td = tsc->data[type]?timer->get(tsc->data[type]->timer):NULL;
-						if( td )
-							sec = DIFF_TICK(td->tick, tick);
+						unsigned int due;
+						if( tsc->data[type] && status->change_timer_gettick(tsc->data[type], &due) )
+							sec = DIFF_TICK(due, tick);
 						///map->moveblock(bl, src->bl.x, src->bl.y, tick); // in official server it doesn't behave like this. [malufett]
 						clif->fixpos(bl);
 						sg->val2 = bl->id;
@@ -12002,11 +11999,10 @@ int skill_unit_onleft (uint16 skill_id, struct block_list *bl, unsigned int tick
 		case DC_FORTUNEKISS:
 		case DC_SERVICEFORYOU:
 			if (sce) {
-				timer->delete(sce->timer, status->change_timer);
 				//NOTE: It'd be nice if we could get the skill_lv for a more accurate extra time, but alas...
 				//not possible on our current implementation.
 				sce->val4 = 1; //Store the fact that this is a "reduced" duration effect.
-				sce->timer = timer->add(tick+skill->get_time2(skill_id,1), status->change_timer, bl->id, type);
+				status->change_timer_add(bl, type, tick+skill->get_time2(skill_id,1));
 			}
 			break;
 		case PF_FOGWALL:
@@ -12016,8 +12012,7 @@ int skill_unit_onleft (uint16 skill_id, struct block_list *bl, unsigned int tick
 					if (bl->type == BL_PC) //Players get blind ended inmediately, others have it still for 30 secs. [Skotlex]
 						status_change_end(bl, SC_BLIND, INVALID_TIMER);
 					else {
-						timer->delete(sce->timer, status->change_timer);
-						sce->timer = timer->add(30000+tick, status->change_timer, bl->id, SC_BLIND);
+						status->change_timer_add(bl, SC_BLIND, 30000+tick);
 					}
 				}
 			}
@@ -18056,15 +18051,17 @@ void skill_readdb(void) {
 	safestrncpy(skill->db[0].name, "UNKNOWN_SKILL", sizeof(skill->db[0].name));
 	safestrncpy(skill->db[0].desc, "Unknown Skill", sizeof(skill->db[0].desc));
 
-	sv->readdb(map->db_path, DBPATH"skill_db.txt",           ',',  17,                       17,               MAX_SKILL_DB, skill->parse_row_skilldb);
-	sv->readdb(map->db_path, DBPATH"skill_require_db.txt",   ',',  32,                       32,               MAX_SKILL_DB, skill->parse_row_requiredb);
+	if( !skill->read_snapshot() ) {
+		sv->readdb(map->db_path, DBPATH"skill_db.txt",           ',',  17,                       17,               MAX_SKILL_DB, skill->parse_row_skilldb);
+		sv->readdb(map->db_path, DBPATH"skill_require_db.txt",   ',',  32,                       32,               MAX_SKILL_DB, skill->parse_row_requiredb);
 #ifdef RENEWAL_CAST
-	sv->readdb(map->db_path, "re/skill_cast_db.txt",         ',',   8,                        8,               MAX_SKILL_DB, skill->parse_row_castdb);
+		sv->readdb(map->db_path, "re/skill_cast_db.txt",         ',',   8,                        8,               MAX_SKILL_DB, skill->parse_row_castdb);
 #else
-	sv->readdb(map->db_path, "pre-re/skill_cast_db.txt",     ',',   7,                        7,               MAX_SKILL_DB, skill->parse_row_castdb);
+		sv->readdb(map->db_path, "pre-re/skill_cast_db.txt",     ',',   7,                        7,               MAX_SKILL_DB, skill->parse_row_castdb);
 #endif
-	sv->readdb(map->db_path, DBPATH"skill_castnodex_db.txt", ',',   2,                        3,               MAX_SKILL_DB, skill->parse_row_castnodexdb);
-	sv->readdb(map->db_path, DBPATH"skill_unit_db.txt",      ',',   8,                        8,               MAX_SKILL_DB, skill->parse_row_unitdb);
+		sv->readdb(map->db_path, DBPATH"skill_castnodex_db.txt", ',',   2,                        3,               MAX_SKILL_DB, skill->parse_row_castnodexdb);
+		sv->readdb(map->db_path, DBPATH"skill_unit_db.txt",      ',',   8,                        8,               MAX_SKILL_DB, skill->parse_row_unitdb);
+	}
 
 	skill->init_unit_layout();
 	sv->readdb(map->db_path, "produce_db.txt",               ',',   4, 4+2*MAX_PRODUCE_RESOURCE,       MAX_SKILL_PRODUCE_DB, skill->parse_row_producedb);
@@ -18079,6 +18076,40 @@ void skill_readdb(void) {
 	sv->readdb(map->db_path, "skill_changematerial_db.txt",  ',',   4,                    4+2*5,       MAX_SKILL_PRODUCE_DB, skill->parse_row_changematerialdb);
 }
 
+/*==========================================
+ * [Hercules] Database snapshot, see map_snapshot_open.
+ * Holds skill->db as filled by skill_db, skill_require_db, skill_cast_db,
+ * skill_castnodex_db and skill_unit_db.
+ *------------------------------------------*/
+int skill_write_snapshot(FILE *fp) {
+	hwrite(skill->db, sizeof(skill->db), 1, fp);
+	return ARRAYLENGTH(skill->db);
+}
+bool skill_read_snapshot(void) {
+	const unsigned char *p;
+	uint32 count, size;
+	int i;
+
+	if( (p = map->snapshot_section(DBS_SKILL, &count, &size)) == NULL )
+		return false;
+	if( count != ARRAYLENGTH(skill->db) || size != sizeof(skill->db) ) {
+		ShowError("skill_read_snapshot: The skill section of the database snapshot does not match MAX_SKILL_DB, reading the skill db.\n");
+		map->snapshot_save = true;
+		return false;
+	}
+
+	memcpy(skill->db, p, sizeof(skill->db));
+	for( i = 1; i < ARRAYLENGTH(skill->db); i++ ) {// what skill_parse_row_skilldb does besides filling skill->db
+		if( !skill->db[i].nameid )
+			continue;
+		strdb_iput(skill->name2id_db, skill->db[i].name, skill->db[i].nameid);
+		script->set_constant2(skill->db[i].name, (int)skill->db[i].nameid, 0);
+	}
+
+	ShowStatus("Done reading '"CL_WHITE"%u"CL_RESET"' entries in '"CL_WHITE"%s"CL_RESET"' ("CL_GREEN"C"CL_RESET").\n", count, DBPATH"skill_db.txt");
+	return true;
+}
+
 void skill_reload (void) {
 	struct s_mapiterator *iter;
 	struct map_session_data *sd;
@@ -18162,6 +18193,8 @@ void skill_defaults(void) {
 	skill->final = do_final_skill;
 	skill->reload = skill_reload;
 	skill->read_db = skill_readdb;
+	skill->write_snapshot = skill_write_snapshot;
+	skill->read_snapshot = skill_read_snapshot;
 	/* */
 	skill->cd_db = NULL;
 	skill->name2id_db = NULL;
@@ -1801,6 +1801,8 @@ struct skill_interface {
 	int (*final) (void);
 	void (*reload) (void);
 	void (*read_db) (void);
+	int (*write_snapshot) (FILE *fp);
+	bool (*read_snapshot) (void);
 	/* */
 	DBMap* cd_db; // char_id -> struct skill_cd
 	DBMap* name2id_db;
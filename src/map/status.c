@@ -6124,6 +6124,7 @@ void status_change_init(struct block_list *bl) {
 	struct status_change *sc = status->get_sc(bl);
 	nullpo_retv(sc);
 	memset(sc, 0, sizeof (struct status_change));
+	sc->timer = INVALID_TIMER;
 }
 
 //Applies SC defense to a given status change.
@@ -7760,8 +7761,7 @@ int status_change_start(struct block_list* bl,enum sc_type type,int rate,int val
 						sc_start4(src,SC_RG_CCONFINE_M,100,val1,1,0,0,tick+1000);
 					else { //Increase count of locked enemies and refresh time.
 						(sce2->val2)++;
-						timer->delete(sce2->timer, status->change_timer);
-						sce2->timer = timer->add(timer->gettick()+tick+1000, status->change_timer, src->id, SC_RG_CCONFINE_M);
+						status->change_timer_add(src, SC_RG_CCONFINE_M, timer->gettick()+tick+1000);
 					}
 				} else //Status failed.
 					return 0;
@@ -9061,20 +9061,19 @@ int status_change_start(struct block_list* bl,enum sc_type type,int rate,int val
 
 	//Don't trust the previous sce assignment, in case the SC ended somewhere between there and here.
 	if((sce=sc->data[type])) {// reuse old sc
-		if( sce->timer != INVALID_TIMER )
-			timer->delete(sce->timer, status->change_timer);
+		status->change_timer_delete(bl, type);
 	} else {// new sc
 		++(sc->count);
 		sce = sc->data[type] = ers_alloc(status->data_ers, struct status_change_entry);
+		sce->timer = INVALID_TIMER;
 	}
 	sce->val1 = val1;
 	sce->val2 = val2;
 	sce->val3 = val3;
 	sce->val4 = val4;
 	if (tick >= 0)
-		sce->timer = timer->add(timer->gettick() + tick, status->change_timer, bl->id, type);
-	else
-		sce->timer = INVALID_TIMER; //Infinite duration
+		status->change_timer_add(bl, type, timer->gettick() + tick);
+	//else: Infinite duration
 
 	if (calc_flag)
 		status_calc_bl(bl,calc_flag);
@@ -9181,8 +9180,17 @@ int status_change_clear(struct block_list* bl, int type) {
 
 	sc = status->get_sc(bl);
 
-	if (!sc || !sc->count)
+	if (!sc)
+		return 0;
+
+	if (!sc->count) {
+		if (type == 1 && sc->timed) {
+			aFree(sc->timed);
+			sc->timed = NULL;
+			sc->timed_count = sc->timed_max = 0;
+		}
 		return 0;
+	}
 
 	for(i = 0; i < SC_MAX; i++) {
 		if(!sc->data[i])
@@ -9216,13 +9224,22 @@ int status_change_clear(struct block_list* bl, int type) {
 		if( type == 1 && sc->data[i] ) {
 			//If for some reason status_change_end decides to still keep the status when quitting. [Skotlex]
 			(sc->count)--;
-			if (sc->data[i]->timer != INVALID_TIMER)
-				timer->delete(sc->data[i]->timer, status->change_timer);
+			status->change_timer_delete(bl, (sc_type)i);
 			ers_free(status->data_ers, sc->data[i]);
 			sc->data[i] = NULL;
 		}
 	}
 
+	if( type == 1 ) {
+		if( sc->timer != INVALID_TIMER ) {
+			timer->delete(sc->timer, status->change_unit_timer);
+			sc->timer = INVALID_TIMER;
+		}
+		aFree(sc->timed);
+		sc->timed = NULL;
+		sc->timed_count = sc->timed_max = 0;
+	}
+
 	sc->opt1 = 0;
 	sc->opt2 = 0;
 	sc->opt3 = 0;
@@ -9265,8 +9282,7 @@ int status_change_end_(struct block_list* bl, enum sc_type type, int tid, const
 		if (type == SC_ENDURE && sce->val4)
 			//Do not end infinite endure.
 				return 0;
-		if (sce->timer != INVALID_TIMER) //Could be a SC with infinite duration
-			timer->delete(sce->timer,status->change_timer);
+		status->change_timer_delete(bl, type); //Could be a SC with infinite duration
 		if (sc->opt1)
 			switch (type) {
 				//"Ugly workaround"  [Skotlex]
@@ -9282,7 +9298,7 @@ int status_change_end_(struct block_list* bl, enum sc_type type, int tid, const
 					//since these SC are not affected by it, and it lets us know
 					//if we have already delayed this attack or not.
 					sce->val1 = 0;
-					sce->timer = timer->add(timer->gettick()+10, status->change_timer, bl->id, type);
+					status->change_timer_add(bl, type, timer->gettick()+10);
 					return 1;
 				}
 		}
@@ -9966,6 +9982,157 @@ int kaahi_heal_timer(int tid, unsigned int tick, int id, intptr_t data) {
 	return 1;
 }
 
+/*==========================================
+* Consolidated status timer.
+* Every unit owns at most one timer for all of its timed status changes,
+* due at the earliest entry; expired entries are handed to
+* status->change_timer in one pass. Entries scheduled directly with
+* timer->add(..., status->change_timer, ...) (e.g. by plugins) keep
+* working as before.
+*------------------------------------------*/
+static void status_change_timed_remove(struct status_change *sc, enum sc_type type) {
+	int i;
+
+	ARR_FIND(0, sc->timed_count, i, sc->timed[i] == type);
+	if( i < sc->timed_count )
+		sc->timed[i] = sc->timed[--sc->timed_count];
+}
+
+/// (Re)arms the consolidated timer so it fires at the earliest scheduled entry.
+static void status_change_unit_timer_update(struct block_list *bl, struct status_change *sc) {
+	unsigned int next = 0;
+	int i;
+
+	for( i = 0; i < sc->timed_count; i++ ) {
+		struct status_change_entry *sce = sc->data[sc->timed[i]];
+		if( i == 0 || DIFF_TICK(sce->tick, next) < 0 )
+			next = sce->tick;
+	}
+
+	if( sc->timer != INVALID_TIMER ) {
+		if( sc->timed_count && sc->timer_tick == next )
+			return; // already due at the right time
+		timer->delete(sc->timer, status->change_unit_timer);
+		sc->timer = INVALID_TIMER;
+	}
+
+	if( sc->timed_count ) {
+		sc->timer = timer->add(next, status->change_unit_timer, bl->id, 0);
+		sc->timer_tick = next;
+	}
+}
+
+/// Schedules the status change 'type' of 'bl' to expire at 'tick', replacing any previous timer.
+void status_change_timer_add(struct block_list *bl, enum sc_type type, unsigned int tick) {
+	struct status_change *sc;
+	struct status_change_entry *sce;
+
+	nullpo_retv(bl);
+	if( type < 0 || type >= SC_MAX || !(sc = status->get_sc(bl)) || !(sce = sc->data[type]) )
+		return;
+
+	if( sce->timer == SC_SHARED_TIMER )
+		status_change_timed_remove(sc, type);
+	else if( sce->timer != INVALID_TIMER )
+		timer->delete(sce->timer, status->change_timer);
+
+	if( sc->timed_count == sc->timed_max ) {
+		sc->timed_max += 8;
+		RECREATE(sc->timed, unsigned short, sc->timed_max);
+	}
+	sc->timed[sc->timed_count++] = type;
+	sce->timer = SC_SHARED_TIMER;
+	sce->tick = tick;
+
+	if( sc->timer == INVALID_TIMER || DIFF_TICK(tick, sc->timer_tick) < 0 )
+		status_change_unit_timer_update(bl, sc);
+}
+
+/// Cancels the expiration timer of the status change 'type' of 'bl', if any.
+void status_change_timer_delete(struct block_list *bl, enum sc_type type) {
+	struct status_change *sc;
+	struct status_change_entry *sce;
+
+	nullpo_retv(bl);
+	if( type < 0 || type >= SC_MAX || !(sc = status->get_sc(bl)) || !(sce = sc->data[type]) )
+		return;
+
+	if( sce->timer == SC_SHARED_TIMER ) {
+		status_change_timed_remove(sc, type);
+		if( !sc->timed_count && sc->timer != INVALID_TIMER ) {
+			timer->delete(sc->timer, status->change_unit_timer);
+			sc->timer = INVALID_TIMER;
+		}
+		// an earlier consolidated timer that no longer matches is harmless, it just reschedules on firing
+	} else if( sce->timer != INVALID_TIMER )
+		timer->delete(sce->timer, status->change_timer);
+
+	sce->timer = INVALID_TIMER;
+}
+
+/// Retrieves the tick at which 'sce' expires.
+/// Returns false when the entry has no expiration timer.
+bool status_change_timer_gettick(struct status_change_entry *sce, unsigned int *tick) {
+	const struct TimerData *td;
+
+	nullpo_retr(false, sce);
+
+	if( sce->timer == SC_SHARED_TIMER ) {
+		*tick = sce->tick;
+		return true;
+	}
+	if( sce->timer == INVALID_TIMER || (td = timer->get(sce->timer)) == NULL || td->func != status->change_timer )
+		return false;
+	*tick = td->tick;
+	return true;
+}
+
+/// Consolidated status timer: dispatches every status change of the unit that is due.
+int status_change_unit_timer(int tid, unsigned int tick, int id, intptr_t data) {
+	unsigned short due[SC_MAX];
+	int i, count = 0;
+	struct block_list *bl;
+	struct status_change *sc;
+
+	if( (bl = map->id2bl(id)) == NULL || (sc = status->get_sc(bl)) == NULL ) {
+		ShowDebug("status_change_unit_timer: Null pointer id: %d\n", id);
+		return 0;
+	}
+	if( sc->timer != tid ) {
+		ShowError("status_change_unit_timer: Mismatch: %d != %d (bl id %d)\n", tid, sc->timer, id);
+		return 0;
+	}
+	sc->timer = INVALID_TIMER;
+
+	// collect first, the handlers add and remove entries as they go
+	for( i = 0; i < sc->timed_count; i++ ) {
+		if( DIFF_TICK(sc->data[sc->timed[i]]->tick, tick) <= 0 )
+			due[count++] = sc->timed[i];
+	}
+
+	for( i = 0; i < count; i++ ) {
+		enum sc_type type = (sc_type)due[i];
+		struct status_change_entry *sce;
+		unsigned int sce_tick;
+
+		// the unit may have been removed by a previous handler
+		if( (bl = map->id2bl(id)) == NULL || (sc = status->get_sc(bl)) == NULL )
+			return 0;
+		if( !(sce = sc->data[type]) || sce->timer != SC_SHARED_TIMER || DIFF_TICK(sce->tick, tick) > 0 )
+			continue;
+
+		status_change_timed_remove(sc, type);
+		// same policy as do_timer: keep periodic effects on schedule unless badly delayed
+		sce_tick = DIFF_TICK(sce->tick, tick) < -1000 ? tick : sce->tick;
+		status->change_timer(SC_SHARED_TIMER, sce_tick, id, (intptr_t)type);
+	}
+
+	if( (bl = map->id2bl(id)) != NULL && (sc = status->get_sc(bl)) != NULL )
+		status_change_unit_timer_update(bl, sc);
+
+	return 0;
+}
+
 /*==========================================
 * For recusive status, like for each 5s we drop sp etc.
 * Reseting the end timer.
@@ -10002,9 +10169,12 @@ int status_change_timer(int tid, unsigned int tick, int id, intptr_t data) {
 
 	// set the next timer of the sce (don't assume the status still exists)
 #define sc_timer_next(t,f,i,d) do { \
-	if( (sce=sc->data[type]) ) \
-		sce->timer = timer->add(t,f,i,d); \
-	else \
+	if( (sce=sc->data[type]) ) { \
+		if( (f) == status->change_timer ) \
+			status->change_timer_add(bl, type, (t)); \
+		else \
+			sce->timer = timer->add(t,f,i,d); \
+	} else \
 		ShowError("status_change_timer: Unexpected NULL status change id: %d data: %d\n", id, data); \
 } while(0)
 
@@ -11079,10 +11249,10 @@ int status_change_spread( struct block_list *src, struct block_list *bl ) {
 		case SC_DEATHHURT:
 		case SC_PARALYSE:
 			if( sc->data[i]->timer != INVALID_TIMER ) {
-				const struct TimerData *td = timer->get(sc->data[i]->timer);
-				if (td == NULL || td->func != status->change_timer || DIFF_TICK(td->tick,tick) < 0)
+				unsigned int due;
+				if (!status->change_timer_gettick(sc->data[i], &due) || DIFF_TICK(due,tick) < 0)
 					continue;
-				data.tick = DIFF_TICK(td->tick,tick);
+				data.tick = DIFF_TICK(due,tick);
 			} else
 				data.tick = INVALID_TIMER;
 			break;
@@ -11512,6 +11682,7 @@ int status_readdb(void)
 *------------------------------------------*/
 int do_init_status(void) {
 	timer->add_func_list(status->change_timer,"status_change_timer");
+	timer->add_func_list(status->change_unit_timer,"status_change_unit_timer");
 	timer->add_func_list(status->kaahi_heal_timer,"status_kaahi_heal_timer");
 	timer->add_func_list(status->natural_heal_timer,"status_natural_heal_timer");
 	status->initChangeTables();
@@ -11611,6 +11782,10 @@ void status_defaults(void) {
 	status->change_end_ = status_change_end_;
 	status->kaahi_heal_timer = kaahi_heal_timer;
 	status->change_timer = status_change_timer;
+	status->change_unit_timer = status_change_unit_timer;
+	status->change_timer_add = status_change_timer_add;
+	status->change_timer_delete = status_change_timer_delete;
+	status->change_timer_gettick = status_change_timer_gettick;
 	status->change_timer_sub = status_change_timer_sub;
 	status->change_clear = status_change_clear;
 	status->change_clear_buffs = status_change_clear_buffs;
@@ -1727,8 +1727,14 @@ struct sc_display_entry {
 	int val1,val2,val3;
 };
 
+/// Value of status_change_entry::timer when the entry is scheduled on its
+/// owner's consolidated status timer (status_change::timer) instead of a
+/// timer of its own.
+#define SC_SHARED_TIMER (-2)
+
 struct status_change_entry {
 	int timer;
+	unsigned int tick; // due tick while timer == SC_SHARED_TIMER
 	int val1,val2,val3,val4;
 };
 
@@ -1749,6 +1755,11 @@ struct status_change {
 	unsigned char sg_counter; //Storm gust counter (previous hits from storm gust)
 #endif
 	unsigned char bs_counter; // Blood Sucker counter
+	// Consolidated status timer, fires for the earliest entry in 'timed'
+	int timer;
+	unsigned int timer_tick;
+	unsigned short *timed; // types currently scheduled on the consolidated timer
+	unsigned short timed_count, timed_max;
 	struct status_change_entry *data[SC_MAX];
 };
 
@@ -1904,6 +1915,10 @@ struct status_interface {
 	int (*change_end_) (struct block_list* bl, enum sc_type type, int tid, const char* file, int line);
 	int (*kaahi_heal_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	int (*change_timer) (int tid, unsigned int tick, int id, intptr_t data);
+	int (*change_unit_timer) (int tid, unsigned int tick, int id, intptr_t data);
+	void (*change_timer_add) (struct block_list *bl, enum sc_type type, unsigned int tick);
+	void (*change_timer_delete) (struct block_list *bl, enum sc_type type);
+	bool (*change_timer_gettick) (struct status_change_entry *sce, unsigned int *tick);
 	int (*change_timer_sub) (struct block_list* bl, va_list ap);
 	int (*change_clear) (struct block_list* bl, int type);
 	int (*change_clear_buffs) (struct block_list* bl, int type);
@@ -85,6 +85,171 @@ struct unit_data* unit_bl2ud2(struct block_list *bl) {
 int unit_attack_timer(int tid, unsigned int tick, int id, intptr_t data);
 int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data);
 
+/*==========================================
+ * Batched movement system
+ *------------------------------------------*/
+
+/// Arms the movement timer for the earliest non-empty wheel slot.
+static void unit_walk_rearm(void) {
+	unsigned int start = unit->walk_tick + 1;
+	int i;
+
+	for( i = 0; i < UNIT_WALK_SLOTS; ) {
+		int slot = (start + i)&(UNIT_WALK_SLOTS-1);
+		uint32 mask = unit->walk_slot_mask[slot/32]>>(slot%32);
+
+		if( mask == 0 ) { // skip to the next word
+			i += 32 - slot%32;
+			continue;
+		}
+		while( !(mask&1) ) {
+			mask >>= 1;
+			i++;
+		}
+		break;
+	}
+	if( i >= UNIT_WALK_SLOTS )
+		return; // nobody is walking
+
+	if( unit->walk_timer != INVALID_TIMER ) {
+		if( unit->walk_timer_tick == start + i )
+			return;
+		timer->delete(unit->walk_timer, unit->walk_batch_timer);
+	}
+	unit->walk_timer_tick = start + i;
+	unit->walk_timer = timer->add(unit->walk_timer_tick, unit->walk_batch_timer, 0, 0);
+}
+
+/**
+ * Queues the next step of a walking unit, due at the given tick.
+ * @param interval duration of the step, kept for unit->stop_walking
+ **/
+void unit_walk_schedule(struct block_list *bl, struct unit_data *ud, unsigned int tick, int interval) {
+	struct unit_walk_slot *slot;
+
+	nullpo_retv(bl);
+	nullpo_retv(ud);
+
+	if( DIFF_TICK(tick, unit->walk_tick) <= 0 ) // behind the wheel, take the next slot
+		tick = unit->walk_tick + 1;
+	slot = &unit->walk_slot[tick&(UNIT_WALK_SLOTS-1)];
+
+	if( slot->count == slot->max ) {
+		slot->max += 16;
+		RECREATE(slot->entry, struct unit_walk_entry, slot->max);
+	}
+	slot->entry[slot->count].id = bl->id;
+	slot->entry[slot->count].m = bl->m;
+	slot->entry[slot->count].tick = tick;
+	slot->count++;
+	unit->walk_slot_mask[(tick&(UNIT_WALK_SLOTS-1))/32] |= 1U<<((tick&(UNIT_WALK_SLOTS-1))%32);
+
+	ud->walktimer = WALKTIMER_BATCHED;
+	ud->walk_tick = tick;
+	ud->walk_interval = interval;
+
+	if( !unit->walk_batching && (unit->walk_timer == INVALID_TIMER || DIFF_TICK(tick, unit->walk_timer_tick) < 0) ) {
+		if( unit->walk_timer != INVALID_TIMER )
+			timer->delete(unit->walk_timer, unit->walk_batch_timer);
+		unit->walk_timer_tick = tick;
+		unit->walk_timer = timer->add(tick, unit->walk_batch_timer, 0, 0);
+	}
+}
+
+/// Cancels the queued step of a unit; its wheel entry is discarded when the slot comes due.
+void unit_walk_unschedule(struct unit_data *ud) {
+	nullpo_retv(ud);
+	if( ud->walktimer == WALKTIMER_BATCHED )
+		ud->walktimer = INVALID_TIMER;
+}
+
+static int unit_walk_entry_compare(const void *a, const void *b) {
+	const struct unit_walk_entry *ea = (const struct unit_walk_entry *)a;
+	const struct unit_walk_entry *eb = (const struct unit_walk_entry *)b;
+
+	if( ea->m != eb->m )
+		return ea->m - eb->m;
+	if( ea->tick != eb->tick )
+		return DIFF_TICK(ea->tick, eb->tick);
+	return ea->id - eb->id;
+}
+
+/// Movement timer: advances every unit whose step is due, one map at a time.
+int unit_walk_batch_timer(int tid, unsigned int tick, int id, intptr_t data) {
+	unsigned int from;
+	int i, j, span, count = 0;
+
+	if( unit->walk_timer != tid ) {
+		ShowError("unit_walk_batch_timer mismatch %d != %d\n", unit->walk_timer, tid);
+		return 0;
+	}
+	unit->walk_timer = INVALID_TIMER;
+
+	if( DIFF_TICK(tick, unit->walk_tick) <= 0 ) {
+		unit_walk_rearm();
+		return 0;
+	}
+	from = unit->walk_tick + 1;
+	span = min(DIFF_TICK(tick, unit->walk_tick), UNIT_WALK_SLOTS);
+	unit->walk_tick = tick;
+
+	// collect due steps, dropping the ones that were cancelled or rescheduled meanwhile
+	for( i = 0; i < span; i++ ) {
+		int idx = (from + i)&(UNIT_WALK_SLOTS-1);
+		struct unit_walk_slot *slot = &unit->walk_slot[idx];
+		int kept = 0;
+
+		if( !(unit->walk_slot_mask[idx/32]&(1U<<(idx%32))) )
+			continue;
+
+		for( j = 0; j < slot->count; j++ ) {
+			struct unit_walk_entry *e = &slot->entry[j];
+			struct block_list *bl;
+			struct unit_data *ud;
+
+			if( DIFF_TICK(e->tick, tick) > 0 ) { // a later round of the wheel
+				slot->entry[kept++] = *e;
+				continue;
+			}
+			if( (bl = map->id2bl(e->id)) == NULL || (ud = unit->bl2ud(bl)) == NULL
+			 || ud->walktimer != WALKTIMER_BATCHED || ud->walk_tick != e->tick )
+				continue;
+			if( count == unit->walk_batch_max ) {
+				unit->walk_batch_max += 256;
+				RECREATE(unit->walk_batch, struct unit_walk_entry, unit->walk_batch_max);
+			}
+			unit->walk_batch[count] = *e;
+			unit->walk_batch[count].m = bl->m;
+			count++;
+		}
+		slot->count = kept;
+		if( !kept )
+			unit->walk_slot_mask[idx/32] &= ~(1U<<(idx%32));
+	}
+
+	if( count > 1 )
+		qsort(unit->walk_batch, count, sizeof(struct unit_walk_entry), unit_walk_entry_compare);
+
+	unit->walk_batching = true;
+	for( i = 0; i < count; i++ ) {
+		struct unit_walk_entry *e = &unit->walk_batch[i];
+		struct block_list *bl;
+		struct unit_data *ud;
+
+		// previous steps may have stopped, warped or removed this unit
+		if( (bl = map->id2bl(e->id)) == NULL || (ud = unit->bl2ud(bl)) == NULL
+		 || ud->walktimer != WALKTIMER_BATCHED || ud->walk_tick != e->tick )
+			continue;
+
+		// same policy as do_timer: keep the walk on schedule unless badly delayed
+		unit->walktoxy_timer(WALKTIMER_BATCHED, DIFF_TICK(e->tick, tick) < -1000 ? tick : e->tick, e->id, ud->walk_interval);
+	}
+	unit->walk_batching = false;
+
+	unit_walk_rearm();
+	return 0;
+}
+
 int unit_walktoxy_sub(struct block_list *bl)
 {
 	int i;
@@ -133,7 +298,7 @@ int unit_walktoxy_sub(struct block_list *bl)
 	else
 		i = status->get_speed(bl);
 	if( i > 0)
-		ud->walktimer = timer->add(timer->gettick()+i,unit->walktoxy_timer,bl->id,i);
+		unit->walk_schedule(bl, ud, timer->gettick()+i, i);
 	return 1;
 }
 
@@ -282,7 +447,7 @@ int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data) {
 		i = status->get_speed(bl);
 
 	if(i > 0) {
-		ud->walktimer = timer->add(tick+i,unit->walktoxy_timer,id,i);
+		unit->walk_schedule(bl, ud, tick+i, i);
 		if( md && DIFF_TICK(tick,md->dmgtick) < 3000 )//not required not damaged recently
 			clif->move(ud);
 	} else if(ud->state.running) {
@@ -854,22 +1019,36 @@ int unit_stop_walking(struct block_list *bl,int type)
 {
 	struct unit_data *ud;
 	const struct TimerData* td;
-	unsigned int tick;
+	unsigned int tick, step_tick = 0;
+	int step_interval = 0;
+	bool step_known = false;
 	nullpo_ret(bl);
 
 	ud = unit->bl2ud(bl);
 	if(!ud || ud->walktimer == INVALID_TIMER)
 		return 0;
-	//NOTE: We are using timer data after deleting it because we know the
-	//timer->delete function does not messes with it. If the function's
-	//behaviour changes in the future, this code could break!
-	td = timer->get(ud->walktimer);
-	timer->delete(ud->walktimer, unit->walktoxy_timer);
+	if( ud->walktimer == WALKTIMER_BATCHED ) {
+		step_known = true;
+		step_tick = ud->walk_tick;
+		step_interval = ud->walk_interval;
+		unit->walk_unschedule(ud);
+	} else {
+		//NOTE: We are using timer data after deleting it because we know the
+		//timer->delete function does not messes with it. If the function's
+		//behaviour changes in the future, this code could break!
+		td = timer->get(ud->walktimer);
+		timer->delete(ud->walktimer, unit->walktoxy_timer);
+		if( td ) {
+			step_known = true;
+			step_tick = td->tick;
+			step_interval = (int)td->data;
+		}
+	}
 	ud->walktimer = INVALID_TIMER;
 	ud->state.change_walk_target = 0;
 	tick = timer->gettick();
 	if( (type&0x02 && !ud->walkpath.path_pos) //Force moving at least one cell.
-	||  (type&0x04 && td && DIFF_TICK(td->tick, tick) <= td->data/2) //Enough time has passed to cover half-cell
+	||  (type&0x04 && step_known && DIFF_TICK(step_tick, tick) <= step_interval/2) //Enough time has passed to cover half-cell
 	) {
 		ud->walkpath.path_len = ud->walkpath.path_pos+1;
 		unit->walktoxy_timer(INVALID_TIMER, tick, bl->id, ud->walkpath.path_pos);
@@ -1716,6 +1895,9 @@ bool unit_can_reach_bl(struct block_list *bl,struct block_list *tbl, int range,
 	if(range>0 && !check_distance_bl(bl, tbl, range))
 		return false;
 
+	if (!easy && bl->type != BL_PC && path->search_chase(NULL, bl->m, bl->x, bl->y, bl->id, tbl->id, tbl->x, tbl->y, x, y, CELL_CHKNOREACH))
+		return true;
+
 	// It judges whether it can adjoin or not.
 	dx=tbl->x - bl->x;
 	dy=tbl->y - bl->y;
@@ -2349,6 +2531,11 @@ int unit_free(struct block_list *bl, clr_type clrtype) {
 			for(i = 1; i < 5; i++)
 				pc->del_charm(sd, sd->charm[i], i);
 
+			pc->autosave_unlink(sd);
+			if( sd->save_base ) {
+				aFree(sd->save_base);
+				sd->save_base = NULL;
+			}
 			if( sd->reg ) {	//Double logout already freed pointer fix... [Skotlex]
 				aFree(sd->reg);
 				sd->reg = NULL;
@@ -2578,13 +2765,20 @@ int unit_free(struct block_list *bl, clr_type clrtype) {
 int do_init_unit(void) {
 	timer->add_func_list(unit->attack_timer,  "unit_attack_timer");
 	timer->add_func_list(unit->walktoxy_timer,"unit_walktoxy_timer");
+	timer->add_func_list(unit->walk_batch_timer,"unit_walk_batch_timer");
+	unit->walk_tick = timer->gettick();
+	unit->walk_timer = INVALID_TIMER;
 	timer->add_func_list(unit->walktobl_sub, "unit_walktobl_sub");
 	timer->add_func_list(unit->delay_walktoxy_timer,"unit_delay_walktoxy_timer");
 	return 0;
 }
 
 int do_final_unit(void) {
-	// nothing to do
+	int i;
+
+	for( i = 0; i < UNIT_WALK_SLOTS; i++ )
+		aFree(unit->walk_slot[i].entry);
+	aFree(unit->walk_batch);
 	return 0;
 }
 
@@ -2598,6 +2792,9 @@ void unit_defaults(void) {
 	unit->bl2ud2 = unit_bl2ud2;
 	unit->attack_timer = unit_attack_timer;
 	unit->walktoxy_timer = unit_walktoxy_timer;
+	unit->walk_schedule = unit_walk_schedule;
+	unit->walk_unschedule = unit_walk_unschedule;
+	unit->walk_batch_timer = unit_walk_batch_timer;
 	unit->walktoxy_sub = unit_walktoxy_sub;
 	unit->delay_walktoxy_timer = unit_delay_walktoxy_timer;
 	unit->walktoxy = unit_walktoxy;
@@ -14,6 +14,26 @@ struct map_session_data;
 #include "path.h" // struct walkpath_data
 #include "skill.h" // struct skill_timerskill, struct skill_unit_group, struct skill_unit_group_tickset
 
+/**
+ * Batched movement system
+ * Walking units are not given a timer each; their next step is queued on a
+ * wheel of 1ms slots and every step due at a given tick is advanced by a
+ * single timer, grouped by map.
+ **/
+#define UNIT_WALK_SLOTS 2048 // wheel size in ms; power of two, larger than the slowest step
+#define WALKTIMER_BATCHED (-3) // unit_data::walktimer value while the next step is queued on the wheel
+
+struct unit_walk_entry {
+	int id;
+	int16 m;
+	unsigned int tick;
+};
+
+struct unit_walk_slot {
+	struct unit_walk_entry *entry;
+	int count, max;
+};
+
 struct unit_data {
 	struct block_list *bl;
 	struct walkpath_data walkpath;
@@ -30,6 +50,8 @@ struct unit_data {
 	int   target_to;
 	int   attacktimer;
 	int   walktimer;
+	unsigned int walk_tick; // due tick of the next step while walktimer == WALKTIMER_BATCHED
+	int   walk_interval; // duration of the step in progress
 	int	chaserange;
 	unsigned int attackabletime;
 	unsigned int canact_tick;
@@ -72,6 +94,16 @@ extern const short dirx[8];
 extern const short diry[8];
 
 struct unit_interface {
+	/* batched movement */
+	struct unit_walk_slot walk_slot[UNIT_WALK_SLOTS];
+	uint32 walk_slot_mask[UNIT_WALK_SLOTS/32];
+	unsigned int walk_tick; // tick up to which the wheel was advanced
+	int walk_timer;
+	unsigned int walk_timer_tick;
+	bool walk_batching;
+	struct unit_walk_entry *walk_batch;
+	int walk_batch_max;
+	/* */
 	int (*init) (void);
 	int (*final) (void);
 	/* */
@@ -79,6 +111,9 @@ struct unit_interface {
 	struct unit_data* (*bl2ud2) (struct block_list *bl);
 	int (*attack_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	int (*walktoxy_timer) (int tid, unsigned int tick, int id, intptr_t data);
+	void (*walk_schedule) (struct block_list *bl, struct unit_data *ud, unsigned int tick, int interval);
+	void (*walk_unschedule) (struct unit_data *ud);
+	int (*walk_batch_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	int (*walktoxy_sub) (struct block_list *bl);
 	int (*delay_walktoxy_timer) (int tid, unsigned int tick, int id, intptr_t data);
 	int (*walktoxy) (struct block_list *bl, short x, short y, int flag);
@@ -0,0 +1,242 @@
+// Copyright (c) Hercules Dev Team, licensed under GNU GPL.
+// See the LICENSE file
+
+// Inter-server link benchmark.
+// Compares tcp loopback with unix domain sockets (login_socket/char_socket)
+// for the traffic pattern of server links: round trips of small packets
+// (latency) and a stream of packets (throughput).
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/strlib.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+int link_count = 20000;           // round trips
+int link_size = 64;               // bytes per round trip packet
+int link_stream = 256*1024*1024;  // bytes streamed for the throughput test
+int link_chunk = 4096;            // bytes per write while streaming
+
+static int64 link_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int link_cmp(const void* a, const void* b)
+{
+	int64 x = *(const int64*)a, y = *(const int64*)b;
+	return ( x < y ) ? -1 : ( x > y ) ? 1 : 0;
+}
+
+static bool link_read(int fd, uint8* buf, size_t len)
+{
+	while( len > 0 ) {
+		ssize_t n = read(fd, buf, len);
+		if( n <= 0 ) {
+			if( n < 0 && errno == EINTR )
+				continue;
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool link_write(int fd, const uint8* buf, size_t len)
+{
+	while( len > 0 ) {
+		ssize_t n = write(fd, buf, len);
+		if( n <= 0 ) {
+			if( n < 0 && errno == EINTR )
+				continue;
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+/// Peer process: echoes the round trips, then swallows the stream and acks it.
+static void link_peer(int fd)
+{
+	uint8* buf = (uint8*)malloc(max(link_size, link_chunk));
+	int i, left;
+
+	for( i = 0; i < link_count; i++ )
+		if( !link_read(fd, buf, link_size) || !link_write(fd, buf, link_size) )
+			_exit(1);
+
+	for( left = link_stream; left > 0; ) {
+		ssize_t n = read(fd, buf, min(left, link_chunk));
+		if( n <= 0 ) {
+			if( n < 0 && errno == EINTR )
+				continue;
+			_exit(1);
+		}
+		left -= (int)n;
+	}
+	link_write(fd, buf, 1);
+	_exit(0);
+}
+
+/// Runs both tests over an already connected socket.
+static void link_measure(const char* name, int fd)
+{
+	uint8* buf;
+	int64* lat;
+	int64 begin, elapsed;
+	int i, left;
+
+	buf = (uint8*)aCalloc(max(link_size, link_chunk), 1);
+	CREATE(lat, int64, link_count);
+
+	for( i = 0; i < link_count; i++ ) {
+		int64 t = link_now();
+		if( !link_write(fd, buf, link_size) || !link_read(fd, buf, link_size) ) {
+			ShowError("%s: round trip failed.\n", name);
+			aFree(buf);
+			aFree(lat);
+			return;
+		}
+		lat[i] = link_now() - t;
+	}
+	qsort(lat, link_count, sizeof(int64), link_cmp);
+
+	begin = link_now();
+	for( left = link_stream; left > 0; left -= link_chunk )
+		if( !link_write(fd, buf, min(left, link_chunk)) )
+			break;
+	link_read(fd, buf, 1);
+	elapsed = link_now() - begin;
+
+	ShowInfo("%-5s round trip (us): p50 %4d, p99 %4d, max %5d | stream: "CL_WHITE"%.0f"CL_RESET" MB/s\n", name,
+		(int)lat[link_count*50/100], (int)lat[link_count*99/100], (int)lat[link_count-1],
+		elapsed > 0 ? (link_stream / 1048576.) / (elapsed / 1000000.) : 0.);
+
+	aFree(buf);
+	aFree(lat);
+}
+
+/// Forks a peer accepting on listen_fd, connects to it and measures the link.
+static void link_run(const char* name, int listen_fd, struct sockaddr* addr, socklen_t addrlen, int family)
+{
+	pid_t pid;
+	int fd, status;
+
+	pid = fork();
+	if( pid == 0 ) {
+		int peer = accept(listen_fd, NULL, NULL);
+		if( peer < 0 )
+			_exit(1);
+		link_peer(peer);
+	}
+	if( pid < 0 ) {
+		ShowError("%s: fork failed (%s).\n", name, strerror(errno));
+		return;
+	}
+
+	fd = socket(family, SOCK_STREAM, 0);
+	if( fd < 0 || connect(fd, addr, addrlen) != 0 ) {
+		ShowError("%s: connect failed (%s).\n", name, strerror(errno));
+		kill(pid, SIGTERM);
+	} else {
+		if( family == AF_INET ) { // like setsocketopts
+			int yes = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&yes, sizeof(yes));
+		}
+		link_measure(name, fd);
+	}
+	if( fd >= 0 )
+		close(fd);
+	waitpid(pid, &status, 0);
+}
+
+static void link_tcp(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0; // any
+	if( fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0
+	||  getsockname(fd, (struct sockaddr*)&addr, &len) != 0 ) {
+		ShowError("tcp: listen failed (%s).\n", strerror(errno));
+		if( fd >= 0 )
+			close(fd);
+		return;
+	}
+	link_run("tcp", fd, (struct sockaddr*)&addr, sizeof(addr), AF_INET);
+	close(fd);
+}
+
+static void link_unix(void)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/linkbench.%d.sock", (int)getpid());
+	unlink(addr.sun_path);
+	if( fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0 ) {
+		ShowError("unix: listen failed (%s).\n", strerror(errno));
+		if( fd >= 0 )
+			close(fd);
+		return;
+	}
+	link_run("unix", fd, (struct sockaddr*)&addr, sizeof(addr), AF_UNIX);
+	close(fd);
+	unlink(addr.sun_path);
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i+1 < argc; i += 2 ) {
+		if( strcmp(argv[i], "-count") == 0 )
+			link_count = max(1, atoi(argv[i+1]));
+		else if( strcmp(argv[i], "-size") == 0 )
+			link_size = max(1, atoi(argv[i+1]));
+		else if( strcmp(argv[i], "-stream") == 0 )
+			link_stream = max(1, atoi(argv[i+1])) * 1024 * 1024;
+		else if( strcmp(argv[i], "-chunk") == 0 )
+			link_chunk = max(1, atoi(argv[i+1]));
+		else
+			break;
+	}
+	if( i < argc ) {
+		ShowInfo("usage: linkbench [-count <round trips>] [-size <bytes>] [-stream <MB>] [-chunk <bytes>]\n");
+		return 1;
+	}
+
+	ShowStatus("%d round trips of %d bytes, %d MB streamed in %d byte writes\n", link_count, link_size, link_stream / 1048576, link_chunk);
+	link_tcp();
+	link_unix();
+	return 0;
+}
+
+void do_final(void)
+{
+}
@@ -0,0 +1,362 @@
+// Copyright (c) Hercules Dev Team, licensed under GNU GPL.
+// See the LICENSE file
+
+// Login-server throughput benchmark.
+// Opens many client connections, sends a plain login request (0x0064) on each
+// and reports the number of logins per second and the latency percentiles.
+//
+// Note: the login-server only accepts a login when a char-server is connected,
+// otherwise it answers with 'server closed' (counted as refused); the request
+// still goes through the whole authentication pipeline.
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/mmo.h"
+#include "../common/showmsg.h"
+#include "../common/socket.h" // WBUF*/RBUF*
+#include "../common/strlib.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET bench_socket;
+#define bench_close closesocket
+#define BENCH_INVALID INVALID_SOCKET
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+typedef int bench_socket;
+#define bench_close close
+#define BENCH_INVALID (-1)
+#endif
+
+#define BENCH_MAX_CONCURRENCY 512
+
+enum bench_state {
+	BENCH_IDLE = 0,
+	BENCH_CONNECTING,
+	BENCH_WAITING,
+};
+
+struct bench_conn {
+	bench_socket fd;
+	enum bench_state state;
+	int64 start; // in microseconds
+	int index;   // login number, picks the account
+	uint8 buf[32];
+	size_t len;
+};
+
+char bench_host[256] = "127.0.0.1";
+uint16 bench_port = 6900;
+char bench_user[NAME_LENGTH] = "s1";
+char bench_pass[NAME_LENGTH] = "p1";
+int bench_accounts = 0; // >0: logins go to <user><n> with n in [0,accounts)
+int bench_count = 1000;
+int bench_concurrency = 32;
+uint32 bench_version = 20;
+int bench_timeout = 10000; // in milliseconds
+
+static struct bench_conn conns[BENCH_MAX_CONCURRENCY];
+static int64* latencies = NULL;
+static int started = 0, finished = 0;
+static int accepted = 0, rejected = 0, refused = 0, errors = 0, timeouts = 0;
+
+static int64 bench_now(void)
+{
+#ifdef WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (int64)(count.QuadPart * 1000000 / freq.QuadPart);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static int bench_cmp(const void* a, const void* b)
+{
+	int64 x = *(const int64*)a, y = *(const int64*)b;
+	return ( x < y ) ? -1 : ( x > y ) ? 1 : 0;
+}
+
+static void bench_finish(struct bench_conn* c, int* counter)
+{
+	if( counter != &timeouts && counter != &errors )
+		latencies[finished] = bench_now() - c->start;
+	else
+		latencies[finished] = (int64)bench_timeout * 1000;
+	++finished;
+	++*counter;
+	bench_close(c->fd);
+	c->fd = BENCH_INVALID;
+	c->state = BENCH_IDLE;
+}
+
+static bool bench_start(struct bench_conn* c, struct sockaddr_in* addr)
+{
+#ifdef WIN32
+	unsigned long nonblock = 1;
+#endif
+	int yes = 1;
+
+	c->fd = socket(AF_INET, SOCK_STREAM, 0);
+	if( c->fd == BENCH_INVALID ) {
+		ShowError("socket: %s\n", strerror(errno));
+		return false;
+	}
+#ifdef WIN32
+	ioctlsocket(c->fd, FIONBIO, &nonblock);
+#else
+	fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+#endif
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, (char*)&yes, sizeof(yes));
+
+	c->index = started++;
+	c->start = bench_now();
+	c->len = 0;
+	c->state = BENCH_CONNECTING;
+	if( connect(c->fd, (struct sockaddr*)addr, sizeof(*addr)) != 0 ) {
+#ifdef WIN32
+		if( WSAGetLastError() != WSAEWOULDBLOCK )
+#else
+		if( errno != EINPROGRESS )
+#endif
+		{
+			bench_finish(c, &errors);
+			return true;
+		}
+	}
+	return true;
+}
+
+static void bench_send_login(struct bench_conn* c)
+{
+	uint8 packet[55];
+	char userid[NAME_LENGTH + 11]; // bench_user followed by the account index
+
+	if( bench_accounts > 0 )
+		snprintf(userid, sizeof(userid), "%s%d", bench_user, c->index % bench_accounts);
+	else
+		safestrncpy(userid, bench_user, sizeof(userid));
+
+	memset(packet, 0, sizeof(packet));
+	WBUFW(packet,0) = 0x0064;
+	WBUFL(packet,2) = bench_version;
+	safestrncpy((char*)WBUFP(packet,6), userid, NAME_LENGTH);
+	safestrncpy((char*)WBUFP(packet,30), bench_pass, NAME_LENGTH);
+	WBUFB(packet,54) = 0; // clienttype
+
+	if( send(c->fd, (const char*)packet, sizeof(packet), 0) != (int)sizeof(packet) ) {
+		bench_finish(c, &errors);
+		return;
+	}
+	c->state = BENCH_WAITING;
+}
+
+static void bench_recv(struct bench_conn* c)
+{
+	int n = recv(c->fd, (char*)c->buf + c->len, sizeof(c->buf) - c->len, 0);
+
+	if( n <= 0 ) {
+		bench_finish(c, &errors);
+		return;
+	}
+	c->len += n;
+	if( c->len < 2 )
+		return;
+
+	switch( RBUFW(c->buf,0) ) {
+	case 0x69:  bench_finish(c, &accepted); break; // server list
+	case 0x6a:
+	case 0x83e: bench_finish(c, &rejected); break; // refused by authentication
+	case 0x81:  bench_finish(c, &refused); break;  // server closed/already online
+	default:    bench_finish(c, &errors); break;
+	}
+}
+
+static void bench_report(int64 elapsed)
+{
+	double seconds = elapsed / 1000000.;
+
+	qsort(latencies, finished, sizeof(int64), bench_cmp);
+
+	ShowInfo("%d logins in %.2fs: "CL_WHITE"%.1f"CL_RESET" logins/s\n", finished, seconds, seconds > 0 ? finished / seconds : 0.);
+	ShowInfo("accepted: %d, rejected: %d, refused: %d, errors: %d, timeouts: %d\n", accepted, rejected, refused, errors, timeouts);
+	if( finished > 0 )
+		ShowInfo("latency (ms): p50 %.2f, p90 %.2f, p99 "CL_WHITE"%.2f"CL_RESET", max %.2f\n",
+			latencies[finished*50/100] / 1000., latencies[finished*90/100] / 1000.,
+			latencies[finished*99/100] / 1000., latencies[finished-1] / 1000.);
+}
+
+static void bench_usage(void)
+{
+	ShowInfo("usage: loginbench [options]\n");
+	ShowInfo("  -host <ip/name>       login-server address (default: 127.0.0.1)\n");
+	ShowInfo("  -port <port>          login-server port (default: 6900)\n");
+	ShowInfo("  -user <userid>        account to log in with (default: s1)\n");
+	ShowInfo("  -pass <password>      password (default: p1)\n");
+	ShowInfo("  -accounts <n>         spread logins over <userid>0..<userid>n-1\n");
+	ShowInfo("  -count <n>            number of logins (default: 1000)\n");
+	ShowInfo("  -concurrency <n>      simultaneous connections (default: 32, max %d)\n", BENCH_MAX_CONCURRENCY);
+	ShowInfo("  -version <n>          client version sent (default: 20)\n");
+	ShowInfo("  -timeout <ms>         per-login timeout (default: 10000)\n");
+}
+
+static bool bench_args(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i < argc; i++ ) {
+		const char* arg = argv[i];
+		const char* val = ( i+1 < argc ) ? argv[i+1] : NULL;
+
+		if( strcmp(arg, "-help") == 0 || strcmp(arg, "--help") == 0 || val == NULL )
+			return false;
+		++i;
+		if( strcmp(arg, "-host") == 0 )
+			safestrncpy(bench_host, val, sizeof(bench_host));
+		else if( strcmp(arg, "-port") == 0 )
+			bench_port = (uint16)atoi(val);
+		else if( strcmp(arg, "-user") == 0 )
+			safestrncpy(bench_user, val, sizeof(bench_user));
+		else if( strcmp(arg, "-pass") == 0 )
+			safestrncpy(bench_pass, val, sizeof(bench_pass));
+		else if( strcmp(arg, "-accounts") == 0 )
+			bench_accounts = max(0, atoi(val));
+		else if( strcmp(arg, "-count") == 0 )
+			bench_count = max(1, atoi(val));
+		else if( strcmp(arg, "-concurrency") == 0 )
+			bench_concurrency = min(max(1, atoi(val)), BENCH_MAX_CONCURRENCY);
+		else if( strcmp(arg, "-version") == 0 )
+			bench_version = (uint32)strtoul(val, NULL, 10);
+		else if( strcmp(arg, "-timeout") == 0 )
+			bench_timeout = max(1, atoi(val));
+		else
+			return false;
+	}
+	return true;
+}
+
+int do_init(int argc, char** argv)
+{
+	struct sockaddr_in addr;
+	struct hostent* host;
+	int64 begin;
+	int i;
+#ifdef WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+
+	if( !bench_args(argc, argv) ) {
+		bench_usage();
+		return 1;
+	}
+#ifndef WIN32
+	if( bench_concurrency >= FD_SETSIZE - 4 )
+		bench_concurrency = FD_SETSIZE - 4;
+#endif
+
+	if( (host = gethostbyname(bench_host)) == NULL ) {
+		ShowError("Unable to resolve '%s'.\n", bench_host);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(bench_port);
+	memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof(addr.sin_addr));
+
+	CREATE(latencies, int64, bench_count);
+	for( i = 0; i < BENCH_MAX_CONCURRENCY; i++ )
+		conns[i].fd = BENCH_INVALID;
+
+	ShowStatus("Benchmarking %s:%u with %d logins, %d at a time...\n", bench_host, bench_port, bench_count, bench_concurrency);
+	begin = bench_now();
+
+	while( finished < bench_count ) {
+		fd_set rfd, wfd;
+		struct timeval tv;
+		bench_socket fd_max = 0;
+		int64 now;
+
+		// keep the pipeline full
+		for( i = 0; i < bench_concurrency && started < bench_count; i++ )
+			if( conns[i].state == BENCH_IDLE && !bench_start(&conns[i], &addr) ) {
+				bench_report(bench_now() - begin);
+				return 1;
+			}
+
+		FD_ZERO(&rfd);
+		FD_ZERO(&wfd);
+		now = bench_now();
+		for( i = 0; i < bench_concurrency; i++ ) {
+			struct bench_conn* c = &conns[i];
+			if( c->state == BENCH_IDLE )
+				continue;
+			if( now - c->start > (int64)bench_timeout * 1000 ) {
+				bench_finish(c, &timeouts);
+				continue;
+			}
+			if( c->state == BENCH_CONNECTING )
+				FD_SET(c->fd, &wfd);
+			else
+				FD_SET(c->fd, &rfd);
+			if( c->fd > fd_max )
+				fd_max = c->fd;
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		if( select((int)fd_max + 1, &rfd, &wfd, NULL, &tv) < 0 ) {
+#ifndef WIN32
+			if( errno == EINTR )
+				continue;
+#endif
+			ShowError("select failed.\n");
+			break;
+		}
+
+		for( i = 0; i < bench_concurrency; i++ ) {
+			struct bench_conn* c = &conns[i];
+			if( c->state == BENCH_CONNECTING && FD_ISSET(c->fd, &wfd) ) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+				if( err != 0 )
+					bench_finish(c, &errors);
+				else
+					bench_send_login(c);
+			} else if( c->state == BENCH_WAITING && FD_ISSET(c->fd, &rfd) )
+				bench_recv(c);
+		}
+	}
+
+	bench_report(bench_now() - begin);
+	return 0;
+}
+
+void do_final(void)
+{
+	int i;
+
+	for( i = 0; i < BENCH_MAX_CONCURRENCY; i++ )
+		if( conns[i].fd != BENCH_INVALID )
+			bench_close(conns[i].fd);
+	if( latencies )
+		aFree(latencies);
+	latencies = NULL;
+}
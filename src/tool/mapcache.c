@@ -6,6 +6,10 @@
 #include "../common/malloc.h"
 #include "../common/mmo.h"
 #include "../common/showmsg.h"
+#include "../common/strlib.h"
+#include "../common/utils.h"
+#include "../common/atomic.h"
+#include "../common/thread.h"
 
 #include "../config/renewal.h"
 
@@ -15,31 +19,28 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/time.h>
 #endif
 
 #define NO_WATER 1000000
 
+#define MAPCACHE_BATCH 256       // maps handed to the threads at once
+#define MAPCACHE_THREADS_MAX 32
+
 char grf_list_file[256] = "conf/grf-files.txt";
 char map_list_file[256] = "db/map_index.txt";
 char map_cache_file[256];
 int rebuild = 0;
+int incremental = 0;
+int threads = 0; // threads reading and compressing maps, 0: one per cpu
 
 FILE *map_cache_fp;
 
-unsigned long file_size;
-
-// Used internally, this structure contains the physical map cells
-struct map_data {
-	int16 xs;
-	int16 ys;
-	unsigned char *cells;
-};
-
 // This is the main header found at the very beginning of the file
 struct main_header {
 	uint32 file_size;
 	uint16 map_count;
-} header;
+};
 
 // This is the header appended before every compressed map cells info
 struct map_info {
@@ -49,6 +50,56 @@ struct map_info {
 	int32 len;
 };
 
+// Version 2 of the cache starts with this header instead, followed by a
+// directory of map_count entries sorted by name, then the maps (map_info + compressed cells)
+#define MAP_CACHE_MAGIC "MCv2"
+struct main_header_v2 {
+	char magic[4];
+	uint32 file_size;
+	uint32 map_count;
+	uint32 crc_offset; // table of the source CRCs, one uint32 per map in directory order (0: none)
+};
+
+struct dir_entry {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint32 offset; // of the map's map_info from the start of the file
+};
+
+// A map of the cache, kept in memory until the cache is written
+struct cache_entry {
+	struct map_info info; // in machine order
+	unsigned char *data;  // compressed cells
+	uint32 crc;           // of the GAT and water level the cells were made from (0: unknown)
+};
+
+struct cache_entry *cache;
+int cache_count = 0;
+int cache_max = 0;
+
+enum cache_job_result { JOB_NOT_FOUND, JOB_UNCHANGED, JOB_COMPRESSED };
+
+// A map of the map list, read and compressed by the threads
+struct cache_job {
+	char name[MAP_NAME_LENGTH_EXT];
+	int entry;            // cache entry it replaces, -1 for a new map
+	uint32 crc;           // in: of the cache entry, out: of the GAT and water level read
+	enum cache_job_result result;
+	int16 xs, ys;
+	unsigned char *zip;   // compressed cells (system allocator)
+	unsigned long zip_len;
+	double time_read, time_zip;
+};
+
+struct cache_job jobs[MAPCACHE_BATCH];
+int job_count = 0;
+volatile int32 job_next = 0;
+
+// statistics
+int maps_new = 0, maps_updated = 0, maps_unchanged = 0;
+double time_read = 0., time_zip = 0., time_jobs = 0.;
+
 
 /*************************************
 * Big-endian compatibility functions *
@@ -104,42 +155,82 @@ float GetFloat(const unsigned char* buf)
 }
 
 
-// Reads a map from GRF's GAT and RSW files
-int read_map(char *name, struct map_data *m)
+// Wall clock time in seconds
+double mapcache_clock(void)
+{
+#ifdef _WIN32
+	return GetTickCount() / 1000.;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.;
+#endif
+}
+
+// Reads a map's GAT and RSW files and compresses its cells unless the CRC
+// of the GAT and water level matches job->crc.
+// Runs on the worker threads, so it does not use the memory manager.
+void read_map(struct cache_job *job, struct grfio_buffer *buf, unsigned char **cells, size_t *cells_size)
 {
 	char filename[256];
-	unsigned char *gat, *rsw;
-	int water_height;
+	const unsigned char *gat, *rsw;
+	unsigned char key[8];
+	int gat_size = 0, rsw_size = 0, water_height;
 	size_t xy, off, num_cells;
 	float height;
-	uint32 type;
-
-	// Open map GAT
-	sprintf(filename,"data\\%s.gat", name);
-	gat = (unsigned char *)grfio_read(filename);
-	if (gat == NULL)
-		return 0;
+	uint32 type, crc;
+	double start = mapcache_clock();
 
-	// Open map RSW
-	sprintf(filename,"data\\%s.rsw", name);
-	rsw = (unsigned char *)grfio_read(filename);
+	job->result = JOB_NOT_FOUND;
 
-	// Read water height
-	if (rsw) {
+	// Read water height from the map RSW
+	sprintf(filename,"data\\%s.rsw", job->name);
+	rsw = grfio_view(filename, &rsw_size, buf);
+	if (rsw && rsw_size >= 170)
 		water_height = (int)GetFloat(rsw+166);
-		aFree(rsw);
-	} else
+	else
 		water_height = NO_WATER;
 
-	// Read map size and allocate needed memory
-	m->xs = (int16)GetULong(gat+6);
-	m->ys = (int16)GetULong(gat+10);
-	if (m->xs <= 0 || m->ys <= 0) {
-		aFree(gat);
-		return 0;
+	// Open map GAT
+	sprintf(filename,"data\\%s.gat", job->name);
+	gat = grfio_view(filename, &gat_size, buf);
+	if (gat == NULL)
+		return;
+
+	// Read map size
+	job->xs = (int16)GetULong(gat+6);
+	job->ys = (int16)GetULong(gat+10);
+	if (job->xs <= 0 || job->ys <= 0 || gat_size < 14 + 20 * (int)job->xs * (int)job->ys)
+		return;
+
+	// The cells only depend on the GAT and the water level of the RSW
+	crc = (uint32)grfio_crc32(gat, gat_size);
+	key[0] = (unsigned char)( crc         );
+	key[1] = (unsigned char)( crc >> 0x08 );
+	key[2] = (unsigned char)( crc >> 0x10 );
+	key[3] = (unsigned char)( crc >> 0x18 );
+	key[4] = (unsigned char)( water_height         );
+	key[5] = (unsigned char)( water_height >> 0x08 );
+	key[6] = (unsigned char)( water_height >> 0x10 );
+	key[7] = (unsigned char)( water_height >> 0x18 );
+	crc = (uint32)grfio_crc32(key, sizeof(key));
+	if (crc == 0)
+		crc = 1; // 0 means unknown
+	job->time_read = mapcache_clock() - start;
+	if (crc == job->crc) {
+		job->result = JOB_UNCHANGED;
+		return;
+	}
+	job->crc = crc;
+
+	num_cells = (size_t)job->xs*(size_t)job->ys;
+	if (*cells_size < num_cells) {
+		unsigned char *p = (unsigned char *)realloc(*cells, num_cells);
+		if (p == NULL)
+			return;
+		*cells = p;
+		*cells_size = num_cells;
 	}
-	num_cells = (size_t)m->xs*(size_t)m->ys;
-	m->cells = (unsigned char *)aMalloc(num_cells);
 
 	// Set cell properties
 	off = 14;
@@ -154,67 +245,272 @@ int read_map(char *name, struct map_data *m)
 		if (type == 0 && water_height != NO_WATER && height > water_height)
 			type = 3; // Cell is 0 (walkable) but under water level, set to 3 (walkable water)
 
-		m->cells[xy] = (unsigned char)type;
+		(*cells)[xy] = (unsigned char)type;
 	}
 
-	aFree(gat);
+	// Create an output buffer twice as big as the uncompressed map... this way we're sure it fits
+	job->zip_len = (unsigned long)num_cells*2;
+	if ((job->zip = (unsigned char *)malloc(job->zip_len)) == NULL)
+		return;
+	// Compress the cells and get the compressed length
+	encode_zip(job->zip, &job->zip_len, *cells, (unsigned long)num_cells);
+	job->result = JOB_COMPRESSED;
+	job->time_zip = mapcache_clock() - start - job->time_read;
+}
 
-	return 1;
+// Worker thread, takes the next map until the batch is done
+void *map_worker(void *param)
+{
+	struct grfio_buffer buf;
+	unsigned char *cells = NULL;
+	size_t cells_size = 0;
+	int i;
+
+	memset(&buf, 0, sizeof(buf));
+	while ((i = InterlockedExchangeAdd(&job_next, 1)) < job_count)
+		read_map(&jobs[i], &buf, &cells, &cells_size);
+	grfio_buffer_free(&buf);
+	free(cells);
+
+	return NULL;
 }
 
-// Adds a map to the cache
-void cache_map(char *name, struct map_data *m)
+// Adds or replaces a compressed map in the cache
+void cache_map(struct cache_job *job)
 {
-	struct map_info info;
-	unsigned long len;
-	unsigned char *write_buf;
+	struct cache_entry *entry;
 
-	// Create an output buffer twice as big as the uncompressed map... this way we're sure it fits
-	len = (unsigned long)m->xs*(unsigned long)m->ys*2;
-	write_buf = (unsigned char *)aMalloc(len);
-	// Compress the cells and get the compressed length
-	encode_zip(write_buf, &len, m->cells, m->xs*m->ys);
+	if (job->entry >= 0) {
+		entry = &cache[job->entry];
+		aFree(entry->data);
+	} else {
+		if (cache_count == cache_max) {
+			cache_max += 256;
+			RECREATE(cache, struct cache_entry, cache_max);
+		}
+		entry = &cache[cache_count++];
+	}
 
 	// Fill the map header
-	if (strlen(name) > MAP_NAME_LENGTH) // It does not hurt to warn that there are maps with name longer than allowed.
-		ShowWarning ("Map name '%s' size '%d' is too long. Truncating to '%d'.\n", name, strlen(name), MAP_NAME_LENGTH);
-	strncpy(info.name, name, MAP_NAME_LENGTH);
-	info.xs = MakeShortLE(m->xs);
-	info.ys = MakeShortLE(m->ys);
-	info.len = MakeLongLE(len);
-
-	// Append map header then compressed cells at the end of the file
-	fseek(map_cache_fp, header.file_size, SEEK_SET);
-	fwrite(&info, sizeof(struct map_info), 1, map_cache_fp);
-	fwrite(write_buf, 1, len, map_cache_fp);
-	header.file_size += sizeof(struct map_info) + len;
-	header.map_count++;
-
-	aFree(write_buf);
-	aFree(m->cells);
+	if (strlen(job->name) > MAP_NAME_LENGTH) // It does not hurt to warn that there are maps with name longer than allowed.
+		ShowWarning ("Map name '%s' size '%d' is too long. Truncating to '%d'.\n", job->name, strlen(job->name), MAP_NAME_LENGTH);
+	memset(entry->info.name, 0, MAP_NAME_LENGTH);
+	strncpy(entry->info.name, job->name, MAP_NAME_LENGTH);
+	entry->info.xs = job->xs;
+	entry->info.ys = job->ys;
+	entry->info.len = (int32)job->zip_len;
+	entry->data = (unsigned char *)aMalloc(job->zip_len > 0 ? job->zip_len : 1);
+	memcpy(entry->data, job->zip, job->zip_len);
+	entry->crc = job->crc;
 
 	return;
 }
 
-// Checks whether a map is already is the cache
+// Reads and compresses the maps of the batch on up to 'threads' threads
+void run_jobs(void)
+{
+	rAthread workers[MAPCACHE_THREADS_MAX];
+	int i, count = 0;
+	double start;
+
+	if (job_count == 0)
+		return;
+
+	start = mapcache_clock();
+	job_next = 0;
+	for (i = 1; i < threads && i < job_count; i++)
+		if ((workers[count] = rathread_create(map_worker, NULL)) != NULL)
+			count++;
+	map_worker(NULL);
+	for (i = 0; i < count; i++)
+		rathread_wait(workers[i], NULL);
+	time_jobs += mapcache_clock() - start;
+
+	for (i = 0; i < job_count; i++) {
+		struct cache_job *job = &jobs[i];
+
+		time_read += job->time_read;
+		switch (job->result) {
+		case JOB_NOT_FOUND:
+			if (job->entry >= 0)
+				ShowWarning("Map '"CL_WHITE"%s"CL_RESET"' not found, keeping the cached one.\n", job->name);
+			else
+				ShowError("Map '"CL_WHITE"%s"CL_RESET"' not found!\n", job->name);
+			break;
+		case JOB_UNCHANGED:
+			maps_unchanged++;
+			break;
+		case JOB_COMPRESSED:
+			time_zip += job->time_zip;
+			if (job->entry >= 0) {
+				ShowInfo("Map '"CL_WHITE"%s"CL_RESET"' changed, cache updated.\n", job->name);
+				maps_updated++;
+			} else {
+				ShowInfo("Map '"CL_WHITE"%s"CL_RESET"' successfully cached.\n", job->name);
+				maps_new++;
+			}
+			cache_map(job);
+			break;
+		}
+		free(job->zip);
+		job->zip = NULL;
+	}
+	job_count = 0;
+}
+
+// Returns the cache entry of a map, -1 if it is not in the cache
 int find_map(char *name)
 {
 	int i;
-	struct map_info info;
 
-	fseek(map_cache_fp, sizeof(struct main_header), SEEK_SET);
+	for(i = 0; i < cache_count; i++)
+		if(strncmp(name, cache[i].info.name, MAP_NAME_LENGTH) == 0) // Map found
+			return i;
 
-	for(i = 0; i < header.map_count; i++) {
-		if(fread(&info, sizeof(info), 1, map_cache_fp) != 1) printf("An error as occured in fread while reading map_cache\n");
-		if(strcmp(name, info.name) == 0) // Map found
+	return -1;
+}
+
+// Checks whether a map is already waiting to be compressed
+int find_job(char *name)
+{
+	int i;
+
+	for(i = 0; i < job_count; i++)
+		if(strncmp(name, jobs[i].name, MAP_NAME_LENGTH) == 0)
 			return 1;
-		else // Map not found, jump to the beginning of the next map info header
-			fseek(map_cache_fp, GetLong((unsigned char *)&(info.len)), SEEK_CUR);
-	}
 
 	return 0;
 }
 
+// Copies a map of an existing cache (little-endian map_info + cells at p) into memory
+int load_map(const unsigned char *p, size_t left)
+{
+	struct cache_entry *entry;
+	int32 len;
+
+	if (left < sizeof(struct map_info))
+		return 0;
+	len = GetLong(p + MAP_NAME_LENGTH + 4);
+	if (len < 0 || (size_t)len > left - sizeof(struct map_info))
+		return 0;
+
+	if (cache_count == cache_max) {
+		cache_max += 256;
+		RECREATE(cache, struct cache_entry, cache_max);
+	}
+	entry = &cache[cache_count++];
+	memcpy(entry->info.name, p, MAP_NAME_LENGTH);
+	entry->info.xs = (int16)GetUShort(p + MAP_NAME_LENGTH);
+	entry->info.ys = (int16)GetUShort(p + MAP_NAME_LENGTH + 2);
+	entry->info.len = len;
+	entry->crc = 0;
+	entry->data = (unsigned char *)aMalloc(len > 0 ? len : 1);
+	memcpy(entry->data, p + sizeof(struct map_info), len);
+
+	return 1;
+}
+
+// Reads the maps of an existing cache, in either format
+int load_cache(FILE *fp)
+{
+	unsigned char *buf;
+	size_t size, off;
+	uint32 i, count;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buf = (unsigned char *)aMalloc(size > 0 ? size : 1);
+	if (fread(buf, 1, size, fp) != size) {
+		aFree(buf);
+		return 0;
+	}
+
+	if (size >= sizeof(struct main_header_v2) && memcmp(buf, MAP_CACHE_MAGIC, 4) == 0) {
+		size_t crcs = GetULong(buf + 12);
+		count = GetULong(buf + 8);
+		if (crcs != 0 && (crcs > size || (size - crcs) / 4 < count))
+			crcs = 0; // no usable CRCs, every map is compressed again in incremental mode
+		for (i = 0; i < count; i++) {
+			off = sizeof(struct main_header_v2) + i * sizeof(struct dir_entry);
+			if (off + sizeof(struct dir_entry) > size)
+				break;
+			off = GetULong(buf + off + MAP_NAME_LENGTH + 4);
+			if (off > size || !load_map(buf + off, size - off))
+				break;
+			if (crcs != 0)
+				cache[cache_count-1].crc = GetULong(buf + crcs + i * 4);
+		}
+	} else if (size >= sizeof(struct main_header)) {
+		count = GetUShort(buf + 4);
+		off = sizeof(struct main_header);
+		for (i = 0; i < count; i++) {
+			if (!load_map(buf + off, size - off))
+				break;
+			off += sizeof(struct map_info) + cache[cache_count-1].info.len;
+		}
+	} else
+		count = i = 0;
+
+	aFree(buf);
+	if (i < count)
+		ShowWarning("Map cache is truncated, %u of %u maps read.\n", i, count);
+	return 1;
+}
+
+static int cache_cmp(const void *a, const void *b)
+{
+	return strncmp(((const struct cache_entry *)a)->info.name, ((const struct cache_entry *)b)->info.name, MAP_NAME_LENGTH);
+}
+
+// Writes all maps as a version 2 cache, with the directory sorted by name
+int write_cache(FILE *fp)
+{
+	struct main_header_v2 header2;
+	struct dir_entry dir;
+	struct map_info info;
+	uint32 offset, crc;
+	int i;
+
+	qsort(cache, cache_count, sizeof(struct cache_entry), cache_cmp);
+
+	offset = sizeof(struct main_header_v2) + cache_count * sizeof(struct dir_entry);
+	for (i = 0; i < cache_count; i++)
+		offset += sizeof(struct map_info) + cache[i].info.len;
+
+	memcpy(header2.magic, MAP_CACHE_MAGIC, 4);
+	header2.file_size = MakeLongLE(offset + cache_count * 4);
+	header2.map_count = MakeLongLE(cache_count);
+	header2.crc_offset = MakeLongLE(offset);
+	fwrite(&header2, sizeof(header2), 1, fp);
+
+	offset = sizeof(struct main_header_v2) + cache_count * sizeof(struct dir_entry);
+	for (i = 0; i < cache_count; i++) {
+		memcpy(dir.name, cache[i].info.name, MAP_NAME_LENGTH);
+		dir.xs = MakeShortLE(cache[i].info.xs);
+		dir.ys = MakeShortLE(cache[i].info.ys);
+		dir.offset = MakeLongLE(offset);
+		fwrite(&dir, sizeof(dir), 1, fp);
+		offset += sizeof(struct map_info) + cache[i].info.len;
+	}
+
+	for (i = 0; i < cache_count; i++) {
+		memcpy(info.name, cache[i].info.name, MAP_NAME_LENGTH);
+		info.xs = MakeShortLE(cache[i].info.xs);
+		info.ys = MakeShortLE(cache[i].info.ys);
+		info.len = MakeLongLE(cache[i].info.len);
+		fwrite(&info, sizeof(info), 1, fp);
+		fwrite(cache[i].data, 1, cache[i].info.len, fp);
+	}
+
+	for (i = 0; i < cache_count; i++) {
+		crc = MakeLongLE(cache[i].crc);
+		fwrite(&crc, sizeof(crc), 1, fp);
+	}
+
+	return ferror(fp) == 0;
+}
+
 // Cuts the extension from a map name
 char *remove_extension(char *mapname)
 {
@@ -246,6 +542,12 @@ void process_args(int argc, char *argv[])
 				strcpy(map_cache_file, argv[i]);
 		} else if(strcmp(argv[i], "-rebuild") == 0)
 			rebuild = 1;
+		else if(strcmp(argv[i], "-incremental") == 0)
+			incremental = 1;
+		else if(strcmp(argv[i], "-threads") == 0) {
+			if(++i < argc)
+				threads = atoi(argv[i]);
+		}
 	}
 
 }
@@ -253,9 +555,9 @@ void process_args(int argc, char *argv[])
 int do_init(int argc, char** argv)
 {
 	FILE *list;
-	char line[1024];
-	struct map_data map;
+	char line[1024], tmp_file[300];
 	char name[MAP_NAME_LENGTH_EXT];
+	double start, time_write;
 
 	/* setup pre-defined, #define-dependant */
 	sprintf(map_cache_file,"db/%s/map_cache.dat",
@@ -269,26 +571,36 @@ int do_init(int argc, char** argv)
 	// Process the command-line arguments
 	process_args(argc, argv);
 
+	if (threads <= 0) {
+#ifdef _WIN32
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		threads = (int)si.dwNumberOfProcessors;
+#else
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+	threads = cap_value(threads, 1, MAPCACHE_THREADS_MAX);
+	rathread_init();
+	start = mapcache_clock();
+
 	ShowStatus("Initializing grfio with %s\n", grf_list_file);
 	grfio_init(grf_list_file);
 
-	// Attempt to open the map cache file and force rebuild if not found
+	// Attempt to read the map cache file and force rebuild if not found
 	ShowStatus("Opening map cache: %s\n", map_cache_file);
 	if(!rebuild) {
 		map_cache_fp = fopen(map_cache_file, "rb");
 		if(map_cache_fp == NULL) {
 			ShowNotice("Existing map cache not found, forcing rebuild mode\n");
 			rebuild = 1;
-		} else
+		} else {
+			if(!load_cache(map_cache_fp)) {
+				ShowError("Failure when reading map cache file %s\n", map_cache_file);
+				exit(EXIT_FAILURE);
+			}
 			fclose(map_cache_fp);
-	}
-	if(rebuild)
-		map_cache_fp = fopen(map_cache_file, "w+b");
-	else
-		map_cache_fp = fopen(map_cache_file, "r+b");
-	if(map_cache_fp == NULL) {
-		ShowError("Failure when opening map cache file %s\n", map_cache_file);
-		exit(EXIT_FAILURE);
+		}
 	}
 
 	// Open the map list
@@ -299,16 +611,6 @@ int do_init(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
-	// Initialize the main header
-	if(rebuild) {
-		header.file_size = sizeof(struct main_header);
-		header.map_count = 0;
-	} else {
-		if(fread(&header, sizeof(struct main_header), 1, map_cache_fp) != 1){ printf("An error as occured while reading map_cache_fp \n"); }
-		header.file_size = GetULong((unsigned char *)&(header.file_size));
-		header.map_count = GetUShort((unsigned char *)&(header.map_count));
-	}
-
 	// Read and process the map list
 	while(fgets(line, sizeof(line), list))
 	{
@@ -323,33 +625,61 @@ int do_init(int argc, char** argv)
 
 		name[MAP_NAME_LENGTH_EXT-1] = '\0';
 		remove_extension(name);
-		if(find_map(name))
+		if(find_job(name))
+			continue;
+		jobs[job_count].entry = find_map(name);
+		if(jobs[job_count].entry >= 0 && !incremental) {
 			ShowInfo("Map '"CL_WHITE"%s"CL_RESET"' already in cache.\n", name);
-		else if(read_map(name, &map)) {
-			cache_map(name, &map);
-			ShowInfo("Map '"CL_WHITE"%s"CL_RESET"' successfully cached.\n", name);
-		} else
-			ShowError("Map '"CL_WHITE"%s"CL_RESET"' not found!\n", name);
-
+			continue;
+		}
+		safestrncpy(jobs[job_count].name, name, sizeof(jobs[job_count].name));
+		jobs[job_count].crc = ( jobs[job_count].entry >= 0 ) ? cache[jobs[job_count].entry].crc : 0;
+		jobs[job_count].zip = NULL;
+		jobs[job_count].time_read = jobs[job_count].time_zip = 0.;
+		if(++job_count == MAPCACHE_BATCH)
+			run_jobs();
 	}
+	run_jobs();
 
 	ShowStatus("Closing map list: %s\n", map_list_file);
 	fclose(list);
 
-	// Write the main header and close the map cache
-	ShowStatus("Closing map cache: %s\n", map_cache_file);
-	fseek(map_cache_fp, 0, SEEK_SET);
-	fwrite(&header, sizeof(struct main_header), 1, map_cache_fp);
+	// Write the whole cache in the indexed format, next to the old one first so
+	// that map-servers using it never see a partial file
+	ShowStatus("Writing map cache: %s\n", map_cache_file);
+	time_write = mapcache_clock();
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", map_cache_file);
+	map_cache_fp = fopen(tmp_file, "wb");
+	if(map_cache_fp == NULL || !write_cache(map_cache_fp)) {
+		ShowError("Failure when writing map cache file %s\n", tmp_file);
+		exit(EXIT_FAILURE);
+	}
 	fclose(map_cache_fp);
+#ifdef _WIN32
+	remove(map_cache_file);
+#endif
+	if(rename(tmp_file, map_cache_file) != 0) {
+		ShowError("Failure when replacing map cache file %s\n", map_cache_file);
+		exit(EXIT_FAILURE);
+	}
+	time_write = mapcache_clock() - time_write;
 
 	ShowStatus("Finalizing grfio\n");
 	grfio_final();
 
-	ShowInfo("%d maps now in cache\n", header.map_count);
+	ShowInfo("%d maps now in cache: %d new, %d updated, %d unchanged\n", cache_count, maps_new, maps_updated, maps_unchanged);
+	ShowInfo("Done in %.2fs: maps %.2fs on %d threads (reading %.2fs, compressing %.2fs of thread time), writing %.2fs\n",
+		mapcache_clock() - start, time_jobs, threads, time_read, time_zip, time_write);
 
 	return 0;
 }
 
 void do_final(void)
 {
+	int i;
+
+	for (i = 0; i < cache_count; i++)
+		aFree(cache[i].data);
+	if (cache)
+		aFree(cache);
 }
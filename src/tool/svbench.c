@@ -0,0 +1,217 @@
+// Copyright (c) Hercules Dev Team, licensed under GNU GPL.
+// See the LICENSE file
+
+// Delim-separated file parser benchmark.
+// Times sv_parse (which skips from delimiter to delimiter on lines without
+// escape sequences) against the character by character state machine of
+// sv_parse_next on generated mob_db and item_db sized inputs, and fuzzes
+// both with random lines to check that they agree.
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/strlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/time.h>
+
+int sv_rounds = 20;      // passes over each generated file
+int sv_fuzz = 1000000;   // random lines compared
+
+static int64 sv_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/// sv_parse built on sv_parse_next only, as it was before the fast path.
+static int sv_parse_ref(const char* str, int len, int startoff, char delim, int* out_pos, int npos, enum e_svopt opt)
+{
+	struct s_svstate svstate;
+	int count;
+
+	if( out_pos == NULL ) npos = 0;
+	for( count = 0; count < npos; ++count )
+		out_pos[count] = -1;
+	svstate.str = str;
+	svstate.len = len;
+	svstate.off = startoff;
+	svstate.opt = opt;
+	svstate.delim = delim;
+	svstate.done = false;
+
+	count = 0;
+	if( npos > 0 ) out_pos[0] = startoff;
+	while( !svstate.done ) {
+		++count;
+		if( sv->parse_next(&svstate) <= 0 )
+			return -1;
+		if( npos > count*2 ) out_pos[count*2] = svstate.start;
+		if( npos > count*2+1 ) out_pos[count*2+1] = svstate.end;
+	}
+	if( npos > 1 ) out_pos[1] = svstate.off;
+	return count;
+}
+
+/// Generates rows looking like the given database: an id, a few names and numeric columns.
+static char* sv_generate(int rows, int columns, size_t* out_len)
+{
+	StringBuf buf;
+	char* data;
+	int i, j;
+
+	StrBuf->Init(&buf);
+	StrBuf->AppendStr(&buf, "// generated by svbench\n");
+	for( i = 0; i < rows; i++ ) {
+		StrBuf->Printf(&buf, "%d,NAME_%d,Name %d,Name %d", 1001 + i, i, i, i);
+		for( j = 4; j < columns; j++ )
+			StrBuf->Printf(&buf, ",%d", ( j%3 == 0 ) ? 0 : rand()%(j%5 == 0 ? 100000 : 1000));
+		if( i%50 == 0 )
+			StrBuf->AppendStr(&buf, " // comment");
+		StrBuf->AppendStr(&buf, ( i%2 ) ? "\r\n" : "\n");
+	}
+	*out_len = StrBuf->Length(&buf);
+	data = (char*)aMalloc(*out_len + 1);
+	memcpy(data, StrBuf->Value(&buf), *out_len + 1);
+	StrBuf->Destroy(&buf);
+	return data;
+}
+
+/// Times both parsers over every line of data, then sv_readrows over the whole file.
+static void sv_bench(const char* name, int rows, int columns)
+{
+	int pos[1024];
+	size_t len, off;
+	char* data = sv_generate(rows, columns, &len);
+	char path[64];
+	int64 ref, fast, read;
+	int r, checksum_ref = 0, checksum_fast = 0;
+	FILE* fp;
+
+	ref = sv_now();
+	for( r = 0; r < sv_rounds; r++ ) {
+		for( off = 0; off < len; ) {
+			const char* eol = strchr(data + off, '\n');
+			int n = (int)(eol - (data + off)) + 1;
+			checksum_ref += sv_parse_ref(data + off, n, 0, ',', pos, ARRAYLENGTH(pos), (e_svopt)(SV_TERMINATE_LF|SV_TERMINATE_CRLF));
+			off += n;
+		}
+	}
+	ref = sv_now() - ref;
+
+	fast = sv_now();
+	for( r = 0; r < sv_rounds; r++ ) {
+		for( off = 0; off < len; ) {
+			const char* eol = strchr(data + off, '\n');
+			int n = (int)(eol - (data + off)) + 1;
+			checksum_fast += sv->parse(data + off, n, 0, ',', pos, ARRAYLENGTH(pos), (e_svopt)(SV_TERMINATE_LF|SV_TERMINATE_CRLF));
+			off += n;
+		}
+	}
+	fast = sv_now() - fast;
+
+	snprintf(path, sizeof(path), "/tmp/svbench.%d.txt", (int)getpid());
+	read = 0;
+	if( (fp = fopen(path, "wb")) != NULL ) {
+		fwrite(data, 1, len, fp);
+		fclose(fp);
+		read = sv_now();
+		for( r = 0; r < sv_rounds; r++ ) {
+			struct s_svrows svrows;
+			sv->readrows(path, ',', &svrows);
+			sv->freerows(&svrows);
+		}
+		read = sv_now() - read;
+		unlink(path);
+	}
+
+	if( checksum_ref != checksum_fast )
+		ShowError("%s: the parsers found a different number of fields (%d, %d).\n", name, checksum_ref, checksum_fast);
+	ShowInfo("%-8s %5d rows x %2d columns, %4lu KB | state machine "CL_WHITE"%6.1f"CL_RESET" MB/s, fast path "CL_WHITE"%6.1f"CL_RESET" MB/s, readrows "CL_WHITE"%6.1f"CL_RESET" MB/s\n",
+		name, rows, columns, (unsigned long)(len / 1024),
+		(double)len * sv_rounds / (ref ? ref : 1), (double)len * sv_rounds / (fast ? fast : 1), (double)len * sv_rounds / (read ? read : 1));
+	aFree(data);
+}
+
+/// Compares both parsers on random lines made of the characters they care about.
+static int sv_fuzz_run(void)
+{
+	static const char alphabet[] = "ab,,\t||\n\r\\\\xn0178\" ";
+	static const int opts[] = {
+		SV_NOESCAPE_NOTERMINATE, SV_TERMINATE_LF, SV_TERMINATE_CRLF, SV_TERMINATE_CR,
+		SV_TERMINATE_LF|SV_TERMINATE_CRLF, SV_TERMINATE_CR|SV_TERMINATE_CRLF,
+		SV_ESCAPE_C, SV_ESCAPE_C|SV_TERMINATE_LF, SV_ESCAPE_C|SV_TERMINATE_LF|SV_TERMINATE_CRLF,
+	};
+	static const char delims[] = { ',', '\t', '|', '\\', 'x' };
+	char str[80];
+	int pos_ref[32], pos_fast[32];
+	int i, j, failed = 0;
+	int silent = msg_silent;
+
+	msg_silent |= 16; // errors of invalid escape sequences
+	for( i = 0; i < sv_fuzz && failed < 10; i++ ) {
+		int len = rand()%(int)sizeof(str);
+		int start = len ? rand()%(len + 1) : 0;
+		int npos = rand()%ARRAYLENGTH(pos_ref);
+		char delim = delims[rand()%ARRAYLENGTH(delims)];
+		enum e_svopt opt = (enum e_svopt)opts[rand()%ARRAYLENGTH(opts)];
+		int ref, fast;
+
+		for( j = 0; j < len; j++ )
+			str[j] = alphabet[rand()%(sizeof(alphabet) - 1)];
+
+		ref = sv_parse_ref(str, len, start, delim, pos_ref, npos, opt);
+		fast = sv->parse(str, len, start, delim, pos_fast, npos, opt);
+		if( ref != fast || memcmp(pos_ref, pos_fast, npos*sizeof(int)) != 0 ) {
+			char escaped[sizeof(str)*4 + 1];
+			sv->escape_c(escaped, str, len, NULL);
+			msg_silent = silent;
+			ShowError("mismatch: \"%s\" from %d, delim 0x%02x, opt 0x%x, npos %d: %d fields, %d with the fast path\n", escaped, start, (unsigned char)delim, opt, npos, ref, fast);
+			msg_silent |= 16;
+			failed++;
+		}
+	}
+	msg_silent = silent;
+
+	if( failed )
+		ShowError("fuzz: the parsers disagree.\n");
+	else
+		ShowInfo("fuzz: "CL_WHITE"%d"CL_RESET" random lines parsed the same way.\n", i);
+	return failed;
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i+1 < argc; i += 2 ) {
+		if( strcmp(argv[i], "-rounds") == 0 )
+			sv_rounds = max(1, atoi(argv[i+1]));
+		else if( strcmp(argv[i], "-fuzz") == 0 )
+			sv_fuzz = max(0, atoi(argv[i+1]));
+		else if( strcmp(argv[i], "-seed") == 0 )
+			srand((unsigned int)atoi(argv[i+1]));
+		else
+			break;
+	}
+	if( i < argc ) {
+		ShowInfo("usage: svbench [-rounds <passes>] [-fuzz <lines>] [-seed <number>]\n");
+		return 1;
+	}
+
+	sv_bench("mob_db", 2500, 57);
+	sv_bench("item_db", 6000, 22);
+	sv_bench("skill_db", 3000, 17);
+	if( sv_fuzz_run() )
+		exit(EXIT_FAILURE);
+	return 0;
+}
+
+void do_final(void)
+{
+}